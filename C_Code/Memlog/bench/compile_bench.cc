@@ -0,0 +1,386 @@
+// compile_bench.cc
+// Compile-time overhead of memlog_plugin: generates synthetic C files of several shapes and sizes, compiles each one
+// without the plugin, with it (mode=static), with mode=runtime, and with mode=static again from a warm output cache
+// (static_cached: the file was compiled once with cache=, so every function is a hit), and prints one JSON line per
+// file and variant:
+//
+//   {"bench":"compile","input":"many_funcs","scale":2000,"variant":"static","wall_ms":812.4,"base_wall_ms":640.2,
+//    "overhead":1.27,"peak_rss_kb":61234,"events":18000,"bytes":2391043}
+//
+// wall_ms is the fastest of --runs compiles, peak_rss_kb the compiler's (cc1's) peak resident set, and events/bytes
+// what the plugin wrote (lines with a "site", and the size of its output file). Plugin variants also report
+// classify_ms, serialize_ms and io_ms: the wall time -ftime-report gives the plugin's own phases (see "Where the
+// plugin's time goes" in memlog_plugin.cc), from one more compile that is not timed (-ftime-report has a cost of its own).
+//
+// Before/after: --baseline <other memlog_plugin.so> adds a static_baseline variant, mode=static with that plugin (e.g.
+// one built from an older commit, see make bench_compare). Every static variant then also reports plugin_ms (wall_ms
+// minus base_wall_ms) and events_per_sec (events per second of plugin_ms), and static reports vs_baseline, its
+// events_per_sec over static_baseline's on the same input. An older plugin may not have the -ftime-report items; its
+// phases are null.
+//
+// Inputs (every one is plain C that compiles on its own with -c):
+//   many_funcs    <scale> small functions with a handful of stores each
+//   deep_exprs    stores whose index and value expressions are <scale> operators deep
+//   structs       nested structs written field by field through pointers, <scale> functions
+//   loops         loop nests filling arrays, <scale> functions
+//
+// usage: compile_bench [--gcc gcc] [--plugin path/memlog_plugin.so] [--baseline path/memlog_plugin.so]
+//                      [--dir out/compile_bench] [--runs 3] [--quick]
+//   (without --plugin only the compile without a plugin is timed)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+  // ---------------------------
+  // Synthetic inputs
+  // ---------------------------
+
+  struct input {
+    const char *name;
+    int scale;
+    std::string path;
+  };
+
+  std::string gen_many_funcs(int n) {
+    std::string s = "#include <stdlib.h>\n";
+    char buf[512];
+    for (int i = 0; i < n; i++) {
+      std::snprintf(buf, sizeof(buf),
+                    "int f%d(int a, int *p) {\n"
+                    "  int x = a + %d;\n"
+                    "  int y = x * 3;\n"
+                    "  p[0] = x;\n"
+                    "  p[1] = y;\n"
+                    "  int *q = malloc(16);\n"
+                    "  q[0] = x - y;\n"
+                    "  free(q);\n"
+                    "  return x + y;\n"
+                    "}\n",
+                    i, i);
+      s += buf;
+    }
+    return s;
+  }
+
+  //((((i + 1) * 2 - 3) + 4) * 5 ...) with depth operators
+  std::string deep_expr(const char *var, int depth) {
+    static const char ops[] = {'+', '*', '-'};
+    std::string e = var;
+    for (int d = 0; d < depth; d++) e = "(" + e + " " + ops[d % 3] + " " + std::to_string(d % 7 + 1) + ")";
+    return e;
+  }
+
+  std::string gen_deep_exprs(int depth) {
+    std::string s;
+    for (int f = 0; f < 50; f++) {
+      s += "void d" + std::to_string(f) + "(int *a, long i, long j) {\n";
+      for (int k = 0; k < 5; k++)
+        s += "  a[" + deep_expr("i", depth) + " & 1023] = (int)" + deep_expr("j", depth) + ";\n";
+      s += "}\n";
+    }
+    return s;
+  }
+
+  std::string gen_structs(int n) {
+    std::string s =
+        "struct point { int x, y; };\n"
+        "struct rect { struct point lo, hi; int color; };\n"
+        "struct shape { struct rect box; struct shape *next; char tag[8]; double area; };\n";
+    char buf[1024];
+    for (int i = 0; i < n; i++) {
+      std::snprintf(buf, sizeof(buf),
+                    "void s%d(struct shape *sh, int v) {\n"
+                    "  sh->box.lo.x = v;\n"
+                    "  sh->box.lo.y = v + 1;\n"
+                    "  sh->box.hi.x = v + 2;\n"
+                    "  sh->box.hi.y = v + 3;\n"
+                    "  sh->box.color = %d;\n"
+                    "  sh->tag[0] = 'a';\n"
+                    "  sh->area = (double)(sh->box.hi.x - sh->box.lo.x) * (sh->box.hi.y - sh->box.lo.y);\n"
+                    "  sh->next->box = sh->box;\n"
+                    "}\n",
+                    i, i);
+      s += buf;
+    }
+    return s;
+  }
+
+  std::string gen_loops(int n) {
+    std::string s;
+    char buf[1024];
+    for (int i = 0; i < n; i++) {
+      std::snprintf(buf, sizeof(buf),
+                    "void l%d(int *a, int rows, int cols, int *out) {\n"
+                    "  for (int r = 0; r < rows; r++) {\n"
+                    "    for (int c = 0; c < cols; c++) {\n"
+                    "      a[r * cols + c] = r + c + %d;\n"
+                    "    }\n"
+                    "  }\n"
+                    "  int sum = 0;\n"
+                    "  for (int k = 0; k < rows; k++) sum = sum + a[k];\n"
+                    "  *out = sum;\n"
+                    "}\n",
+                    i, i);
+      s += buf;
+    }
+    return s;
+  }
+
+  bool write_file(const std::string &path, const std::string &data) {
+    FILE *f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    bool ok = std::fwrite(data.data(), 1, data.size(), f) == data.size();
+    return std::fclose(f) == 0 && ok;
+  }
+
+  bool read_file(const std::string &path, std::string &data) {
+    FILE *f = std::fopen(path.c_str(), "r");
+    if (!f) return false;
+    char buf[4096];
+    size_t n;
+    data.clear();
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    std::fclose(f);
+    return true;
+  }
+
+  // ---------------------------
+  // Running the compiler
+  // ---------------------------
+
+  struct run_result {
+    bool ok;
+    double wall_ms;
+    long peak_rss_kb;
+  };
+
+  /*
+    Runs argv to completion and measures it. ru_maxrss of the children covers cc1, which is where the plugin runs.
+  */
+  run_result run(const std::vector<std::string> &args, const char *err_path) {
+    run_result r = { false, 0, 0 };
+    std::vector<char *> argv;
+    for (const std::string &a : args) argv.push_back(const_cast<char *>(a.c_str()));
+    argv.push_back(nullptr);
+
+    auto t0 = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return r;
+    if (pid == 0) {
+      if (err_path) {
+        int fd = open(err_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) dup2(fd, 2);
+      }
+      execvp(argv[0], argv.data());
+      _exit(127);
+    }
+
+    //wait4 only reports the gcc driver itself; RUSAGE_CHILDREN also includes cc1 and as once they've been reaped
+    int status = 0;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return r;
+    r.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    r.ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    getrusage(RUSAGE_CHILDREN, &ru);
+    r.peak_rss_kb = ru.ru_maxrss;
+    return r;
+  }
+
+  /*
+    Runs the compile in its own process, so RUSAGE_CHILDREN's high-water mark belongs to this compile alone.
+    The compiler's stderr goes to err_path if it is not null.
+  */
+  run_result run_isolated(const std::vector<std::string> &args, const char *err_path = nullptr) {
+    int fds[2];
+    run_result r = { false, 0, 0 };
+    if (pipe(fds) != 0) return r;
+    pid_t pid = fork();
+    if (pid < 0) return r;
+    if (pid == 0) {
+      close(fds[0]);
+      run_result c = run(args, err_path);
+      ssize_t w = write(fds[1], &c, sizeof(c));
+      _exit(w == (ssize_t)sizeof(c) ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], &r, sizeof(r)) != (ssize_t)sizeof(r)) r.ok = false;
+    close(fds[0]);
+    waitpid(pid, nullptr, 0);
+    return r;
+  }
+
+  //events = lines with a "site" member; bytes = file size
+  void count_output(const std::string &path, long long &events, long long &bytes) {
+    events = bytes = 0;
+    FILE *f = std::fopen(path.c_str(), "r");
+    if (!f) return;
+    char line[1 << 16];
+    while (std::fgets(line, sizeof(line), f)) {
+      bytes += (long long)std::strlen(line);
+      if (std::strstr(line, "\"site\":")) events++;
+    }
+    std::fclose(f);
+  }
+
+  /*
+    The wall time -ftime-report gives a client item, in ms: its line reads
+      " memlog: serialization   :   0.02 (  1%)   0.00 (  0%)   0.03 (  1%)   112k (  1%)"
+    (usr, sys, wall, memory). -1 if the report has no such line (the phase took no measurable time).
+  */
+  double phase_ms(const std::string &report, const char *item) {
+    size_t p = report.find(item);
+    if (p == std::string::npos || (p = report.find(':', p)) == std::string::npos) return -1;
+    const char *c = report.c_str() + p + 1;
+    double v[3];
+    for (int i = 0; i < 3; i++) {
+      char *end;
+      v[i] = std::strtod(c, &end);
+      if (end == c) return -1;
+      c = std::strchr(end, ')');
+      if (!c) return -1;
+      c++;
+    }
+    return v[2] * 1000;
+  }
+
+  void json_ms(const char *key, double ms) {
+    if (ms < 0) std::printf(",\"%s\":null", key);
+    else std::printf(",\"%s\":%.1f", key, ms);
+  }
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  std::string gcc = "gcc", plugin, baseline, dir = "out/compile_bench";
+  int runs = 3;
+  bool quick = false;
+  for (int i = 1; i < argc; i++) {
+    std::string a = argv[i];
+    if (a == "--gcc" && i + 1 < argc) gcc = argv[++i];
+    else if (a == "--plugin" && i + 1 < argc) plugin = argv[++i];
+    else if (a == "--baseline" && i + 1 < argc) baseline = argv[++i];
+    else if (a == "--dir" && i + 1 < argc) dir = argv[++i];
+    else if (a == "--runs" && i + 1 < argc) runs = std::atoi(argv[++i]);
+    else if (a == "--quick") quick = true;
+    else {
+      std::fprintf(stderr,
+                   "usage: %s [--gcc gcc] [--plugin memlog_plugin.so] [--baseline memlog_plugin.so] "
+                   "[--dir out/compile_bench] [--runs 3] [--quick]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+  if (runs <= 0) runs = 1;
+  if (!baseline.empty() && plugin.empty()) {
+    std::fprintf(stderr, "compile_bench: --baseline needs --plugin to compare against\n");
+    return 2;
+  }
+  mkdir(dir.c_str(), 0755);
+
+  //two sizes of each shape (--quick: just the small one)
+  std::vector<input> inputs;
+  const struct { const char *name; int small, large; std::string (*gen)(int); } shapes[] = {
+    {"many_funcs", 500, 4000, gen_many_funcs},
+    {"deep_exprs", 8, 40, gen_deep_exprs},
+    {"structs", 300, 2000, gen_structs},
+    {"loops", 300, 2000, gen_loops},
+  };
+  for (const auto &sh : shapes) {
+    for (int scale : {sh.small, sh.large}) {
+      if (quick && scale == sh.large) continue;
+      input in = { sh.name, scale, dir + "/" + sh.name + "_" + std::to_string(scale) + ".c" };
+      if (!write_file(in.path, sh.gen(scale))) {
+        std::perror(in.path.c_str());
+        return 1;
+      }
+      inputs.push_back(in);
+    }
+  }
+
+  //variant name and the extra compiler arguments it needs (the site file path is appended per input);
+  //rate: report plugin_ms and events_per_sec. static_baseline runs before static so static can report vs_baseline
+  struct variant { const char *name; std::vector<std::string> args; bool cached, rate; };
+  std::vector<variant> variants = { {"base", {}, false, false} };
+  if (!baseline.empty()) variants.push_back({"static_baseline", {"-fplugin=" + baseline}, false, true});
+  if (!plugin.empty()) {
+    variants.push_back({"static", {"-fplugin=" + plugin}, false, true});
+    variants.push_back({"runtime", {"-fplugin=" + plugin, "-fplugin-arg-memlog_plugin-mode=runtime"}, false, false});
+    variants.push_back({"static_cached", {"-fplugin=" + plugin}, true, false});
+  }
+
+  int failures = 0;
+  for (const input &in : inputs) {
+    double base_ms = 0, baseline_eps = 0;
+    for (const variant &v : variants) {
+      std::string obj = dir + "/" + in.name + "_" + std::to_string(in.scale) + "_" + v.name + ".o";
+      std::string sites = dir + "/" + in.name + "_" + std::to_string(in.scale) + "_" + v.name + ".jsonl";
+      std::vector<std::string> args = { gcc, "-g", "-O0", "-c", in.path, "-o", obj };
+      args.insert(args.end(), v.args.begin(), v.args.end());
+      if (!v.args.empty()) args.push_back("-fplugin-arg-memlog_plugin-out=" + sites);
+      if (v.cached) {
+        //a cache of its own per input, filled by one untimed compile
+        std::string cache = dir + "/" + in.name + "_" + std::to_string(in.scale) + "_cache";
+        mkdir(cache.c_str(), 0755);
+        args.push_back("-fplugin-arg-memlog_plugin-cache=" + cache);
+        run_isolated(args);
+      }
+
+      run_result best = { false, 0, 0 };
+      for (int r = 0; r < runs; r++) {
+        std::remove(sites.c_str());
+        run_result got = run_isolated(args);
+        if (!got.ok) { best.ok = false; break; }
+        if (!best.ok || got.wall_ms < best.wall_ms) best.wall_ms = got.wall_ms;
+        best.peak_rss_kb = std::max(best.peak_rss_kb, got.peak_rss_kb);
+        best.ok = true;
+      }
+      if (!best.ok) {
+        std::fprintf(stderr, "compile_bench: %s failed for %s\n", v.name, in.path.c_str());
+        failures++;
+        continue;
+      }
+      if (v.args.empty()) base_ms = best.wall_ms;
+
+      long long events = 0, bytes = 0;
+      if (!v.args.empty()) count_output(sites, events, bytes);
+      std::printf("{\"bench\":\"compile\",\"input\":\"%s\",\"scale\":%d,\"variant\":\"%s\",\"wall_ms\":%.1f,"
+                  "\"base_wall_ms\":%.1f,\"overhead\":%.2f,\"peak_rss_kb\":%ld,\"events\":%lld,\"bytes\":%lld",
+                  in.name, in.scale, v.name, best.wall_ms, base_ms, base_ms > 0 ? best.wall_ms / base_ms : 0.0,
+                  best.peak_rss_kb, events, bytes);
+      if (v.rate) {
+        //the plugin's share of the compile, and its throughput
+        double plugin_ms = best.wall_ms - base_ms;
+        double eps = plugin_ms > 0 ? events * 1000.0 / plugin_ms : 0;
+        std::printf(",\"plugin_ms\":%.1f,\"events_per_sec\":%.0f", plugin_ms, eps);
+        if (std::strcmp(v.name, "static_baseline") == 0) baseline_eps = eps;
+        else if (baseline_eps > 0 && eps > 0) std::printf(",\"vs_baseline\":%.2f", eps / baseline_eps);
+      }
+      if (!v.args.empty()) {
+        //the plugin's phases, from one more compile with -ftime-report
+        std::string report_path = dir + "/" + in.name + "_" + std::to_string(in.scale) + "_" + v.name + ".time";
+        std::vector<std::string> targs = args;
+        targs.push_back("-ftime-report");
+        std::string report;
+        if (run_isolated(targs, report_path.c_str()).ok) read_file(report_path, report);
+        json_ms("classify_ms", phase_ms(report, "memlog: classification"));
+        json_ms("serialize_ms", phase_ms(report, "memlog: serialization"));
+        json_ms("io_ms", phase_ms(report, "memlog: I/O"));
+      }
+      std::printf("}\n");
+      std::fflush(stdout);
+    }
+  }
+  return failures ? 1 : 0;
+}
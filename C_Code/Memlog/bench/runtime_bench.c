@@ -0,0 +1,284 @@
+// runtime_bench.c
+// Cost of the memlog_runtime hooks under load, measured against an uninstrumented baseline (a no-op function
+// with the same signature). The hooks are called directly, so this needs only memlog_runtime.o, not the plugin.
+//
+// Prints one JSON line per measurement:
+//   {"test":"latency","hook":"store",...}        single thread: ns and cycles per call, minus the baseline
+//   {"test":"contention","threads":4,...}        1..N threads storing at once: events/sec, ns per event per thread
+//   {"test":"drain","threads":4,...}             throughput to a real trace file: until shutdown, and until fsync
+//
+// Each test runs in a child process of its own, so each gets a fresh runtime and its own trace file:
+// latency and contention trace to /dev/null (they measure the producers), drain to <dir>/runtime_bench.trace,
+// which is deleted afterwards.
+// (The slowdown of whole kernels compiled with the plugin - array fill, struct copy, list update - is
+// measured by store_bench: make bench_store.)
+//
+// usage: runtime_bench [--threads N] [--events N] [--dir path]      (build and run with: make bench_runtime)
+
+#define _GNU_SOURCE
+#include "../memlog_runtime.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SITE 42 //any site id will do; nothing reads the trace
+
+static uint64_t now_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static double now_sec(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+//The baseline: what a call costs when it records nothing.
+__attribute__((noinline)) static void nop_store(uint64_t site, const void *addr, size_t size) {
+  __asm__ volatile("" : : "r"(site), "r"(addr), "r"(size) : "memory");
+}
+__attribute__((noinline)) static void nop_free(uint64_t site, const void *ptr) {
+  __asm__ volatile("" : : "r"(site), "r"(ptr) : "memory");
+}
+
+// ---------------------------
+// Single-thread hook latency
+// ---------------------------
+
+typedef void (*store_fn)(uint64_t, const void *, size_t);
+typedef void (*free_fn)(uint64_t, const void *);
+
+//Calls are made in batches smaller than a ring (so the drainer keeps up and no batch waits for room);
+//the fastest batch is the hook's own cost.
+#define LATENCY_BATCH 8192
+#define LATENCY_ROUNDS 200
+
+static volatile long g_slot[16];
+
+static void latency_store_calls(store_fn f, uint64_t *best_ticks, double *best_sec) {
+  *best_ticks = UINT64_MAX;
+  *best_sec = 1e30;
+  for (int r = 0; r < LATENCY_ROUNDS; r++) {
+    double s0 = now_sec();
+    uint64_t t0 = now_ticks();
+    for (int i = 0; i < LATENCY_BATCH; i++) {
+      g_slot[i & 15] = i;
+      f(SITE, (const void *)&g_slot[i & 15], sizeof(long));
+    }
+    uint64_t t = now_ticks() - t0;
+    double s = now_sec() - s0;
+    if (t < *best_ticks) *best_ticks = t;
+    if (s < *best_sec) *best_sec = s;
+  }
+}
+
+static void latency_free_calls(free_fn f, uint64_t *best_ticks, double *best_sec) {
+  *best_ticks = UINT64_MAX;
+  *best_sec = 1e30;
+  for (int r = 0; r < LATENCY_ROUNDS; r++) {
+    double s0 = now_sec();
+    uint64_t t0 = now_ticks();
+    for (int i = 0; i < LATENCY_BATCH; i++) f(SITE, (const void *)&g_slot[i & 15]);
+    uint64_t t = now_ticks() - t0;
+    double s = now_sec() - s0;
+    if (t < *best_ticks) *best_ticks = t;
+    if (s < *best_sec) *best_sec = s;
+  }
+}
+
+//__memlog_alloc has the same shape as __memlog_store
+static void alloc_hook(uint64_t site, const void *ptr, size_t size) { __memlog_alloc(site, ptr, size); }
+
+static void print_latency(const char *hook, uint64_t ticks, double sec, uint64_t base_ticks, double base_sec) {
+  printf("{\"bench\":\"runtime\",\"test\":\"latency\",\"hook\":\"%s\",\"calls\":%d,\"ns_per_call\":%.2f,"
+         "\"cycles_per_call\":%.2f,\"base_ns_per_call\":%.2f,\"base_cycles_per_call\":%.2f,\"overhead_ns\":%.2f}\n",
+         hook, LATENCY_BATCH, sec * 1e9 / LATENCY_BATCH, (double)ticks / LATENCY_BATCH,
+         base_sec * 1e9 / LATENCY_BATCH, (double)base_ticks / LATENCY_BATCH, (sec - base_sec) * 1e9 / LATENCY_BATCH);
+}
+
+static void test_latency(void) {
+  uint64_t base_t, t;
+  double base_s, s;
+
+  latency_store_calls(nop_store, &base_t, &base_s);
+  latency_store_calls(__memlog_store, &t, &s);
+  print_latency("store", t, s, base_t, base_s);
+
+  latency_store_calls(alloc_hook, &t, &s);
+  print_latency("alloc", t, s, base_t, base_s);
+
+  latency_free_calls(nop_free, &base_t, &base_s);
+  latency_free_calls(__memlog_free, &t, &s);
+  print_latency("free", t, s, base_t, base_s);
+}
+
+// ---------------------------
+// Multi-thread contention and drain throughput
+// ---------------------------
+
+struct worker {
+  pthread_t th;
+  store_fn f;
+  long events;
+  pthread_barrier_t *start;
+  double sec; //how long this thread took for its events
+};
+
+static void *worker_main(void *p) {
+  struct worker *w = p;
+  long slot[8];
+  pthread_barrier_wait(w->start);
+  double s0 = now_sec();
+  for (long i = 0; i < w->events; i++) {
+    slot[i & 7] = i;
+    w->f(SITE, &slot[i & 7], sizeof(long));
+  }
+  w->sec = now_sec() - s0;
+  return NULL;
+}
+
+/*
+  Runs threads workers of events calls each, all started at once.
+
+  returns: wall time from the start until the last one finished; *avg_thread_sec gets the mean per-thread time
+*/
+static double run_workers(store_fn f, int threads, long events, double *avg_thread_sec) {
+  struct worker *ws = calloc((size_t)threads, sizeof(*ws));
+  pthread_barrier_t start;
+  pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+  for (int i = 0; i < threads; i++) {
+    ws[i].f = f;
+    ws[i].events = events;
+    ws[i].start = &start;
+    pthread_create(&ws[i].th, NULL, worker_main, &ws[i]);
+  }
+  pthread_barrier_wait(&start);
+  double s0 = now_sec();
+  double sum = 0;
+  for (int i = 0; i < threads; i++) {
+    pthread_join(ws[i].th, NULL);
+    sum += ws[i].sec;
+  }
+  double wall = now_sec() - s0;
+  pthread_barrier_destroy(&start);
+  free(ws);
+  *avg_thread_sec = sum / threads;
+  return wall;
+}
+
+static void test_contention(int threads, long events) {
+  double base_thread, thread;
+  run_workers(nop_store, threads, events, &base_thread);
+  uint64_t stalls0 = memlog_runtime_stall_count();
+  double wall = run_workers(__memlog_store, threads, events, &thread);
+  uint64_t stalls = memlog_runtime_stall_count() - stalls0;
+
+  double total = (double)events * threads;
+  printf("{\"bench\":\"runtime\",\"test\":\"contention\",\"threads\":%d,\"events\":%.0f,\"seconds\":%.4f,"
+         "\"events_per_sec\":%.0f,\"ns_per_event\":%.2f,\"base_ns_per_event\":%.2f,\"stalls\":%llu}\n",
+         threads, total, wall, total / wall, thread * 1e9 / (double)events,
+         base_thread * 1e9 / (double)events, (unsigned long long)stalls);
+}
+
+static void test_drain(int threads, long events, const char *path) {
+  double thread;
+  double s0 = now_sec();
+  double produce = run_workers(__memlog_store, threads, events, &thread);
+  uint64_t stalls = memlog_runtime_stall_count();
+  memlog_runtime_shutdown(); //drains what is left and closes the file
+  double closed = now_sec() - s0;
+
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    fsync(fd);
+    close(fd);
+  }
+  double synced = now_sec() - s0;
+
+  struct stat st;
+  long long bytes = stat(path, &st) == 0 ? (long long)st.st_size : 0;
+  double total = (double)events * threads;
+  printf("{\"bench\":\"runtime\",\"test\":\"drain\",\"threads\":%d,\"events\":%.0f,\"bytes\":%lld,"
+         "\"produce_seconds\":%.4f,\"close_seconds\":%.4f,\"fsync_seconds\":%.4f,"
+         "\"events_per_sec\":%.0f,\"mb_per_sec\":%.1f,\"synced_mb_per_sec\":%.1f,\"stalls\":%llu}\n",
+         threads, total, bytes, produce, closed, synced, total / closed, (double)bytes / closed / 1e6,
+         (double)bytes / synced / 1e6, (unsigned long long)stalls);
+}
+
+// ---------------------------
+// Driver
+// ---------------------------
+
+/*
+  Runs one test in a child process whose runtime traces to trace_path.
+  test: 0 latency, 1 contention, 2 drain
+*/
+static int run_child(int test, int threads, long events, const char *trace_path) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return 1;
+  if (pid == 0) {
+    setenv("MEMLOG_TRACE", trace_path, 1);
+    if (test == 0) test_latency();
+    else if (test == 1) test_contention(threads, events);
+    else test_drain(threads, events, trace_path);
+    fflush(stdout);
+    exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int max_threads = cpus > 0 ? (int)cpus : 1;
+  long events = 1 << 22;
+  const char *dir = ".";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--threads") && i + 1 < argc) max_threads = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--events") && i + 1 < argc) events = atol(argv[++i]);
+    else if (!strcmp(argv[i], "--dir") && i + 1 < argc) dir = argv[++i];
+    else {
+      fprintf(stderr, "usage: %s [--threads N] [--events N] [--dir path]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (max_threads <= 0 || events <= 0) {
+    fprintf(stderr, "usage: %s [--threads N] [--events N] [--dir path]\n", argv[0]);
+    return 2;
+  }
+
+  char trace[4096];
+  snprintf(trace, sizeof(trace), "%s/runtime_bench.trace", dir);
+
+  int failures = run_child(0, 1, 0, "/dev/null");
+
+  //1, 2, 4, ... threads, and max_threads itself
+  for (int t = 1;; t *= 2) {
+    if (t > max_threads) t = max_threads;
+    failures += run_child(1, t, events, "/dev/null");
+    if (t == max_threads) break;
+  }
+
+  //the drain tests write events records in total (events * 32 bytes), however many threads produce them
+  failures += run_child(2, 1, events, trace);
+  if (max_threads > 1) failures += run_child(2, max_threads, events / max_threads, trace);
+  unlink(trace);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,155 @@
+// store_bench.c
+// Cost of recording a store at runtime: the kernels in store_kernels.c without instrumentation (base_),
+// with the inline fast path (inline_) and with a __memlog_store call per store (call_).
+//
+// Prints one JSON line per kernel and variant:
+//   {"kernel":"array_fill","variant":"inline","stores":...,"events":...,"cycles_per_store":...,"overhead_per_event":...}
+// overhead_per_event is (variant - base) / events recorded, in cycles (TSC ticks on x86, nanoseconds elsewhere).
+//
+// usage: store_bench [n] [rounds]      (build and run with: make bench_store)
+
+#define _GNU_SOURCE
+#include "../memlog_runtime.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct Node {
+  struct Node *next;
+  int data;
+} node_t;
+
+typedef struct Person {
+  int age;
+  double height;
+  long id;
+} person;
+
+typedef struct NamedPerson {
+  int age;
+  char name[50];
+} named_person;
+
+#define DECLARE_KERNELS(prefix)                                       \
+  long prefix##array_fill(int *arr, int n);                           \
+  long prefix##struct_fields(person *p, int n);                       \
+  long prefix##struct_copy(named_person *dst, int n);                 \
+  long prefix##list_update(node_t *head);                             \
+  long prefix##local_scalar(const int *arr, int n, long *out);
+
+DECLARE_KERNELS(base_)
+DECLARE_KERNELS(inline_)
+DECLARE_KERNELS(call_)
+
+static uint64_t now_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __builtin_ia32_rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+struct workload {
+  int n;
+  int *arr;
+  person *people;
+  named_person *named;
+  node_t *list;
+  long sink;
+};
+
+struct variant {
+  const char *name;
+  long (*array_fill)(int *, int);
+  long (*struct_fields)(person *, int);
+  long (*struct_copy)(named_person *, int);
+  long (*list_update)(node_t *);
+  long (*local_scalar)(const int *, int, long *);
+};
+
+static const struct variant g_variants[] = {
+  {"base", base_array_fill, base_struct_fields, base_struct_copy, base_list_update, base_local_scalar},
+  {"inline", inline_array_fill, inline_struct_fields, inline_struct_copy, inline_list_update, inline_local_scalar},
+  {"call", call_array_fill, call_struct_fields, call_struct_copy, call_list_update, call_local_scalar},
+};
+#define N_VARIANTS (sizeof(g_variants) / sizeof(g_variants[0]))
+
+static long run_kernel(const struct variant *v, int kernel, struct workload *w) {
+  switch (kernel) {
+    case 0: return v->array_fill(w->arr, w->n);
+    case 1: return v->struct_fields(w->people, w->n);
+    case 2: return v->struct_copy(w->named, w->n);
+    case 3: return v->list_update(w->list);
+    default: return v->local_scalar(w->arr, w->n, &w->sink);
+  }
+}
+
+static const char *const g_kernel_names[] = {"array_fill", "struct_fields", "struct_copy", "list_update", "local_scalar"};
+#define N_KERNELS 5
+
+int main(int argc, char **argv) {
+  struct workload w;
+  w.n = argc > 1 ? atoi(argv[1]) : 1 << 16;
+  int rounds = argc > 2 ? atoi(argv[2]) : 200;
+  if (w.n <= 0 || rounds <= 0) {
+    fprintf(stderr, "usage: %s [n] [rounds]\n", argv[0]);
+    return 2;
+  }
+
+  w.arr = calloc((size_t)w.n, sizeof(int));
+  w.people = calloc((size_t)w.n, sizeof(person));
+  w.named = calloc((size_t)w.n, sizeof(named_person));
+  node_t *nodes = calloc((size_t)w.n, sizeof(node_t));
+  if (!w.arr || !w.people || !w.named || !nodes) return 1;
+  //link the nodes in a shuffled order, like a list built up by malloc over time
+  int *order = malloc((size_t)w.n * sizeof(int));
+  if (!order) return 1;
+  for (int i = 0; i < w.n; i++) order[i] = i;
+  uint64_t seed = 88172645463325252ull;
+  for (int i = w.n - 1; i > 0; i--) {
+    seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+    int j = (int)(seed % (uint64_t)(i + 1));
+    int t = order[i]; order[i] = order[j]; order[j] = t;
+  }
+  for (int i = 0; i + 1 < w.n; i++) nodes[order[i]].next = &nodes[order[i + 1]];
+  nodes[order[w.n - 1]].next = NULL;
+  w.list = &nodes[order[0]];
+  free(order);
+
+  for (int k = 0; k < N_KERNELS; k++) {
+    uint64_t base_ticks = 0;
+    for (size_t v = 0; v < N_VARIANTS; v++) {
+      const struct variant *var = &g_variants[v];
+      run_kernel(var, k, &w); //warm up
+
+      uint64_t best = UINT64_MAX;
+      long stores = 0;
+      uint64_t events = 0;
+      for (int r = 0; r < rounds; r++) {
+        uint64_t ev0 = memlog_runtime_event_count();
+        uint64_t t0 = now_ticks();
+        stores = run_kernel(var, k, &w);
+        uint64_t t = now_ticks() - t0;
+        events = memlog_runtime_event_count() - ev0;
+        if (t < best) best = t;
+      }
+      if (v == 0) base_ticks = best;
+
+      double overhead = events ? ((double)best - (double)base_ticks) / (double)events : 0.0;
+      printf("{\"kernel\":\"%s\",\"variant\":\"%s\",\"stores\":%ld,\"events\":%llu,"
+             "\"cycles_per_store\":%.2f,\"overhead_per_event\":%.2f}\n",
+             g_kernel_names[k], var->name, stores, (unsigned long long)events,
+             stores ? (double)best / (double)stores : 0.0, overhead);
+    }
+  }
+
+  free(w.arr);
+  free(w.people);
+  free(w.named);
+  free(nodes);
+  return w.sink == -1;
+}
@@ -0,0 +1,87 @@
+// store_kernels.c
+// Store-heavy kernels for store_bench.c, shaped like the code in ../main.c (array fill, struct fields,
+// struct copy, linked-list update, a local scalar in a loop).
+//
+// This file is compiled three times, with a different KERNEL_PREFIX each time (see the bench_store target):
+//   base_    no plugin
+//   inline_  -fplugin-arg-memlog_plugin-mode=runtime                   (scalar stores recorded inline)
+//   call_    ... -fplugin-arg-memlog_plugin-inline-stores=0            (every store through __memlog_store)
+// Both instrumented builds add -fplugin-arg-memlog_plugin-ranges=0, so the loops below record every store instead of
+// being summarized as one range_store per loop run.
+//
+// Every kernel returns the number of stores it executed, so the driver can report cost per store.
+
+#include <stddef.h>
+
+#ifndef KERNEL_PREFIX
+#define KERNEL_PREFIX base_
+#endif
+#define KERNEL_CAT2(a, b) a##b
+#define KERNEL_CAT(a, b) KERNEL_CAT2(a, b)
+#define KERNEL(name) KERNEL_CAT(KERNEL_PREFIX, name)
+
+typedef struct Node {
+  struct Node *next;
+  int data;
+} node_t;
+
+typedef struct Person {
+  int age;
+  double height;
+  long id;
+} person;
+
+//like main.c's person thomas = {21,"Thomas"}: a copy of it is one "write" event with its fields captured
+//(__memlog_fields_begin/__memlog_fields_end), the same in the inline and call builds
+typedef struct NamedPerson {
+  int age;
+  char name[50];
+} named_person;
+
+//dynamic_array[i] = i, as in int_array()
+long KERNEL(array_fill)(int *arr, int n) {
+  for (int i = 0; i < n; i++) {
+    arr[i] = i;
+  }
+  return n;
+}
+
+//three field stores per element
+long KERNEL(struct_fields)(person *p, int n) {
+  for (int i = 0; i < n; i++) {
+    p[i].age = i;
+    p[i].height = i * 0.5;
+    p[i].id = (long)i * 7;
+  }
+  return 3L * n;
+}
+
+//one field store and one whole-struct copy (a write event, not a store) per element
+long KERNEL(struct_copy)(named_person *dst, int n) {
+  named_person thomas = {21, "Thomas"};
+  for (int i = 0; i < n; i++) {
+    thomas.age = i;
+    dst[i] = thomas;
+  }
+  return 2L * n;
+}
+
+//walk the list and bump every node's data
+long KERNEL(list_update)(node_t *head) {
+  long stores = 0;
+  for (node_t *cur = head; cur; cur = cur->next) {
+    cur->data = cur->data + 1;
+    stores++;
+  }
+  return stores;
+}
+
+//a local that lives in a register (recorded with addr 0 inline)
+long KERNEL(local_scalar)(const int *arr, int n, long *out) {
+  long sum = 0;
+  for (int i = 0; i < n; i++) {
+    sum = sum + arr[i];
+  }
+  *out = sum;
+  return n + 1;
+}
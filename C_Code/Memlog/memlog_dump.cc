@@ -0,0 +1,52 @@
+// memlog_dump.cc
+// Converts a binary site file (memlog_plugin format=bin) or a merged index (memlog_merge) back into "v":1 JSONL,
+// or a runtime trace (memlog_runtime.c) into one JSON object per record.
+//
+// usage: memlog_dump <site-file.bin | trace.bin | index.idx> [out.jsonl]
+//   (output goes to stdout when no output path is given)
+
+#include "memlog_reader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    std::fprintf(stderr, "usage: %s <site-file.bin | trace.bin | index.idx> [out.jsonl]\n", argv[0]);
+    return 2;
+  }
+
+  FILE *in = std::fopen(argv[1], "rb");
+  if (!in) {
+    std::perror(argv[1]);
+    return 1;
+  }
+
+  FILE *out = stdout;
+  if (argc == 3) {
+    out = std::fopen(argv[2], "w");
+    if (!out) {
+      std::perror(argv[2]);
+      std::fclose(in);
+      return 1;
+    }
+  }
+
+  //every kind of file starts with an 8 byte magic; peek at it to pick the reader
+  char magic[MEMLOG_BIN_MAGIC_LEN] = {0};
+  size_t got = std::fread(magic, 1, sizeof(magic), in);
+  std::rewind(in);
+  bool is_trace = got == sizeof(magic) && std::memcmp(magic, MEMLOG_RT_MAGIC, sizeof(magic)) == 0;
+  bool is_index = got == sizeof(magic) && std::memcmp(magic, MEMLOG_IDX_MAGIC, sizeof(magic)) == 0;
+
+  std::string err;
+  bool ok = is_trace ? memlog_rt_to_jsonl(in, out, err)
+          : is_index ? memlog_idx_to_jsonl(in, out, err)
+          : memlog_bin_to_jsonl(in, out, err);
+  if (!ok) std::fprintf(stderr, "%s: %s\n", argv[1], err.c_str());
+
+  std::fclose(in);
+  if (out != stdout) std::fclose(out);
+  return ok ? 0 : 1;
+}
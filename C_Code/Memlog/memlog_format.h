@@ -0,0 +1,688 @@
+// memlog_format.h
+// On-disk layout of the binary site file written by memlog_plugin when it is run with
+//   -fplugin-arg-memlog_plugin-format=bin
+//
+// It also describes the trace file the runtime library (memlog_runtime.c) writes when an
+// instrumented program runs (see "RUNTIME TRACE LAYOUT" below).
+//
+// This header is plain C so that the plugin (C++), the reader library (C++) and the
+// runtime library (C) can all share the exact same struct definitions.
+
+#ifndef MEMLOG_FORMAT_H
+#define MEMLOG_FORMAT_H
+
+#include <stdint.h>
+
+/**
+  NOTE: BINARY FILE LAYOUT
+
+  The file is written once, at PLUGIN_FINISH, in host byte order (little endian on every machine we build on).
+
+    +------------------------------+
+    | memlog_bin_header            |  magic, version, and how many entries each section below holds
+    +------------------------------+
+    | file string table            |  n_files  strings  (source file paths)
+    | function string table        |  n_funcs  strings  (function names)
+    | identifier string table      |  n_idents strings  (variable, field and allocator names)
+    +------------------------------+
+    | memlog_bin_expr[n_exprs]     |  fixed-width expression nodes (the "lhs"/"size_expr"/"ptr_expr" trees)
+    +------------------------------+
+    | memlog_bin_site[n_sites]     |  fixed-width site records, one per store/alloc/free/write/frame
+    +------------------------------+
+    | memlog_bin_range[n_ranges]   |  loop summaries of store sites (see "LOOP RANGE STORES" below)
+    +------------------------------+
+    | memlog_bin_local[n_locals]   |  the locals of frame sites (see "FRAMES" below)
+    +------------------------------+
+    | memlog_bin_inline[n_inlines] |  the calls inlined code came through (see "INLINED CODE" below)
+    +------------------------------+
+    | memlog_bin_reg_store[...]    |  n_reg_stores stores to register locals (see "REGISTER LOCAL STORES" below)
+    +------------------------------+
+    | memlog_bin_points_to[...]    |  n_points_to: the blocks stores and writes go to (see "POINTS-TO" below)
+    +------------------------------+
+    | memlog_bin_type[n_types]     |  the type dictionary (see "TYPES" below)
+    | memlog_bin_field[n_fields]   |  the fields of its struct and union types
+    +------------------------------+
+    | memlog_bin_stats             |  stats_size bytes: what the compile processed (see "STATS RECORD" below)
+    +------------------------------+
+
+  Each string is stored as a uint32_t byte length followed by that many bytes (no NUL terminator).
+  Strings are interned: a path like "/home/me/project/main.c" is written once and every site refers to it by index.
+
+  Expression trees are flattened into the expression array. A node refers to its children by their index in
+  that array (children are always written before their parents), and MEMLOG_NONE means "no child".
+ */
+
+/**
+  NOTE: SITE IDS
+
+  Every compile numbers its sites from 1, so on their own those numbers repeat in every translation unit. The id a
+  site is known by everywhere else (the JSONL "site" field, runtime records) therefore also carries a 32-bit hash of
+  the translation unit's source path and of the object it is compiled into (the "TU id"), so one source built into
+  two objects (say with different -D flags) gets two ids:
+
+      site id = tu_id * 2^21 + local index          (MEMLOG_SITE_ID)
+
+  That fits in 53 bits, so it survives a round trip through a JavaScript number, and ids of one file don't change
+  when some other file is rebuilt. -fplugin-arg-memlog_plugin-tu-id=<n> picks the TU id by hand. A file with more
+  than 2^21 - 1 sites is a compile error: its ids would repeat.
+ */
+#define MEMLOG_SITE_LOCAL_BITS 21
+#define MEMLOG_SITE_LOCAL_MAX  ((1u << MEMLOG_SITE_LOCAL_BITS) - 1)
+#define MEMLOG_SITE_ID(tu_id, local) (((uint64_t)(uint32_t)(tu_id) << MEMLOG_SITE_LOCAL_BITS) | (uint64_t)(local))
+
+//"MEMLOGB" followed by a NUL byte
+#define MEMLOG_BIN_MAGIC "MEMLOGB"
+#define MEMLOG_BIN_MAGIC_LEN 8
+
+//bump this whenever a struct below changes shape
+#define MEMLOG_BIN_VERSION 11
+
+//used for "no string" / "no expression" in any index field
+#define MEMLOG_NONE 0xffffffffu
+
+//what kind of event a site record describes (matches the "kind" field of the JSONL output)
+enum memlog_site_kind {
+  MEMLOG_SITE_STORE = 1,
+  MEMLOG_SITE_ALLOC = 2,
+  MEMLOG_SITE_FREE  = 3,
+  MEMLOG_SITE_WRITE = 4, // one write of a whole block (see "BULK WRITES")
+  MEMLOG_SITE_FRAME = 5  // a function's stack frame (see "FRAMES")
+};
+
+//memlog_bin_site.flags
+#define MEMLOG_SITE_F_ARENA 1u  // alloc: the allocator hands out arena chunks (see "ALLOCATOR FAMILIES")
+#define MEMLOG_SITE_F_FIELDS 2u // write: the runtime captures the struct's fields, not its bytes (see "FIELD CAPTURES")
+#define MEMLOG_SITE_F_VALUE_STATIC 4u // store: it writes a constant, "value_static":true (see "STORE VALUES")
+
+//what kind of expression a node describes (matches the "k" field of the JSONL output)
+enum memlog_expr_kind {
+  MEMLOG_EX_UNKNOWN = 0, // {"k":"unknown"}
+  MEMLOG_EX_VAR     = 1, // {"k":"var","name":...}          name
+  MEMLOG_EX_INT     = 2, // {"k":"int","v":...}             value
+  MEMLOG_EX_BIGINT  = 3, // {"k":"int","v":"<bigint>"}
+  MEMLOG_EX_BIN     = 4, // {"k":"bin","op":...,"a":...,"b":...}   op (+ - * / % & | ^ << >> < <= > >= == !=), a, b
+  MEMLOG_EX_CAST    = 5, // {"k":"cast","to":"<nop>","x":...}      a
+  MEMLOG_EX_ADDR    = 6, // {"k":"addr","x":...}                   a
+  MEMLOG_EX_INDEX   = 7, // {"k":"index","base":...,"index":...}   a, b, value = elem_bytes (-1 if unknown)
+  MEMLOG_EX_FIELD   = 8, // {"k":"field","base":...,"field":...}   a, name, MEMLOG_EXF_VIA_PTR
+  MEMLOG_EX_DEREF   = 9, // {"k":"deref","base":...}               a
+  MEMLOG_EX_MEM_REF = 10,// {"k":"mem_ref","base":...,"offset":...} a, b
+  MEMLOG_EX_STR     = 11,// {"k":"str","v":...}             name = the string's contents (identifier table)
+  MEMLOG_EX_CTOR    = 12,// {"k":"ctor","n":...}            value = explicit elements (0: "= {}", all zero)
+  MEMLOG_EX_FLOAT   = 13,// {"k":"float","v":...}           name = v's JSON text: a number, or "inf", "-inf", "nan"
+  MEMLOG_EX_UN      = 14 // {"k":"un","op":...,"x":...}     op (- ~ !), a
+};
+
+//flag bits for memlog_bin_expr.flags
+#define MEMLOG_EXF_VIA_PTR 0x01
+
+struct memlog_bin_header {
+  char     magic[MEMLOG_BIN_MAGIC_LEN]; // MEMLOG_BIN_MAGIC
+  uint32_t version;                    // MEMLOG_BIN_VERSION
+  uint32_t header_size;                // sizeof(struct memlog_bin_header), lets readers skip fields they don't know
+  uint32_t n_files;                    // entries in the file string table
+  uint32_t n_funcs;                    // entries in the function string table
+  uint32_t n_idents;                   // entries in the identifier string table
+  uint32_t n_exprs;                    // entries in the expression array
+  uint32_t n_sites;                    // entries in the site array
+  uint32_t n_ranges;                   // entries in the range array
+  uint32_t tu_id;                      // TU id of every site in the file (see "SITE IDS")
+  uint32_t stats_size;                 // size of the memlog_bin_stats at the end of the file (0: none)
+  uint32_t n_locals;                   // entries in the locals array
+  uint32_t n_inlines;                  // entries in the inlines array
+  uint32_t n_reg_stores;               // entries in the register local stores array
+  uint32_t n_points_to;                // entries in the points-to array
+  uint32_t n_types;                    // entries in the type array
+  uint32_t n_fields;                   // entries in the field array
+};
+
+//one node of an expression tree (24 bytes)
+struct memlog_bin_expr {
+  uint8_t  kind;   // memlog_expr_kind
+  uint8_t  flags;  // MEMLOG_EXF_* bits
+  char     op[2];  // operator of MEMLOG_EX_BIN/MEMLOG_EX_UN ("+", "<<", "~"), NUL padded
+  uint32_t a;      // first child (expr index) or MEMLOG_NONE
+  uint32_t b;      // second child (expr index) or MEMLOG_NONE
+  uint32_t name;   // identifier index or MEMLOG_NONE
+  int64_t  value;  // integer value (MEMLOG_EX_INT) or elem_bytes (MEMLOG_EX_INDEX)
+};
+
+//one store/alloc/free/write/frame site (64 bytes)
+struct memlog_bin_site {
+  uint32_t site;     // local index; the site id ("site" in the JSONL output) is MEMLOG_SITE_ID(header.tu_id, site)
+  uint32_t kind;     // memlog_site_kind
+  uint32_t file;     // file string index
+  uint32_t func;     // function string index
+  uint32_t line;
+  uint32_t col;
+  uint32_t expr;     // store: lhs, alloc: lhs (MEMLOG_NONE => null), free: ptr_expr
+  uint32_t expr2;    // alloc: size_expr, store: rhs, otherwise MEMLOG_NONE
+  uint32_t name;     // alloc/free/write: the function called (identifier index), otherwise MEMLOG_NONE
+  uint32_t expr3;    // write: src (memset: the fill value), otherwise MEMLOG_NONE
+  uint32_t name2;    // alloc: the matching free function (identifier index), MEMLOG_NONE if unknown
+  uint32_t flags;    // MEMLOG_SITE_F_*
+  uint32_t type;     // store: the destination's type, alloc: lhs's, write: the object's (type index), MEMLOG_NONE => none
+  uint32_t reserved; // always 0
+  int64_t  bytes;    // store: size of the destination, -1 => null
+};
+
+/**
+  NOTE: STORE VALUES
+
+  A store also says what it writes ("rhs", after "type" in the "store" object), as an expression like its lhs:
+
+    x = 50;           "rhs":{"k":"int","v":50},"value_static":true
+    d = 1.5;          "rhs":{"k":"float","v":1.5e+0},"value_static":true
+    p->n = a + b;     "rhs":{"k":"bin","op":"+","a":{"k":"var","name":"a"},"b":{"k":"var","name":"b"}},"value_static":false
+    ex[i] = s.len;    "rhs":{"k":"field","base":{"k":"var","name":"s"},"field":"len","via_ptr":false},...
+
+  The compiler's temporaries are followed back to what they were computed from (a few steps deep), so the second
+  example reads as written even though gcc first computes a + b into a temporary. A load prints as the place it
+  reads, and "rhs" is {"k":"unknown"} for a call's result or anything else we can't describe.
+
+  value_static is true when the value is a compile-time constant: it is the "rhs" itself, converted to the store's
+  type. In runtime mode such a store does not read its value back: its record's value is the constant, put in by
+  the instrumentation. In the binary file rhs is expr2 and value_static is MEMLOG_SITE_F_VALUE_STATIC in flags.
+ */
+
+/**
+  NOTE: LOOP RANGE STORES
+
+  A store inside a simple counting loop, whose address and value are both affine in the loop's induction variable,
+
+    for (int i = 0; i < n; i++) dynamic_array[i] = i;
+
+  is not recorded once per iteration at runtime. Its site carries a range description instead
+  ("range" inside the "store" object of the JSONL output, a memlog_bin_range in the binary file):
+
+    "range":{"iv":"i","step":1,"stride":4,"value":{"mul":1,"add":0}}
+
+  and the runtime writes one MEMLOG_RT_RANGE_STORE record each time the loop finishes, with the address of the first
+  store, the number of iterations and the value the induction variable had when the loop started (iv0).
+  Iteration k (from 0) then wrote
+      address  addr + k * stride
+      value    mul * (iv0 + k * step) + add
+  The induction variable's own increment (i = i + 1) is summarized the same way, with stride 0 and address 0.
+ */
+
+/**
+  NOTE: BULK WRITES
+
+  Calls that fill or copy a whole block (memcpy, memmove, mempcpy, memset, strcpy, strncpy, stpcpy) and stores of a
+  whole struct or array (s = t;  int ex[9] = {};  person thomas = {21, "Thomas"} where gcc copies it in one piece)
+  are one "write" site each, not a store per element:
+
+    "write":{"fn":"memcpy","dst":<address>,"len":<bytes>,"src":<address>}
+    "write":{"fn":"memset","dst":<address>,"len":<bytes>,"value":<fill byte>}
+    "write":{"fn":"aggregate","dst":{"k":"addr","x":<lhs>},"len":{"k":"int","v":56},"src":{"k":"ctor","n":0}}
+
+  dst and src are addresses (for an aggregate store, of its two sides); src may also be a constructor
+  ({"k":"ctor"}) or a string literal ({"k":"str"}). len is null for strcpy and stpcpy: the length is only known
+  at runtime. In the binary file these are expr, expr2 and expr3, and the function name is in name.
+
+  At runtime each call writes one MEMLOG_RT_WRITE record, followed by the first bytes of the block (see
+  "RUNTIME TRACE LAYOUT"), or by the struct's fields for a write marked "capture":"fields" (see "FIELD CAPTURES").
+ */
+
+/**
+  NOTE: ALLOCATOR FAMILIES
+
+  Every alloc site names its allocator and the function that frees what it returns; every free site names the
+  function called:
+
+    "alloc":{"fn":"aligned_alloc","lhs":<lhs>,"size_expr":<bytes>,"free_fn":"free","arena":false}
+    "alloc":{"fn":"arena_grow","lhs":<lhs>,"size_expr":<bytes>,"free_fn":"arena_release","arena":true}
+    "free":{"fn":"pool_free","ptr_expr":<pointer>}
+
+  Besides the C library's allocators, the plugin knows the ones declared in an allocator file
+  (-fplugin-arg-memlog_plugin-allocators=<file>, see memlog_plugin.cc). An "arena" allocator hands out chunks that
+  the program carves up itself: each chunk is one alloc event, and the objects inside it are not tracked one by one.
+  free_fn is null when no free function was declared. In the binary file fn and free_fn are name and name2, and
+  "arena" is MEMLOG_SITE_F_ARENA in flags.
+ */
+
+//loop summary of one store site (40 bytes)
+struct memlog_bin_range {
+  uint32_t site;      // local index of the store site this describes
+  uint32_t iv;        // induction variable (identifier index)
+  int64_t  step;      // added to the induction variable every iteration
+  int64_t  stride;    // bytes between the addresses written by consecutive iterations
+  int64_t  value_mul; // value stored = value_mul * iv + value_add
+  int64_t  value_add;
+};
+
+
+/**
+  NOTE: FRAMES
+
+  Every function of the user's code gets one "frame" site describing its stack frame:
+
+    {"v":2,"site":40,"kind":"frame","fid":3,"file":"/home/.../main.c","line":16,"col":6,
+     "frame":{"locals":[{"name":"n","param":true,"offset":-36,"size":4},
+                        {"name":"buf","param":false,"offset":-32,"size":16}]}}
+
+  offset is where the variable lives relative to the frame base (__builtin_frame_address(0), i.e. the frame
+  pointer), null if it has no fixed stack slot there (a variable-sized array, a register variable); size is null
+  for variable-sized locals. Parameters come first, then the locals of every block of the function.
+
+  "esc" (after size) is what the plugin's escape analysis found out about the variable:
+    "reg"     a scalar whose address is never taken: only the function's own assignments ever change it
+    "addr"    lives in memory (an aggregate, or its address is taken), but no pointer to it leaves the function
+              (the address is only compared or handed to memset/memcpy-style builtins)
+    "escapes" a pointer to it may be kept elsewhere (passed to a call, stored, returned), so anything may write it
+  Variables the analysis didn't see (a function inlined at stage=late keeps its own) have no "esc".
+
+  Stack slots are only assigned during register allocation, long after the pass that finds the function's other
+  sites, so the frame site is written last, with its location (the function's declaration) spelled out in full.
+  Its fid refers to the function header written before the function's other events.
+
+  In runtime mode the function records MEMLOG_RT_ENTER (addr = frame base) when it starts and MEMLOG_RT_EXIT
+  right before each return, both with the frame site's id. The call stack at any point of the trace is the
+  enters of that thread not yet matched by an exit, and a local's address is its frame base plus its offset.
+  (A function left through longjmp or exit records no exit.)
+
+  In the binary file a frame site's locals are consecutive memlog_bin_local records.
+ */
+
+//memlog_bin_local.flags
+#define MEMLOG_LOCAL_F_PARAM 1u   // a parameter
+#define MEMLOG_LOCAL_F_INLINED 2u // belongs to a function inlined into this one (inl names it, see "INLINED CODE")
+#define MEMLOG_LOCAL_F_REG 4u     // "esc":"reg"
+#define MEMLOG_LOCAL_F_ADDR 8u    // "esc":"addr"
+#define MEMLOG_LOCAL_F_ESCAPES 16u// "esc":"escapes"
+
+//for memlog_bin_local.offset: no fixed offset from the frame base
+#define MEMLOG_NO_OFFSET INT64_MIN
+
+//one local variable of a frame site (40 bytes)
+struct memlog_bin_local {
+  uint32_t site;    // local index of the frame site it belongs to
+  uint32_t name;    // identifier index
+  uint32_t flags;   // MEMLOG_LOCAL_F_*
+  uint32_t inl;     // MEMLOG_LOCAL_F_INLINED: the inlined function (function string index), otherwise MEMLOG_NONE
+  uint32_t type;    // type index
+  uint32_t reserved;// always 0
+  int64_t  offset;  // from the frame base, MEMLOG_NO_OFFSET => null
+  int64_t  size;    // bytes, -1 => null
+};
+
+
+/**
+  NOTE: INLINED CODE
+
+  A file compiled with -fplugin-arg-memlog_plugin-stage=late is instrumented after the optimizers have run, so a
+  function's code may include copies of other functions inlined into it. A site in such a copy keeps the location
+  it has in the inlined function, and lists the calls it was inlined through, outermost first:
+
+    {"v":2,"site":57,"kind":"store","fid":3,"dl":-12,"dc":3,
+     "inl":[{"fn":"push","file":"/home/.../main.c","line":40,"col":5}],"store":{...}}
+
+  reads: the store is in push(), whose call at main.c:40:5 was inlined into function 3. With several entries, each
+  call is inside the function named by the entry before it. At runtime an inlined call records no
+  MEMLOG_RT_ENTER/EXIT; its locals are part of the caller's frame site, each marked with the function it belongs to
+  ("inl":"push" after "size"; the inlined function's parameters have "param":true).
+
+  In the binary file a site's calls are consecutive memlog_bin_inline records; a site without any has none.
+ */
+
+//one call a site was inlined through (24 bytes)
+struct memlog_bin_inline {
+  uint32_t site;     // local index of the site
+  uint32_t fn;       // the function inlined (function string index)
+  uint32_t file;     // where it was called: file string index
+  uint32_t line;
+  uint32_t col;
+  uint32_t reserved; // always 0
+};
+
+
+/**
+  NOTE: REGISTER LOCAL STORES
+
+  A store to an "esc":"reg" local (see "FRAMES") is recorded without the local's address: taking it would force
+  the variable into memory, so its MEMLOG_RT_STORE has addr 0. The frame site says which local each such site
+  assigns, so a reader can still put the value at the local's place in the frame:
+
+    "frame":{"locals":[...],"reg_stores":[{"site":44,"local":2},
+                                          {"site":41,"local":2,"anchor":44,"from":null,"add":0},
+                                          {"site":45,"local":2,"anchor":40,"from":2,"add":1}]}
+
+  An entry with an anchor is a store that gets no runtime hook at all (runtime mode, stage=early), because the
+  record it would write is implied by another one:
+    - its value is a constant, or another "reg" local of the function (not a parameter, and only ever assigned
+      by stores listed here) plus a constant: i = 0; i = i + 1; p = q - 8;
+    - a later statement of the same basic block writes a runtime record (a hooked store, or the MEMLOG_RT_EXIT
+      before the function's return), with no call and no other record in between.
+  The function then runs the store exactly when it writes that anchor record, and nothing can observe the local in
+  between. Above: right before each record of site 44, the innermost frame of this frame site sets its locals[2]
+  to 0 as site 41; right before each MEMLOG_RT_EXIT (anchor = the frame site itself), locals[2] becomes its own
+  value plus 1 as site 45. The value is (from == null ? 0 : the current value of locals[from]) + add, wrapped to the
+  local's size. Entries with the same anchor happen in the order listed. memlog_replay puts them back into the
+  trace as stores of their own; -fplugin-arg-memlog_plugin-derive=0 hooks every store again.
+
+  In the binary file a frame site's entries are consecutive memlog_bin_reg_store records.
+ */
+
+//one store to a register local of a frame site (32 bytes)
+struct memlog_bin_reg_store {
+  uint32_t site;     // local index of the store site
+  uint32_t frame;    // local index of the frame site
+  uint32_t local;    // the local it stores to (index among the frame site's locals)
+  uint32_t anchor;   // local index of the anchor site (== frame: its MEMLOG_RT_EXIT), MEMLOG_NONE => recorded itself
+  uint32_t from;     // anchored: the local the value is based on, MEMLOG_NONE => null
+  uint32_t reserved; // always 0
+  int64_t  add;      // anchored: added to it
+};
+
+
+/**
+  NOTE: POINTS-TO
+
+  A store or bulk write through a pointer says which allocation sites of its own function that pointer can point
+  into, if the plugin could tell ("pt" at the end of the "store" or "write" object):
+
+    {"v":2,"site":43,"kind":"store","fid":3,"dl":2,"dc":10,"store":{"lhs":<lhs>,"bytes":4,
+     "pt":{"alloc":[41],"definite":true}}}
+
+  alloc lists every alloc site whose blocks the pointer may point into; anything else it may point at is not a
+  heap block (a local, a global, a string literal). definite is true when there is exactly one such site and
+  nothing else: the write always lands in a block allocated by site 41 (not necessarily the latest one, if site 41
+  runs more than once). "alloc":[] means the pointer never points into a heap block.
+
+  The analysis is intra-procedural and flow-insensitive: a pointer's targets are collected from every assignment
+  to it in the function, through copies, pointer arithmetic and casts. A pointer that may come from outside the
+  function (a parameter, a global, a call's result, anything loaded from memory other than its own locals) could
+  point anywhere, and writes through it have no "pt".
+
+  In the binary file a site's entries are consecutive memlog_bin_points_to records, one per alloc site
+  (a single one with alloc = MEMLOG_NONE for "alloc":[]); a site without any has no "pt".
+ */
+
+//memlog_bin_points_to.flags
+#define MEMLOG_PT_F_DEFINITE 1u // "definite":true (set on each of the site's records)
+
+//one alloc site a store or write site's pointer may point into (16 bytes)
+struct memlog_bin_points_to {
+  uint32_t site;     // local index of the store or write site
+  uint32_t alloc;    // local index of the alloc site, MEMLOG_NONE => "alloc":[]
+  uint32_t flags;    // MEMLOG_PT_F_*
+  uint32_t reserved; // always 0
+};
+
+
+/**
+  NOTE: TYPES
+
+  Store sites ("type" after "bytes"), alloc sites (after "lhs": the pointer's type), aggregate bulk writes (after
+  "dst") and frame locals (after "size") refer to the type of what they write by id. Each type is described once,
+  in a record of its own written at PLUGIN_FINISH, before the stats record:
+
+    {"v":2,"kind":"type","id":7165286510842893,"k":"struct","name":"struct node","size":16,"align":8,
+     "fields":[{"name":"value","offset":0,"type":2210339270138414},
+               {"name":"flags","offset":4,"bit":3,"bits":2,"type":4505118722262950},
+               {"name":"next","offset":8,"type":5014719046102077}]}
+    {"v":2,"kind":"type","id":5014719046102077,"k":"ptr","size":8,"align":8,"to":7165286510842893}
+    {"v":2,"kind":"type","id":2210339270138414,"k":"int","name":"int","size":4,"align":4,"unsigned":false}
+    {"v":2,"kind":"type","id":3817340551937561,"k":"array","size":40,"align":4,"elem":2210339270138414,"count":10}
+
+  k is one of "int", "bool", "enum", "float", "ptr", "array", "struct", "union", "func", "void" and "other".
+  Qualifiers and typedefs are looked through: a type is named by its main variant ("long unsigned int" for size_t),
+  and an anonymous struct by the first typedef naming it. "name" is left out when there is none (pointers, arrays).
+  size and align are in bytes, null when unknown (a variable-sized array, an incomplete struct, a function).
+  "unsigned" comes with "int" and "enum", "to" with "ptr", "elem" and "count" (null: not a constant, "int a[]") with
+  "array", and "fields" with every complete struct or union, in declaration order. A field's offset is in bytes from
+  the start of the struct (null: not a constant); a bit-field also has the bit it starts at within that byte and its
+  width. Every type referred to is in the dictionary.
+
+  A type id is a 53-bit hash of the type's layout (kind, name, size, alignment, its fields' names, offsets and types,
+  what it points to or holds), so the same type gets the same id in every translation unit and every compile, and a
+  reader can merge the dictionaries of several files by id. A pointer to a struct or union hashes only the struct's
+  kind, name, size and field names, which is what lets a struct point to itself.
+
+  In the binary file sites and locals refer to types by their index in the type array, and a struct's fields are
+  consecutive memlog_bin_field records.
+ */
+
+/**
+  NOTE: FIELD CAPTURES
+
+  In runtime mode (stage=early) an aggregate write of a struct says
+
+    "write":{"fn":"aggregate","dst":...,"type":7165286510842893,"len":...,"src":...,"capture":"fields"}
+
+  (MEMLOG_SITE_F_FIELDS in the binary file). The plugin compiles a capture function for each such struct type, and
+  the bytes after the write's MEMLOG_RT_WRITE record are the struct's fields packed one after another, instead of
+  the first bytes of the struct. To decode them walk the type's "fields" in the dictionary, in order, going into
+  every field that is itself a struct (its fields are packed the same way), and take for each:
+
+    a bit-field                        its value, in as many bytes as its type has (native byte order)
+    a char array ("elem" is "char")    its bytes up to and including the first NUL, or all "count" of them
+    anything else                      its bytes as they are in memory (size of its type; 0 for "int a[]")
+
+  Padding and unnamed bit-fields are left out. Fields are packed while they fit into MEMLOG_WRITE_BYTES (see
+  memlog_runtime.c); the record's value is the number of bytes packed, so a capture ends with the first field that
+  did not fit.
+ */
+
+//what kind of type a dictionary entry describes ("k" in the JSONL output)
+enum memlog_type_kind {
+  MEMLOG_TY_OTHER  = 0,  // "other" (complex, vector, ...)
+  MEMLOG_TY_INT    = 1,  // "int"
+  MEMLOG_TY_BOOL   = 2,  // "bool"
+  MEMLOG_TY_ENUM   = 3,  // "enum"
+  MEMLOG_TY_FLOAT  = 4,  // "float"
+  MEMLOG_TY_PTR    = 5,  // "ptr"     ref = the type pointed to
+  MEMLOG_TY_ARRAY  = 6,  // "array"   ref = the element type
+  MEMLOG_TY_STRUCT = 7,  // "struct"
+  MEMLOG_TY_UNION  = 8,  // "union"
+  MEMLOG_TY_FUNC   = 9,  // "func"
+  MEMLOG_TY_VOID   = 10  // "void"
+};
+
+//memlog_bin_type.flags
+#define MEMLOG_TYPE_F_UNSIGNED 1u // "unsigned":true
+#define MEMLOG_TYPE_F_COMPLETE 2u // struct/union: has "fields" (its fields follow in the field array)
+
+//one type of the dictionary (48 bytes)
+struct memlog_bin_type {
+  uint64_t id;       // type id
+  uint32_t kind;     // memlog_type_kind
+  uint32_t name;     // identifier index, MEMLOG_NONE => none
+  uint32_t flags;    // MEMLOG_TYPE_F_*
+  uint32_t ref;      // ptr: the type pointed to, array: the element type (type index), otherwise MEMLOG_NONE
+  int64_t  size;     // bytes, -1 => null
+  int64_t  count;    // array: elements, -1 => null
+  uint32_t align;    // bytes, 0 => null
+  uint32_t reserved; // always 0
+};
+
+//one field of a struct or union type (24 bytes)
+struct memlog_bin_field {
+  uint32_t owner;      // type index of the struct or union
+  uint32_t name;       // identifier index, MEMLOG_NONE => null (an anonymous struct or union member)
+  uint32_t type;       // type index
+  uint32_t bits;       // bit-field width, 0 => not a bit-field
+  int64_t  bit_offset; // from the start of the struct, -1 => null
+};
+
+
+/**
+  NOTE: STATS RECORD
+
+  At PLUGIN_FINISH the plugin writes one record summarizing the whole compile, so the trace itself shows which
+  translation units make the plugin expensive. In a JSONL file it is the last line:
+
+    {"v":2,"kind":"stats","funcs":12,"cached":9,"stmts":913,"filtered":40,
+     "events":{"store":210,"range_store":3,"alloc":4,"free":4,"write":6,"frame":12},"derived":96,"bytes":48211,
+     "largest_func":{"name":"main","stmts":301,"events":77}}
+
+  funcs/stmts count every function and GIMPLE statement the pass walked, cached the functions whose records were
+  taken from the output cache instead (see "Incremental output cache" in memlog_plugin.cc; they still count in every
+  other number), filtered the statements skipped as system (or excluded) code, events the sites logged by kind ("range_store": stores summarized for their whole loop),
+  derived the store sites among them that got no runtime hook (see "REGISTER LOCAL STORES"),
+  and bytes everything written before the record. largest_func is the function with the most statements
+  (null when no function was walked). In a binary file the same numbers are a memlog_bin_stats at the end.
+ */
+
+//compile statistics (120 bytes)
+struct memlog_bin_stats {
+  uint64_t funcs;               // functions walked
+  uint64_t stmts;               // statements visited
+  uint64_t stmts_filtered;      // statements skipped as system code
+  uint64_t stores;              // events by kind
+  uint64_t range_stores;
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t writes;
+  uint64_t frames;
+  uint64_t bytes;               // bytes written before this record
+  uint32_t largest_func;        // function string table index, MEMLOG_NONE if no function was walked
+  uint32_t reserved;            // always 0
+  uint64_t largest_func_stmts;
+  uint64_t largest_func_events;
+  uint64_t funcs_cached;        // functions whose records came from the output cache (0 in files written before it)
+  uint64_t stores_derived;      // store sites without a runtime hook (0 in files written before it)
+};
+
+
+/**
+  NOTE: RUNTIME TRACE LAYOUT
+
+  Written by memlog_runtime.c while an instrumented program (built with -fplugin-arg-memlog_plugin-mode=runtime) runs.
+
+    +------------------------------+
+    | memlog_rt_header             |  magic, version, record size, pid
+    +------------------------------+
+    | memlog_rt_chunk              |  which thread, how many records follow
+    | memlog_rt_record[n_records]  |  fixed-width records, in the order that thread produced them
+    +------------------------------+
+    | memlog_rt_chunk ...          |  (repeated until end of file)
+    +------------------------------+
+
+  Every thread fills its own ring buffer, and a background thread copies whatever is in the rings out in chunks.
+  Records of one thread are always in order; chunks of different threads are interleaved in whatever order the
+  drainer got to them. The site field carries the same site id the plugin wrote to the static site file
+  (see "SITE IDS"), so a runtime record is joined to its static description (lhs expression, location, ...) by site,
+  whichever translation unit it came from.
+
+  A MEMLOG_RT_WRITE record is the only one followed by something other than records: the captured bytes of the
+  block, packed into whole records (the last one zero padded). They are always in the same chunk as their record.
+ */
+
+#define MEMLOG_RT_MAGIC "MEMLOGR"
+#define MEMLOG_RT_VERSION 4
+
+//what a runtime record describes
+enum memlog_rt_kind {
+  MEMLOG_RT_STORE = 1, // addr, size = bytes written, value = first (up to) 8 bytes now at addr
+  MEMLOG_RT_ALLOC = 2, // addr = returned pointer, size = bytes requested, value = the block it resized (realloc
+                       // and other allocators with ptr=; 0 for the rest). Unless addr is 0 (the call failed), that
+                       // block ends here: it was moved to addr, or resized in place if addr is the same
+  MEMLOG_RT_FREE  = 3, // addr = pointer passed to free
+  MEMLOG_RT_RANGE_STORE = 4, // a whole loop's stores to one site: addr = first address, size = iterations,
+                             // value = induction variable at loop entry (see "LOOP RANGE STORES")
+  MEMLOG_RT_WRITE = 5,       // a bulk write (see "BULK WRITES"): addr, size = bytes written, value = how many of
+                             // them were captured; those bytes follow in ceil(value / record_size) more records
+  MEMLOG_RT_ENTER = 6,       // a function started: site = its frame site, addr = frame base (see "FRAMES")
+  MEMLOG_RT_EXIT  = 7        // it is about to return: same site and addr
+};
+
+struct memlog_rt_header {
+  char     magic[MEMLOG_BIN_MAGIC_LEN]; // MEMLOG_RT_MAGIC
+  uint32_t version;                    // MEMLOG_RT_VERSION
+  uint32_t header_size;                // sizeof(struct memlog_rt_header)
+  uint32_t record_size;                // sizeof(struct memlog_rt_record)
+  uint32_t pid;                        // process that wrote the trace
+};
+
+//precedes every run of records from one thread (8 bytes)
+struct memlog_rt_chunk {
+  uint32_t tid;       // runtime thread number (1 = first thread that logged anything)
+  uint32_t n_records; // how many memlog_rt_record follow
+};
+
+//a record's site field holds the site id in its low 56 bits and the memlog_rt_kind above them
+#define MEMLOG_RT_KIND_SHIFT 56
+#define MEMLOG_RT_SITE_MASK  ((UINT64_C(1) << MEMLOG_RT_KIND_SHIFT) - 1)
+#define MEMLOG_RT_SITE_KIND(site, kind) ((uint64_t)(site) | ((uint64_t)(kind) << MEMLOG_RT_KIND_SHIFT))
+
+//one runtime event (32 bytes)
+struct memlog_rt_record {
+  uint64_t site;   // MEMLOG_RT_SITE_KIND(site id, memlog_rt_kind)
+  uint64_t addr;
+  uint64_t size;
+  uint64_t value;
+};
+
+
+/**
+  NOTE: MERGED INDEX LAYOUT
+
+  Written by memlog_merge, which folds the per-compile site files of a session directory (site-*.jsonl, or format=bin
+  files) into one file that can be loaded without parsing any JSON.
+
+    +------------------------------+
+    | memlog_idx_header            |
+    +------------------------------+
+    | uint32_t str_off[n_strings+1]|  string i is blob[str_off[i] .. str_off[i+1])
+    | char blob[string_bytes]      |  (zero padded, so the sections below start 8-byte aligned)
+    +------------------------------+
+    | memlog_idx_site[n_sites]     |  sorted by site id: look a runtime record's site up with a binary search
+    +------------------------------+
+    | memlog_idx_type[n_types]     |  the type dictionaries of every file, one entry per type id, sorted by id
+    +------------------------------+
+    | memlog_idx_range[n_files]    |  one per source file, sorted by path
+    | uint32_t by_line[n_sites]    |  site indices sorted by (file, line, col); a file's range covers its sites
+    +------------------------------+
+    | memlog_idx_range[n_funcs]    |  one per (function name, file), sorted by name then path
+    | uint32_t by_func[n_sites]    |  site indices sorted by (function, file, line, col)
+    +------------------------------+
+
+  Every string (paths, function names, and each site's kind-specific JSON object, e.g. {"lhs":...,"bytes":4}) is
+  stored once, however many sites or translation units use it. A type is kept as its whole "kind":"type" record
+  (see "TYPES"); the same type id in two files is the same layout, so it is stored once.
+ */
+
+#define MEMLOG_IDX_MAGIC "MEMLOGI"
+#define MEMLOG_IDX_VERSION 2
+
+struct memlog_idx_header {
+  char     magic[MEMLOG_BIN_MAGIC_LEN]; // MEMLOG_IDX_MAGIC
+  uint32_t version;                    // MEMLOG_IDX_VERSION
+  uint32_t header_size;                // sizeof(struct memlog_idx_header)
+  uint32_t n_strings;
+  uint32_t n_sites;
+  uint32_t n_files;
+  uint32_t n_funcs;
+  uint64_t string_bytes;               // size of the string blob, before padding
+  uint32_t n_types;
+  uint32_t reserved;                   // always 0
+};
+
+//one site (32 bytes)
+struct memlog_idx_site {
+  uint64_t site;   // site id (see "SITE IDS")
+  uint32_t kind;   // memlog_site_kind
+  uint32_t file;   // string index
+  uint32_t func;   // string index
+  uint32_t line;
+  uint32_t col;
+  uint32_t detail; // string index of the kind-specific JSON object ("store"/"alloc"/"free" in the JSONL output)
+};
+
+//one type of the dictionary (16 bytes)
+struct memlog_idx_type {
+  uint64_t id;       // type id (see "TYPES")
+  uint32_t json;     // string index of its "kind":"type" record
+  uint32_t reserved; // always 0
+};
+
+//a run of entries in by_line or by_func that share a key (16 bytes)
+struct memlog_idx_range {
+  uint32_t name;   // string index: file path (by_line) or function name (by_func)
+  uint32_t file;   // by_func: string index of the function's file. by_line: same as name
+  uint32_t first;  // first entry of the run
+  uint32_t count;
+};
+
+#endif // MEMLOG_FORMAT_H
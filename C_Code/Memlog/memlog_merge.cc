@@ -0,0 +1,660 @@
+// memlog_merge.cc
+// Folds every site file of a session directory (what the extension's compiler wrappers leave behind: one
+// site-<src>-<pid>.jsonl per compile, or format=bin files) into one indexed file (memlog_format.h,
+// "MERGED INDEX LAYOUT") that can be loaded without parsing any JSON.
+//
+// Files are parsed in parallel, one worker thread per core; each worker interns the strings of its own files, and
+// the results are then merged into one table so every path, function name and site description is stored once.
+//
+// usage: memlog_merge <session-dir> [out.idx] [-j threads]
+//   (the index goes to <session-dir>/memlog-index.idx when no output path is given)
+//
+// A site id found in more than one file (the same source compiled again into the same session) is taken from the
+// newest file; if the older copies disagree with it, memlog_merge says which files did. The files' type dictionaries
+// ("kind":"type" records) are merged by type id.
+
+#include "memlog_reader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+  // ---------------------------
+  // Just enough JSON for our own output
+  //
+  // Every line the plugin (or memlog_dump) writes is one object. We only ever need a few top-level members of it,
+  // and the kind-specific member ("store", "alloc", "free") is kept as raw text, so instead of building a tree we
+  // walk the object once and hand back where each member's value starts and ends.
+  // ---------------------------
+
+  const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+  }
+
+  //p is at an opening quote; returns the position after the closing quote (or nullptr)
+  const char *skip_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+      if (*p == '\\') p++;
+      else if (*p == '"') return p + 1;
+    }
+    return nullptr;
+  }
+
+  //returns the position right after the value starting at p (or nullptr if it is malformed)
+  const char *skip_value(const char *p, const char *end) {
+    p = skip_ws(p, end);
+    if (p >= end) return nullptr;
+    if (*p == '"') return skip_string(p, end);
+    if (*p == '{' || *p == '[') {
+      int depth = 0;
+      for (; p < end; p++) {
+        if (*p == '"') {
+          p = skip_string(p, end);
+          if (!p) return nullptr;
+          p--;
+        } else if (*p == '{' || *p == '[') {
+          depth++;
+        } else if (*p == '}' || *p == ']') {
+          if (--depth == 0) return p + 1;
+        }
+      }
+      return nullptr;
+    }
+    //number, true, false, null
+    while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ') p++;
+    return p;
+  }
+
+  //one member of an object: key without its quotes (our keys never contain escapes), value as raw text
+  struct member {
+    const char *key;
+    size_t key_len;
+    const char *val;
+    const char *val_end;
+  };
+
+  /*
+    Splits the object in [p, end) into its members.
+
+    returns: false if it isn't a well-formed object
+  */
+  bool object_members(const char *p, const char *end, std::vector<member> &out) {
+    out.clear();
+    p = skip_ws(p, end);
+    if (p >= end || *p != '{') return false;
+    p = skip_ws(p + 1, end);
+    if (p < end && *p == '}') return true;
+
+    while (p < end) {
+      if (*p != '"') return false;
+      const char *key_end = skip_string(p, end);
+      if (!key_end) return false;
+      member m;
+      m.key = p + 1;
+      m.key_len = (size_t)(key_end - 1 - m.key);
+
+      p = skip_ws(key_end, end);
+      if (p >= end || *p != ':') return false;
+      m.val = skip_ws(p + 1, end);
+      m.val_end = skip_value(m.val, end);
+      if (!m.val_end) return false;
+      out.push_back(m);
+
+      p = skip_ws(m.val_end, end);
+      if (p < end && *p == ',') { p = skip_ws(p + 1, end); continue; }
+      return p < end && *p == '}';
+    }
+    return false;
+  }
+
+  /*
+    Finds the last element of the array in [p, end).
+
+    returns: where it starts (its end in elem_end), or nullptr if the array is empty or malformed
+  */
+  const char *last_element(const char *p, const char *end, const char *&elem_end) {
+    p = skip_ws(p, end);
+    if (p >= end || *p != '[') return nullptr;
+    p = skip_ws(p + 1, end);
+    const char *last = nullptr;
+    while (p < end && *p != ']') {
+      const char *v_end = skip_value(p, end);
+      if (!v_end) return nullptr;
+      last = p;
+      elem_end = v_end;
+      p = skip_ws(v_end, end);
+      if (p < end && *p == ',') p = skip_ws(p + 1, end);
+    }
+    return last;
+  }
+
+  const member *find_member(const std::vector<member> &ms, const char *key) {
+    size_t n = std::strlen(key);
+    for (const member &m : ms)
+      if (m.key_len == n && std::memcmp(m.key, key, n) == 0) return &m;
+    return nullptr;
+  }
+
+  bool member_int(const std::vector<member> &ms, const char *key, long long &v) {
+    const member *m = find_member(ms, key);
+    if (!m || m->val == m->val_end || (*m->val != '-' && (*m->val < '0' || *m->val > '9'))) return false;
+    v = std::strtoll(m->val, nullptr, 10);
+    return true;
+  }
+
+  bool member_u64(const std::vector<member> &ms, const char *key, uint64_t &v) {
+    const member *m = find_member(ms, key);
+    if (!m || m->val == m->val_end || *m->val < '0' || *m->val > '9') return false;
+    v = std::strtoull(m->val, nullptr, 10);
+    return true;
+  }
+
+  //appends code point c to out as UTF-8
+  void put_utf8(unsigned c, std::string &out) {
+    if (c < 0x80) {
+      out += (char)c;
+    } else if (c < 0x800) {
+      out += (char)(0xc0 | (c >> 6));
+      out += (char)(0x80 | (c & 0x3f));
+    } else {
+      out += (char)(0xe0 | (c >> 12));
+      out += (char)(0x80 | ((c >> 6) & 0x3f));
+      out += (char)(0x80 | (c & 0x3f));
+    }
+  }
+
+  //decodes the string member key into out (undoing json_escape in memlog_plugin.cc)
+  bool member_str(const std::vector<member> &ms, const char *key, std::string &out) {
+    const member *m = find_member(ms, key);
+    if (!m || *m->val != '"') return false;
+    out.clear();
+    for (const char *p = m->val + 1; p < m->val_end - 1; p++) {
+      if (*p != '\\') { out += *p; continue; }
+      if (++p >= m->val_end - 1) return false;
+      switch (*p) {
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u':
+          if (p + 4 >= m->val_end) return false;
+          put_utf8((unsigned)std::strtoul(std::string(p + 1, 4).c_str(), nullptr, 16), out);
+          p += 4;
+          break;
+        default: out += *p; break; // \" \\ \/
+      }
+    }
+    return true;
+  }
+
+  // ---------------------------
+  // Parsing one site file
+  // ---------------------------
+
+  //A string table local to whoever fills it (one per worker, then the merged one).
+  struct strings {
+    std::unordered_map<std::string, uint32_t> index;
+    std::vector<std::string> list;
+
+    uint32_t intern(const std::string &s) {
+      auto it = index.find(s);
+      if (it != index.end()) return it->second;
+      uint32_t id = (uint32_t)list.size();
+      list.push_back(s);
+      index.emplace(s, id);
+      return id;
+    }
+  };
+
+  //What one worker produced: sites and types whose string fields index into its own table.
+  struct parsed {
+    strings str;
+    std::vector<memlog_idx_site> sites;
+    std::vector<memlog_idx_type> types;
+    std::vector<uint32_t> from; //for each site, the index of the file it came from
+    size_t files = 0;
+    size_t bad_lines = 0;
+  };
+
+  //A function header record ("kind":"func") of a v2 file, plus its running event position.
+  struct func_hdr {
+    uint32_t name, file;
+    long long line, col;
+  };
+
+  uint32_t site_kind(const std::string &kind) {
+    if (kind == "store") return MEMLOG_SITE_STORE;
+    if (kind == "alloc") return MEMLOG_SITE_ALLOC;
+    if (kind == "free") return MEMLOG_SITE_FREE;
+    if (kind == "write") return MEMLOG_SITE_WRITE;
+    if (kind == "frame") return MEMLOG_SITE_FRAME;
+    return 0;
+  }
+
+  /*
+    Parses one JSONL line ("v":1 or "v":2) into w. fids maps the file's function ids to their header records.
+  */
+  void parse_line(const char *p, const char *end, parsed &w, std::unordered_map<long long, func_hdr> &fids,
+                  std::vector<member> &ms, std::string &tmp) {
+    if (!object_members(p, end, ms)) { w.bad_lines++; return; }
+
+    std::string kind;
+    if (!member_str(ms, "kind", kind)) { w.bad_lines++; return; }
+
+    if (kind == "func") {
+      long long fid;
+      func_hdr h;
+      const member *decl = find_member(ms, "decl");
+      std::vector<member> dm;
+      if (!member_int(ms, "fid", fid) || !decl || !object_members(decl->val, decl->val_end, dm)) { w.bad_lines++; return; }
+      member_str(ms, "name", tmp);
+      h.name = w.str.intern(tmp);
+      member_str(ms, "file", tmp);
+      h.file = w.str.intern(tmp);
+      h.line = h.col = 0;
+      member_int(dm, "line", h.line);
+      member_int(dm, "col", h.col);
+      fids[fid] = h;
+      return;
+    }
+
+    if (kind == "type") {
+      //kept whole; the id is all the index needs to find it
+      memlog_idx_type t;
+      std::memset(&t, 0, sizeof(t));
+      if (!member_u64(ms, "id", t.id)) { w.bad_lines++; return; }
+      p = skip_ws(p, end);
+      while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) end--;
+      t.json = w.str.intern(std::string(p, end));
+      w.types.push_back(t);
+      return;
+    }
+
+    uint32_t k = site_kind(kind);
+    if (!k) return; //not a site (stats records and the like)
+
+    memlog_idx_site s;
+    std::memset(&s, 0, sizeof(s));
+    s.kind = k;
+    if (!member_u64(ms, "site", s.site)) { w.bad_lines++; return; }
+
+    const member *detail = find_member(ms, kind.c_str());
+    if (!detail) { w.bad_lines++; return; }
+    s.detail = w.str.intern(std::string(detail->val, detail->val_end));
+
+    long long fid, line = 0, col = 0;
+    const member *loc = find_member(ms, "loc");
+    if (loc) {
+      //"v":1 - location and function spelled out
+      std::vector<member> lm;
+      if (!object_members(loc->val, loc->val_end, lm)) { w.bad_lines++; return; }
+      member_str(lm, "file", tmp);
+      s.file = w.str.intern(tmp);
+      member_int(lm, "line", line);
+      member_int(lm, "col", col);
+      member_str(ms, "func", tmp);
+      s.func = w.str.intern(tmp);
+    } else if (member_int(ms, "fid", fid) && fids.count(fid)) {
+      //"v":2 - relative to the previous event of the same function, unless the file is spelled out
+      func_hdr &h = fids[fid];
+      s.func = h.name;
+      if (member_str(ms, "file", tmp)) {
+        s.file = w.str.intern(tmp);
+        member_int(ms, "line", line);
+        member_int(ms, "col", col);
+      } else {
+        long long dl = 0, dc = 0;
+        member_int(ms, "dl", dl);
+        member_int(ms, "dc", dc);
+        h.line += dl;
+        h.col += dc;
+        s.file = h.file;
+        line = h.line;
+        col = h.col;
+      }
+    } else {
+      w.bad_lines++;
+      return;
+    }
+
+    //inlined code is filed under the function it was inlined from, which is where its location is
+    //(the innermost call of "inl", see "INLINED CODE" in memlog_format.h)
+    if (const member *inl = find_member(ms, "inl")) {
+      const char *call_end = nullptr;
+      const char *call = last_element(inl->val, inl->val_end, call_end);
+      std::vector<member> cm;
+      if (call && object_members(call, call_end, cm) && member_str(cm, "fn", tmp)) s.func = w.str.intern(tmp);
+    }
+    s.line = (uint32_t)line;
+    s.col = (uint32_t)col;
+    w.sites.push_back(s);
+  }
+
+  bool read_whole_file(const std::string &path, std::string &out) {
+    FILE *f = std::fopen(path.c_str(), "rb");
+    if (!f) return false;
+    out.clear();
+    char buf[1 << 16];
+    size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) out.append(buf, n);
+    std::fclose(f);
+    return true;
+  }
+
+  /*
+    Parses one site file (JSONL, or a format=bin file which memlog_reader turns into "v":1 lines first) into w.
+  */
+  void parse_file(const std::string &path, uint32_t file_index, parsed &w) {
+    std::string data;
+    if (!read_whole_file(path, data)) {
+      std::fprintf(stderr, "memlog_merge: cannot read %s\n", path.c_str());
+      return;
+    }
+    w.files++;
+
+    if (data.size() >= MEMLOG_BIN_MAGIC_LEN && std::memcmp(data.data(), MEMLOG_BIN_MAGIC, MEMLOG_BIN_MAGIC_LEN) == 0) {
+      FILE *in = std::fopen(path.c_str(), "rb");
+      memlog_bin_file bf;
+      std::string err;
+      bool ok = in && memlog_bin_load(in, bf, err);
+      if (in) std::fclose(in);
+      if (!ok) {
+        std::fprintf(stderr, "memlog_merge: %s: %s\n", path.c_str(), err.c_str());
+        return;
+      }
+      data.clear();
+      for (const memlog_bin_site &s : bf.sites) {
+        memlog_bin_site_json(bf, s, data);
+        data += '\n';
+      }
+      for (uint32_t i = 0; i < bf.types.size(); i++) {
+        memlog_bin_type_json(bf, i, data);
+        data += '\n';
+      }
+    }
+
+    std::unordered_map<long long, func_hdr> fids;
+    std::vector<member> ms;
+    std::string tmp;
+    const char *p = data.data(), *end = p + data.size();
+    while (p < end) {
+      const char *nl = (const char *)std::memchr(p, '\n', (size_t)(end - p));
+      const char *line_end = nl ? nl : end;
+      if (skip_ws(p, line_end) < line_end) parse_line(p, line_end, w, fids, ms, tmp);
+      p = line_end + 1;
+    }
+    w.from.resize(w.sites.size(), file_index);
+  }
+
+  //modification time of path in nanoseconds (0 if it can't be read, which sorts it as the oldest)
+  int64_t mtime_ns(const std::string &path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return 0;
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  }
+
+  bool same_site(const memlog_idx_site &a, const memlog_idx_site &b) {
+    return a.kind == b.kind && a.file == b.file && a.func == b.func && a.line == b.line && a.col == b.col &&
+           a.detail == b.detail;
+  }
+
+  //Does name look like something the plugin wrote? (site-*.jsonl from the wrappers, anything *.jsonl or *.bin)
+  bool is_site_file(const char *name) {
+    size_t n = std::strlen(name);
+    auto ends_with = [&](const char *suf) {
+      size_t k = std::strlen(suf);
+      return n >= k && std::strcmp(name + n - k, suf) == 0;
+    };
+    return ends_with(".jsonl") || (ends_with(".bin") && std::strncmp(name, "memlog-trace-", 13) != 0);
+  }
+
+  // ---------------------------
+  // Writing the index
+  // ---------------------------
+
+  void write_u32s(FILE *out, const std::vector<uint32_t> &v) {
+    std::fwrite(v.data(), sizeof(uint32_t), v.size(), out);
+  }
+
+  /*
+    Builds one index section: a sorted permutation of the sites, and the runs of it that share a key.
+  */
+  template <typename Less, typename Key>
+  void build_index(const std::vector<memlog_idx_site> &sites, Less less, Key key,
+                   std::vector<uint32_t> &order, std::vector<memlog_idx_range> &runs) {
+    order.resize(sites.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return less(sites[a], sites[b]); });
+
+    runs.clear();
+    for (uint32_t i = 0; i < order.size(); i++) {
+      memlog_idx_range r = key(sites[order[i]]);
+      if (!runs.empty() && runs.back().name == r.name && runs.back().file == r.file) {
+        runs.back().count++;
+        continue;
+      }
+      r.first = i;
+      r.count = 1;
+      runs.push_back(r);
+    }
+  }
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  const char *dir = nullptr;
+  const char *out_path_arg = nullptr;
+  unsigned threads = std::thread::hardware_concurrency();
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc) threads = (unsigned)std::atoi(argv[++i]);
+    else if (!dir) dir = argv[i];
+    else if (!out_path_arg) out_path_arg = argv[i];
+    else dir = nullptr, i = argc; //too many arguments
+  }
+  if (!dir) {
+    std::fprintf(stderr, "usage: %s <session-dir> [out.idx] [-j threads]\n", argv[0]);
+    return 2;
+  }
+  if (threads == 0) threads = 1;
+  std::string out_path = out_path_arg ? out_path_arg : std::string(dir) + "/memlog-index.idx";
+
+  auto t0 = std::chrono::steady_clock::now();
+
+  //1. find the site files
+  std::vector<std::string> paths;
+  DIR *d = opendir(dir);
+  if (!d) {
+    std::perror(dir);
+    return 1;
+  }
+  while (struct dirent *e = readdir(d)) {
+    if (is_site_file(e->d_name)) paths.push_back(std::string(dir) + "/" + e->d_name);
+  }
+  closedir(d);
+  //a stable order, so the same session always gives the same index
+  std::sort(paths.begin(), paths.end());
+
+  //2. parse them, spread over the workers (each takes the next unclaimed file)
+  if (threads > paths.size()) threads = paths.empty() ? 1 : (unsigned)paths.size();
+  std::vector<parsed> results(threads);
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> pool;
+  for (unsigned t = 0; t < threads; t++) {
+    pool.emplace_back([&, t] {
+      for (size_t i; (i = next.fetch_add(1)) < paths.size();) parse_file(paths[i], (uint32_t)i, results[t]);
+    });
+  }
+  for (std::thread &th : pool) th.join();
+
+  //3. merge the workers' string tables into one, rewriting their sites' string indices
+  strings str;
+  std::vector<memlog_idx_site> sites;
+  std::vector<memlog_idx_type> types;
+  std::vector<uint32_t> from;
+  size_t n_files = 0, bad_lines = 0;
+  for (parsed &w : results) {
+    std::vector<uint32_t> remap(w.str.list.size());
+    for (size_t i = 0; i < remap.size(); i++) remap[i] = str.intern(w.str.list[i]);
+    for (memlog_idx_site s : w.sites) {
+      s.file = remap[s.file];
+      s.func = remap[s.func];
+      s.detail = remap[s.detail];
+      sites.push_back(s);
+    }
+    for (memlog_idx_type t : w.types) {
+      t.json = remap[t.json];
+      types.push_back(t);
+    }
+    from.insert(from.end(), w.from.begin(), w.from.end());
+    n_files += w.files;
+    bad_lines += w.bad_lines;
+    w = parsed(); //free it as we go
+  }
+
+  //sort the strings themselves, so the index doesn't depend on how files were spread over the workers,
+  //and comparing two string indices compares the strings
+  std::vector<uint32_t> order(str.list.size()), rank(str.list.size());
+  for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return str.list[a] < str.list[b]; });
+  std::vector<std::string> sorted(order.size());
+  for (uint32_t i = 0; i < order.size(); i++) {
+    rank[order[i]] = i;
+    sorted[i] = std::move(str.list[order[i]]);
+  }
+  str.list.swap(sorted);
+  str.index.clear();
+  for (memlog_idx_site &s : sites) {
+    s.file = rank[s.file];
+    s.func = rank[s.func];
+    s.detail = rank[s.detail];
+  }
+  for (memlog_idx_type &t : types) t.json = rank[t.json];
+
+  //4. sort by site id; the same id twice means the same source was compiled twice. The newest file's copy wins
+  //(ties go to the later path), and older copies that say something else are reported, since a trace recorded
+  //against one of those builds would be explained with the wrong source
+  std::vector<int64_t> mtime(paths.size());
+  for (size_t i = 0; i < paths.size(); i++) mtime[i] = mtime_ns(paths[i]);
+  std::vector<uint32_t> by_id(sites.size());
+  for (uint32_t i = 0; i < by_id.size(); i++) by_id[i] = i;
+  std::sort(by_id.begin(), by_id.end(), [&](uint32_t a, uint32_t b) {
+    if (sites[a].site != sites[b].site) return sites[a].site < sites[b].site;
+    if (mtime[from[a]] != mtime[from[b]]) return mtime[from[a]] > mtime[from[b]];
+    return from[a] > from[b];
+  });
+  std::vector<memlog_idx_site> kept;
+  kept.reserve(sites.size());
+  size_t dupes = 0, conflicts = 0;
+  uint32_t winner = 0;
+  for (uint32_t i : by_id) {
+    if (kept.empty() || kept.back().site != sites[i].site) {
+      kept.push_back(sites[i]);
+      winner = i;
+      continue;
+    }
+    dupes++;
+    if (same_site(kept.back(), sites[i])) continue;
+    if (conflicts++ < 10) {
+      std::fprintf(stderr, "memlog_merge: site %llu differs between %s (kept, newer) and %s\n",
+                   (unsigned long long)sites[i].site, paths[from[winner]].c_str(), paths[from[i]].c_str());
+    }
+  }
+  if (conflicts > 10) std::fprintf(stderr, "memlog_merge: ... %zu conflicting sites in all\n", conflicts);
+  sites.swap(kept);
+  std::vector<uint32_t>().swap(from);
+
+  //a type id is a hash of the layout, so every file that has it describes it the same way: keep one
+  std::sort(types.begin(), types.end(), [](const memlog_idx_type &a, const memlog_idx_type &b) {
+    return a.id != b.id ? a.id < b.id : a.json < b.json;
+  });
+  types.erase(std::unique(types.begin(), types.end(),
+                          [](const memlog_idx_type &a, const memlog_idx_type &b) { return a.id == b.id; }),
+              types.end());
+
+  //5. the by-line and by-function indices (string indices are in string order, so paths and names come out sorted)
+  std::vector<uint32_t> by_line, by_func;
+  std::vector<memlog_idx_range> file_runs, func_runs;
+  build_index(sites,
+      [&](const memlog_idx_site &a, const memlog_idx_site &b) {
+        if (a.file != b.file) return a.file < b.file;
+        if (a.line != b.line) return a.line < b.line;
+        return a.col < b.col;
+      },
+      [](const memlog_idx_site &s) { memlog_idx_range r = { s.file, s.file, 0, 0 }; return r; },
+      by_line, file_runs);
+  build_index(sites,
+      [&](const memlog_idx_site &a, const memlog_idx_site &b) {
+        if (a.func != b.func) return a.func < b.func;
+        if (a.file != b.file) return a.file < b.file;
+        if (a.line != b.line) return a.line < b.line;
+        return a.col < b.col;
+      },
+      [](const memlog_idx_site &s) { memlog_idx_range r = { s.func, s.file, 0, 0 }; return r; },
+      by_func, func_runs);
+
+  //6. write it out
+  std::vector<uint32_t> str_off(str.list.size() + 1);
+  uint64_t blob = 0;
+  for (size_t i = 0; i < str.list.size(); i++) {
+    str_off[i] = (uint32_t)blob;
+    blob += str.list[i].size();
+  }
+  str_off.back() = (uint32_t)blob;
+  if (blob > UINT32_MAX) {
+    std::fprintf(stderr, "memlog_merge: more than 4 GiB of strings\n");
+    return 1;
+  }
+
+  FILE *out = std::fopen(out_path.c_str(), "wb");
+  if (!out) {
+    std::perror(out_path.c_str());
+    return 1;
+  }
+  memlog_idx_header h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, MEMLOG_IDX_MAGIC, sizeof(MEMLOG_IDX_MAGIC));
+  h.version = MEMLOG_IDX_VERSION;
+  h.header_size = sizeof(h);
+  h.n_strings = (uint32_t)str.list.size();
+  h.n_sites = (uint32_t)sites.size();
+  h.n_files = (uint32_t)file_runs.size();
+  h.n_funcs = (uint32_t)func_runs.size();
+  h.string_bytes = blob;
+  h.n_types = (uint32_t)types.size();
+
+  std::fwrite(&h, sizeof(h), 1, out);
+  write_u32s(out, str_off);
+  for (const std::string &s : str.list) std::fwrite(s.data(), 1, s.size(), out);
+  static const char zeros[8] = {0};
+  std::fwrite(zeros, 1, (size_t)((8 - (blob + sizeof(uint32_t) * str_off.size()) % 8) % 8), out);
+  std::fwrite(sites.data(), sizeof(memlog_idx_site), sites.size(), out);
+  std::fwrite(types.data(), sizeof(memlog_idx_type), types.size(), out);
+  std::fwrite(file_runs.data(), sizeof(memlog_idx_range), file_runs.size(), out);
+  write_u32s(out, by_line);
+  std::fwrite(func_runs.data(), sizeof(memlog_idx_range), func_runs.size(), out);
+  write_u32s(out, by_func);
+  bool ok = std::fflush(out) == 0 && !std::ferror(out);
+  std::fclose(out);
+  if (!ok) {
+    std::fprintf(stderr, "memlog_merge: error writing %s\n", out_path.c_str());
+    return 1;
+  }
+
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  std::fprintf(stderr, "memlog_merge: %zu files, %zu sites, %zu types, %zu strings -> %s (%.3f s, %u threads)\n",
+               n_files, sites.size(), types.size(), str.list.size(), out_path.c_str(), secs, threads);
+  if (dupes) std::fprintf(stderr, "memlog_merge: dropped %zu older copies of sites compiled more than once\n", dupes);
+  if (bad_lines) std::fprintf(stderr, "memlog_merge: skipped %zu malformed lines\n", bad_lines);
+  return 0;
+}
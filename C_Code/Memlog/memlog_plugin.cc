@@ -6,21 +6,51 @@
 
 #include "context.h"
 #include "tree.h"
+#include "tree-iterator.h"
 #include "tree-pass.h"
 #include "gimple.h"
+#include "gimple-expr.h"
 #include "gimple-iterator.h"
+#include "gimplify-me.h"
+#include "gimple-walk.h"
 #include "basic-block.h"
+#include "tree-cfg.h"
+#include "cfghooks.h"
+#include "cfgloop.h"
+#include "dominance.h"
+#include "varasm.h"
+#include "ggc.h"
+#include "timevar.h"
+#include "diagnostic-core.h"
 
 #include "cgraph.h"
 #include "function.h"
+#include "rtl.h"
+#include "insn-config.h"
+#include "ira.h"
+#include "lra.h"
+#include "reload.h"
 #include "stringpool.h"
 #include "wide-int.h"  
+#include "real.h"
+#include "ssa.h"
+#include "tree-into-ssa.h"
+#include "asan.h"
 
+#include "memlog_format.h"
+
+#include <algorithm>
+#include <cstddef>
 #include <cstring>
 #include <string>
 #include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 #include <cstdio>
-#include <sstream>
+#include <cstdlib>
+#include <pthread.h>
+#include <fnmatch.h>
 
 
 int plugin_is_GPL_compatible;
@@ -256,6 +286,33 @@ static FILE *g_out = nullptr;
 //path comes from -fplugin-arg-memlog_plugin-out=/path/to/file.jsonl
 static std::string g_out_path;
 
+//Which output format we write.
+//  FORMAT_JSONL (default) - one JSON object per line, written as each site is found
+//  FORMAT_BIN             - the binary layout described in memlog_format.h, written once at PLUGIN_FINISH
+//format comes from -fplugin-arg-memlog_plugin-format=jsonl|bin
+enum out_format { FORMAT_JSONL, FORMAT_BIN };
+static out_format g_format = FORMAT_JSONL;
+
+//What the pass does to the code it compiles.
+//  MODE_STATIC (default) - only describes sites; the program is compiled unchanged
+//  MODE_RUNTIME          - also inserts calls to the memlog_runtime hooks (memlog_runtime.h) at every site,
+//                          so the program records what actually happens when it runs (link it with memlog_runtime.o)
+//mode comes from -fplugin-arg-memlog_plugin-mode=static|runtime
+enum run_mode { MODE_STATIC, MODE_RUNTIME };
+static run_mode g_mode = MODE_STATIC;
+
+//Where in gcc's pipeline the pass runs.
+//  STAGE_EARLY (default) - right after "cfg", on the code as written (what an -O0 build wants)
+//  STAGE_LATE            - right before expansion to RTL, on the optimized code (see "Optimized builds")
+//stage comes from -fplugin-arg-memlog_plugin-stage=early|late
+enum pipeline_stage { STAGE_EARLY, STAGE_LATE };
+static pipeline_stage g_stage = STAGE_EARLY;
+
+//TU id: the high bits of every site id this compile hands out (see "SITE IDS" in memlog_format.h).
+//A hash of the main source file's path unless -fplugin-arg-memlog_plugin-tu-id=<n> sets it.
+static uint32_t g_tu_id = 0;
+static bool g_tu_id_set = false;
+
 /*
   Namespace makes it so that these functions and variables are only visible within the scope of this file (memlog_plugin.cc)
   This is so that there are no naming conflicts with other parts of gcc or other plugins/extensions.
@@ -265,20 +322,71 @@ static std::string g_out_path;
 */
 namespace{
   /**
-  * This function takes a raw C string and returns a version that is safe to embed inside JSON.
-  * 
-  * params: s (string) - infomation from GIMPLE about the state of the program
+  * NOTE: One reusable output buffer
+  *
+  * Every JSON event is written straight into a single append-only buffer (g_buf). The expression walkers
+  * (emit_expr, emit_bin, emit_lhs) append into it directly instead of returning std::strings that the caller
+  * then glues together.
+  *
+  * clear() only resets the length, so the memory grows to fit the biggest event seen so far and is then
+  * reused for every event after that. Once it has warmed up, logging an event does no heap allocation.
   */
-  static std::string json_escape(const char *s) {
-    //if there is no data from GIMPLE, return the empty string
-    if (!s) return "";
+  struct out_buf {
+    char *data = nullptr; //the bytes written so far (not NUL terminated)
+    size_t len = 0;       //how many bytes are in use
+    size_t cap = 0;       //how many bytes are allocated
+
+    //make sure there is room for n more bytes
+    void reserve(size_t n) {
+      if (len + n <= cap) return;
+      size_t new_cap = cap ? cap * 2 : 4096;
+      while (new_cap < len + n) new_cap *= 2;
+      //xrealloc is libiberty's realloc: it aborts instead of returning NULL (we are built with -fno-exceptions)
+      data = (char *)xrealloc(data, new_cap);
+      cap = new_cap;
+    }
+
+    void clear() { len = 0; }
+
+    void put(char c) {
+      reserve(1);
+      data[len++] = c;
+    }
+
+    void put(const char *s, size_t n) {
+      reserve(n);
+      std::memcpy(data + len, s, n);
+      len += n;
+    }
+
+    //append a string literal; the length is known at compile time, so no strlen
+    template <size_t N> void lit(const char (&s)[N]) { put(s, N - 1); }
+
+    //append a C string that we know needs no escaping (operators, numbers)
+    void str(const char *s) { put(s, std::strlen(s)); }
+
+    //append a signed integer in decimal
+    void num(long long v) {
+      //the longest value, -9223372036854775808, is 20 characters
+      char tmp[24];
+      int n = std::snprintf(tmp, sizeof(tmp), "%lld", v);
+      put(tmp, (size_t)n);
+    }
+  };
 
-    //Return string (what we will log to the output file)
-    std::string out;
+  //The one buffer every JSONL event is built in.
+  static out_buf g_buf;
 
-    //this line gives us a bit of buffer room in our output string (array of characters) so that we don't have to keep 
-    //re-sizing the array every time we add an escape character (this would slow down the runtime of gcc)
-    out.reserve(std::strlen(s) + 8);
+  /**
+  * This function takes a raw C string and appends a version that is safe to embed inside JSON to out.
+  * 
+  * params: 
+  *  -out (out_buf &): the buffer to append to
+  *  -s (string) - infomation from GIMPLE about the state of the program
+  */
+  static void json_escape(out_buf &out, const char *s) {
+    //if there is no data from GIMPLE, append nothing
+    if (!s) return;
 
     //switch statement that reccognizes C strings that need to be represented differently in JSONL
     for (const unsigned char *p = (const unsigned char*)s; *p; ++p) {
@@ -288,27 +396,26 @@ namespace{
 
       //if c is any of these characters, replace it with the JSONL equivalent
       switch (c) { 
-        case '\\': out += "\\\\"; break;
-        case '"':  out += "\\\""; break;
-        case '\n': out += "\\n"; break;
-        case '\r': out += "\\r"; break;
-        case '\t': out += "\\t"; break;
+        case '\\': out.lit("\\\\"); break;
+        case '"':  out.lit("\\\""); break;
+        case '\n': out.lit("\\n"); break;
+        case '\r': out.lit("\\r"); break;
+        case '\t': out.lit("\\t"); break;
         default:
           //checks to see if c is a control character (ex. /n, /t) (0x20 in hex is 32 in decimal)
           if (c < 0x20) {
-            //allocate a small buffer (the longest thing we'll write is 7 characters)
+            //small stack buffer (the longest thing we'll write is 6 characters plus the NUL)
             char buf[7];
             //converts byte into a JSON-safe escape
             std::snprintf(buf, sizeof(buf), "\\u%04x", c);
-            //add this escape character to the output string
-            out += buf;
+            //add this escape character to the output
+            out.put(buf, 6);
           } else {
-            //if c is not a control character, we convert it to ASCII and add it to the output string
-            out += (char)c;
+            //if c is not a control character, we add it to the output as is
+            out.put((char)c);
           }
       }
     }
-    return out;
   }
 
   /**
@@ -331,38 +438,467 @@ namespace{
       g_out = stderr;
     }
 
-    //this makes our output line buffered, so that output is flushed every time you print \n
-    //(this makes it so every JSON object is written immedietly)
-    setvbuf(g_out, NULL, _IOLBF, 0);
+    //stderr is line buffered, so that each JSON object shows up as soon as it is printed.
+    //Files are written in big blocks by the writer thread (see out_write below), so they are fully buffered.
+    setvbuf(g_out, NULL, g_out == stderr ? _IOLBF : _IOFBF, 0);
+  }
+
+  // ---------------------------
+  // Pass statistics and timing
+  // ---------------------------
+
+  /**
+  * NOTE: Where the plugin's time goes
+  *
+  * The pass runs under gcc's TV_PLUGIN_RUN timing variable ("plugin execution" in -ftime-report); plugins can't add
+  * entries to gcc's own timevar table. gcc's timer does take named "client items" though, which -ftime-report lists
+  * on their own, so the pass splits its time into three of them:
+  *   memlog: classification   walking the statements: user code or not, and which are stores/allocs/frees
+  *   memlog: serialization    turning those into JSONL lines or binary records (and queueing runtime hooks)
+  *   memlog: I/O              handing full output blocks to the writer thread; writing and draining the file at finish
+  * Time spent in a phase is not counted again in the phase around it, or in TV_PLUGIN_RUN.
+  * Without -ftime-report gcc keeps no timer (g_timer is null), and a phase costs one null check.
+  *
+  * The counters below go into the stats record written at PLUGIN_FINISH (see "STATS RECORD" in memlog_format.h).
+  */
+
+  //gcc's timer keys client items by the name pointer, so every use of a phase goes through one of these
+  static const char *const PHASE_CLASSIFY = "memlog: classification";
+  static const char *const PHASE_SERIALIZE = "memlog: serialization";
+  static const char *const PHASE_IO = "memlog: I/O";
+
+  struct plugin_stats {
+    unsigned long long funcs;        //functions walked
+    unsigned long long cached;       //of those, functions whose records came from the output cache
+    unsigned long long stmts;        //statements visited
+    unsigned long long filtered;     //statements skipped as system (or excluded) code
+    unsigned long long stores, range_stores, allocs, frees, writes, frames; //events by kind
+    unsigned long long derived;      //store sites recorded through another site's record (see "REGISTER LOCAL STORES")
+    unsigned long long bytes;        //bytes handed to the output file so far
+
+    //the function with the most statements
+    std::string largest_func;
+    unsigned long long largest_stmts;
+    unsigned long long largest_events;
+
+    unsigned long long events() const { return stores + range_stores + allocs + frees + writes + frames; }
+  };
+  static plugin_stats g_stats;
+
+  /**
+  * NOTE: Block-buffered, asynchronous output
+  *
+  * Writing one line per event means one write() system call per site while gcc is compiling.
+  * Instead, every byte we output is copied into big in-memory blocks (OUT_BLOCK_SIZE). When a block fills up it is
+  * queued for a background writer thread, which does the fwrite to disk and then hands the block back for reuse.
+  *
+  * The compiler thread only copies bytes and briefly takes g_out_mutex to queue a block; if no written block is
+  * ready for reuse it allocates a new one rather than wait. So gcc itself never blocks on disk I/O.
+  *
+  * Everything still queued is drained by out_close(), which runs from the PLUGIN_FINISH callback, and also from an
+  * atexit() handler so that a compile that dies early (-Wfatal-errors, or an internal compiler error, both of which
+  * end in exit()) still leaves its partial trace on disk.
+  *
+  * Output that goes to stderr (no output file) is written straight away, so it still shows up as it happens.
+  */
+
+  static const size_t OUT_BLOCK_SIZE = 1 << 20; // 1 MiB
+
+  //one chunk of output waiting to be written
+  struct out_block {
+    char *data;
+    size_t len;
+  };
+
+  static out_block *g_block = nullptr;             //the block the compiler thread is currently filling
+  static std::vector<out_block *> g_full_blocks;   //filled blocks waiting for the writer (guarded by g_out_mutex)
+  static std::vector<out_block *> g_spare_blocks;  //written blocks ready for reuse (guarded by g_out_mutex)
+  static pthread_mutex_t g_out_mutex = PTHREAD_MUTEX_INITIALIZER;
+  static pthread_cond_t g_out_cond = PTHREAD_COND_INITIALIZER; //wakes the writer when a block is queued or it is told to stop
+  static bool g_writer_stop = false;               //set by out_close() (guarded by g_out_mutex)
+
+  //We use plain pthreads rather than <thread>/<mutex>: gcc's system.h (pulled in by gcc-plugin.h) poisons and
+  //redefines a few names that the C++ threading headers trip over.
+  static pthread_t g_writer;
+  static bool g_writer_running = false;
+
+  /*
+    The background writer thread: writes queued blocks in order until out_close() asks it to stop
+    and there is nothing left to write.
+  */
+  static void *writer_main(void *) {
+    std::vector<out_block *> batch;
+    pthread_mutex_lock(&g_out_mutex);
+
+    for (;;) {
+      while (g_full_blocks.empty() && !g_writer_stop) pthread_cond_wait(&g_out_cond, &g_out_mutex);
+      //stop was requested and everything has been written
+      if (g_full_blocks.empty()) break;
+
+      //take every queued block at once, and do the (slow) writing without holding the lock
+      batch.swap(g_full_blocks);
+      pthread_mutex_unlock(&g_out_mutex);
+
+      for (out_block *b : batch) {
+        std::fwrite(b->data, 1, b->len, g_out);
+        b->len = 0;
+      }
+
+      pthread_mutex_lock(&g_out_mutex);
+      g_spare_blocks.insert(g_spare_blocks.end(), batch.begin(), batch.end());
+      batch.clear();
+    }
+
+    pthread_mutex_unlock(&g_out_mutex);
+    std::fflush(g_out);
+    return nullptr;
+  }
+
+  /*
+    Starts the writer thread. Only used when we write to a real file.
+    If the thread can't be created, out_write just keeps writing synchronously.
+  */
+  static void out_start_writer() {
+    if (g_writer_running || !g_out || g_out == stderr) return;
+    g_writer_running = pthread_create(&g_writer, nullptr, writer_main, nullptr) == 0;
+  }
+
+  /*
+    Queues the current block for the writer and makes g_block a fresh (empty) block.
+  */
+  static void out_submit_block() {
+    auto_client_timevar tv(PHASE_IO);
+    out_block *next = nullptr;
+
+    pthread_mutex_lock(&g_out_mutex);
+    if (g_block && g_block->len) g_full_blocks.push_back(g_block);
+    else if (g_block) g_spare_blocks.push_back(g_block);
+
+    if (!g_spare_blocks.empty()) {
+      next = g_spare_blocks.back();
+      g_spare_blocks.pop_back();
+    }
+    pthread_cond_signal(&g_out_cond);
+    pthread_mutex_unlock(&g_out_mutex);
+
+    //nothing to reuse yet: allocate instead of waiting for the disk
+    if (!next) {
+      next = new out_block;
+      next->data = (char *)xmalloc(OUT_BLOCK_SIZE);
+      next->len = 0;
+    }
+    g_block = next;
+  }
+
+  /*
+    Writes n bytes of output. This is the only function the rest of the plugin uses to write to the output file.
+  */
+  static void out_write(const char *p, size_t n) {
+    g_stats.bytes += n;
+
+    //no writer thread (output is stderr, or the plugin is shutting down): write directly
+    if (!g_writer_running) {
+      std::fwrite(p, 1, n, g_out ? g_out : stderr);
+      return;
+    }
+
+    while (n) {
+      if (!g_block || g_block->len == OUT_BLOCK_SIZE) out_submit_block();
+
+      size_t room = OUT_BLOCK_SIZE - g_block->len;
+      size_t chunk = n < room ? n : room;
+      std::memcpy(g_block->data + g_block->len, p, chunk);
+      g_block->len += chunk;
+      p += chunk;
+      n -= chunk;
+    }
   }
 
   /**
-  * This function closes the output file if the plugin opened one, and then clears the global pointer.
+  * This function drains everything still buffered, stops the writer thread, closes the output file
+  * if the plugin opened one, and then clears the global pointer.
   * (Does not close the stream if output is stderr)
   */
   static void out_close() {
+    if (g_writer_running) {
+      //hand over the partly filled block, then tell the writer to finish up
+      pthread_mutex_lock(&g_out_mutex);
+      if (g_block && g_block->len) {
+        g_full_blocks.push_back(g_block);
+        g_block = nullptr;
+      }
+      g_writer_stop = true;
+      pthread_cond_signal(&g_out_cond);
+      pthread_mutex_unlock(&g_out_mutex);
+
+      pthread_join(g_writer, nullptr);
+      g_writer_running = false;
+    }
+
     if (g_out && g_out != stderr) std::fclose(g_out);
+    else if (g_out) std::fflush(g_out);
     g_out = nullptr;
   }
 
 
   /**
-  * Checks whether the source file path is a system path or user-defined
+  * NOTE: Deciding what counts as user code
+  *
+  * Every GIMPLE statement knows which source file it came from. We only want to log statements from the user's own
+  * files, not from system headers, and not from vendored third-party or generated code that happens to live inside
+  * the project.
+  *
+  * Rules are "include" or "exclude" path patterns:
+  *   - a plain prefix:   /usr/   third_party/
+  *   - or a glob:        *\/generated/*   src/*.pb.c        (*, ? and [...] as in fnmatch, where * also matches /)
+  *
+  * Patterns that don't start with / or * are relative to the directory gcc runs in (or to the config file's
+  * directory, for patterns read from a config file).
+  *
+  * They come from plugin arguments (each may be repeated, and may hold several patterns separated by ':')
+  *   -fplugin-arg-memlog_plugin-include=<patterns>
+  *   -fplugin-arg-memlog_plugin-exclude=<patterns>
+  *   -fplugin-arg-memlog_plugin-filter=<config file>   (lines of "include <pattern>" / "exclude <pattern>", # comments)
+  * on top of the built-in defaults: exclude /usr/, /lib/ and /opt/.
+  *
+  * All rules are stored in a prefix trie keyed by their literal prefix (the part before any glob character).
+  * To classify a path we walk the trie along the path's characters; the rule with the longest literal prefix that
+  * matches wins (ties go to the rule given last). So "include /opt/myproject/" beats the default "exclude /opt/".
+  * A path no rule matches is user code.
+  *
+  * gcc hands us the same file name pointer for every statement from the same file, so each verdict is cached by
+  * that pointer: classifying a statement costs one pointer lookup after the first statement of each file.
+  */
+
+  //One include/exclude rule.
+  struct path_rule {
+    bool include;         //true: matching files are user code. false: they are not.
+    std::string pattern;  //full pattern (absolute, or starting with *)
+    bool is_glob;         //does pattern contain *, ? or [ (then it is checked with fnmatch)
+    unsigned order;       //position in the order rules were given (later rules win ties)
+  };
+
+  //A node of the prefix trie. Node 0 is the root (the empty prefix).
+  struct trie_node {
+    std::map<unsigned char, unsigned> next; //next character -> child node index
+    std::vector<unsigned> rules;            //indexes into g_path_rules whose literal prefix ends here
+  };
+
+  static std::vector<path_rule> g_path_rules;
+  static std::vector<trie_node> g_path_trie(1);
+
+  //verdict cache: gcc-owned file name pointer -> is it user code?
+  static std::unordered_map<const char *, bool> g_path_verdicts;
+
+  /*
+    32-bit FNV-1a hash of a C string.
+  */
+  static uint32_t fnv1a_32(const char *s) {
+    uint32_t h = 2166136261u;
+    for (; *s; s++) {
+      h ^= (unsigned char)*s;
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  //64-bit FNV-1a, fed one field at a time
+  struct hasher {
+    uint64_t h = 14695981039346656037ull;
+
+    void bytes(const void *p, size_t n) {
+      const unsigned char *c = (const unsigned char *)p;
+      for (size_t i = 0; i < n; i++) {
+        h ^= c[i];
+        h *= 1099511628211ull;
+      }
+    }
+    void num(uint64_t v) { bytes(&v, sizeof(v)); }
+    //the terminating NUL goes in too, so "ab","c" and "a","bc" differ
+    void str(const char *s) { if (!s) s = ""; bytes(s, std::strlen(s) + 1); }
+  };
+
+  /*
+    Joins a relative path onto dir (lexically; nothing has to exist on disk).
+  */
+  static std::string path_join(const std::string &dir, const char *rel) {
+    //drop any leading "./"
+    while (rel[0] == '.' && rel[1] == '/') rel += 2;
+
+    std::string out = dir;
+    if (out.empty() || out.back() != '/') out += '/';
+    out += rel;
+    return out;
+  }
+
+  /*
+    Adds one include/exclude rule.
+
+    params:
+      -include (bool): include rule (true) or exclude rule (false)
+      -pattern (const char *): prefix or glob, as described in the NOTE above
+      -base_dir (std::string): directory relative patterns are resolved against
+  */
+  static void add_path_rule(bool include, const char *pattern, const std::string &base_dir) {
+    if (!pattern || !*pattern) return;
+
+    path_rule r;
+    r.include = include;
+    r.pattern = (pattern[0] == '/' || pattern[0] == '*') ? std::string(pattern) : path_join(base_dir, pattern);
+    r.is_glob = r.pattern.find_first_of("*?[") != std::string::npos;
+    r.order = (unsigned)g_path_rules.size();
+    g_path_rules.push_back(r);
+
+    //walk/extend the trie along the literal prefix
+    size_t literal_len = r.is_glob ? r.pattern.find_first_of("*?[") : r.pattern.size();
+    unsigned node = 0;
+    for (size_t i = 0; i < literal_len; i++) {
+      unsigned char c = (unsigned char)r.pattern[i];
+      auto it = g_path_trie[node].next.find(c);
+      if (it != g_path_trie[node].next.end()) {
+        node = it->second;
+      } else {
+        unsigned child = (unsigned)g_path_trie.size();
+        g_path_trie[node].next[c] = child;
+        g_path_trie.emplace_back();
+        node = child;
+      }
+    }
+    g_path_trie[node].rules.push_back(r.order);
+  }
+
+  /*
+    Adds every pattern in a ':' separated list (the value of an include= or exclude= plugin argument).
+  */
+  static void add_path_rules(bool include, const char *list, const std::string &base_dir) {
+    if (!list) return;
+    std::string item;
+    for (const char *p = list; ; ++p) {
+      if (*p == ':' || *p == '\0') {
+        add_path_rule(include, item.c_str(), base_dir);
+        item.clear();
+        if (*p == '\0') break;
+      } else {
+        item += *p;
+      }
+    }
+  }
+
+  /*
+    Reads include/exclude rules from a config file (the value of the filter= plugin argument).
+    Each line is "include <pattern>" or "exclude <pattern>"; blank lines and lines starting with # are skipped.
+
+    return: false if the file could not be opened
+  */
+  static bool load_path_rules(const char *config_path) {
+    FILE *f = std::fopen(config_path, "r");
+    if (!f) return false;
+
+    //relative patterns in the file are relative to the file itself
+    std::string base_dir = ".";
+    if (const char *slash = std::strrchr(config_path, '/')) base_dir.assign(config_path, slash - config_path);
+    if (base_dir.empty()) base_dir = "/";
+    if (base_dir[0] != '/') base_dir = path_join(getpwd(), base_dir.c_str());
+
+    char line[4096];
+    while (std::fgets(line, sizeof(line), f)) {
+      //trim trailing whitespace / newline
+      size_t n = std::strlen(line);
+      while (n && (line[n - 1] == '\n' || line[n - 1] == '\r' || line[n - 1] == ' ' || line[n - 1] == '\t')) line[--n] = '\0';
+
+      char *p = line;
+      while (*p == ' ' || *p == '\t') ++p;
+      if (*p == '\0' || *p == '#') continue;
+
+      bool include;
+      if (std::strncmp(p, "include", 7) == 0) { include = true; p += 7; }
+      else if (std::strncmp(p, "exclude", 7) == 0) { include = false; p += 7; }
+      else {
+        std::fprintf(stderr, "memlog_plugin: %s: ignoring line '%s'\n", config_path, line);
+        continue;
+      }
+      while (*p == ' ' || *p == '\t') ++p;
+      add_path_rule(include, p, base_dir);
+    }
+    std::fclose(f);
+    return true;
+  }
+
+  /*
+    The built-in rules: system install locations are never user code.
+  */
+  static void add_default_path_rules() {
+    add_path_rule(false, "/usr/", "/");
+    add_path_rule(false, "/lib/", "/");
+    add_path_rule(false, "/opt/", "/");
+  }
+
+  /**
+  * Checks whether the source file path is user code, by running it through the include/exclude trie.
+  * (Uncached; stmt_is_user_code caches the answer per file.)
   * 
   * params: p (string) - the path to the source file that produced a given GIMPLE statement.
   * 
   * ex. p could be: 
-  *  - "/usr/include/stdio.h"-"/home/jrakow/Visual-Debugger/C_Code/main.c"
-  *  - "/usr/include/stdlib.h"
-  *  - "/usr/lib/gcc/x86_64-linux-gnu/13/include/stddef.h"
+  *  - "/home/jrakow/Visual-Debugger/C_Code/main.c"  (user code)
+  *  - "/usr/include/stdlib.h"  (not user code)
+  *  - "/usr/lib/gcc/x86_64-linux-gnu/13/include/stddef.h"  (not user code)
   */ 
-  static bool is_system_path(const char *p) {
-    //if no valid path exists, return true (system path)
-    if (!p) return true;
-    //checks whether the file path starts with /usr/, /lib/, or /opt/ (if so, return true for system path)
-    return (std::strncmp(p, "/usr/", 5) == 0) ||
-          (std::strncmp(p, "/lib/", 5) == 0) ||
-          (std::strncmp(p, "/opt/", 5) == 0);
+  static bool classify_path(const char *p) {
+    //if no valid path exists, it is not user code
+    if (!p) return false;
+
+    //match against the absolute, symlink-free path, so rules work no matter how gcc was invoked
+    char *real = lrealpath(p);
+    std::string path = real ? real : p;
+    free(real);
+    if (path.empty() || path[0] != '/') path = path_join(getpwd(), path.c_str());
+
+    //best match so far: longest literal prefix, then latest rule
+    const path_rule *best = nullptr;
+    size_t best_depth = 0;
+
+    unsigned node = 0;
+    for (size_t depth = 0; ; depth++) {
+      for (unsigned ri : g_path_trie[node].rules) {
+        const path_rule &r = g_path_rules[ri];
+        if (r.is_glob && fnmatch(r.pattern.c_str(), path.c_str(), 0) != 0) continue;
+        if (!best || depth > best_depth || (depth == best_depth && r.order > best->order)) {
+          best = &r;
+          best_depth = depth;
+        }
+      }
+
+      if (depth == path.size()) break;
+      auto it = g_path_trie[node].next.find((unsigned char)path[depth]);
+      if (it == g_path_trie[node].next.end()) break;
+      node = it->second;
+    }
+
+    return best ? best->include : true;
+  }
+
+  /*
+    Cached classify_path, keyed by the file name pointer gcc gives us (LOCATION_FILE).
+  */
+  static bool path_is_user_code(const char *file) {
+    //consecutive statements nearly always come from the same file, so remember the last answer too
+    static const char *last_file = nullptr;
+    static bool last_verdict = false;
+    if (file == last_file) return last_verdict;
+
+    auto it = g_path_verdicts.find(file);
+    bool verdict;
+    if (it != g_path_verdicts.end()) {
+      verdict = it->second;
+    } else {
+      verdict = classify_path(file);
+      g_path_verdicts.emplace(file, verdict);
+    }
+
+    last_file = file;
+    last_verdict = verdict;
+    return verdict;
   }
 
   /**
@@ -393,8 +929,8 @@ namespace{
     //if the statement cannot be traced back to a file, it is not user code (so return false)
     if (!file) return false;
 
-    //Return true only if this statement’s source file is NOT a system path
-    return !is_system_path(file);
+    //Return true only if this statement’s source file passes the include/exclude rules
+    return path_is_user_code(file);
   }
 
   /**
@@ -443,16 +979,17 @@ namespace{
 
   /**
   * Given a GCC tree node that might represent a variable, parameter, or function, 
-  * this function extracts its source-level name (like x, p, malloc) and returns it as a C++ string.
+  * this function extracts its source-level name (like x, p, malloc).
   * 
   * params: d (tree node pointer) 
   * 
-  * returns: the identifer name (string), or "" if none exists
+  * returns: the identifer name, or "" if none exists.
+  *   The pointer is owned by gcc (see the NOTE above), so returning it costs no copy.
   * 
   * TREE_CODE can be VAR_DECL, PARM_DECL, or FUNCTION_DECL
   * 
   */
-  static std::string decl_name(tree d) {
+  static const char *decl_name(tree d) {
     //if no valid tree node is provided, return empty string
     if (!d) return "";
 
@@ -470,6 +1007,281 @@ namespace{
   }
 
 
+  // ---------------------------
+  // Optimized code (-fplugin-arg-memlog_plugin-stage=late)
+  // ---------------------------
+
+  /**
+  * NOTE: Optimized builds
+  *
+  * By default the pass runs right after "cfg", on the code as it was written. That is what an -O0 build wants, but
+  * it makes an -O2 build almost as slow as an -O0 one: the hooks are in place before the optimizers run, so every
+  * variable they look at stays in memory and every store they follow stays in the program.
+  *
+  * With stage=late the pass runs right before expansion to RTL (after "optimized"), on what the optimizers left:
+  *   - a store the optimizers removed is not recorded; one they moved is recorded where it now happens
+  *   - a variable kept in a register is never stored to memory; each definition of one of its SSA names
+  *     (x_3 = ...) is a "store" site on the variable instead, which in runtime mode records the new value with
+  *     address 0 (as register variables do at -O0, see instrument_store_inline). Values that only meet at a
+  *     PHI node (x_5 = PHI <x_3, x_4>) are not recorded again.
+  *   - an SSA name is mapped back to the source variable it holds:
+  *       its SSA_NAME_VAR, if that is one of the user's variables
+  *       otherwise the debug statement gcc keeps for the debugger (# DEBUG x => _7; only with -g)
+  *       a scalar SRA split out of an aggregate (SR.5) prints as what it replaced (s.f), from its DECL_DEBUG_EXPR
+  *     and an anonymous one in an expression is printed as how it was computed (_5 = p_2 + 8: p + 8), up to
+  *     LATE_HISTORY_DEPTH definitions back
+  *   - code inlined from another function keeps its own locations and carries "inl", the calls it was inlined
+  *     through (see "INLINED CODE" in memlog_format.h); the inlined function's locals are in the caller's frame site
+  *   - loop range summaries are off: they read the shape the gimplifier gives a loop, which the optimizers change
+  *
+  * Statements are in SSA form by then (at -O0 as well), so the hooks' temporaries are SSA names and the virtual
+  * operands are renamed once a function's hooks are in. In runtime mode __builtin_frame_address(0) keeps the frame
+  * pointer of every instrumented function, so the frame site's offsets are there; in static mode an -O2 build needs
+  * -fno-omit-frame-pointer for them.
+  */
+
+  //How many definitions back an anonymous SSA name in an expression is followed.
+  static const int LATE_HISTORY_DEPTH = 4;
+
+  //The user variable each SSA name of the function being walked was bound to by a debug statement (stage=late).
+  static std::unordered_map<tree, tree> g_debug_binds;
+
+  /*
+    Fills g_debug_binds from the function's debug bind statements (there are none without -g, or at stage=early).
+  */
+  static void collect_debug_binds(function *fun) {
+    g_debug_binds.clear();
+    basic_block bb;
+    FOR_EACH_BB_FN(bb, fun) {
+      for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+        gimple *s = gsi_stmt(gsi);
+        if (!gimple_debug_bind_p(s) || !gimple_debug_bind_has_value_p(s)) continue;
+        tree var = gimple_debug_bind_get_var(s);
+        tree val = gimple_debug_bind_get_value(s);
+        //the first binding wins: a later one is usually the same value copied into another variable
+        if (TREE_CODE(val) == SSA_NAME && (TREE_CODE(var) == VAR_DECL || TREE_CODE(var) == PARM_DECL))
+          g_debug_binds.emplace(val, var);
+      }
+    }
+  }
+
+  /*
+    What the declaration d stands for in the source: d itself for a user variable, s.f for a scalar SRA split out
+    of s.f (its DECL_DEBUG_EXPR).
+
+    return: NULL_TREE for a compiler temporary
+  */
+  static tree source_ref(tree d) {
+    if (VAR_P(d) && DECL_HAS_DEBUG_EXPR_P(d)) return DECL_DEBUG_EXPR(d);
+    if (DECL_ARTIFICIAL(d) || !DECL_NAME(d)) return NULL_TREE;
+    return d;
+  }
+
+  /*
+    The source variable whose value the SSA name holds (see the NOTE above), or NULL_TREE if it is a temporary.
+  */
+  static tree ssa_source_var(tree name) {
+    tree v = SSA_NAME_VAR(name);
+    if (v && (v = source_ref(v))) return v;
+    auto it = g_debug_binds.find(name);
+    return it != g_debug_binds.end() ? source_ref(it->second) : NULL_TREE;
+  }
+
+  /*
+    The operator of a binary expression as emit_expr prints it ("op" of {"k":"bin"}), or nullptr if it doesn't
+    describe that kind. Every one fits memlog_bin_expr.op.
+  */
+  static const char *bin_op_str(enum tree_code code) {
+    switch (code) {
+      case PLUS_EXPR:
+      case POINTER_PLUS_EXPR: return "+";
+      case MINUS_EXPR:
+      case POINTER_DIFF_EXPR: return "-";
+      case MULT_EXPR:         return "*";
+      case TRUNC_DIV_EXPR:
+      case EXACT_DIV_EXPR:
+      case RDIV_EXPR:         return "/";
+      case TRUNC_MOD_EXPR:    return "%";
+      case BIT_AND_EXPR:      return "&";
+      case BIT_IOR_EXPR:      return "|";
+      case BIT_XOR_EXPR:      return "^";
+      case LSHIFT_EXPR:       return "<<";
+      case RSHIFT_EXPR:       return ">>";
+      case LT_EXPR:           return "<";
+      case LE_EXPR:           return "<=";
+      case GT_EXPR:           return ">";
+      case GE_EXPR:           return ">=";
+      case EQ_EXPR:           return "==";
+      case NE_EXPR:           return "!=";
+      default:                return nullptr;
+    }
+  }
+
+  //The same for a unary expression ({"k":"un"}).
+  static const char *un_op_str(enum tree_code code) {
+    switch (code) {
+      case NEGATE_EXPR:    return "-";
+      case BIT_NOT_EXPR:   return "~";
+      case TRUTH_NOT_EXPR: return "!";
+      default:             return nullptr;
+    }
+  }
+
+  //A conversion, printed as {"k":"cast"}.
+  static bool is_conversion(enum tree_code code) {
+    return CONVERT_EXPR_CODE_P(code) || code == FLOAT_EXPR || code == FIX_TRUNC_EXPR;
+  }
+
+  /*
+    The nodes late_source and store_rhs build for the function being walked, by what they are made of. A node is
+    built once per function: every store that reads the same SSA name, or computes the same a + b, prints the same
+    node, so describing a store allocates nothing once its operands have been seen. Cleared when the pass is done
+    with the function (no garbage collection runs while it is walked, so the nodes need no root).
+  */
+  static std::map<std::tuple<int, tree, tree, tree>, tree> g_built_nodes;
+
+  static tree built_node(enum tree_code code, tree type, tree a, tree b = NULL_TREE) {
+    tree &n = g_built_nodes[std::make_tuple((int)code, type, a, b)];
+    if (!n) n = b ? build2(code, type, a, b) : build1(code, type, a);
+    return n;
+  }
+
+  /*
+    t as the source would say it: a user variable, or for an anonymous SSA name, the expression it was computed
+    from. The trees built here are only ever printed (see built_node).
+    Past LATE_HISTORY_DEPTH the name becomes error_mark_node ({"k":"unknown"}), so printing the result (which
+    unwraps every operand again) can't start the walk over.
+    At stage=early only store_rhs comes here, for the gimplifier's temporaries (which are SSA names already).
+  */
+  static tree late_source(tree t, int depth) {
+    if (DECL_P(t)) {
+      tree r = source_ref(t);
+      return r ? r : t;
+    }
+    if (TREE_CODE(t) != SSA_NAME) return t;
+    if (tree v = ssa_source_var(t)) return v;
+    if (depth >= LATE_HISTORY_DEPTH) return error_mark_node;
+
+    gimple *def = SSA_NAME_DEF_STMT(t);
+    if (!def || !is_gimple_assign(def)) return t;
+    enum tree_code code = gimple_assign_rhs_code(def);
+    switch (code) {
+      //a copy (or a load of a variable in memory)
+      case SSA_NAME:
+      case VAR_DECL:
+      case PARM_DECL:
+      case INTEGER_CST:
+      case REAL_CST:
+        return late_source(gimple_assign_rhs1(def), depth + 1);
+      //a load: printed as the place it reads
+      case ARRAY_REF:
+      case COMPONENT_REF:
+      case MEM_REF:
+      case TARGET_MEM_REF:
+        return gimple_assign_rhs1(def);
+      default:
+        if (is_conversion(code))
+          return built_node(NOP_EXPR, TREE_TYPE(t), late_source(gimple_assign_rhs1(def), depth + 1));
+        if (un_op_str(code))
+          return built_node(code, TREE_TYPE(t), late_source(gimple_assign_rhs1(def), depth + 1));
+        //(POINTER_PLUS_EXPR insists on a sizetype offset, which an unknown operand isn't)
+        if (bin_op_str(code))
+          return built_node(code == POINTER_PLUS_EXPR ? PLUS_EXPR : code, TREE_TYPE(t),
+                            late_source(gimple_assign_rhs1(def), depth + 1),
+                            late_source(gimple_assign_rhs2(def), depth + 1));
+        return t;
+    }
+  }
+
+  /*
+    The right-hand side of the store stmt as the source would say it: its value for a copy ("x = 50", "*p = y"),
+    the operation for "x = a + b", with the gimplifier's temporaries followed back to what they were computed from
+    (see late_source).
+
+    return: NULL_TREE if stmt is not an assignment, or is one we can't describe
+  */
+  static tree store_rhs(gimple *stmt) {
+    if (!is_gimple_assign(stmt)) return NULL_TREE;
+    enum tree_code code = gimple_assign_rhs_code(stmt);
+    tree type = TREE_TYPE(gimple_assign_lhs(stmt));
+    tree a = gimple_assign_rhs1(stmt);
+    switch (get_gimple_rhs_class(code)) {
+      case GIMPLE_SINGLE_RHS:
+        return late_source(a, 0);
+      case GIMPLE_UNARY_RHS:
+        if (is_conversion(code)) return built_node(NOP_EXPR, type, late_source(a, 1));
+        return un_op_str(code) ? built_node(code, type, late_source(a, 1)) : NULL_TREE;
+      case GIMPLE_BINARY_RHS:
+        if (!bin_op_str(code)) return NULL_TREE;
+        return built_node(code == POINTER_PLUS_EXPR ? PLUS_EXPR : code, type, late_source(a, 1),
+                          late_source(gimple_assign_rhs2(stmt), 1));
+      default:
+        return NULL_TREE;
+    }
+  }
+
+  /*
+    The value the store stmt writes, if the compiler already knows it: the constant of "x = 50" or "ex[3] = 4".
+    Such a store is "value_static", and its runtime record carries the constant instead of reading the value back.
+
+    return: an INTEGER_CST or REAL_CST, NULL_TREE for any other store
+  */
+  static tree store_static_value(gimple *stmt) {
+    if (!gimple_assign_single_p(stmt)) return NULL_TREE;
+    tree rhs = gimple_assign_rhs1(stmt);
+    return TREE_CODE(rhs) == INTEGER_CST || TREE_CODE(rhs) == REAL_CST ? rhs : NULL_TREE;
+  }
+
+  /*
+    The address a TARGET_MEM_REF (what ivopts leaves behind) reads or writes, without its constant offset:
+    base + index * step + index2.
+  */
+  static tree tmr_address(tree t) {
+    tree addr = TMR_BASE(t);
+    if (tree idx = TMR_INDEX(t)) {
+      if (TMR_STEP(t)) idx = built_node(MULT_EXPR, TREE_TYPE(idx), idx, TMR_STEP(t));
+      addr = built_node(PLUS_EXPR, TREE_TYPE(addr), addr, idx);
+    }
+    if (tree idx2 = TMR_INDEX2(t)) addr = built_node(PLUS_EXPR, TREE_TYPE(addr), addr, idx2);
+    return addr;
+  }
+
+  //One function inlined into the function being compiled, and the call it was inlined at.
+  struct inline_call {
+    tree fn;
+    const char *file;
+    int line, col;
+  };
+
+  /*
+    The calls stmt was inlined through, outermost first (none for the function's own code, or at stage=early,
+    where nothing has been inlined yet).
+  */
+  static void inline_chain(gimple *stmt, std::vector<inline_call> &out) {
+    out.clear();
+    if (g_stage != STAGE_LATE) return;
+    for (tree b = gimple_block(stmt); b && TREE_CODE(b) == BLOCK; b = BLOCK_SUPERCONTEXT(b)) {
+      if (!inlined_function_outer_scope_p(b)) continue;
+      tree fn = block_ultimate_origin(b);
+      if (!fn || TREE_CODE(fn) != FUNCTION_DECL) continue;
+      location_t call = BLOCK_SOURCE_LOCATION(b);
+      inline_call c = { fn, LOCATION_FILE(call), LOCATION_LINE(call), LOCATION_COLUMN(call) };
+      if (!c.file) c.file = "<unknown>";
+      //we walk from the innermost scope outwards
+      out.insert(out.begin(), c);
+    }
+  }
+
+  /*
+    The function a BLOCK's variables belong to, if it is the outermost scope of an inlined call (NULL_TREE otherwise).
+  */
+  static tree inlined_fn_of_block(tree block) {
+    if (!inlined_function_outer_scope_p(block)) return NULL_TREE;
+    tree fn = block_ultimate_origin(block);
+    return fn && TREE_CODE(fn) == FUNCTION_DECL ? fn : NULL_TREE;
+  }
+
+
   /**
       This function returns the VAR_DECL or PARM_DECL tree node variable corresponding to the SSA_NAME tree node parameter
 
@@ -478,9 +1290,11 @@ namespace{
       return: 
         tree node (VAR_DECL or PARM_DECL) representing base variable of the ssa expression 
         (or original tree node if t is not an SSA_NAME tree node)
+      At stage=late, what late_source says t stands for.
   */
   static tree unwrap_ssa(tree t) {
     if (!t) return t;
+    if (g_stage == STAGE_LATE) return late_source(t, 0);
     if (TREE_CODE(t) == SSA_NAME) {
       //V is a VAR_DECL or PARM_DECL tree node
       tree v = SSA_NAME_VAR(t);
@@ -491,76 +1305,82 @@ namespace{
 
 
   /**
-    This function attempts to convert a GCC INTEGER_CST tree node into a human-readable string
+    This function appends a GCC INTEGER_CST tree node to out as a JSON value
 
     params:
+      - out (out_buf &): the buffer to append to
       - t (tree node pointer)
-      - reference to std:string (output parameter where string representation of interger will be written)
 
-    return: true if t represented and integer constant and we wrote the equivalent string, false otherwise
+    return: true if t represented an integer constant and we wrote it, false otherwise (nothing is written)
   */
-  static bool int_cst_to_string(tree t, std::string &out) {
+  static bool emit_int_cst(out_buf &out, tree t) {
     if (!t) return false;
     if (TREE_CODE(t) != INTEGER_CST) return false;
 
 
     if (tree_fits_shwi_p(t)) {
-      HOST_WIDE_INT v = tree_to_shwi(t);
-      out = std::to_string((long long)v);
-      // stringify v and log it
+      // write the value as a plain JSON number
+      out.num((long long)tree_to_shwi(t));
       return true;
     } else {
-      // log "<bigint>" or null
       // If it doesn't fit, just say "big" *FIX LATER*
-      out = "\"<bigint>\"";
+      out.lit("\"<bigint>\"");
       return true;
     }
   }
 
-  //Declares the function emit_expr(tree t) to be defined later 
+  //Declares the function emit_expr to be defined later 
   // (because emit_expr is defined after emit_bin, and emit_bin calls emit_expr)
-  static std::string emit_expr(tree t);
+  static void emit_expr(out_buf &out, tree t);
+  static void emit_lhs(out_buf &out, tree lhs, long long &bytes_out);
+
+  /*
+    The JSON value of the floating-point constant t: a number with as many digits as its type holds, or "inf",
+    "-inf" or "nan" (as a string, since JSON has no number for those). The digits go into the caller's buf, so a
+    float constant costs no allocation; the result points either there or at a literal.
+  */
+  static const char *real_cst_json(tree t, char (&buf)[64]) {
+    const REAL_VALUE_TYPE *r = TREE_REAL_CST_PTR(t);
+    if (real_isnan(r)) return "\"nan\"";
+    if (real_isinf(r)) return real_isneg(r) ? "\"-inf\"" : "\"inf\"";
+    real_to_decimal_for_mode(buf, r, sizeof(buf), 0, 1, TYPE_MODE(TREE_TYPE(t)));
+    return buf;
+  }
 
 
   /**
-    This function returns a string representing the binary expression given by params
+    This function appends JSON describing the binary expression given by params
 
     params:
+      -out (out_buf &): the buffer to append to
       -op (const char *): the operator for the binary expression (ex. "+", "-", "/", "*", "<<", ">>")
       -a (tree node pointer): pointer to a tree node representing the left-hand operand of the binary expression
       -b (tree node pointer): pointer to a tree node representing the right-hand operand of the binary expression
-
-    return: std::string (A JSON-formatted string describing the binary expression)
   */
-  static std::string emit_bin(const char *op, tree a, tree b) {
-    //emit_expr returns a std::string of the operands
-    std::string A = emit_expr(a);
-    std::string B = emit_expr(b);
-
+  static void emit_bin(out_buf &out, const char *op, tree a, tree b) {
     //"k":"bin" means “this node is a binary expression”
     //"op" will have the operator symbol after it
-    std::string s = "{\"k\":\"bin\",\"op\":\"";
-    s += op;
-    s += "\",\"a\":";
-    s += A;
-    s += ",\"b\":";
-    s += B;
-    s += "}";
-    return s;
+    out.lit("{\"k\":\"bin\",\"op\":\"");
+    out.str(op);
+    out.lit("\",\"a\":");
+    //the operands are written straight into the same buffer
+    emit_expr(out, a);
+    out.lit(",\"b\":");
+    emit_expr(out, b);
+    out.put('}');
   }
 
   /**
-    This function takes a GCC expression tree node and returns a JSON string that describes that expression in a structured way.
+    This function takes a GCC expression tree node and appends JSON that describes that expression in a structured way.
 
     For example, it might turn a binary expression represented by a tree node pointer into: "{"k":"bin","op":"+","a":{"k":"var","name":"x"},"b":{"k":"int","v":1}}"
 
-    params: t (tree pointer) - represents an expression
-
-    returns: std::string representing the expression
-
+    params: 
+      -out (out_buf &): the buffer to append to
+      -t (tree pointer) - represents an expression
   */
-  static std::string emit_expr(tree t) {
-    if (!t) return "{\"k\":\"unknown\"}";
+  static void emit_expr(out_buf &out, tree t) {
+    if (!t) { out.lit("{\"k\":\"unknown\"}"); return; }
 
     //t is a tree node (VAR_DECL or PARM_DECL) representing base variable of the ssa expression
     t = unwrap_ssa(t);
@@ -569,43 +1389,89 @@ namespace{
       //case VAR_DECL OR PARM_DECL
       case VAR_DECL:
       case PARM_DECL: {
-        //n is a std::string representing the name of the variable
-        std::string n = decl_name(t);
-        if (n.empty()) return "{\"k\":\"var\",\"name\":\"?\"}"; //name unknown
-
-        //json_escape() accepts a const char *, so we must turn n into a const char * to pass it to the function (by using n.c_str(), which converts std:string to const char *)
-        //We need to pass n into json_escape() so the C string can be formatted properly as a JSON (with escapes added)
-        return std::string("{\"k\":\"var\",\"name\":\"") + json_escape(n.c_str()) + "\"}"; 
+        //n is the name of the variable ("" if it has none)
+        const char *n = decl_name(t);
+        out.lit("{\"k\":\"var\",\"name\":\"");
+        //We pass n through json_escape() so the C string is formatted properly as JSON (with escapes added)
+        if (*n) json_escape(out, n);
+        else out.put('?'); //name unknown
+        out.lit("\"}");
+        return;
       }
       case INTEGER_CST: {
-        //v will hold the integer as a string
-        std::string v;
+        out.lit("{\"k\":\"int\",\"v\":");
+        //emit_int_cst always succeeds for an INTEGER_CST, but stay safe and write "?" if it doesn't
+        if (!emit_int_cst(out, t)) out.lit("\"?\"");
+        out.put('}');
+        return;
+      }
 
-        //int_cst_to_string(t, v) returns true if it successfully wrote the integer represented by t to the output variable v
-        if (int_cst_to_string(t, v)) {
-          return std::string("{\"k\":\"int\",\"v\":") + v + "}";
-        }
-        //if t did not represent an integer value, the value of the variable is left as "?"
-        return "{\"k\":\"int\",\"v\":\"?\"}";
+      //a floating-point constant
+      case REAL_CST: {
+        char buf[64];
+        out.lit("{\"k\":\"float\",\"v\":");
+        out.str(real_cst_json(t, buf));
+        out.put('}');
+        return;
       }
 
-      //emit_bin(const char*, tree, tree) returns std::string representing a binary operation
-      case PLUS_EXPR:  return emit_bin("+", TREE_OPERAND(t, 0), TREE_OPERAND(t, 1));     //TREE_OPERAND(t, i) returns tree node pointer representing an operand
-      case MINUS_EXPR: return emit_bin("-", TREE_OPERAND(t, 0), TREE_OPERAND(t, 1));
-      case MULT_EXPR:  return emit_bin("*", TREE_OPERAND(t, 0), TREE_OPERAND(t, 1));
+      //a load, as in the right-hand side of a store: the place it reads, printed like a store's lhs
+      case ARRAY_REF:
+      case COMPONENT_REF:
+      case INDIRECT_REF:
+      case MEM_REF:
+      case TARGET_MEM_REF: {
+        long long bytes;
+        emit_lhs(out, t, bytes);
+        return;
+      }
       //A NOP_EXPR represents when there is a type cast in C, but the value of the variable does not actually change
-      case NOP_EXPR: {
+      //(int to float and back are printed the same way)
+      case NOP_EXPR:
+      case CONVERT_EXPR:
+      case FLOAT_EXPR:
+      case FIX_TRUNC_EXPR:
         // cast
-        std::string X = emit_expr(TREE_OPERAND(t, 0));
-        return std::string("{\"k\":\"cast\",\"to\":\"<nop>\",\"x\":") + X + "}";
-      }
+        out.lit("{\"k\":\"cast\",\"to\":\"<nop>\",\"x\":");
+        emit_expr(out, TREE_OPERAND(t, 0));
+        out.put('}');
+        return;
       //ADDR_EXPR corresponds to &something (the address of some variable)
-      case ADDR_EXPR: {
-        std::string X = emit_expr(TREE_OPERAND(t, 0));
-        return std::string("{\"k\":\"addr\",\"x\":") + X + "}";
-      }
+      case ADDR_EXPR:
+        out.lit("{\"k\":\"addr\",\"x\":");
+        emit_expr(out, TREE_OPERAND(t, 0));
+        out.put('}');
+        return;
+      //a string literal ("Thomas")
+      case STRING_CST:
+        out.lit("{\"k\":\"str\",\"v\":\"");
+        json_escape(out, TREE_STRING_POINTER(t));
+        out.lit("\"}");
+        return;
+      //a brace initializer; gcc keeps only the elements that aren't zero, so "= {}" has none
+      case CONSTRUCTOR:
+        out.lit("{\"k\":\"ctor\",\"n\":");
+        out.num((long long)CONSTRUCTOR_NELTS(t));
+        out.put('}');
+        return;
       default:
-        return "{\"k\":\"unknown\"}";
+        //emit_bin appends a binary operation (+, -, *, /, <<, ==, ...)
+        //TREE_OPERAND(t, i) returns tree node pointer representing an operand
+        if (const char *op = bin_op_str(TREE_CODE(t))) {
+          emit_bin(out, op, TREE_OPERAND(t, 0), TREE_OPERAND(t, 1));
+          return;
+        }
+        //-x, ~x, !x
+        if (const char *op = un_op_str(TREE_CODE(t))) {
+          out.lit("{\"k\":\"un\",\"op\":\"");
+          out.str(op);
+          out.lit("\",\"x\":");
+          emit_expr(out, TREE_OPERAND(t, 0));
+          out.put('}');
+          return;
+        }
+        out.lit("{\"k\":\"unknown\"}");
+        return;
     }
   }
 
@@ -622,33 +1488,23 @@ namespace{
     tree n = TYPE_SIZE_UNIT(ty);
     if (!n) return -1;
 
-    if (TREE_CODE(n) == INTEGER_CST) {
-      
-    
-      if (tree_fits_shwi_p(ty)) {
-        HOST_WIDE_INT v = tree_to_shwi(ty);
-        return (long long)v;
-        // stringify v and log it
-      } else {
-        // log "<bigint>" or null
-        // If it doesn't fit, just say "big" *FIX LATER*
-        return -1;
-      }
-    }
-    return -1; // not a constant size
+    //the size node (not the type) is what has to fit in a HOST_WIDE_INT
+    if (TREE_CODE(n) == INTEGER_CST && tree_fits_shwi_p(n)) return (long long)tree_to_shwi(n);
+    return -1; // not a constant size (or too big to say)
   }
 
 
   /*
-    This function returns a string representing where memory writes/variable assignments are located, and how many bytes that address has (if it is constant)
+    This function appends JSON describing where a memory write/variable assignment goes, and works out how many bytes that address has (if it is constant)
 
     params:
+      - out (out_buf &): the buffer to append to
       - lhs (tree node pointer): a GCC tree node representing the destination of a store/assignment (the left hand side)
       - bytes_out (long long &): reference to an output parameter (we will set this to be the number of bytes that the address has, if it is a constant value)
   */
-  static std::string emit_lhs(tree lhs, long long &bytes_out) {
+  static void emit_lhs(out_buf &out, tree lhs, long long &bytes_out) {
     bytes_out = -1;
-    if (!lhs) return "{\"k\":\"unknown\"}";
+    if (!lhs) { out.lit("{\"k\":\"unknown\"}"); return; }
 
     //ty is a tree node that represents the type of the left hand side
     tree ty = TREE_TYPE(lhs);
@@ -662,10 +1518,13 @@ namespace{
 
     // x = ...
     if (code == VAR_DECL || code == PARM_DECL) {
-      //n ia a std::string representing the base name of the ssa variable
-      std::string n = decl_name(lhs);
-      if (n.empty()) n = "?";
-      return std::string("{\"k\":\"var\",\"name\":\"") + json_escape(n.c_str()) + "\"}";
+      //n is the base name of the ssa variable
+      const char *n = decl_name(lhs);
+      if (!*n) n = "?";
+      out.lit("{\"k\":\"var\",\"name\":\"");
+      json_escape(out, n);
+      out.lit("\"}");
+      return;
     }
 
     // p[i] = ...  (or a[i])
@@ -675,21 +1534,20 @@ namespace{
       //idx is a tree node representing the index expression
       tree idx  = TREE_OPERAND(lhs, 1);
 
-      //turn base and index expressions into std::string
-      std::string B = emit_expr(base);
-      std::string I = emit_expr(idx);
-
       //elem_bytes gives us the size in bytes (long long) of the element being indexed
       long long elem_bytes = type_size_bytes(TREE_TYPE(lhs));
 
-      //this is an output string stream that we write out std::string output to. We use it because bytes get added as strings automatically
-      std::ostringstream oss;
-      oss << "{\"k\":\"index\",\"base\":" << B << ",\"index\":" << I;
+      out.lit("{\"k\":\"index\",\"base\":");
+      emit_expr(out, base);
+      out.lit(",\"index\":");
+      emit_expr(out, idx);
       //add elem_bytes field if we know what it is
-      if (elem_bytes >= 0) oss << ",\"elem_bytes\":" << elem_bytes;
-      oss << "}";
-      //returns a copy of the string buffer
-      return oss.str();
+      if (elem_bytes >= 0) {
+        out.lit(",\"elem_bytes\":");
+        out.num(elem_bytes);
+      }
+      out.put('}');
+      return;
     }
 
     // s.f or s->f
@@ -698,8 +1556,6 @@ namespace{
       tree base = TREE_OPERAND(lhs, 0);
       //field is a tree node representing the field being accessed (in this case, f)
       tree field = TREE_OPERAND(lhs, 1); // FIELD_DECL
-      //returns a string representation of the base struct expression
-      std::string base_j = emit_expr(base);
 
       //fname will hold the name of the field being accessed (<field> if unknown)
       const char *fname = "<field>";
@@ -719,346 +1575,4489 @@ namespace{
       //via_ptr is true if the base struct is a "dereference-like form" (i.e. *p for INDIRECT_REF or something like *(p + offset) for MEM_REF)
       if (bc == INDIRECT_REF || bc == MEM_REF) via_ptr = true;
 
-      //return json-escaped string representing struct and field
-      std::ostringstream oss;
-      oss << "{\"k\":\"field\",\"base\":" << base_j
-          << ",\"field\":\"" << json_escape(fname) << "\""
-          //via_ptr tells us whether or not this struct was accessed through a pointer (ex. *P.f)
-          << ",\"via_ptr\":" << (via_ptr ? "true" : "false") << "}";
-      return oss.str();
+      //append the struct expression, then the escaped field name
+      out.lit("{\"k\":\"field\",\"base\":");
+      emit_expr(out, base);
+      out.lit(",\"field\":\"");
+      json_escape(out, fname);
+      //via_ptr tells us whether or not this struct was accessed through a pointer (ex. *P.f)
+      if (via_ptr) out.lit("\",\"via_ptr\":true}");
+      else out.lit("\",\"via_ptr\":false}");
+      return;
     }
 
     // *p = ... sometimes shows up as INDIRECT_REF
     //This branch triggers when the entire LHS is a dereference expression (ex. *p)
     if (code == INDIRECT_REF) {
       //base is a tree node pointer representing the base expression being dereferenced (ex. p)
-      tree base = TREE_OPERAND(lhs, 0);
-      //B is a json string representing the base expression being dereferenced
-      std::string B = emit_expr(base);
-      return std::string("{\"k\":\"deref\",\"base\":") + B + "}";
+      out.lit("{\"k\":\"deref\",\"base\":");
+      emit_expr(out, TREE_OPERAND(lhs, 0));
+      out.put('}');
+      return;
     }
 
     // MEM_REF: generalized memory reference (often pointer + offset)
     if (code == MEM_REF) {
-      tree base = TREE_OPERAND(lhs, 0);  //base expression (tree node pointer)
-      tree off  = TREE_OPERAND(lhs, 1); // offset (tree node pointer)
-      std::string B = emit_expr(base); //json string representing base expression
-      std::string O = emit_expr(off); //json string representing offset
-      return std::string("{\"k\":\"mem_ref\",\"base\":") + B + ",\"offset\":" + O + "}";
+      out.lit("{\"k\":\"mem_ref\",\"base\":");
+      emit_expr(out, TREE_OPERAND(lhs, 0)); //base expression
+      out.lit(",\"offset\":");
+      emit_expr(out, TREE_OPERAND(lhs, 1)); //offset
+      out.put('}');
+      return;
+    }
+
+    // TARGET_MEM_REF (stage=late, after ivopts): the same, with the address spelled out from its parts
+    if (code == TARGET_MEM_REF) {
+      out.lit("{\"k\":\"mem_ref\",\"base\":");
+      emit_expr(out, tmr_address(lhs));
+      out.lit(",\"offset\":");
+      emit_expr(out, TMR_OFFSET(lhs));
+      out.put('}');
+      return;
     }
 
     // ARRAY_REF/COMPONENT_REF cover most student cases at -O0.
-    return "{\"k\":\"unknown\"}";
+    out.lit("{\"k\":\"unknown\"}");
   }
 
 
   // ---------------------------
-  // Site logging
+  // Binary output (-fplugin-arg-memlog_plugin-format=bin)
   //
-  // A site is a specific program point where something interesting happens (store, alloc, free, ect.)
-  // Sites are identified by a unique site number
+  // Instead of printing one JSON line per event, binary mode keeps every site in memory and writes the
+  // whole file (layout in memlog_format.h) once, in finish_output.
+  // Strings are interned, so each file path, function name and identifier is stored once no matter how
+  // many sites refer to it. memlog_reader.cc turns the file back into the "v":1 JSONL schema.
   // ---------------------------
 
   /*
-    This code is responsible for outputing one json per "event"
+    An interned string table. intern() hands back the same index every time it sees the same string.
+
+    Most strings we intern come straight out of gcc (LOCATION_FILE, IDENTIFIER_POINTER). Those pointers are
+    unique per string and stay valid for the whole compilation, so intern_gcc() looks them up by pointer first
+    and only hashes the characters the first time a pointer is seen.
   */
+  struct string_table {
+    std::unordered_map<std::string, uint32_t> index;   //string contents -> index
+    std::unordered_map<const char*, uint32_t> by_ptr;  //gcc-owned pointer -> index
+    std::vector<std::string> strings;                  //index -> string contents
+    std::string key;                                   //lookup key, reused so a hit never allocates
+
+    uint32_t intern(const char *s) {
+      if (!s) return MEMLOG_NONE;
+      key.assign(s);
+      auto it = index.find(key);
+      if (it != index.end()) return it->second;
+
+      uint32_t id = (uint32_t)strings.size();
+      strings.emplace_back(s);
+      index.emplace(strings.back(), id);
+      return id;
+    }
 
-  //This is a global counter used to assign unique IDs to logged events
-  static unsigned g_site_counter = 1;
+    uint32_t intern_gcc(const char *s) {
+      if (!s) return MEMLOG_NONE;
+      auto it = by_ptr.find(s);
+      if (it != by_ptr.end()) return it->second;
 
-  /*
-    This function prints a json event to the output file (or stderr if the output file does not exist)
+      uint32_t id = intern(s);
+      by_ptr.emplace(s, id);
+      return id;
+    }
+  };
 
-    params: 
-      -line: a std:string reference that already contains a complete json object representing an event
-  */
-  static void emit_jsonl_line(const std::string &line) {
+  static string_table g_bin_files;  //source file paths
+  static string_table g_bin_funcs;  //function names
+  static string_table g_bin_idents; //variable, field and allocator names
+
+  static std::vector<memlog_bin_expr> g_bin_exprs; //every expression node, children before parents
+  static std::vector<memlog_bin_site> g_bin_sites; //every site, in the order we found them
+  static std::vector<memlog_bin_range> g_bin_ranges; //loop summaries of store sites
+  static std::vector<memlog_bin_local> g_bin_locals; //locals of frame sites
+  static std::vector<memlog_bin_inline> g_bin_inlines; //calls inlined sites came through
+  static std::vector<memlog_bin_reg_store> g_bin_reg_stores; //stores to the register locals of frame sites
+  static std::vector<memlog_bin_points_to> g_bin_points_to; //alloc sites stores and writes may write into
+  //the type dictionary's share of the file (see "Type dictionary" below)
+  static void bin_type_counts(uint32_t &n_types, uint32_t &n_fields);
+  static void bin_write_types();
 
-    //if g_out is set, write to it; otherwise write to stderr
-    FILE *out = g_out ? g_out : stderr;
-    //print line to output file (or stderr depending on what out is)
-    std::fprintf(out, "%s\n", line.c_str());
+  /*
+    Appends one expression node and returns its index in g_bin_exprs.
+  */
+  static uint32_t bin_push_expr(uint8_t kind, uint32_t a = MEMLOG_NONE, uint32_t b = MEMLOG_NONE,
+                                uint32_t name = MEMLOG_NONE, int64_t value = 0, uint8_t flags = 0,
+                                const char *op = nullptr) {
+    memlog_bin_expr e;
+    std::memset(&e, 0, sizeof(e));
+    e.kind = kind;
+    e.flags = flags;
+    if (op) std::strncpy(e.op, op, sizeof(e.op));
+    e.a = a;
+    e.b = b;
+    e.name = name;
+    e.value = value;
+
+    g_bin_exprs.push_back(e);
+    return (uint32_t)(g_bin_exprs.size() - 1);
   }
 
   /*
-    This function logs a memory write/variable assignment as a JSONL object. 
-    It records where the event happened and what the destination memory/varaiable looks like
+    Pushes a {"k":"var"} node for a VAR_DECL/PARM_DECL. Anonymous declarations get the name "?" (same as emit_expr).
+  */
+  static uint32_t bin_push_var(tree d) {
+    tree n = DECL_NAME(d);
+    uint32_t name = n ? g_bin_idents.intern_gcc(IDENTIFIER_POINTER(n)) : g_bin_idents.intern("?");
+    return bin_push_expr(MEMLOG_EX_VAR, MEMLOG_NONE, MEMLOG_NONE, name);
+  }
+
+  static uint32_t bin_lhs(tree lhs, long long &bytes_out);
+
+  /*
+    Binary twin of emit_expr(): flattens the expression tree t into g_bin_exprs and returns the index of its root.
+    Every case here must produce the same JSON as emit_expr once memlog_reader converts it back.
+  */
+  static uint32_t bin_expr(tree t) {
+    if (!t) return bin_push_expr(MEMLOG_EX_UNKNOWN);
+
+    t = unwrap_ssa(t);
+
+    switch (TREE_CODE(t)) {
+      case VAR_DECL:
+      case PARM_DECL:
+        return bin_push_var(t);
+
+      case INTEGER_CST:
+        if (tree_fits_shwi_p(t)) return bin_push_expr(MEMLOG_EX_INT, MEMLOG_NONE, MEMLOG_NONE, MEMLOG_NONE, tree_to_shwi(t));
+        return bin_push_expr(MEMLOG_EX_BIGINT);
+
+      case REAL_CST: {
+        //the JSON text itself, so the reader prints exactly what emit_expr does
+        char buf[64];
+        return bin_push_expr(MEMLOG_EX_FLOAT, MEMLOG_NONE, MEMLOG_NONE, g_bin_idents.intern(real_cst_json(t, buf)));
+      }
+
+      case ARRAY_REF:
+      case COMPONENT_REF:
+      case INDIRECT_REF:
+      case MEM_REF:
+      case TARGET_MEM_REF: {
+        long long bytes;
+        return bin_lhs(t, bytes);
+      }
+
+      case NOP_EXPR:
+      case CONVERT_EXPR:
+      case FLOAT_EXPR:
+      case FIX_TRUNC_EXPR:
+        return bin_push_expr(MEMLOG_EX_CAST, bin_expr(TREE_OPERAND(t, 0)));
+
+      case ADDR_EXPR:
+        return bin_push_expr(MEMLOG_EX_ADDR, bin_expr(TREE_OPERAND(t, 0)));
+
+      case STRING_CST:
+        return bin_push_expr(MEMLOG_EX_STR, MEMLOG_NONE, MEMLOG_NONE, g_bin_idents.intern(TREE_STRING_POINTER(t)));
+
+      case CONSTRUCTOR:
+        return bin_push_expr(MEMLOG_EX_CTOR, MEMLOG_NONE, MEMLOG_NONE, MEMLOG_NONE, (int64_t)CONSTRUCTOR_NELTS(t));
+
+      default:
+        if (const char *op = bin_op_str(TREE_CODE(t))) {
+          //children first, so that a reader can always resolve a node's children before the node itself
+          uint32_t a = bin_expr(TREE_OPERAND(t, 0));
+          uint32_t b = bin_expr(TREE_OPERAND(t, 1));
+          return bin_push_expr(MEMLOG_EX_BIN, a, b, MEMLOG_NONE, 0, 0, op);
+        }
+        if (const char *op = un_op_str(TREE_CODE(t)))
+          return bin_push_expr(MEMLOG_EX_UN, bin_expr(TREE_OPERAND(t, 0)), MEMLOG_NONE, MEMLOG_NONE, 0, 0, op);
+        return bin_push_expr(MEMLOG_EX_UNKNOWN);
+    }
+  }
+
+  /*
+    Binary twin of emit_lhs(): same cases, same bytes_out, but returns an expression index instead of a string.
+  */
+  static uint32_t bin_lhs(tree lhs, long long &bytes_out) {
+    bytes_out = -1;
+    if (!lhs) return bin_push_expr(MEMLOG_EX_UNKNOWN);
+
+    bytes_out = type_size_bytes(TREE_TYPE(lhs));
+    lhs = unwrap_ssa(lhs);
+
+    switch (TREE_CODE(lhs)) {
+      case VAR_DECL:
+      case PARM_DECL:
+        return bin_push_var(lhs);
+
+      case ARRAY_REF: {
+        uint32_t base = bin_expr(TREE_OPERAND(lhs, 0));
+        uint32_t idx  = bin_expr(TREE_OPERAND(lhs, 1));
+        //elem_bytes rides in the value field (-1 when unknown, which the reader leaves out)
+        return bin_push_expr(MEMLOG_EX_INDEX, base, idx, MEMLOG_NONE, type_size_bytes(TREE_TYPE(lhs)));
+      }
+
+      case COMPONENT_REF: {
+        tree base = TREE_OPERAND(lhs, 0);
+        tree field = TREE_OPERAND(lhs, 1);
+        uint32_t base_e = bin_expr(base);
+
+        uint32_t fname = MEMLOG_NONE;
+        if (field && TREE_CODE(field) == FIELD_DECL && DECL_NAME(field))
+          fname = g_bin_idents.intern_gcc(IDENTIFIER_POINTER(DECL_NAME(field)));
+        if (fname == MEMLOG_NONE) fname = g_bin_idents.intern("<field>");
+
+        //same s->f vs s.f heuristic as emit_lhs
+        enum tree_code bc = TREE_CODE(base);
+        uint8_t flags = (bc == INDIRECT_REF || bc == MEM_REF) ? MEMLOG_EXF_VIA_PTR : 0;
+        return bin_push_expr(MEMLOG_EX_FIELD, base_e, MEMLOG_NONE, fname, 0, flags);
+      }
+
+      case INDIRECT_REF:
+        return bin_push_expr(MEMLOG_EX_DEREF, bin_expr(TREE_OPERAND(lhs, 0)));
+
+      case MEM_REF: {
+        uint32_t base = bin_expr(TREE_OPERAND(lhs, 0));
+        uint32_t off  = bin_expr(TREE_OPERAND(lhs, 1));
+        return bin_push_expr(MEMLOG_EX_MEM_REF, base, off);
+      }
+
+      case TARGET_MEM_REF: {
+        uint32_t base = bin_expr(tmr_address(lhs));
+        uint32_t off  = bin_expr(TMR_OFFSET(lhs));
+        return bin_push_expr(MEMLOG_EX_MEM_REF, base, off);
+      }
+
+      default:
+        return bin_push_expr(MEMLOG_EX_UNKNOWN);
+    }
+  }
+
+  /*
+    Appends a site record with the fields every kind of site shares, and returns it so the caller can fill in the rest.
+  */
+  static memlog_bin_site &bin_new_site(uint64_t site, uint32_t kind, const char *file, int line, int col,
+                                       gimple *stmt = nullptr) {
+    memlog_bin_site s;
+    std::memset(&s, 0, sizeof(s));
+    s.site = (uint32_t)(site & MEMLOG_SITE_LOCAL_MAX); //the header carries the TU id
+    s.kind = kind;
+    s.file = g_bin_files.intern_gcc(file);
+    s.func = g_bin_funcs.intern_gcc(current_func_name());
+    s.line = (uint32_t)line;
+    s.col = (uint32_t)col;
+    s.expr = MEMLOG_NONE;
+    s.expr2 = MEMLOG_NONE;
+    s.expr3 = MEMLOG_NONE;
+    s.name = MEMLOG_NONE;
+    s.name2 = MEMLOG_NONE;
+    s.flags = 0;
+    s.type = MEMLOG_NONE;
+    s.bytes = -1;
+
+    //code inlined into this function: the calls it came through (see "INLINED CODE" in memlog_format.h)
+    if (stmt) {
+      static std::vector<inline_call> chain;
+      inline_chain(stmt, chain);
+      for (const inline_call &c : chain) {
+        memlog_bin_inline bi;
+        std::memset(&bi, 0, sizeof(bi));
+        bi.site = s.site;
+        bi.fn = g_bin_funcs.intern_gcc(decl_name(c.fn));
+        bi.file = g_bin_files.intern_gcc(c.file);
+        bi.line = (uint32_t)c.line;
+        bi.col = (uint32_t)c.col;
+        g_bin_inlines.push_back(bi);
+      }
+    }
+
+    g_bin_sites.push_back(s);
+    return g_bin_sites.back();
+  }
+
+  /*
+    Writes one string table: a uint32_t length followed by the bytes of each string.
+  */
+  static void bin_write_table(const string_table &t) {
+    for (const std::string &s : t.strings) {
+      uint32_t len = (uint32_t)s.size();
+      out_write((const char *)&len, sizeof(len));
+      out_write(s.data(), len);
+    }
+  }
+
+  /*
+    Writes the complete binary file (header, string tables, expressions, sites, ranges, locals, inlines, register
+    local stores, points-to, types, stats) to g_out.
+    Called once from finish_output.
+  */
+  static void bin_write_file() {
+    if (!g_out) return;
+
+    memlog_bin_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MEMLOG_BIN_MAGIC, sizeof(MEMLOG_BIN_MAGIC));
+    h.version = MEMLOG_BIN_VERSION;
+    h.header_size = sizeof(h);
+    h.n_files = (uint32_t)g_bin_files.strings.size();
+    h.n_funcs = (uint32_t)g_bin_funcs.strings.size();
+    h.n_idents = (uint32_t)g_bin_idents.strings.size();
+    h.n_exprs = (uint32_t)g_bin_exprs.size();
+    h.n_sites = (uint32_t)g_bin_sites.size();
+    h.n_ranges = (uint32_t)g_bin_ranges.size();
+    h.tu_id = g_tu_id;
+    h.stats_size = sizeof(memlog_bin_stats);
+    h.n_locals = (uint32_t)g_bin_locals.size();
+    h.n_inlines = (uint32_t)g_bin_inlines.size();
+    h.n_reg_stores = (uint32_t)g_bin_reg_stores.size();
+    h.n_points_to = (uint32_t)g_bin_points_to.size();
+    bin_type_counts(h.n_types, h.n_fields);
+
+    //the largest function's name has to be in the string table before the tables are written
+    memlog_bin_stats st;
+    std::memset(&st, 0, sizeof(st));
+    st.largest_func = g_stats.funcs ? g_bin_funcs.intern(g_stats.largest_func.c_str()) : MEMLOG_NONE;
+    h.n_funcs = (uint32_t)g_bin_funcs.strings.size();
+
+    out_write((const char *)&h, sizeof(h));
+    bin_write_table(g_bin_files);
+    bin_write_table(g_bin_funcs);
+    bin_write_table(g_bin_idents);
+    out_write((const char *)g_bin_exprs.data(), sizeof(memlog_bin_expr) * g_bin_exprs.size());
+    out_write((const char *)g_bin_sites.data(), sizeof(memlog_bin_site) * g_bin_sites.size());
+    out_write((const char *)g_bin_ranges.data(), sizeof(memlog_bin_range) * g_bin_ranges.size());
+    out_write((const char *)g_bin_locals.data(), sizeof(memlog_bin_local) * g_bin_locals.size());
+    out_write((const char *)g_bin_inlines.data(), sizeof(memlog_bin_inline) * g_bin_inlines.size());
+    out_write((const char *)g_bin_reg_stores.data(), sizeof(memlog_bin_reg_store) * g_bin_reg_stores.size());
+    out_write((const char *)g_bin_points_to.data(), sizeof(memlog_bin_points_to) * g_bin_points_to.size());
+    bin_write_types();
+
+    st.funcs = g_stats.funcs;
+    st.stmts = g_stats.stmts;
+    st.stmts_filtered = g_stats.filtered;
+    st.stores = g_stats.stores;
+    st.range_stores = g_stats.range_stores;
+    st.allocs = g_stats.allocs;
+    st.frees = g_stats.frees;
+    st.writes = g_stats.writes;
+    st.frames = g_stats.frames;
+    st.bytes = g_stats.bytes;
+    st.largest_func_stmts = g_stats.largest_stmts;
+    st.largest_func_events = g_stats.largest_events;
+    st.funcs_cached = g_stats.cached;
+    st.stores_derived = g_stats.derived;
+    out_write((const char *)&st, sizeof(st));
+  }
+
+
+  // ---------------------------
+  // Loop range summaries
+  //
+  // A store in a simple counting loop whose address and value are affine in the loop's induction variable is
+  // described once (layout and meaning in memlog_format.h, "LOOP RANGE STORES"), and in runtime mode recorded
+  // once per loop run instead of once per iteration (see instrument_pending_ranges).
+  //
+  // We run right after the cfg pass, before into-SSA, so gcc's scalar evolution analysis is not available yet.
+  // What is available is the loop tree (current_loops) and the shape the gimplifier gives a for/while loop:
+  //
+  //     i = 0;                          <- entry edge into the header
+  //   header:
+  //     if (i < n) goto body; else goto done;       <- the loop's only exit
+  //   body:
+  //     _1 = (long unsigned int) i;  _2 = _1 * 4;  _3 = dynamic_array + _2;
+  //     *_3 = i;                        <- the store: address and value affine in i
+  //     i = i + 1;                      <- the only assignment to i in the loop
+  //     goto header;
+  //
+  // Temporaries like _1.._3 are already SSA names (each has exactly one definition), so we can follow them back to
+  // i by hand. Plain variables other than i must not be assigned in the loop or have their address taken.
+  //
+  // -fplugin-arg-memlog_plugin-ranges=0 turns the summaries off.
+  // ---------------------------
+
+  static bool g_loop_ranges = true;
+
+  //An induction variable: assigned exactly once in the loop, by v = v + step, on every iteration.
+  struct iv_info {
+    tree var;
+    HOST_WIDE_INT step;
+    gimple *inc;        //the v = v + step statement
+  };
+
+  //What we found out about one loop of the current function (see analyze_loop).
+  struct loop_summary {
+    bool ok;                          //does the loop have the shape above?
+    edge entry;                       //the one edge into the header from outside the loop
+    edge exit;                        //the one edge out of the loop (leaving the header)
+    std::vector<iv_info> ivs;
+    std::vector<tree> assigned;       //every plain variable assigned somewhere in the loop
+  };
+  static std::map<class loop *, loop_summary> g_loop_summaries; //cleared for every function
+
+  //The range description of one store site (what the "range" JSON object holds).
+  struct store_range {
+    class loop *loop;
+    tree iv;
+    HOST_WIDE_INT step;
+    HOST_WIDE_INT stride;             //bytes between consecutive iterations' stores (0 for the increment itself)
+    HOST_WIDE_INT value_mul, value_add;
+    bool is_iv_inc;                   //this is the i = i + step statement
+  };
+
+  //t = iv * coef + cst (+ something loop-invariant, unless pure)
+  struct affine {
+    tree iv;             //NULL_TREE: t does not depend on an induction variable
+    HOST_WIDE_INT coef;
+    HOST_WIDE_INT cst;
+    bool pure;           //only constants and iv are involved
+  };
+
+  static const iv_info *find_iv(const loop_summary &ls, tree var) {
+    for (const iv_info &iv : ls.ivs)
+      if (iv.var == var) return &iv;
+    return nullptr;
+  }
+
+  /*
+    Is v a local of the current function whose value only changes through plain assignments we can see?
+  */
+  static bool is_tracked_local(tree v) {
+    if (!VAR_P(v) && TREE_CODE(v) != PARM_DECL) return false;
+    if (TREE_ADDRESSABLE(v) || TREE_THIS_VOLATILE(v)) return false;
+    return auto_var_in_fn_p(v, current_function_decl);
+  }
+
+  /*
+    Fills in ls for loop. Called once per loop, the first time one of its stores is looked at.
+  */
+  static void analyze_loop(class loop *loop, loop_summary &ls) {
+    ls.ok = false;
+    ls.entry = ls.exit = nullptr;
+    if (!loop->latch || loop->latch == loop->header) return;
+
+    //exactly one way in and one way out, both ordinary edges, the way out at the top (the loop condition)
+    auto_vec<edge> exits = get_loop_exit_edges(loop);
+    if (exits.length() != 1 || exits[0]->src != loop->header || (exits[0]->flags & EDGE_COMPLEX)) return;
+    ls.exit = exits[0];
+
+    edge e;
+    edge_iterator ei;
+    FOR_EACH_EDGE(e, ei, loop->header->preds) {
+      if (flow_bb_inside_loop_p(loop, e->src)) continue;
+      if (ls.entry || (e->flags & EDGE_COMPLEX)) return;
+      ls.entry = e;
+    }
+    if (!ls.entry) return;
+
+    //which plain variables does the loop assign, and how?
+    std::map<tree, unsigned> n_defs;
+    std::map<tree, gimple *> last_def;
+    basic_block *body = get_loop_body(loop);
+    for (unsigned i = 0; i < loop->num_nodes; i++) {
+      for (gimple_stmt_iterator gsi = gsi_start_bb(body[i]); !gsi_end_p(gsi); gsi_next(&gsi)) {
+        gimple *stmt = gsi_stmt(gsi);
+        //inline asm can write anything
+        if (gimple_code(stmt) == GIMPLE_ASM) { free(body); return; }
+        tree lhs = gimple_get_lhs(stmt);
+        if (lhs && DECL_P(lhs)) {
+          n_defs[lhs]++;
+          last_def[lhs] = stmt;
+        }
+      }
+    }
+    free(body);
+
+    for (const auto &d : n_defs) {
+      ls.assigned.push_back(d.first);
+      if (d.second != 1 || !is_tracked_local(d.first) || !INTEGRAL_TYPE_P(TREE_TYPE(d.first))) continue;
+
+      //v = v + C, v = C + v or v = v - C
+      gimple *inc = last_def[d.first];
+      if (!is_gimple_assign(inc)) continue;
+      enum tree_code code = gimple_assign_rhs_code(inc);
+      if (code != PLUS_EXPR && code != MINUS_EXPR) continue;
+      tree a = gimple_assign_rhs1(inc), b = gimple_assign_rhs2(inc);
+      if (code == PLUS_EXPR && b == d.first) std::swap(a, b);
+      if (a != d.first || TREE_CODE(b) != INTEGER_CST || !tree_fits_shwi_p(b)) continue;
+      HOST_WIDE_INT step = tree_to_shwi(b);
+      if (code == MINUS_EXPR) step = -step;
+      if (step == 0) continue;
+
+      //it has to run exactly once per iteration: in this loop (not a nested one), never skipped, not in the header
+      basic_block bb = gimple_bb(inc);
+      if (bb->loop_father != loop || bb == loop->header || !dominated_by_p(CDI_DOMINATORS, loop->latch, bb)) continue;
+
+      iv_info iv = { d.first, step, inc };
+      ls.ivs.push_back(iv);
+    }
+    ls.ok = !ls.ivs.empty();
+  }
+
+  static const loop_summary &loop_summary_for(class loop *loop) {
+    auto it = g_loop_summaries.find(loop);
+    if (it != g_loop_summaries.end()) return it->second;
+    loop_summary &ls = g_loop_summaries[loop];
+    analyze_loop(loop, ls);
+    return ls;
+  }
+
+  //a = a + sign * b, for affine values of the same induction variable
+  static bool affine_add(affine &a, const affine &b, int sign) {
+    if (a.iv && b.iv && a.iv != b.iv) return false;
+    if (!a.iv) a.iv = b.iv;
+    HOST_WIDE_INT bc = sign * b.coef, bk = sign * b.cst;
+    if (__builtin_add_overflow(a.coef, bc, &a.coef) || __builtin_add_overflow(a.cst, bk, &a.cst)) return false;
+    a.pure = a.pure && b.pure;
+    return true;
+  }
+
+  /*
+    Expresses the value t (an operand of a statement inside loop) as affine in one of the loop's induction variables.
+
+    returns: false if t is anything else
+  */
+  static bool affine_of(tree t, class loop *loop, const loop_summary &ls, affine &out, int depth = 0) {
+    out.iv = NULL_TREE;
+    out.coef = out.cst = 0;
+    out.pure = true;
+    if (depth > 16) return false;
+
+    switch (TREE_CODE(t)) {
+      case INTEGER_CST:
+        if (!tree_fits_shwi_p(t)) return false;
+        out.cst = tree_to_shwi(t);
+        return true;
+
+      case VAR_DECL:
+      case PARM_DECL:
+        if (find_iv(ls, t)) {
+          out.iv = t;
+          out.coef = 1;
+          return true;
+        }
+        //any other variable has to hold the same value for the whole loop
+        if (!is_tracked_local(t)) return false;
+        for (tree v : ls.assigned)
+          if (v == t) return false;
+        out.pure = false;
+        return true;
+
+      case ADDR_EXPR:
+        //&local_array, &global: the same address on every iteration
+        if (!DECL_P(TREE_OPERAND(t, 0))) return false;
+        out.pure = false;
+        return true;
+
+      case SSA_NAME: {
+        gimple *def = SSA_NAME_DEF_STMT(t);
+        if (gimple_nop_p(def) || !flow_bb_inside_loop_p(loop, gimple_bb(def))) {
+          out.pure = false;  //computed before the loop
+          return true;
+        }
+        if (!is_gimple_assign(def)) return false;
+
+        tree a = gimple_assign_rhs1(def);
+        switch (gimple_assign_rhs_code(def)) {
+          CASE_CONVERT: {
+            tree to = TREE_TYPE(t), from = TREE_TYPE(a);
+            //widening (or same width) integer/pointer conversions keep the value
+            if (!(INTEGRAL_TYPE_P(to) || POINTER_TYPE_P(to)) || !(INTEGRAL_TYPE_P(from) || POINTER_TYPE_P(from)))
+              return false;
+            if (TYPE_PRECISION(to) < TYPE_PRECISION(from)) return false;
+            return affine_of(a, loop, ls, out, depth + 1);
+          }
+          case PLUS_EXPR:
+          case POINTER_PLUS_EXPR:
+          case MINUS_EXPR: {
+            affine b;
+            if (!affine_of(a, loop, ls, out, depth + 1) || !affine_of(gimple_assign_rhs2(def), loop, ls, b, depth + 1))
+              return false;
+            return affine_add(out, b, gimple_assign_rhs_code(def) == MINUS_EXPR ? -1 : 1);
+          }
+          case MULT_EXPR: {
+            affine b;
+            if (!affine_of(a, loop, ls, out, depth + 1) || !affine_of(gimple_assign_rhs2(def), loop, ls, b, depth + 1))
+              return false;
+            if (out.iv || !out.pure) std::swap(out, b);
+            //one side has to be a plain constant
+            if (b.iv || !b.pure) return false;
+            return !__builtin_mul_overflow(out.coef, b.cst, &out.coef) && !__builtin_mul_overflow(out.cst, b.cst, &out.cst);
+          }
+          default:
+            if (gimple_assign_single_p(def) && (TREE_CODE(a) == SSA_NAME || DECL_P(a) || TREE_CODE(a) == INTEGER_CST))
+              return affine_of(a, loop, ls, out, depth + 1);
+            return false;
+        }
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  /*
+    Same as affine_of, for the address of the memory reference ref (only coef and iv are meaningful).
+  */
+  static bool affine_address_of(tree ref, class loop *loop, const loop_summary &ls, affine &out) {
+    switch (TREE_CODE(ref)) {
+      case VAR_DECL:
+      case PARM_DECL:
+      case RESULT_DECL:
+        out.iv = NULL_TREE;
+        out.coef = out.cst = 0;
+        out.pure = false;
+        return true;
+
+      case MEM_REF:
+        return affine_of(TREE_OPERAND(ref, 0), loop, ls, out);
+
+      case COMPONENT_REF:
+        //a constant offset into the base object
+        if (DECL_BIT_FIELD(TREE_OPERAND(ref, 1)) || TREE_OPERAND(ref, 2)) return false;
+        return affine_address_of(TREE_OPERAND(ref, 0), loop, ls, out);
+
+      case ARRAY_REF: {
+        if (TREE_OPERAND(ref, 2) || TREE_OPERAND(ref, 3)) return false; //variable lower bound or element size
+        tree elem = array_ref_element_size(ref);
+        if (!elem || !tree_fits_shwi_p(elem)) return false;
+
+        affine idx;
+        if (!affine_address_of(TREE_OPERAND(ref, 0), loop, ls, out) ||
+            !affine_of(TREE_OPERAND(ref, 1), loop, ls, idx))
+          return false;
+        HOST_WIDE_INT esz = tree_to_shwi(elem);
+        if (__builtin_mul_overflow(idx.coef, esz, &idx.coef) || __builtin_mul_overflow(idx.cst, esz, &idx.cst)) return false;
+        return affine_add(out, idx, 1);
+      }
+
+      default:
+        return false;
+    }
+  }
+
+  /*
+    Decides whether the store stmt (lhs = ...) can be summarized per loop run, and if so fills in r.
+  */
+  static bool analyze_store_range(gimple *stmt, tree lhs, store_range &r) {
+    if (!g_loop_ranges || !current_loops || !is_gimple_assign(stmt) || stmt_ends_bb_p(stmt)) return false;
+
+    basic_block bb = gimple_bb(stmt);
+    class loop *loop = bb->loop_father;
+    if (!loop || !loop_outer(loop)) return false;
+
+    calculate_dominance_info(CDI_DOMINATORS);
+    const loop_summary &ls = loop_summary_for(loop);
+    if (!ls.ok) return false;
+
+    //runs exactly once per iteration (the header also runs once more, for the final test)
+    if (bb == loop->header || !dominated_by_p(CDI_DOMINATORS, loop->latch, bb)) return false;
+
+    r.loop = loop;
+    r.is_iv_inc = false;
+
+    //the increment itself: i takes the values iv0 + step, iv0 + 2 * step, ...
+    for (const iv_info &iv : ls.ivs) {
+      if (iv.inc != stmt) continue;
+      r.iv = iv.var;
+      r.step = iv.step;
+      r.stride = 0;
+      r.value_mul = 1;
+      r.value_add = iv.step;
+      r.is_iv_inc = true;
+      return true;
+    }
+
+    if (TREE_CODE(lhs) == SSA_NAME || DECL_P(lhs) || TREE_THIS_VOLATILE(lhs)) return false;
+    if (!gimple_assign_single_p(stmt) || !INTEGRAL_TYPE_P(TREE_TYPE(lhs))) return false;
+    tree size = TYPE_SIZE_UNIT(TREE_TYPE(lhs));
+    if (!size || TREE_CODE(size) != INTEGER_CST) return false;
+
+    affine addr, val;
+    if (!affine_address_of(lhs, loop, ls, addr) || !addr.iv) return false;
+    if (!affine_of(gimple_assign_rhs1(stmt), loop, ls, val) || !val.pure) return false;
+    if (val.iv && val.iv != addr.iv) return false;
+
+    const iv_info *iv = find_iv(ls, addr.iv);
+    r.iv = iv->var;
+    r.step = iv->step;
+    if (__builtin_mul_overflow(addr.coef, iv->step, &r.stride) || r.stride == 0) return false;
+    r.value_mul = val.coef;
+    r.value_add = val.cst;
+
+    //the formulas use i as it was at the start of the iteration. A store after the increment only qualifies if its
+    //value doesn't depend on i (its operands may have been computed from i before or after the increment).
+    basic_block inc_bb = gimple_bb(iv->inc);
+    bool before_inc;
+    if (inc_bb == bb) {
+      before_inc = false;
+      for (gimple_stmt_iterator gsi = gsi_for_stmt(stmt); !gsi_end_p(gsi); gsi_next(&gsi))
+        if (gsi_stmt(gsi) == iv->inc) { before_inc = true; break; }
+    } else {
+      before_inc = dominated_by_p(CDI_DOMINATORS, inc_bb, bb);
+    }
+    if (!before_inc && val.iv) return false;
+    return true;
+  }
+
+  /*
+    Appends the "range" member of a store event for r.
+  */
+  static void emit_range(out_buf &out, const store_range &r) {
+    out.lit(",\"range\":{\"iv\":\"");
+    json_escape(out, decl_name(r.iv));
+    out.lit("\",\"step\":");
+    out.num((long long)r.step);
+    out.lit(",\"stride\":");
+    out.num((long long)r.stride);
+    out.lit(",\"value\":{\"mul\":");
+    out.num((long long)r.value_mul);
+    out.lit(",\"add\":");
+    out.num((long long)r.value_add);
+    out.lit("}}");
+  }
+
+  // ---------------------------
+  // Type dictionary
+  //
+  // Every type a record refers to is described once per output file, at PLUGIN_FINISH (see "TYPES" in
+  // memlog_format.h); records only carry its id. The descriptions are taken from the trees as soon as a type is first
+  // referred to, since the atexit path runs after gcc has torn its trees down.
+  // ---------------------------
+
+  //one type of the dictionary
+  struct type_desc {
+    uint64_t id;
+    uint32_t kind;        //memlog_type_kind
+    uint32_t name;        //identifier index (g_bin_idents), MEMLOG_NONE: none
+    uint32_t flags;       //MEMLOG_TYPE_F_*
+    uint32_t align;       //bytes, 0: unknown
+    uint64_t ref;         //ptr: the id of the type pointed to, array: of the element type, otherwise 0
+    int64_t  size, count; //-1: unknown
+    uint32_t first_field; //its fields are g_type_fields[first_field, first_field + n_fields)
+    uint32_t n_fields;
+  };
+
+  //one field of a struct or union
+  struct type_field {
+    uint64_t type;        //its type's id
+    uint32_t name;        //identifier index, MEMLOG_NONE: anonymous
+    uint32_t bits;        //bit-field width, 0: not a bit-field
+    int64_t  bit_offset;  //from the start of the struct, -1: not a constant
+  };
+
+  static std::vector<type_desc> g_types;                     //in the order they were first referred to
+  static std::vector<type_field> g_type_fields;
+  static std::unordered_map<uint64_t, uint32_t> g_type_by_id; //id -> index in g_types
+  static std::unordered_map<tree, uint32_t> g_type_by_tree;   //main variant -> index in g_types
+  //pointers to structs registered before the struct itself (see type_index)
+  static std::vector<std::pair<uint32_t, tree>> g_type_pending;
+  static int g_type_depth = 0;
+  //the types the current function's records referred to, for the output cache
+  static std::vector<uint32_t> g_func_types;
+
+  static uint32_t type_kind(tree ty) {
+    switch (TREE_CODE(ty)) {
+      case INTEGER_TYPE:   return MEMLOG_TY_INT;
+      case BOOLEAN_TYPE:   return MEMLOG_TY_BOOL;
+      case ENUMERAL_TYPE:  return MEMLOG_TY_ENUM;
+      case REAL_TYPE:      return MEMLOG_TY_FLOAT;
+      case POINTER_TYPE:
+      case REFERENCE_TYPE: return MEMLOG_TY_PTR;
+      case ARRAY_TYPE:     return MEMLOG_TY_ARRAY;
+      case RECORD_TYPE:    return MEMLOG_TY_STRUCT;
+      case UNION_TYPE:
+      case QUAL_UNION_TYPE: return MEMLOG_TY_UNION;
+      case FUNCTION_TYPE:
+      case METHOD_TYPE:    return MEMLOG_TY_FUNC;
+      case VOID_TYPE:      return MEMLOG_TY_VOID;
+      default:             return MEMLOG_TY_OTHER;
+    }
+  }
+
+  /*
+    The name of main variant ty: "int", "struct node", or the first typedef of an anonymous struct. Empty if none.
+  */
+  static std::string type_name_of(tree ty) {
+    for (tree v = ty; v; v = TYPE_NEXT_VARIANT(v)) {
+      tree n = TYPE_NAME(v);
+      //a C struct, union or enum tag
+      if (n && TREE_CODE(n) == IDENTIFIER_NODE) {
+        const char *kw = TREE_CODE(ty) == ENUMERAL_TYPE ? "enum " : TREE_CODE(ty) == RECORD_TYPE ? "struct " : "union ";
+        return std::string(kw) + IDENTIFIER_POINTER(n);
+      }
+      if (n && TREE_CODE(n) == TYPE_DECL && DECL_NAME(n)) return IDENTIFIER_POINTER(DECL_NAME(n));
+      //only an anonymous struct, union or enum goes on to its typedefs
+      if (!RECORD_OR_UNION_TYPE_P(ty) && TREE_CODE(ty) != ENUMERAL_TYPE) break;
+    }
+    return std::string();
+  }
+
+  static int64_t tree_shwi_or(tree t, int64_t fallback) {
+    return t && tree_fits_shwi_p(t) ? (int64_t)tree_to_shwi(t) : fallback;
+  }
+
+  /*
+    What a pointer to the struct or union rec hashes: its kind, name, size and field names, but not its fields'
+    types, which may point back to it.
+  */
+  static uint64_t record_key(tree rec) {
+    hasher h;
+    h.num(type_kind(rec));
+    h.str(type_name_of(rec).c_str());
+    h.num((uint64_t)type_size_bytes(rec));
+    if (COMPLETE_TYPE_P(rec))
+      for (tree f = TYPE_FIELDS(rec); f; f = DECL_CHAIN(f))
+        if (TREE_CODE(f) == FIELD_DECL) h.str(DECL_NAME(f) ? IDENTIFIER_POINTER(DECL_NAME(f)) : "");
+    return h.h;
+  }
+
+  /*
+    Adds d (with its fields) to the dictionary unless a type with its id is already there.
+
+    return: its index in g_types
+  */
+  static uint32_t type_add(type_desc d, const type_field *fields) {
+    auto it = g_type_by_id.find(d.id);
+    if (it != g_type_by_id.end()) return it->second;
+    d.first_field = (uint32_t)g_type_fields.size();
+    g_type_fields.insert(g_type_fields.end(), fields, fields + d.n_fields);
+    uint32_t idx = (uint32_t)g_types.size();
+    g_types.push_back(d);
+    g_type_by_id.emplace(d.id, idx);
+    return idx;
+  }
+
+  /*
+    The dictionary entry of ty, added (with every type it refers to) the first time ty is seen.
+
+    return: its index in g_types, or MEMLOG_NONE if ty is null
+  */
+  static uint32_t type_index(tree ty) {
+    if (!ty) return MEMLOG_NONE;
+    ty = TYPE_MAIN_VARIANT(ty);
+    auto it = g_type_by_tree.find(ty);
+    if (it != g_type_by_tree.end()) return it->second;
+    g_type_depth++;
+
+    type_desc d;
+    std::memset(&d, 0, sizeof(d));
+    d.kind = type_kind(ty);
+    std::string name = type_name_of(ty);
+    d.name = name.empty() ? MEMLOG_NONE : g_bin_idents.intern(name.c_str());
+    bool sized = d.kind != MEMLOG_TY_FUNC && d.kind != MEMLOG_TY_VOID && COMPLETE_TYPE_P(ty);
+    d.size = sized ? type_size_bytes(ty) : -1;
+    d.align = sized ? TYPE_ALIGN_UNIT(ty) : 0;
+    d.count = -1;
+    if ((d.kind == MEMLOG_TY_INT || d.kind == MEMLOG_TY_ENUM) && TYPE_UNSIGNED(ty)) d.flags |= MEMLOG_TYPE_F_UNSIGNED;
+
+    hasher h;
+    h.num(d.kind);
+    h.str(name.c_str());
+    h.num((uint64_t)d.size);
+    h.num(d.align);
+    h.num(d.flags);
+
+    std::vector<type_field> fields;
+    tree pending = NULL_TREE;
+    if (d.kind == MEMLOG_TY_PTR) {
+      tree to = TYPE_MAIN_VARIANT(TREE_TYPE(ty));
+      //a struct may point to itself: its pointers hash its key, and get their "to" once it is in the dictionary
+      if (RECORD_OR_UNION_TYPE_P(to)) {
+        h.num(record_key(to));
+        pending = to;
+      } else {
+        d.ref = g_types[type_index(to)].id;
+        h.num(d.ref);
+      }
+    } else if (d.kind == MEMLOG_TY_ARRAY) {
+      d.ref = g_types[type_index(TREE_TYPE(ty))].id;
+      tree dom = TYPE_DOMAIN(ty);
+      if (dom && TYPE_MAX_VALUE(dom) && tree_fits_shwi_p(TYPE_MAX_VALUE(dom)) && (!TYPE_MIN_VALUE(dom) ||
+          tree_fits_shwi_p(TYPE_MIN_VALUE(dom))))
+        d.count = tree_to_shwi(TYPE_MAX_VALUE(dom)) - tree_shwi_or(TYPE_MIN_VALUE(dom), 0) + 1;
+      h.num(d.ref);
+      h.num((uint64_t)d.count);
+    } else if ((d.kind == MEMLOG_TY_STRUCT || d.kind == MEMLOG_TY_UNION) && COMPLETE_TYPE_P(ty)) {
+      d.flags |= MEMLOG_TYPE_F_COMPLETE;
+      h.num(d.flags);
+      for (tree f = TYPE_FIELDS(ty); f; f = DECL_CHAIN(f)) {
+        if (TREE_CODE(f) != FIELD_DECL) continue;
+        //an unnamed bit-field is only padding
+        if (DECL_BIT_FIELD(f) && !DECL_NAME(f)) continue;
+        type_field tf;
+        std::memset(&tf, 0, sizeof(tf));
+        tf.name = DECL_NAME(f) ? g_bin_idents.intern_gcc(IDENTIFIER_POINTER(DECL_NAME(f))) : MEMLOG_NONE;
+        tf.bit_offset = tree_shwi_or(bit_position(f), -1);
+        if (DECL_BIT_FIELD(f)) tf.bits = (uint32_t)tree_shwi_or(DECL_SIZE(f), 0);
+        tree fty = DECL_BIT_FIELD(f) && DECL_BIT_FIELD_TYPE(f) ? DECL_BIT_FIELD_TYPE(f) : TREE_TYPE(f);
+        tf.type = g_types[type_index(fty)].id;
+        fields.push_back(tf);
+
+        h.str(DECL_NAME(f) ? IDENTIFIER_POINTER(DECL_NAME(f)) : "");
+        h.num((uint64_t)tf.bit_offset);
+        h.num(tf.bits);
+        h.num(tf.type);
+      }
+    }
+
+    //53 bits, so an id survives a JavaScript number (0 is "none")
+    d.id = h.h & ((1ull << 53) - 1);
+    if (!d.id) d.id = 1;
+    d.n_fields = (uint32_t)fields.size();
+    uint32_t idx = type_add(d, fields.data());
+    g_type_by_tree.emplace(ty, idx);
+    if (pending && !g_types[idx].ref) g_type_pending.emplace_back(idx, pending);
+
+    //the outermost call resolves the pointers to structs (which may add more)
+    if (--g_type_depth == 0) {
+      g_type_depth++;
+      while (!g_type_pending.empty()) {
+        std::pair<uint32_t, tree> p = g_type_pending.back();
+        g_type_pending.pop_back();
+        uint64_t to = g_types[type_index(p.second)].id;
+        g_types[p.first].ref = to;
+      }
+      g_type_depth--;
+    }
+    return idx;
+  }
+
+  static void bin_type_counts(uint32_t &n_types, uint32_t &n_fields) {
+    n_types = (uint32_t)g_types.size();
+    n_fields = (uint32_t)g_type_fields.size();
+  }
+
+  /*
+    Writes the dictionary's memlog_bin_type and memlog_bin_field records (binary mode), which refer to types by
+    their index in g_types instead of their id.
+  */
+  static void bin_write_types() {
+    auto index_of = [](uint64_t id) {
+      auto it = g_type_by_id.find(id);
+      return it != g_type_by_id.end() ? it->second : MEMLOG_NONE;
+    };
+    for (const type_desc &t : g_types) {
+      memlog_bin_type bt;
+      std::memset(&bt, 0, sizeof(bt));
+      bt.id = t.id;
+      bt.kind = t.kind;
+      bt.name = t.name;
+      bt.flags = t.flags;
+      bt.ref = index_of(t.ref);
+      bt.size = t.size;
+      bt.count = t.count;
+      bt.align = t.align;
+      out_write((const char *)&bt, sizeof(bt));
+    }
+    for (uint32_t i = 0; i < g_types.size(); i++) {
+      for (uint32_t j = 0; j < g_types[i].n_fields; j++) {
+        const type_field &f = g_type_fields[g_types[i].first_field + j];
+        memlog_bin_field bf;
+        std::memset(&bf, 0, sizeof(bf));
+        bf.owner = i;
+        bf.name = f.name;
+        bf.type = index_of(f.type);
+        bf.bits = f.bits;
+        bf.bit_offset = f.bit_offset;
+        out_write((const char *)&bf, sizeof(bf));
+      }
+    }
+  }
+
+  /*
+    The type a record refers to: its index in g_types (the binary records' "type"), noted for the output cache.
+
+    return: MEMLOG_NONE if ty is null
+  */
+  static uint32_t type_ref(tree ty) {
+    uint32_t idx = type_index(ty);
+    if (idx != MEMLOG_NONE) g_func_types.push_back(idx);
+    return idx;
+  }
+
+  //Appends ,"type":<id> (nothing for MEMLOG_NONE).
+  static void emit_type_ref(out_buf &out, uint32_t idx) {
+    if (idx == MEMLOG_NONE) return;
+    out.lit(",\"type\":");
+    out.num((long long)g_types[idx].id);
+  }
+
+  /*
+    Hashes ty and every type reachable from it (what a pointer or array refers to, a struct's fields), each the way
+    its dictionary entry describes it: kind, name, size, alignment, element count, and a struct's fields with their
+    offsets. seen numbers the types already hashed, so a struct that points back to itself ends the walk.
+  */
+  static void type_layout_walk(tree ty, hasher &h, std::unordered_map<tree, uint64_t> &seen) {
+    ty = TYPE_MAIN_VARIANT(ty);
+    auto it = seen.find(ty);
+    if (it != seen.end()) {
+      h.num(0);
+      h.num(it->second);
+      return;
+    }
+    seen.emplace(ty, seen.size());
+
+    uint32_t kind = type_kind(ty);
+    bool sized = kind != MEMLOG_TY_FUNC && kind != MEMLOG_TY_VOID && COMPLETE_TYPE_P(ty);
+    h.num(1);
+    h.num(kind);
+    h.str(type_name_of(ty).c_str());
+    h.num((uint64_t)(sized ? type_size_bytes(ty) : -1));
+    h.num(sized ? TYPE_ALIGN_UNIT(ty) : 0);
+    h.num(TYPE_UNSIGNED(ty));
+    if (kind == MEMLOG_TY_PTR) {
+      type_layout_walk(TREE_TYPE(ty), h, seen);
+    } else if (kind == MEMLOG_TY_ARRAY) {
+      tree dom = TYPE_DOMAIN(ty);
+      h.num((uint64_t)(dom ? tree_shwi_or(TYPE_MAX_VALUE(dom), -1) - tree_shwi_or(TYPE_MIN_VALUE(dom), 0) : -1));
+      type_layout_walk(TREE_TYPE(ty), h, seen);
+    } else if (RECORD_OR_UNION_TYPE_P(ty) && COMPLETE_TYPE_P(ty)) {
+      for (tree f = TYPE_FIELDS(ty); f; f = DECL_CHAIN(f)) {
+        if (TREE_CODE(f) != FIELD_DECL) continue;
+        h.str(DECL_NAME(f) ? IDENTIFIER_POINTER(DECL_NAME(f)) : "");
+        h.num((uint64_t)tree_shwi_or(bit_position(f), -1));
+        h.num(DECL_BIT_FIELD(f) ? (uint64_t)tree_shwi_or(DECL_SIZE(f), 0) : 0);
+        type_layout_walk(DECL_BIT_FIELD(f) && DECL_BIT_FIELD_TYPE(f) ? DECL_BIT_FIELD_TYPE(f) : TREE_TYPE(f), h, seen);
+      }
+    }
+  }
+
+  static std::unordered_map<tree, uint64_t> g_type_layouts; //main variant -> type_layout_key
+
+  /*
+    A hash of the dictionary entries ty would add (its own and those of every type it refers to), without adding
+    them. The output cache hashes it for every type a function body uses, since a cached function keeps those
+    entries: editing a struct makes every function that uses it, or a pointer to it, a miss.
+  */
+  static uint64_t type_layout_key(tree ty) {
+    ty = TYPE_MAIN_VARIANT(ty);
+    auto it = g_type_layouts.find(ty);
+    if (it != g_type_layouts.end()) return it->second;
+    hasher h;
+    std::unordered_map<tree, uint64_t> seen;
+    type_layout_walk(ty, h, seen);
+    g_type_layouts.emplace(ty, h.h);
+    return h.h;
+  }
+
+  //-fplugin-arg-memlog_plugin-fields=0 captures struct assignments as plain bytes, like any other bulk write
+  static bool g_field_captures = true;
+
+  //A char array, which a field capture packs up to its terminating NUL (see "FIELD CAPTURES" in memlog_format.h).
+  static bool is_char_array(tree ty) {
+    if (TREE_CODE(ty) != ARRAY_TYPE || TYPE_MAIN_VARIANT(TREE_TYPE(ty)) != char_type_node) return false;
+    tree size = TYPE_SIZE_UNIT(ty);
+    return size && tree_fits_uhwi_p(size) && tree_to_uhwi(size) > 0;
+  }
+
+  /*
+    Can a capture function pack the fields of the struct rec? Every field (the fields of its struct fields too) has
+    to sit at a constant offset and have a constant size, or be a trailing "int a[]".
+  */
+  static bool fields_packable(tree rec) {
+    if (TREE_CODE(rec) != RECORD_TYPE || !COMPLETE_TYPE_P(rec)) return false;
+    tree size = TYPE_SIZE_UNIT(rec);
+    if (!size || TREE_CODE(size) != INTEGER_CST) return false;
+    for (tree f = TYPE_FIELDS(rec); f; f = DECL_CHAIN(f)) {
+      if (TREE_CODE(f) != FIELD_DECL || (DECL_BIT_FIELD(f) && !DECL_NAME(f))) continue;
+      if (!tree_fits_shwi_p(bit_position(f))) return false;
+      tree fty = TREE_TYPE(f);
+      if (TREE_CODE(fty) == RECORD_TYPE && !fields_packable(fty)) return false;
+      tree fsize = TYPE_SIZE_UNIT(fty);
+      if (fsize && TREE_CODE(fsize) != INTEGER_CST) return false;
+      if (is_char_array(fty) && !builtin_decl_explicit(BUILT_IN_STRNLEN)) return false;
+    }
+    return true;
+  }
+
+  /*
+    Does an aggregate write of type ty get its fields captured instead of its bytes? Runtime mode only, and only at
+    stage=early: the capture functions are new functions, which gcc takes in quietly until it starts expanding
+    (a function added after that would be lowered from inside our own pass).
+  */
+  static bool fields_captured(tree ty) {
+    return g_field_captures && g_mode == MODE_RUNTIME && g_stage == STAGE_EARLY &&
+           fields_packable(TYPE_MAIN_VARIANT(ty));
+  }
+
+  // ---------------------------
+  // Site logging
+  //
+  // A site is a specific program point where something interesting happens (store, alloc, free, ect.)
+  // Sites are identified by a site id that is unique across the whole program (see "SITE IDS" in memlog_format.h)
+  // ---------------------------
+
+  /*
+    This code is responsible for outputing one json per "event"
+  */
+
+  //This is a global counter used to number the sites of this translation unit (the low bits of their ids)
+  static unsigned g_site_counter = 1;
+
+  //The local numbers the current function's sites had last time (see "Incremental output cache"): its sites get
+  //them back, in the order they are found, before any new number is handed out. g_reuse_frame is its frame site's.
+  static const std::vector<uint32_t> *g_reuse_ids = nullptr;
+  static size_t g_reuse_next = 0;
+  static uint32_t g_reuse_frame = 0;
+
+  /*
+    Sets g_tu_id from the main source file and the object being built, unless the tu-id= argument already did.
+    One source built twice (-DVARIANT=1 into a.o, -DVARIANT=2 into b.o) has two sets of sites, so it needs two ids.
+  */
+  static void ensure_tu_id() {
+    if (g_tu_id_set) return;
+    //absolute paths, so the id doesn't depend on which directory the build runs from
+    const char *src = main_input_filename ? main_input_filename : "<stdin>";
+    std::string key = src[0] == '/' ? std::string(src) : path_join(getpwd(), src);
+    //the driver names cc1's auxiliary outputs after the object: -o out/a.o gives -dumpdir out/ -dumpbase a.c
+    std::string out = std::string(dump_dir_name ? dump_dir_name : "") + (dump_base_name ? dump_base_name : "");
+    if (!out.empty()) {
+      key += '\n';
+      key += out[0] == '/' ? out : path_join(getpwd(), out.c_str());
+    }
+    g_tu_id = fnv1a_32(key.c_str());
+    g_tu_id_set = true;
+  }
+
+  /*
+    Returns the id for the next site: this translation unit's TU id combined with the next local number.
+  */
+  static uint64_t next_site_id() {
+    ensure_tu_id();
+    if (g_reuse_ids && g_reuse_next < g_reuse_ids->size()) return MEMLOG_SITE_ID(g_tu_id, (*g_reuse_ids)[g_reuse_next++]);
+
+    //numbering on from 1 would hand out ids that sites of this file already have
+    if (g_site_counter > MEMLOG_SITE_LOCAL_MAX)
+      fatal_error(UNKNOWN_LOCATION, "memlog_plugin: more than %u sites in %s; split the file",
+                  MEMLOG_SITE_LOCAL_MAX, main_input_filename ? main_input_filename : "<stdin>");
+    return MEMLOG_SITE_ID(g_tu_id, g_site_counter++);
+  }
+
+  /*
+    This function prints the json event sitting in g_buf to the output file (or stderr if the output file does not exist)
+    The event is expected to be a complete json object; the newline is added here.
+  */
+  static void emit_jsonl_line() {
+    g_buf.put('\n');
+
+    //out_write copies the line into the current output block (or straight to stderr when there is no output file)
+    out_write(g_buf.data, g_buf.len);
+  }
+
+  /**
+  * NOTE: Function header records ("v":2)
+  *
+  * Every event used to repeat "loc":{"file":...} and "func":..., escaping both strings again each time.
+  * Now, the first time a function produces an event, we write one header record for it:
+  *
+  *   {"v":2,"kind":"func","fid":3,"name":"int_array","file":"/home/.../main.c","decl":{"line":16,"col":6}}
+  *
+  * and its events only refer to it by fid, with their position as a delta from the previous position in that function
+  * (starting from the "decl" location):
+  *
+  *   {"v":2,"site":12,"kind":"store","fid":3,"dl":7,"dc":8,"store":{...}}
+  *
+  * So a consumer keeps a running (line, col) per fid and adds dl/dc to it for each event.
+  * If a statement comes from a different file than the function (code from a macro or an included file) the event
+  * carries "file","line","col" in full instead, and the running position is left alone.
+  *
+  * Functions with no events get no header (every function of the user's own code has at least its frame site, see
+  * "FRAMES" in memlog_format.h). fids are numbered from 1 in the order their headers are written.
+  */
+
+  //This is a global counter used to assign function ids to header records
+  static unsigned g_func_counter = 1;
+
+  //What we know about the function memlog_pass::execute is currently walking
+  struct func_state {
+    bool header_done;  //has its header record been written yet?
+    unsigned fid;      //its id (valid once header_done)
+    const char *file;  //file it is declared in
+    int decl_line, decl_col;
+    int last_line, last_col; //position of the previous event, which dl/dc are relative to
+  };
+  static func_state g_func;
+
+  //Is file the one the current function is declared in? (file names from LOCATION_FILE are shared pointers, so
+  //the strcmp almost never runs)
+  static bool in_func_file(const char *file) {
+    return file == g_func.file || std::strcmp(file, g_func.file) == 0;
+  }
+
+  //A number in the event being built in g_buf that the output cache fills in afresh when it writes the event again:
+  //the fid (it depends on what was compiled before) or a line of the function's own file (it moves whenever code
+  //above the function does), see "Incremental output cache"
+  struct event_hole {
+    size_t begin, end; //where it is in g_buf
+    bool fid;
+    int line;
+  };
+  static std::vector<event_hole> g_event_holes;
+
+  /*
+    Resets g_func for a new function. Called at the start of memlog_pass::execute.
+    Nothing is written until the function produces its first event.
+  */
+  static void begin_function(function *fun) {
+    g_func.header_done = false;
+    g_func.fid = 0;
+    g_func.file = "<unknown>";
+    g_func.decl_line = 0;
+    g_func.decl_col = 0;
+
+    //DECL_SOURCE_LOCATION gives where the function itself was declared
+    if (fun && fun->decl) {
+      location_t loc = DECL_SOURCE_LOCATION(fun->decl);
+      if (loc != UNKNOWN_LOCATION) {
+        if (LOCATION_FILE(loc)) g_func.file = LOCATION_FILE(loc);
+        g_func.decl_line = LOCATION_LINE(loc);
+        g_func.decl_col = LOCATION_COLUMN(loc);
+      }
+    }
+    g_func.last_line = g_func.decl_line;
+    g_func.last_col = g_func.decl_col;
+  }
+
+  /*
+    Writes the header record for the current function (the only place the function name and its file are escaped).
+  */
+  static void emit_func_header() {
+    g_func.fid = g_func_counter++;
+    g_func.header_done = true;
+
+    g_buf.clear();
+    g_buf.lit("{\"v\":2,\"kind\":\"func\",\"fid\":");
+    g_buf.num(g_func.fid);
+    g_buf.lit(",\"name\":\"");
+    json_escape(g_buf, current_func_name());
+    g_buf.lit("\",\"file\":\"");
+    json_escape(g_buf, g_func.file);
+    g_buf.lit("\",\"decl\":{\"line\":");
+    g_buf.num(g_func.decl_line);
+    g_buf.lit(",\"col\":");
+    g_buf.num(g_func.decl_col);
+    g_buf.lit("}}");
+    emit_jsonl_line();
+  }
+
+  /*
+    Writes the dictionary as "kind":"type" records (JSONL). Called once, from finish_output, before the stats record.
+  */
+  static void emit_type_lines() {
+    static const char *const kinds[] = { "other", "int", "bool", "enum", "float", "ptr", "array", "struct", "union",
+                                         "func", "void" };
+    auto num_or_null = [](long long v) {
+      if (v >= 0) g_buf.num(v);
+      else g_buf.lit("null");
+    };
+    for (const type_desc &t : g_types) {
+      g_buf.clear();
+      g_buf.lit("{\"v\":2,\"kind\":\"type\",\"id\":");
+      g_buf.num((long long)t.id);
+      g_buf.lit(",\"k\":\"");
+      g_buf.str(kinds[t.kind]);
+      g_buf.put('"');
+      if (t.name != MEMLOG_NONE) {
+        g_buf.lit(",\"name\":\"");
+        json_escape(g_buf, g_bin_idents.strings[t.name].c_str());
+        g_buf.put('"');
+      }
+      g_buf.lit(",\"size\":");
+      num_or_null(t.size);
+      g_buf.lit(",\"align\":");
+      num_or_null(t.align ? (long long)t.align : -1);
+      switch (t.kind) {
+        case MEMLOG_TY_INT:
+        case MEMLOG_TY_ENUM:
+          if (t.flags & MEMLOG_TYPE_F_UNSIGNED) g_buf.lit(",\"unsigned\":true");
+          else g_buf.lit(",\"unsigned\":false");
+          break;
+        case MEMLOG_TY_PTR:
+          g_buf.lit(",\"to\":");
+          g_buf.num((long long)t.ref);
+          break;
+        case MEMLOG_TY_ARRAY:
+          g_buf.lit(",\"elem\":");
+          g_buf.num((long long)t.ref);
+          g_buf.lit(",\"count\":");
+          num_or_null(t.count);
+          break;
+        case MEMLOG_TY_STRUCT:
+        case MEMLOG_TY_UNION:
+          if (!(t.flags & MEMLOG_TYPE_F_COMPLETE)) break;
+          g_buf.lit(",\"fields\":[");
+          for (uint32_t i = 0; i < t.n_fields; i++) {
+            const type_field &f = g_type_fields[t.first_field + i];
+            if (i) g_buf.put(',');
+            g_buf.lit("{\"name\":");
+            if (f.name != MEMLOG_NONE) {
+              g_buf.put('"');
+              json_escape(g_buf, g_bin_idents.strings[f.name].c_str());
+              g_buf.put('"');
+            } else {
+              g_buf.lit("null");
+            }
+            g_buf.lit(",\"offset\":");
+            num_or_null(f.bit_offset >= 0 ? f.bit_offset / 8 : -1);
+            if (f.bits) {
+              g_buf.lit(",\"bit\":");
+              num_or_null(f.bit_offset >= 0 ? f.bit_offset % 8 : -1);
+              g_buf.lit(",\"bits\":");
+              g_buf.num(f.bits);
+            }
+            g_buf.lit(",\"type\":");
+            g_buf.num((long long)f.type);
+            g_buf.put('}');
+          }
+          g_buf.put(']');
+          break;
+        default:
+          break;
+      }
+      g_buf.put('}');
+      emit_jsonl_line();
+    }
+  }
+
+  /*
+    Writes the stats record (see "STATS RECORD" in memlog_format.h). Called once, from finish_output,
+    so "bytes" counts everything written before it.
+  */
+  static void emit_stats_line() {
+    g_buf.clear();
+    g_buf.lit("{\"v\":2,\"kind\":\"stats\",\"funcs\":");
+    g_buf.num((long long)g_stats.funcs);
+    g_buf.lit(",\"cached\":");
+    g_buf.num((long long)g_stats.cached);
+    g_buf.lit(",\"stmts\":");
+    g_buf.num((long long)g_stats.stmts);
+    g_buf.lit(",\"filtered\":");
+    g_buf.num((long long)g_stats.filtered);
+    g_buf.lit(",\"events\":{\"store\":");
+    g_buf.num((long long)g_stats.stores);
+    g_buf.lit(",\"range_store\":");
+    g_buf.num((long long)g_stats.range_stores);
+    g_buf.lit(",\"alloc\":");
+    g_buf.num((long long)g_stats.allocs);
+    g_buf.lit(",\"free\":");
+    g_buf.num((long long)g_stats.frees);
+    g_buf.lit(",\"write\":");
+    g_buf.num((long long)g_stats.writes);
+    g_buf.lit(",\"frame\":");
+    g_buf.num((long long)g_stats.frames);
+    g_buf.lit("},\"derived\":");
+    g_buf.num((long long)g_stats.derived);
+    g_buf.lit(",\"bytes\":");
+    g_buf.num((long long)g_stats.bytes);
+    g_buf.lit(",\"largest_func\":");
+    if (g_stats.funcs) {
+      g_buf.lit("{\"name\":\"");
+      json_escape(g_buf, g_stats.largest_func.c_str());
+      g_buf.lit("\",\"stmts\":");
+      g_buf.num((long long)g_stats.largest_stmts);
+      g_buf.lit(",\"events\":");
+      g_buf.num((long long)g_stats.largest_events);
+      g_buf.put('}');
+    } else {
+      g_buf.lit("null");
+    }
+    g_buf.put('}');
+    emit_jsonl_line();
+  }
+
+  /*
+    This function starts a new event in g_buf and writes the fields every event shares:
+      {"v":2,"site":N,"kind":"...","fid":F,"dl":DL,"dc":DC,
+    (plus "inl":[...] when stmt was inlined into the function, see "INLINED CODE" in memlog_format.h)
+
+    The caller then appends its own kind-specific object and the closing brace.
+  */
+  static void emit_event_head(uint64_t site, const char *kind, const char *file, int line, int col, gimple *stmt) {
+    //the function's header goes out right before its first event
+    if (!g_func.header_done) emit_func_header();
+
+    g_buf.clear();
+    g_buf.lit("{\"v\":2,\"site\":"); //log format version (2 = events refer to a function header record)
+    g_buf.num((long long)site);       //site id, unique across the program
+    g_buf.lit(",\"kind\":\"");        //type of event (store, alloc, free)
+    g_buf.str(kind);
+    g_buf.lit("\",\"fid\":");
+    g_event_holes.clear();
+    size_t begin = g_buf.len;
+    g_buf.num(g_func.fid);
+    g_event_holes.push_back({begin, g_buf.len, true, 0});
+
+    if (in_func_file(file)) {
+      //where this event happened, relative to the previous event of this function
+      g_buf.lit(",\"dl\":");
+      g_buf.num(line - g_func.last_line);
+      g_buf.lit(",\"dc\":");
+      g_buf.num(col - g_func.last_col);
+      g_func.last_line = line;
+      g_func.last_col = col;
+    } else {
+      //statement from another file: spell the location out in full
+      g_buf.lit(",\"file\":\"");
+      json_escape(g_buf, file);
+      g_buf.lit("\",\"line\":");
+      g_buf.num(line);
+      g_buf.lit(",\"col\":");
+      g_buf.num(col);
+    }
+
+    static std::vector<inline_call> chain;
+    inline_chain(stmt, chain);
+    if (!chain.empty()) {
+      g_buf.lit(",\"inl\":[");
+      for (size_t i = 0; i < chain.size(); i++) {
+        if (i) g_buf.put(',');
+        g_buf.lit("{\"fn\":\"");
+        json_escape(g_buf, decl_name(chain[i].fn));
+        g_buf.lit("\",\"file\":\"");
+        json_escape(g_buf, chain[i].file);
+        g_buf.lit("\",\"line\":");
+        begin = g_buf.len;
+        g_buf.num(chain[i].line);
+        if (in_func_file(chain[i].file)) g_event_holes.push_back({begin, g_buf.len, false, chain[i].line});
+        g_buf.lit(",\"col\":");
+        g_buf.num(chain[i].col);
+        g_buf.put('}');
+      }
+      g_buf.put(']');
+    }
+    g_buf.put(',');
+  }
+
+  //The alloc sites a store or write site's pointer may point into (see "POINTS-TO" in memlog_format.h).
+  struct site_pt {
+    std::vector<uint64_t> allocs; //site ids
+    bool definite;
+  };
+
+  /*
+    Adds a site's points-to annotation: ,"pt":{...} at the end of its object in g_buf, or its
+    memlog_bin_points_to records. Nothing if pt is null (nothing known).
+  */
+  static void log_points_to(uint64_t site, const site_pt *pt) {
+    if (!pt) return;
+    if (g_format == FORMAT_BIN) {
+      memlog_bin_points_to bp;
+      std::memset(&bp, 0, sizeof(bp));
+      bp.site = (uint32_t)(site & MEMLOG_SITE_LOCAL_MAX);
+      bp.flags = pt->definite ? MEMLOG_PT_F_DEFINITE : 0;
+      bp.alloc = MEMLOG_NONE;
+      if (pt->allocs.empty()) g_bin_points_to.push_back(bp);
+      for (uint64_t a : pt->allocs) {
+        bp.alloc = (uint32_t)(a & MEMLOG_SITE_LOCAL_MAX);
+        g_bin_points_to.push_back(bp);
+      }
+      return;
+    }
+    g_buf.lit(",\"pt\":{\"alloc\":[");
+    for (size_t i = 0; i < pt->allocs.size(); i++) {
+      if (i) g_buf.put(',');
+      g_buf.num((long long)pt->allocs[i]);
+    }
+    if (pt->definite) g_buf.lit("],\"definite\":true}");
+    else g_buf.lit("],\"definite\":false}");
+  }
+
+  /*
+    This function logs a memory write/variable assignment as a JSONL object. 
+    It records where the event happened and what the destination memory/varaiable looks like
+
+    params:
+      -site (uint64_t): the site number given to this store (see log_found_sites)
+      -stmt (gimple *): pointer to a gimple struct which represents the specific statement being logged
+      -lhs (tree): a tree node pointer that represents the expression on the left-hand side of the assignment
+      -range (const store_range *): the store's loop summary, or null if it is recorded one iteration at a time
+      -pt (const site_pt *): the alloc sites the store may write into, or null if unknown
+  */
+  static void log_store_site(uint64_t site, gimple *stmt, tree lhs, const store_range *range, const site_pt *pt) {
+    const char *file; int line, col;
+
+    //get_loc initializes the file, line and col for this expression
+    get_loc(stmt, file, line, col);
+    //the destination's type, described once in the type dictionary
+    uint32_t type = lhs ? type_ref(TREE_TYPE(lhs)) : MEMLOG_NONE;
+    //what is written (see "STORE VALUES" in memlog_format.h)
+    tree rhs = store_rhs(stmt);
+    bool value_static = store_static_value(stmt) != NULL_TREE;
+
+    //binary mode: record the same information as fixed-width records instead of a JSON line
+    if (g_format == FORMAT_BIN) {
+      memlog_bin_site &rec = bin_new_site(site, MEMLOG_SITE_STORE, file, line, col, stmt);
+      long long bin_bytes = -1;
+      rec.expr = bin_lhs(lhs, bin_bytes);
+      rec.bytes = bin_bytes;
+      rec.type = type;
+      rec.expr2 = bin_expr(rhs);
+      if (value_static) rec.flags |= MEMLOG_SITE_F_VALUE_STATIC;
+      if (range) {
+        memlog_bin_range br;
+        std::memset(&br, 0, sizeof(br));
+        br.site = (uint32_t)(site & MEMLOG_SITE_LOCAL_MAX);
+        br.iv = g_bin_idents.intern(decl_name(range->iv));
+        br.step = range->step;
+        br.stride = range->stride;
+        br.value_mul = range->value_mul;
+        br.value_add = range->value_add;
+        g_bin_ranges.push_back(br);
+      }
+      log_points_to(site, pt);
+      return;
+    }
+
+    //bytes is the size of the memory location/variable being written to (-1 if unknown or not static)
+    long long bytes = -1;
+
+    emit_event_head(site, "store", file, line, col, stmt);
+
+    //emit_lhs writes JSON describing where the store writes (and initializes bytes by reference)
+    g_buf.lit("\"store\":{\"lhs\":");
+    emit_lhs(g_buf, lhs, bytes);
+
+    //log size of memory/variable being written to if it is known
+    g_buf.lit(",\"bytes\":");
+    if (bytes >= 0) g_buf.num(bytes);
+    else g_buf.lit("null");
+    emit_type_ref(g_buf, type);
+    g_buf.lit(",\"rhs\":");
+    emit_expr(g_buf, rhs);
+    if (value_static) g_buf.lit(",\"value_static\":true");
+    else g_buf.lit(",\"value_static\":false");
+    if (range) emit_range(g_buf, *range);
+    log_points_to(site, pt);
+    g_buf.lit("}}");
+
+    //emit_jsonl_line prints the event with a newline to file/stderr
+    emit_jsonl_line();
+  }
+
+
+  /*
+    This function logs a memory allocation as a JSONL object. 
+    It records where the allocation happens, the size of the allocation, and the variable the memory location is stored in
+
+    params:
+      -site (uint64_t): the site number given to this allocation (see log_found_sites)
+      -stmt (gimple *): pointer to a gimple struct representing the gimple call statement for malloc/calloc/realloc
+      -fn_name (const char *): C string naming the allocator function, e.g. "malloc", "calloc", "realloc"
+      -lhs (tree): a tree node pointer representing the left-hand side of the call, i.e. the pointer to the allocated memory location
+      -size_expr_j: a tree node pointer representing the size expression of the memory assignment call (ex. n for malloc(n), a*b for calloc(a,b))
+      -free_fn (const char *): the function that frees the block ("" if unknown; see "ALLOCATOR FAMILIES" in memlog_format.h)
+      -arena (bool): the allocator hands out arena chunks
+  */
+  static void log_alloc_site(uint64_t site, gimple *stmt, const char *fn_name, tree lhs /* may be null */,
+                             tree size_expr_j, const char *free_fn, bool arena) {
+    const char *file; int line, col;
+    get_loc(stmt, file, line, col);  //get_loc initializes the file, line and col for this expression
+    //the pointer's type says what the block is meant to hold
+    uint32_t type = lhs ? type_ref(TREE_TYPE(lhs)) : MEMLOG_NONE;
+
+    if (g_format == FORMAT_BIN) {
+      memlog_bin_site &rec = bin_new_site(site, MEMLOG_SITE_ALLOC, file, line, col, stmt);
+      rec.expr = lhs ? bin_expr(lhs) : MEMLOG_NONE;
+      rec.type = type;
+      rec.expr2 = bin_expr(size_expr_j);
+      rec.name = g_bin_idents.intern_gcc(fn_name);
+      rec.name2 = *free_fn ? g_bin_idents.intern_gcc(free_fn) : MEMLOG_NONE;
+      rec.flags = arena ? MEMLOG_SITE_F_ARENA : 0;
+      return;
+    }
+
+    emit_event_head(site, "alloc", file, line, col, stmt);
+    g_buf.lit("\"alloc\":{\"fn\":\"");
+    json_escape(g_buf, fn_name);
+
+    //the left hand side expression, if it exists; otherwise null
+    g_buf.lit("\",\"lhs\":");
+    if (lhs) emit_expr(g_buf, lhs);
+    else g_buf.lit("null");
+    emit_type_ref(g_buf, type);
+
+    //the size of the memory being allocated
+    //Examples:
+    //n → {"k":"var","name":"n"}
+    //a*b → {"k":"bin","op":"*","a":...,"b":...}
+    //40 → {"k":"int","v":40}
+    g_buf.lit(",\"size_expr\":");
+    emit_expr(g_buf, size_expr_j);
+
+    //the allocator's family: what frees it, and whether it hands out arena chunks
+    if (*free_fn) {
+      g_buf.lit(",\"free_fn\":\"");
+      json_escape(g_buf, free_fn);
+      g_buf.put('"');
+    } else {
+      g_buf.lit(",\"free_fn\":null");
+    }
+    if (arena) g_buf.lit(",\"arena\":true}}");
+    else g_buf.lit(",\"arena\":false}}");
+
+    emit_jsonl_line();
+  }
+
+  /*
+    This function logs a memory free as a JSONL object. 
+    It records where the free occurs, which function it’s in, and what pointer expression is being freed.
+
+    params:
+      -site (uint64_t): the site number given to this free (see log_found_sites)
+      -stmt (gimple *): pointer to a gimple statement representing the gimple call for free
+      -fn_name (const char *): the function called ("free", or one declared in the allocator file)
+      -ptr_expr (tree): a tree node pointer to the expression passed to the free() function
+  */
+  static void log_free_site(uint64_t site, gimple *stmt, const char *fn_name, tree ptr_expr) {
+    const char *file; int line, col;
+    //
+    get_loc(stmt, file, line, col);
+
+    if (g_format == FORMAT_BIN) {
+      memlog_bin_site &rec = bin_new_site(site, MEMLOG_SITE_FREE, file, line, col, stmt);
+      rec.expr = bin_expr(ptr_expr);
+      rec.name = g_bin_idents.intern_gcc(fn_name);
+      return;
+    }
+
+    //ptr_expr is the expression passed to free
+    emit_event_head(site, "free", file, line, col, stmt);
+    g_buf.lit("\"free\":{\"fn\":\"");
+    json_escape(g_buf, fn_name);
+    g_buf.lit("\",\"ptr_expr\":");
+    emit_expr(g_buf, ptr_expr);
+    g_buf.lit("}}");
+
+    emit_jsonl_line();
+  }
+
+  /*
+    Appends the address of one side of an aggregate assignment: {"k":"addr","x":<the object>}, or the constructor or
+    string literal itself when that side is not an object in memory.
+  */
+  static void emit_addr_of(out_buf &out, tree obj) {
+    if (TREE_CODE(obj) == CONSTRUCTOR || TREE_CODE(obj) == STRING_CST) {
+      emit_expr(out, obj);
+      return;
+    }
+    long long bytes;
+    out.lit("{\"k\":\"addr\",\"x\":");
+    emit_lhs(out, obj, bytes);
+    out.put('}');
+  }
+
+  //Binary twin of emit_addr_of().
+  static uint32_t bin_addr_of(tree obj) {
+    if (TREE_CODE(obj) == CONSTRUCTOR || TREE_CODE(obj) == STRING_CST) return bin_expr(obj);
+    long long bytes;
+    return bin_push_expr(MEMLOG_EX_ADDR, bin_lhs(obj, bytes));
+  }
+
+  /*
+    This function logs a bulk write (see "BULK WRITES" in memlog_format.h) as a JSONL object.
+
+    params:
+      -site (uint64_t): the site number given to this write (see log_found_sites)
+      -stmt (gimple *): the call (memcpy, memset, strcpy, ...) or the aggregate assignment
+      -fn (const char *): the function called, or "aggregate"
+      -obj (tree): aggregate assignment: the object written (its left-hand side). call: NULL_TREE
+      -len (tree): how many bytes are written, or NULL_TREE when that is only known at runtime (strcpy)
+      -src (tree): call: the source pointer, or memset's fill value. aggregate assignment: the right-hand side
+      -pt (const site_pt *): the alloc sites the write may write into, or null if unknown
+  */
+  static void log_write_site(uint64_t site, gimple *stmt, const char *fn, tree obj, tree len, tree src,
+                             const site_pt *pt) {
+    const char *file; int line, col;
+    get_loc(stmt, file, line, col);
+    //a call's destination is its first argument
+    tree dst = obj ? NULL_TREE : gimple_call_arg(stmt, 0);
+    //an aggregate assignment writes a whole object of its type (a call just bytes)
+    uint32_t type = obj ? type_ref(TREE_TYPE(obj)) : MEMLOG_NONE;
+    bool fields = obj && fields_captured(TREE_TYPE(obj));
+
+    if (g_format == FORMAT_BIN) {
+      memlog_bin_site &rec = bin_new_site(site, MEMLOG_SITE_WRITE, file, line, col, stmt);
+      rec.expr = obj ? bin_addr_of(obj) : bin_expr(dst);
+      rec.type = type;
+      rec.expr2 = len ? bin_expr(len) : MEMLOG_NONE;
+      rec.expr3 = obj ? bin_addr_of(src) : bin_expr(src);
+      rec.name = g_bin_idents.intern(fn);
+      if (fields) rec.flags |= MEMLOG_SITE_F_FIELDS;
+      log_points_to(site, pt);
+      return;
+    }
+
+    emit_event_head(site, "write", file, line, col, stmt);
+    g_buf.lit("\"write\":{\"fn\":\"");
+    g_buf.str(fn);
+    g_buf.lit("\",\"dst\":");
+    if (obj) emit_addr_of(g_buf, obj);
+    else emit_expr(g_buf, dst);
+    emit_type_ref(g_buf, type);
+
+    g_buf.lit(",\"len\":");
+    if (len) emit_expr(g_buf, len);
+    else g_buf.lit("null");
+
+    //memset has a fill value instead of a source
+    if (std::strcmp(fn, "memset") == 0) g_buf.lit(",\"value\":");
+    else g_buf.lit(",\"src\":");
+    if (obj) emit_addr_of(g_buf, src);
+    else emit_expr(g_buf, src);
+    if (fields) g_buf.lit(",\"capture\":\"fields\"");
+    log_points_to(site, pt);
+    g_buf.lit("}}");
+
+    emit_jsonl_line();
+  }
+
+  // ---------------------------
+  // Runtime instrumentation (-fplugin-arg-memlog_plugin-mode=runtime)
+  //
+  // Every logged site also gets a hook into memlog_runtime, passing the same site number,
+  // so the runtime records can be joined to the site descriptions written above:
+  //   x = ...;  a[i] = ...;  p->f = ...;    =>  the store, then a record written inline (see instrument_store_inline)
+  //   ld = 1.0L;  (>8 byte scalars)          =>  the store, then __memlog_store(site, &lhs, sizeof lhs)
+  //   s = t;  (structs and arrays)           =>  the store, then __memlog_write(site, &lhs, sizeof lhs)
+  //   s = t;  (struct, stage=early)          =>  the store, then __memlog_fields_<type id>(site, &lhs) (see build_field_capturer)
+  //   memcpy(d, s, n);  memset(d, c, n);     =>  the call,  then __memlog_write(site, d, n)
+  //   strcpy(d, s);                          =>  the call,  then __memlog_write_str(site, d)
+  //   p = malloc(n);                         =>  the call,  then __memlog_alloc(site, p, n)
+  //   free(p);                               =>  __memlog_free(site, p), then the call
+  //   function entry / each return           =>  __memlog_enter / __memlog_exit(site, __builtin_frame_address(0))
+  //   a[i] = i;  (summarized loop store)     =>  see instrument_pending_ranges
+  //
+  // Sites are only collected while memlog_pass::execute walks a function (g_pending_hooks); the hooks are inserted
+  // once the walk is done, because the inline store path splits basic blocks and the walk must not trip over them.
+  // ---------------------------
+
+  //-fplugin-arg-memlog_plugin-inline-stores=0 sends every store through __memlog_store instead (for comparison)
+  static bool g_inline_stores = true;
+
+  //-fplugin-arg-memlog_plugin-derive=0 hooks the stores plan_reg_stores would leave to another site's record
+  static bool g_derive_stores = true;
+
+  //A site that still needs its runtime hook.
+  enum hook_kind { HOOK_STORE, HOOK_ALLOC, HOOK_FREE, HOOK_WRITE };
+  struct pending_hook {
+    hook_kind kind;
+    gimple *stmt;   //the store, allocator call, free call or bulk write
+    tree lhs;       //store: destination. alloc: where the result goes (may be null). write: the aggregate written, or null for a call
+    tree arg;       //alloc: size expression. free: the pointer. write: bytes written (null: a string, measured at runtime)
+    tree old;       //alloc: the block being resized (realloc's first argument), or null
+    uint64_t site;
+  };
+  static std::vector<pending_hook> g_pending_hooks;
+
+  //Declarations of what we reference in memlog_runtime, built the first time they are needed.
+  //They outlive any one function, so they are registered as GC roots in plugin_init.
+  static tree g_hook_store = NULL_TREE;  //void __memlog_store(uint64_t, const void *, size_t)
+  static tree g_hook_alloc = NULL_TREE;  //void __memlog_alloc(uint64_t, const void *, size_t)
+  static tree g_hook_realloc = NULL_TREE; //void __memlog_realloc(uint64_t, const void *, size_t, const void *)
+  static tree g_hook_free = NULL_TREE;   //void __memlog_free(uint64_t, const void *)
+  static tree g_hook_range = NULL_TREE;  //void __memlog_range_store(uint64_t, const void *, int64_t, uint64_t, int64_t)
+  static tree g_hook_write = NULL_TREE;  //void __memlog_write(uint64_t, const void *, size_t)
+  static tree g_hook_write_str = NULL_TREE; //void __memlog_write_str(uint64_t, const void *)
+  static tree g_hook_fields_begin = NULL_TREE; //char *__memlog_fields_begin(uint64_t, const void *, size_t, size_t, size_t *)
+  static tree g_hook_fields_end = NULL_TREE;   //void __memlog_fields_end(const void *)
+  static tree g_hook_enter = NULL_TREE;  //void __memlog_enter(uint64_t, const void *)
+  static tree g_hook_exit = NULL_TREE;   //void __memlog_exit(uint64_t, const void *)
+  static tree g_hook_refill = NULL_TREE; //struct memlog_rt_record *__memlog_refill(void)
+  static tree g_rt_cursor = NULL_TREE;   //extern __thread struct memlog_rt_record *__memlog_cursor
+  static tree g_rt_limit = NULL_TREE;    //extern __thread struct memlog_rt_record *__memlog_limit
+  static tree g_field_capturer_list = NULL_TREE; //TREE_LIST of the capture functions built so far (see build_field_capturer)
+
+  static const struct ggc_root_tab memlog_gc_roots[] = {
+    { &g_hook_store, 1, sizeof(g_hook_store), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_alloc, 1, sizeof(g_hook_alloc), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_realloc, 1, sizeof(g_hook_realloc), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_free, 1, sizeof(g_hook_free), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_range, 1, sizeof(g_hook_range), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_write, 1, sizeof(g_hook_write), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_write_str, 1, sizeof(g_hook_write_str), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_fields_begin, 1, sizeof(g_hook_fields_begin), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_fields_end, 1, sizeof(g_hook_fields_end), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_enter, 1, sizeof(g_hook_enter), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_exit, 1, sizeof(g_hook_exit), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_hook_refill, 1, sizeof(g_hook_refill), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_rt_cursor, 1, sizeof(g_rt_cursor), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_rt_limit, 1, sizeof(g_rt_limit), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    { &g_field_capturer_list, 1, sizeof(g_field_capturer_list), &gt_ggc_mx_tree_node, &gt_pch_nx_tree_node },
+    LAST_GGC_ROOT_TAB
+  };
+
+  /*
+    Declares one external hook function, e.g. void __memlog_store(uint64_t, const void *, size_t).
+  */
+  static tree build_hook_decl(const char *name, tree fntype) {
+    //build_fn_decl gives us a public, external, artificial declaration: exactly a function defined in another object
+    tree fn = build_fn_decl(name, fntype);
+    //the hooks never throw, so a call to one never has to end a basic block (matters when compiling with -fexceptions)
+    TREE_NOTHROW(fn) = 1;
+    return fn;
+  }
+
+  /*
+    Declares one of the runtime's thread-local window pointers. We only ever use them as plain pointers (the record
+    fields are written at fixed offsets), so void * is as good as the real struct type.
+  */
+  static tree build_tls_decl(const char *name) {
+    tree v = build_decl(UNKNOWN_LOCATION, VAR_DECL, get_identifier(name), ptr_type_node);
+    TREE_PUBLIC(v) = 1;
+    DECL_EXTERNAL(v) = 1;
+    DECL_ARTIFICIAL(v) = 1;
+    set_decl_tls_model(v, decl_default_tls_model(v));
+    return v;
+  }
+
+  static void build_hook_decls() {
+    if (g_hook_store) return;
+
+    tree const_void_ptr = build_pointer_type(build_qualified_type(void_type_node, TYPE_QUAL_CONST));
+    g_hook_store = build_hook_decl("__memlog_store",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, size_type_node, NULL_TREE));
+    g_hook_alloc = build_hook_decl("__memlog_alloc",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, size_type_node, NULL_TREE));
+    g_hook_realloc = build_hook_decl("__memlog_realloc",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, size_type_node, const_void_ptr,
+                                 NULL_TREE));
+    g_hook_free = build_hook_decl("__memlog_free",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, NULL_TREE));
+    g_hook_range = build_hook_decl("__memlog_range_store",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, long_long_integer_type_node,
+                                 long_long_unsigned_type_node, long_long_integer_type_node, NULL_TREE));
+    g_hook_write = build_hook_decl("__memlog_write",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, size_type_node, NULL_TREE));
+    g_hook_write_str = build_hook_decl("__memlog_write_str",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, NULL_TREE));
+    g_hook_fields_begin = build_hook_decl("__memlog_fields_begin",
+        build_function_type_list(build_pointer_type(char_type_node), uint64_type_node, const_void_ptr, size_type_node,
+                                 size_type_node, build_pointer_type(size_type_node), NULL_TREE));
+    g_hook_fields_end = build_hook_decl("__memlog_fields_end",
+        build_function_type_list(void_type_node, const_void_ptr, NULL_TREE));
+    g_hook_enter = build_hook_decl("__memlog_enter",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, NULL_TREE));
+    g_hook_exit = build_hook_decl("__memlog_exit",
+        build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, NULL_TREE));
+    g_hook_refill = build_hook_decl("__memlog_refill", build_function_type_list(ptr_type_node, NULL_TREE));
+    g_rt_cursor = build_tls_decl("__memlog_cursor");
+    g_rt_limit = build_tls_decl("__memlog_limit");
+  }
+
+  /*
+    Turns expr into a valid call argument (a constant or a plain variable), inserting any statements needed to
+    compute it right before the statement at gsi.
+  */
+  static tree hook_arg_before(gimple_stmt_iterator *gsi, tree expr) {
+    return force_gimple_operand_gsi(gsi, expr, true, NULL_TREE, true, GSI_SAME_STMT);
+  }
+
+  /*
+    A new temporary for the hooks' bookkeeping: a plain variable before into-SSA (stage=early), an SSA name after
+    it (stage=late).
+  */
+  static tree new_temp(tree type, const char *name) {
+    return gimple_in_ssa_p(cfun) ? make_ssa_name(type) : create_tmp_var(type, name);
+  }
+
+  /*
+    The value a runtime store record carries for val, as a 64-bit unsigned expression: integers and pointers
+    zero-extended, floats as their bit pattern. This matches what __memlog_store reads back with memcpy.
+
+    returns: NULL_TREE if val has no such value (aggregates, vectors, long double, __int128, ...)
+  */
+  static tree store_value_u64(tree val) {
+    tree ty = TREE_TYPE(val);
+
+    if ((INTEGRAL_TYPE_P(ty) || POINTER_TYPE_P(ty)) && TYPE_PRECISION(ty) <= 64)
+      return fold_convert(uint64_type_node, fold_convert(unsigned_type_for(ty), val));
+
+    if (SCALAR_FLOAT_TYPE_P(ty)) {
+      long long bytes = type_size_bytes(ty);
+      if (bytes == 4) return fold_convert(uint64_type_node, fold_build1(VIEW_CONVERT_EXPR, uint32_type_node, val));
+      if (bytes == 8) return fold_build1(VIEW_CONVERT_EXPR, uint64_type_node, val);
+    }
+    return NULL_TREE;
+  }
+
+  /*
+    Builds MEM[rec + offset] of the given type. The offset is typed char *, so the store may alias anything
+    (the runtime reads the record back through struct memlog_rt_record).
+  */
+  static tree rec_field(tree rec, tree type, unsigned offset) {
+    return build2(MEM_REF, type, rec, build_int_cst(build_pointer_type(char_type_node), offset));
+  }
+
+  /*
+    The inline fast path for a scalar store at gsi. The block holding the store is split right after it:
+
+        <store>
+        rec = __memlog_cursor;
+        lim = __memlog_limit;
+        if (rec >= lim)                  //unlikely: the thread's window is used up
+          rec = __memlog_refill ();
+        rec->site = site | MEMLOG_RT_STORE << 56;  rec->addr = &lhs;  rec->size = sizeof lhs;
+        rec->value = lhs;                //reloaded after the store (a value_static store: the constant itself)
+        __memlog_cursor = rec + 1;
+
+    Locals that live in registers are not forced into memory: their records get addr 0, and the variable is
+    identified by the site alone.
+  */
+  static void instrument_store_inline(gimple_stmt_iterator *gsi, tree lhs, tree size, tree cst, uint64_t site) {
+    gimple *stmt = gsi_stmt(*gsi);
+    location_t loc = gimple_location(stmt);
+
+    //the address is computed before the store, from the same operands the store uses
+    tree addr = null_pointer_node;
+    if (!is_gimple_reg(lhs)) {
+      mark_addressable(lhs);
+      addr = hook_arg_before(gsi, build_fold_addr_expr(unshare_expr(lhs)));
+    }
+
+    //cond_bb ends with the store, then_bb holds the refill call, and *gsi moves to the start of join_bb
+    basic_block then_bb, join_bb;
+    gimple_stmt_iterator cond_gsi = create_cond_insert_point(gsi, /*before_p=*/false, /*then_more_likely_p=*/false,
+                                                             /*create_then_fallthru_edge=*/true, &then_bb, &join_bb);
+
+    //early, into-SSA gives rec its PHI node later; late, the PHI is built below
+    tree rec = new_temp(ptr_type_node, "memlog_rec");
+    tree lim = new_temp(ptr_type_node, "memlog_lim");
+
+    gimple *g = gimple_build_assign(rec, g_rt_cursor);
+    gimple_set_location(g, loc);
+    gsi_insert_after(&cond_gsi, g, GSI_NEW_STMT);
+    g = gimple_build_assign(lim, g_rt_limit);
+    gimple_set_location(g, loc);
+    gsi_insert_after(&cond_gsi, g, GSI_NEW_STMT);
+    g = gimple_build_cond(GE_EXPR, rec, lim, NULL_TREE, NULL_TREE);
+    gimple_set_location(g, loc);
+    gsi_insert_after(&cond_gsi, g, GSI_NEW_STMT);
+
+    gimple_stmt_iterator then_gsi = gsi_last_bb(then_bb);
+    gcall *refill = gimple_build_call(g_hook_refill, 0);
+    tree refilled = gimple_in_ssa_p(cfun) ? new_temp(ptr_type_node, "memlog_rec") : rec;
+    gimple_call_set_lhs(refill, refilled);
+    gimple_set_location(refill, loc);
+    gsi_insert_after(&then_gsi, refill, GSI_NEW_STMT);
+
+    if (gimple_in_ssa_p(cfun)) {
+      basic_block cond_bb = gsi_bb(cond_gsi);
+      tree merged = new_temp(ptr_type_node, "memlog_rec");
+      gphi *phi = create_phi_node(merged, join_bb);
+      edge e;
+      edge_iterator ei;
+      FOR_EACH_EDGE(e, ei, join_bb->preds) {
+        if (e->src == cond_bb) add_phi_arg(phi, rec, e, loc);
+      }
+      add_phi_arg(phi, refilled, single_succ_edge(then_bb), loc);
+      rec = merged;
+    }
+
+    //the record (field offsets of struct memlog_rt_record in memlog_format.h)
+    tree value = hook_arg_before(gsi, store_value_u64(cst ? fold_convert(TREE_TYPE(lhs), cst) : unshare_expr(lhs)));
+    const struct { tree type; unsigned offset; tree val; } fields[] = {
+      { uint64_type_node, offsetof(memlog_rt_record, site),  build_int_cst(uint64_type_node, MEMLOG_RT_SITE_KIND(site, MEMLOG_RT_STORE)) },
+      { ptr_type_node,    offsetof(memlog_rt_record, addr),  addr },
+      { uint64_type_node, offsetof(memlog_rt_record, size),  fold_convert(uint64_type_node, size) },
+      { uint64_type_node, offsetof(memlog_rt_record, value), value },
+    };
+    for (const auto &f : fields) {
+      g = gimple_build_assign(rec_field(rec, f.type, f.offset), f.val);
+      gimple_set_location(g, loc);
+      gsi_insert_before(gsi, g, GSI_SAME_STMT);
+    }
+
+    tree next = new_temp(ptr_type_node, "memlog_rec");
+    g = gimple_build_assign(next, POINTER_PLUS_EXPR, rec, size_int(sizeof(memlog_rt_record)));
+    gimple_set_location(g, loc);
+    gsi_insert_before(gsi, g, GSI_SAME_STMT);
+    g = gimple_build_assign(g_rt_cursor, next);
+    gimple_set_location(g, loc);
+    gsi_insert_before(gsi, g, GSI_SAME_STMT);
+  }
+
+  /*
+    The out-of-line path: __memlog_store(site, &lhs, sizeof lhs) right after the store at gsi.
+  */
+  static void instrument_store_call(gimple_stmt_iterator *gsi, tree lhs, tree size, uint64_t site) {
+    gimple *stmt = gsi_stmt(*gsi);
+
+    //&lhs needs the variable to live in memory (at -O0 it does anyway)
+    mark_addressable(lhs);
+    //compute the address before the store, from the same operands the store uses
+    tree addr = hook_arg_before(gsi, build_fold_addr_expr(unshare_expr(lhs)));
+
+    gcall *call = gimple_build_call(g_hook_store, 3, build_int_cst(uint64_type_node, site), addr,
+                                    fold_convert(size_type_node, size));
+    gimple_set_location(call, gimple_location(stmt));
+    gsi_insert_after(gsi, call, GSI_NEW_STMT);
+  }
+
+  /*
+    Can the store stmt (to lhs) get a runtime hook at all? The stores that can't are still logged as sites.
+  */
+  static bool store_hookable(gimple *stmt, tree lhs) {
+    //nothing can be inserted after a statement that ends its basic block
+    if (stmt_ends_bb_p(stmt)) return false;
+    //a gimplifier temporary lives in a register: there is no memory to point at (stage=late only gets here for
+    //SSA names that stand for a user variable, and records them by value)
+    if (TREE_CODE(lhs) == SSA_NAME && g_stage == STAGE_EARLY) return false;
+    //bit-fields have no address
+    if (TREE_CODE(lhs) == COMPONENT_REF && DECL_BIT_FIELD(TREE_OPERAND(lhs, 1))) return false;
+    //register variables can't have their address taken either
+    tree base = lhs;
+    while (handled_component_p(base)) base = TREE_OPERAND(base, 0);
+    if (VAR_P(base) && DECL_HARD_REGISTER(base)) return false;
+
+    //variable-sized stores (VLAs) are skipped for now
+    tree size = TYPE_SIZE_UNIT(TREE_TYPE(lhs));
+    return size && TREE_CODE(size) == INTEGER_CST;
+  }
+
+  /*
+    Records the store at gsi at runtime: inline for scalars, through __memlog_store for everything else.
+  */
+  static void instrument_store(gimple_stmt_iterator *gsi, tree lhs, uint64_t site) {
+    if (!store_hookable(gsi_stmt(*gsi), lhs)) return;
+    tree size = TYPE_SIZE_UNIT(TREE_TYPE(lhs));
+
+    build_hook_decls();
+
+    //the inline record stores a pointer in a 64-bit field, and re-reading a volatile would add an access (a
+    //value_static store doesn't read anything back)
+    tree cst = store_static_value(gsi_stmt(*gsi));
+    bool inline_ok = g_inline_stores && POINTER_SIZE == 64 && (cst || !TREE_THIS_VOLATILE(lhs)) &&
+                     store_value_u64(lhs) != NULL_TREE;
+    if (inline_ok) instrument_store_inline(gsi, lhs, size, cst, site);
+    else if (TREE_CODE(lhs) != SSA_NAME) instrument_store_call(gsi, lhs, size, site);
+  }
+
+  /*
+    Inserts __memlog_alloc(site, lhs, size_expr) right after the allocator call at gsi, or
+    __memlog_realloc(site, lhs, size_expr, old) if it resizes the block old.
+  */
+  static void instrument_alloc(gimple_stmt_iterator *gsi, tree lhs, tree size_expr, tree old, uint64_t site) {
+    gimple *stmt = gsi_stmt(*gsi);
+    if (!lhs || stmt_ends_bb_p(stmt)) return;
+
+    build_hook_decls();
+
+    //the size is known before the call
+    tree size = hook_arg_before(gsi, fold_convert(size_type_node, unshare_expr(size_expr)));
+
+    //and so is the old block, which p = realloc(p, n) overwrites: keep a copy of it
+    tree old_copy = NULL_TREE;
+    if (old) {
+      tree v = hook_arg_before(gsi, fold_convert(ptr_type_node, unshare_expr(old)));
+      old_copy = new_temp(ptr_type_node, "memlog_old");
+      gimple *g = gimple_build_assign(old_copy, v);
+      gimple_set_location(g, gimple_location(stmt));
+      gsi_insert_before(gsi, g, GSI_SAME_STMT);
+    }
+
+    //the pointer only exists after it; if the result went straight into memory (s->p = malloc(n)) load it back
+    gimple_stmt_iterator after = *gsi;
+    tree ptr = force_gimple_operand_gsi(&after, unshare_expr(lhs), true, NULL_TREE, false, GSI_CONTINUE_LINKING);
+
+    gcall *call = old_copy
+        ? gimple_build_call(g_hook_realloc, 4, build_int_cst(uint64_type_node, site), ptr, size, old_copy)
+        : gimple_build_call(g_hook_alloc, 3, build_int_cst(uint64_type_node, site), ptr, size);
+    gimple_set_location(call, gimple_location(stmt));
+    gsi_insert_after(&after, call, GSI_CONTINUE_LINKING);
+  }
+
+  /*
+    Inserts __memlog_free(site, ptr) right before the call to free at gsi (afterwards the pointer is dangling).
+  */
+  static void instrument_free(gimple_stmt_iterator *gsi, tree ptr, uint64_t site) {
+    if (!ptr) return;
+    build_hook_decls();
+
+    gcall *call = gimple_build_call(g_hook_free, 2, build_int_cst(uint64_type_node, site), ptr);
+    gimple_set_location(call, gimple_location(gsi_stmt(*gsi)));
+    gsi_insert_before(gsi, call, GSI_SAME_STMT);
+  }
+
+  // ---------------------------
+  // Field captures
+  //
+  // A struct assignment is recorded by a capture function compiled for its type: instead of the struct's first bytes
+  // it packs its fields into the trace, leaving out the padding, and stops at the end of a name instead of copying
+  // the whole char array (see "FIELD CAPTURES" in memlog_format.h). For
+  //
+  //   struct person { int age; char name[32]; struct { unsigned flag : 1; } opts; };
+  //
+  // it is, in C terms:
+  //
+  //   static void __memlog_fields_<type id>(uint64_t site, const void *dst) {
+  //     const struct person *p = dst;
+  //     size_t room, n;
+  //     char *b = __memlog_fields_begin(site, dst, sizeof *p, 4 + 32 + 4, &room);
+  //     if (!b) return;
+  //     if (room < 4) goto done;  memcpy(b, &p->age, 4);  b += 4;  room -= 4;
+  //     n = strnlen(p->name, 32);  n += n < 32;
+  //     if (room < n) goto done;  memcpy(b, p->name, n);  b += n;  room -= n;
+  //     if (room < 4) goto done;  *(unsigned *)b = p->opts.flag;  b += 4;  room -= 4;
+  //   done:
+  //     __memlog_fields_end(b);
+  //   }
+  //
+  // One function per struct type and translation unit, built the first time a site needs it. Our pass skips them
+  // (see memlog_pass::gate).
+  // ---------------------------
+
+  //type id -> its capture function
+  static std::unordered_map<uint64_t, tree> g_field_capturers;
+
+  static bool is_field_capturer(tree fndecl) {
+    for (tree l = g_field_capturer_list; l; l = TREE_CHAIN(l))
+      if (TREE_VALUE(l) == fndecl) return true;
+    return false;
+  }
+
+  //What build_field_capturer is putting together.
+  struct capturer_body {
+    tree stmts;       //statement list
+    tree b, room, n;  //the locals of the sketch above
+    tree done;        //label
+  };
+
+  /*
+    Appends the statements that pack bytes bytes (a size_t expression) starting at addr to body.stmts, or, when
+    val is given, the value val (bytes is then its size).
+  */
+  static void pack_bytes(capturer_body &body, tree addr, tree bytes, tree val) {
+    bytes = fold_convert(size_type_node, bytes);
+    tree full = build2(LT_EXPR, boolean_type_node, body.room, bytes);
+    append_to_statement_list(build3(COND_EXPR, void_type_node, full, build1(GOTO_EXPR, void_type_node, body.done),
+                                    NULL_TREE), &body.stmts);
+    if (val) {
+      //stored as it is, whatever the alignment of b
+      tree type = build_aligned_type(TREE_TYPE(val), BITS_PER_UNIT);
+      tree dst = build2(MEM_REF, type, body.b, build_int_cst(build_pointer_type(char_type_node), 0));
+      append_to_statement_list(build2(MODIFY_EXPR, type, dst, fold_convert(type, val)), &body.stmts);
+    } else {
+      tree memcpy_fn = builtin_decl_explicit(BUILT_IN_MEMCPY);
+      append_to_statement_list(build_call_expr(memcpy_fn, 3, body.b, addr, bytes), &body.stmts);
+    }
+    append_to_statement_list(build2(MODIFY_EXPR, TREE_TYPE(body.b), body.b, fold_build_pointer_plus(body.b, bytes)),
+                             &body.stmts);
+    append_to_statement_list(build2(MODIFY_EXPR, size_type_node, body.room,
+                                    build2(MINUS_EXPR, size_type_node, body.room, bytes)), &body.stmts);
+  }
+
+  /*
+    Appends the statements that pack the fields of obj (a struct lvalue) to body.stmts, in the order of the type
+    dictionary's fields, going into struct fields.
+
+    return: the most bytes they can take
+  */
+  static uint64_t pack_fields(capturer_body &body, tree obj) {
+    uint64_t packed = 0;
+    for (tree f = TYPE_FIELDS(TREE_TYPE(obj)); f; f = DECL_CHAIN(f)) {
+      if (TREE_CODE(f) != FIELD_DECL || (DECL_BIT_FIELD(f) && !DECL_NAME(f))) continue;
+      tree ref = build3(COMPONENT_REF, TREE_TYPE(f), unshare_expr(obj), f, NULL_TREE);
+      tree fty = TREE_TYPE(f);
+
+      if (DECL_BIT_FIELD(f)) {
+        //widened to the type it was declared with, as the dictionary gives it
+        tree declared = DECL_BIT_FIELD_TYPE(f) ? DECL_BIT_FIELD_TYPE(f) : fty;
+        tree bytes = TYPE_SIZE_UNIT(declared);
+        pack_bytes(body, NULL_TREE, bytes, fold_convert(TYPE_MAIN_VARIANT(declared), ref));
+        packed += tree_to_uhwi(bytes);
+      } else if (TREE_CODE(fty) == RECORD_TYPE) {
+        packed += pack_fields(body, ref);
+      } else if (is_char_array(fty)) {
+        //n = strnlen(p->name, N);  n += n < N;
+        tree cap = TYPE_SIZE_UNIT(fty);
+        tree addr = build_fold_addr_expr(ref);
+        tree len = build_call_expr(builtin_decl_explicit(BUILT_IN_STRNLEN), 2, addr, cap);
+        append_to_statement_list(build2(MODIFY_EXPR, size_type_node, body.n, len), &body.stmts);
+        tree nul = fold_convert(size_type_node, build2(LT_EXPR, boolean_type_node, body.n, cap));
+        append_to_statement_list(build2(MODIFY_EXPR, size_type_node, body.n,
+                                        build2(PLUS_EXPR, size_type_node, body.n, nul)), &body.stmts);
+        pack_bytes(body, build_fold_addr_expr(unshare_expr(ref)), body.n, NULL_TREE);
+        packed += tree_to_uhwi(cap);
+      } else {
+        //"int a[]" has no size and packs nothing
+        tree bytes = TYPE_SIZE_UNIT(fty);
+        if (!bytes || integer_zerop(bytes)) continue;
+        pack_bytes(body, build_fold_addr_expr(ref), bytes, NULL_TREE);
+        packed += tree_to_uhwi(bytes);
+      }
+    }
+    return packed;
+  }
+
+  static tree new_capturer_var(tree fn, tree type, const char *name) {
+    tree v = build_decl(BUILTINS_LOCATION, VAR_DECL, get_identifier(name), type);
+    DECL_ARTIFICIAL(v) = 1;
+    DECL_IGNORED_P(v) = 1;
+    DECL_CONTEXT(v) = fn;
+    return v;
+  }
+
+  /*
+    The capture function of the struct type ty (see "Field captures"), built the first time it is asked for: a
+    static function of this translation unit, void __memlog_fields_<type id>(uint64_t site, const void *dst).
+  */
+  static tree build_field_capturer(tree ty) {
+    ty = TYPE_MAIN_VARIANT(ty);
+    uint64_t id = g_types[type_index(ty)].id;
+    auto it = g_field_capturers.find(id);
+    if (it != g_field_capturers.end()) return it->second;
+
+    char name[48];
+    std::snprintf(name, sizeof(name), "__memlog_fields_%llx", (unsigned long long)id);
+    tree const_void_ptr = build_pointer_type(build_qualified_type(void_type_node, TYPE_QUAL_CONST));
+    tree fntype = build_function_type_list(void_type_node, uint64_type_node, const_void_ptr, NULL_TREE);
+    tree fn = build_decl(BUILTINS_LOCATION, FUNCTION_DECL, get_identifier(name), fntype);
+    TREE_STATIC(fn) = 1;
+    TREE_USED(fn) = 1;
+    TREE_NOTHROW(fn) = 1;
+    DECL_ARTIFICIAL(fn) = 1;
+    DECL_IGNORED_P(fn) = 1;
+    DECL_NO_INSTRUMENT_FUNCTION_ENTRY_EXIT(fn) = 1;
+
+    tree result = build_decl(BUILTINS_LOCATION, RESULT_DECL, NULL_TREE, void_type_node);
+    DECL_ARTIFICIAL(result) = 1;
+    DECL_IGNORED_P(result) = 1;
+    DECL_CONTEXT(result) = fn;
+    DECL_RESULT(fn) = result;
+
+    tree site = build_decl(BUILTINS_LOCATION, PARM_DECL, get_identifier("site"), uint64_type_node);
+    tree dst = build_decl(BUILTINS_LOCATION, PARM_DECL, get_identifier("dst"), const_void_ptr);
+    for (tree p : { site, dst }) {
+      DECL_ARG_TYPE(p) = TREE_TYPE(p);
+      DECL_ARTIFICIAL(p) = 1;
+      DECL_CONTEXT(p) = fn;
+    }
+    DECL_CHAIN(site) = dst;
+    DECL_ARGUMENTS(fn) = site;
+
+    //the new function is cfun while its body is built and gimplified; the one being instrumented comes back after
+    push_struct_function(fn);
+
+    capturer_body body;
+    body.stmts = alloc_stmt_list();
+    body.b = new_capturer_var(fn, build_pointer_type(char_type_node), "b");
+    body.room = new_capturer_var(fn, size_type_node, "room");
+    body.n = new_capturer_var(fn, size_type_node, "n");
+    TREE_ADDRESSABLE(body.room) = 1;
+    body.done = build_decl(BUILTINS_LOCATION, LABEL_DECL, NULL_TREE, void_type_node);
+    DECL_ARTIFICIAL(body.done) = 1;
+    DECL_CONTEXT(body.done) = fn;
+
+    //the fields first: the call to __memlog_fields_begin needs their packed size, and goes in front of them
+    tree obj = build_simple_mem_ref(fold_convert(build_pointer_type(ty), dst));
+    uint64_t packed = pack_fields(body, obj);
+    tree fields = body.stmts;
+
+    body.stmts = alloc_stmt_list();
+    tree begin = build_call_expr(g_hook_fields_begin, 5, site, dst, fold_convert(size_type_node, TYPE_SIZE_UNIT(ty)),
+                                 build_int_cst(size_type_node, packed), build_fold_addr_expr(body.room));
+    append_to_statement_list(build2(MODIFY_EXPR, TREE_TYPE(body.b), body.b, begin), &body.stmts);
+    tree none = build2(EQ_EXPR, boolean_type_node, body.b, build_int_cst(TREE_TYPE(body.b), 0));
+    append_to_statement_list(build3(COND_EXPR, void_type_node, none, build1(RETURN_EXPR, void_type_node, NULL_TREE),
+                                    NULL_TREE), &body.stmts);
+    append_to_statement_list(fields, &body.stmts);
+    append_to_statement_list(build1(LABEL_EXPR, void_type_node, body.done), &body.stmts);
+    append_to_statement_list(build_call_expr(g_hook_fields_end, 1, body.b), &body.stmts);
+
+    tree vars = body.b;
+    DECL_CHAIN(body.b) = body.room;
+    DECL_CHAIN(body.room) = body.n;
+    tree block = make_node(BLOCK);
+    BLOCK_VARS(block) = vars;
+    BLOCK_SUPERCONTEXT(block) = fn;
+    TREE_USED(block) = 1;
+    DECL_INITIAL(fn) = block;
+    DECL_SAVED_TREE(fn) = build3(BIND_EXPR, void_type_node, vars, body.stmts, block);
+    DECL_SOURCE_LOCATION(fn) = BUILTINS_LOCATION;
+    cfun->function_end_locus = BUILTINS_LOCATION;
+
+    //the same way gcc adds its own static constructors (cgraph_build_static_cdtor)
+    gimplify_function_tree(fn);
+    cgraph_node::add_new_function(fn, false);
+    pop_cfun();
+
+    g_field_capturer_list = tree_cons(NULL_TREE, fn, g_field_capturer_list);
+    g_field_capturers.emplace(id, fn);
+    return fn;
+  }
+
+  /*
+    Inserts the hook for a bulk write right after it: __memlog_write(site, &lhs, sizeof lhs) for an aggregate
+    assignment (or its type's capture function, see "Field captures"), __memlog_write(site, dst, len) for a call,
+    or __memlog_write_str(site, dst) when the length is only known once the string has been copied.
+  */
+  static void instrument_write(gimple_stmt_iterator *gsi, tree lhs, tree len, uint64_t site) {
+    gimple *stmt = gsi_stmt(*gsi);
+    if (stmt_ends_bb_p(stmt)) return;
+    build_hook_decls();
+    tree site_cst = build_int_cst(uint64_type_node, site);
+
+    if (lhs) {
+      //variable-sized aggregates (VLAs) are skipped, as for stores
+      tree size = TYPE_SIZE_UNIT(TREE_TYPE(lhs));
+      if (!size || TREE_CODE(size) != INTEGER_CST) return;
+
+      mark_addressable(lhs);
+      tree addr = hook_arg_before(gsi, build_fold_addr_expr(unshare_expr(lhs)));
+      gcall *call = fields_captured(TREE_TYPE(lhs))
+                        ? gimple_build_call(build_field_capturer(TREE_TYPE(lhs)), 2, site_cst, addr)
+                        : gimple_build_call(g_hook_write, 3, site_cst, addr, fold_convert(size_type_node, size));
+      gimple_set_location(call, gimple_location(stmt));
+      gsi_insert_after(gsi, call, GSI_NEW_STMT);
+      return;
+    }
+
+    //the call's arguments are plain operands, still valid after it returns
+    tree dst = unshare_expr(gimple_call_arg(stmt, 0));
+    gimple_stmt_iterator after = *gsi;
+    gcall *call;
+    if (len) {
+      tree n = force_gimple_operand_gsi(&after, fold_convert(size_type_node, unshare_expr(len)), true, NULL_TREE,
+                                        false, GSI_CONTINUE_LINKING);
+      call = gimple_build_call(g_hook_write, 3, site_cst, dst, n);
+    } else {
+      call = gimple_build_call(g_hook_write_str, 2, site_cst, dst);
+    }
+    gimple_set_location(call, gimple_location(stmt));
+    gsi_insert_after(&after, call, GSI_CONTINUE_LINKING);
+  }
+
+  /*
+    Remembers that site needs a runtime hook (runtime mode only). See instrument_pending_hooks.
+  */
+  static void queue_hook(hook_kind kind, gimple *stmt, tree lhs, tree arg, uint64_t site, tree old = NULL_TREE) {
+    if (g_mode != MODE_RUNTIME) return;
+    pending_hook h = { kind, stmt, lhs, arg, old, site };
+    g_pending_hooks.push_back(h);
+  }
+
+  //A summarized loop store that still needs its instrumentation.
+  struct pending_range {
+    gimple *stmt;
+    tree lhs;
+    store_range range;
+    uint64_t site;
+  };
+  static std::vector<pending_range> g_pending_ranges;
+
+  static void queue_range(gimple *stmt, tree lhs, const store_range &range, uint64_t site) {
+    if (g_mode != MODE_RUNTIME) return;
+    pending_range p = { stmt, lhs, range, site };
+    g_pending_ranges.push_back(p);
+  }
+
+  /*
+    Instruments every summarized loop store of the function just walked. For each such loop:
+
+        memlog_iv0 = i;  memlog_last = 0;          //new block on the entry edge
+      header:
+        if (i < n) ...
+        *_3 = i;
+        memlog_last = _3;                          //after each summarized store: where it wrote
+        i = i + 1;
+      ...
+        __memlog_range_store(site, memlog_last, stride, (i - memlog_iv0) / step, memlog_iv0);   //new block on the exit edge
+
+    Since the exit is the loop test at the top, and every summarized store (and the increment) runs once per
+    iteration, (i - iv0) / step is how many times each of them ran. A loop left through longjmp or exit() records
+    nothing.
+  */
+  static void instrument_pending_ranges() {
+    struct loop_blocks {
+      basic_block pre = nullptr, done = nullptr;
+      std::map<tree, tree> iv0;  //induction variable -> its copy taken at loop entry
+    };
+    std::map<class loop *, loop_blocks> blocks;
+
+    for (const pending_range &p : g_pending_ranges) {
+      build_hook_decls();
+      const store_range &r = p.range;
+      location_t loc = gimple_location(p.stmt);
+
+      loop_blocks &lb = blocks[r.loop];
+      if (!lb.pre) {
+        const loop_summary &ls = g_loop_summaries[r.loop];
+        lb.pre = split_edge(ls.entry);
+        lb.done = split_edge(ls.exit);
+      }
+      gimple_stmt_iterator pre_gsi = gsi_last_bb(lb.pre);
+
+      tree &iv0 = lb.iv0[r.iv];
+      if (!iv0) {
+        iv0 = create_tmp_var(TREE_TYPE(r.iv), "memlog_iv0");
+        gimple *g = gimple_build_assign(iv0, r.iv);
+        gimple_set_location(g, loc);
+        gsi_insert_after(&pre_gsi, g, GSI_NEW_STMT);
+      }
+
+      //the address the latest iteration wrote (the increment has no address: i is a register variable)
+      tree last = null_pointer_node;
+      if (!r.is_iv_inc) {
+        last = create_tmp_var(ptr_type_node, "memlog_last");
+        gimple *g = gimple_build_assign(last, null_pointer_node);
+        gsi_insert_after(&pre_gsi, g, GSI_NEW_STMT);
+
+        gimple_stmt_iterator gsi = gsi_for_stmt(p.stmt);
+        mark_addressable(p.lhs);
+        tree addr = hook_arg_before(&gsi, fold_convert(ptr_type_node, build_fold_addr_expr(unshare_expr(p.lhs))));
+        g = gimple_build_assign(last, addr);
+        gimple_set_location(g, loc);
+        gsi_insert_after(&gsi, g, GSI_NEW_STMT);
+      }
+
+      //iterations = (i - iv0) / step, all in 64 bits
+      gimple_stmt_iterator done_gsi = gsi_last_bb(lb.done);
+      tree ll = long_long_integer_type_node;
+      tree diff = fold_build2(MINUS_EXPR, ll, fold_convert(ll, r.iv), fold_convert(ll, iv0));
+      tree count = fold_convert(long_long_unsigned_type_node, fold_build2(TRUNC_DIV_EXPR, ll, diff, build_int_cst(ll, r.step)));
+      count = force_gimple_operand_gsi(&done_gsi, count, true, NULL_TREE, false, GSI_CONTINUE_LINKING);
+      tree start = force_gimple_operand_gsi(&done_gsi, fold_convert(ll, iv0), true, NULL_TREE, false, GSI_CONTINUE_LINKING);
+
+      gcall *call = gimple_build_call(g_hook_range, 5, build_int_cst(uint64_type_node, p.site), last,
+                                      build_int_cst(ll, r.stride), count, start);
+      gimple_set_location(call, loc);
+      gsi_insert_after(&done_gsi, call, GSI_CONTINUE_LINKING);
+    }
+
+    g_pending_ranges.clear();
+    g_loop_summaries.clear();
+  }
+
+  /*
+    Inserts the hooks for every site found in the function just walked.
+  */
+  static void instrument_pending_hooks() {
+    for (const pending_hook &h : g_pending_hooks) {
+      //the statement may have moved to another block when an earlier store was instrumented
+      gimple_stmt_iterator gsi = gsi_for_stmt(h.stmt);
+      switch (h.kind) {
+        case HOOK_STORE: instrument_store(&gsi, h.lhs, h.site); break;
+        case HOOK_ALLOC: instrument_alloc(&gsi, h.lhs, h.arg, h.old, h.site); break;
+        case HOOK_FREE:  instrument_free(&gsi, h.arg, h.site); break;
+        case HOOK_WRITE: instrument_write(&gsi, h.lhs, h.arg, h.site); break;
+      }
+    }
+    g_pending_hooks.clear();
+  }
+
+  // ---------------------------
+  // Callee classification
+  // ---------------------------
+
+  /**
+  * NOTE: Classifying callees
+  *
+  * Every call the pass sees is looked up in one table (g_callees, keyed by function name) that says whether the
+  * callee allocates, frees or bulk-writes memory, and which of its arguments hold the size, the pointer and so on.
+  *
+  *   - Functions gcc knows as builtins (malloc, calloc, realloc, aligned_alloc, posix_memalign, strdup, strndup,
+  *     free, memcpy, memset, strcpy, ..., and the __builtin___memcpy_chk forms _FORTIFY_SOURCE turns them into)
+  *     are recognised by their DECL_FUNCTION_CODE, whatever they are called in the source.
+  *   - Everything else goes by name: the same library functions (for -fno-builtin), a few gcc has no builtin for
+  *     (valloc, memalign, reallocarray), and whatever the allocator file declares.
+  *
+  * The answer for each callee is cached by its name's IDENTIFIER_POINTER (gcc keeps one per name for the whole
+  * compilation, and never frees it), so each distinct callee is classified once per compile, not once per call.
+  *
+  * The allocator file (-fplugin-arg-memlog_plugin-allocators=<file>) declares the program's own allocators, one per
+  * line (# comments; argument numbers start at 1, as in gcc's alloc_size attribute):
+  *
+  *   alloc pool_get    size=2 free=pool_put          //void *pool_get(struct pool *, size_t)
+  *   alloc table_new   size=1*2 free=table_free      //size is argument 1 times argument 2, as for calloc
+  *   alloc buf_grow    size=2 ptr=1 free=buf_free    //ptr: the block being resized, as for realloc
+  *   alloc obj_create  size=2 out=1                  //out: the pointer is stored through argument 1
+  *   arena arena_grow  size=2 free=arena_release     //hands out arena chunks (see "ALLOCATOR FAMILIES")
+  *   free  pool_put    ptr=2                         //ptr defaults to 1
+  *
+  * A free= function that isn't declared itself becomes a free taking its pointer in argument 1. A declaration
+  * with the name of a known function replaces the built-in entry.
+  */
+
+  enum callee_role { CALLEE_ALLOC, CALLEE_FREE, CALLEE_WRITE };
+  //how an allocator's size is computed from its arguments
+  enum size_rule { SIZE_ARGS, SIZE_STRING };
+
+  //One table entry. Argument numbers here start at 0; -1 means "none".
+  struct callee_info {
+    callee_role role;
+    std::string name;     //the name events carry ("malloc", "memcpy", ... whatever the call was spelled as)
+    size_rule size_how;   //alloc: SIZE_ARGS (arg size_arg, times arg count_arg if any) or SIZE_STRING
+                          //       (strlen(arg size_arg) + 1, at most arg count_arg + 1 if any: strdup, strndup)
+    int size_arg;         //alloc: see size_how. write: the byte count (-1: up to the source's terminator)
+    int count_arg;        //alloc: see size_how
+    int ptr_arg;          //alloc: the block being resized. free: the pointer freed
+    int out_arg;          //alloc: the new block is stored through this pointer argument instead of returned
+    std::string free_fn;  //alloc: what frees its blocks ("" if unknown)
+    bool arena;           //alloc: an arena chunk
+  };
+
+  static std::unordered_map<std::string, callee_info> g_callees;
+  //verdict cache: gcc-owned callee name pointer -> its entry (null: not interesting)
+  static std::unordered_map<const char *, const callee_info *> g_callee_verdicts;
+
+  static callee_info make_alloc(const char *name, int size_arg, int count_arg = -1, const char *free_fn = "free") {
+    callee_info c = { CALLEE_ALLOC, name, SIZE_ARGS, size_arg, count_arg, -1, -1, free_fn, false };
+    return c;
+  }
+
+  static callee_info make_free(const char *name, int ptr_arg) {
+    callee_info c = { CALLEE_FREE, name, SIZE_ARGS, -1, -1, ptr_arg, -1, "", false };
+    return c;
+  }
+
+  static callee_info make_write(const char *name, int len_arg) {
+    callee_info c = { CALLEE_WRITE, name, SIZE_ARGS, len_arg, -1, -1, -1, "", false };
+    return c;
+  }
+
+  static void add_callee(const callee_info &c) {
+    g_callees[c.name] = c;
+  }
+
+  /*
+    The C library's allocators, frees and block writes.
+  */
+  static void add_default_callees() {
+    add_callee(make_alloc("malloc", 0));
+    add_callee(make_alloc("calloc", 0, 1));
+    callee_info re = make_alloc("realloc", 1);
+    re.ptr_arg = 0;
+    add_callee(re);
+    callee_info rea = make_alloc("reallocarray", 1, 2);
+    rea.ptr_arg = 0;
+    add_callee(rea);
+    add_callee(make_alloc("aligned_alloc", 1));
+    add_callee(make_alloc("memalign", 1));
+    add_callee(make_alloc("valloc", 0));
+    callee_info pm = make_alloc("posix_memalign", 2);
+    pm.out_arg = 0;
+    add_callee(pm);
+    callee_info sd = make_alloc("strdup", 0);
+    sd.size_how = SIZE_STRING;
+    add_callee(sd);
+    callee_info snd = make_alloc("strndup", 0, 1);
+    snd.size_how = SIZE_STRING;
+    add_callee(snd);
+
+    add_callee(make_free("free", 0));
+
+    add_callee(make_write("memcpy", 2));
+    add_callee(make_write("memmove", 2));
+    add_callee(make_write("mempcpy", 2));
+    add_callee(make_write("memset", 2));
+    add_callee(make_write("strncpy", 2));
+    add_callee(make_write("strcpy", -1));
+    add_callee(make_write("stpcpy", -1));
+  }
+
+  /*
+    The table name of a builtin, or nullptr if it isn't one we classify. The _chk forms take the same leading
+    arguments as the plain function (plus the object size at the end).
+  */
+  static const char *builtin_callee_name(built_in_function code) {
+    switch (code) {
+      case BUILT_IN_MALLOC:         return "malloc";
+      case BUILT_IN_CALLOC:         return "calloc";
+      case BUILT_IN_REALLOC:        return "realloc";
+      case BUILT_IN_ALIGNED_ALLOC:  return "aligned_alloc";
+      case BUILT_IN_POSIX_MEMALIGN: return "posix_memalign";
+      case BUILT_IN_STRDUP:         return "strdup";
+      case BUILT_IN_STRNDUP:        return "strndup";
+      case BUILT_IN_FREE:           return "free";
+      case BUILT_IN_MEMCPY:  case BUILT_IN_MEMCPY_CHK:  return "memcpy";
+      case BUILT_IN_MEMMOVE: case BUILT_IN_MEMMOVE_CHK: return "memmove";
+      case BUILT_IN_MEMPCPY: case BUILT_IN_MEMPCPY_CHK: return "mempcpy";
+      case BUILT_IN_MEMSET:  case BUILT_IN_MEMSET_CHK:  return "memset";
+      case BUILT_IN_STRCPY:  case BUILT_IN_STRCPY_CHK:  return "strcpy";
+      case BUILT_IN_STRNCPY: case BUILT_IN_STRNCPY_CHK: return "strncpy";
+      case BUILT_IN_STPCPY:  case BUILT_IN_STPCPY_CHK:  return "stpcpy";
+      default: return nullptr;
+    }
+  }
+
+  /*
+    Looks up the function a call goes to (see the NOTE above).
+
+    return: its table entry, or nullptr if calls to it are not events
+  */
+  static const callee_info *classify_callee(tree callee) {
+    if (!callee || !DECL_NAME(callee)) return nullptr;
+    const char *id = IDENTIFIER_POINTER(DECL_NAME(callee));
+
+    auto hit = g_callee_verdicts.find(id);
+    if (hit != g_callee_verdicts.end()) return hit->second;
+
+    const char *name = id;
+    if (fndecl_built_in_p(callee, BUILT_IN_NORMAL))
+      if (const char *canonical = builtin_callee_name(DECL_FUNCTION_CODE(callee))) name = canonical;
+
+    auto it = g_callees.find(name);
+    const callee_info *info = it != g_callees.end() ? &it->second : nullptr;
+    g_callee_verdicts.emplace(id, info);
+    return info;
+  }
+
+  /*
+    Parses an argument number as written in the allocator file (counting from 1) into *out (counting from 0).
+  */
+  static bool parse_arg_number(const char *s, const char *end, int *out) {
+    char *stop;
+    long n = std::strtol(s, &stop, 10);
+    if (stop != end || n < 1 || n > 64) return false;
+    *out = (int)n - 1;
+    return true;
+  }
+
+  /*
+    Reads allocator declarations from a file (the value of the allocators= plugin argument); the format is in the
+    NOTE above. Bad lines are reported and skipped.
+
+    return: false if the file could not be opened
+  */
+  static bool load_callees(const char *config_path) {
+    FILE *f = std::fopen(config_path, "r");
+    if (!f) return false;
+
+    std::vector<std::string> free_fns;
+    char line[4096];
+    int lineno = 0;
+    while (std::fgets(line, sizeof(line), f)) {
+      lineno++;
+      if (char *hash = std::strchr(line, '#')) *hash = '\0';
+
+      std::vector<std::string> words;
+      for (char *w = std::strtok(line, " \t\r\n"); w; w = std::strtok(nullptr, " \t\r\n")) words.push_back(w);
+      if (words.empty()) continue;
+
+      bool ok = words.size() >= 2;
+      callee_info c;
+      if (ok && (words[0] == "alloc" || words[0] == "arena")) {
+        c = make_alloc(words[1].c_str(), -1, -1, "");
+        c.arena = words[0] == "arena";
+      } else if (ok && words[0] == "free") {
+        c = make_free(words[1].c_str(), 0);
+      } else {
+        ok = false;
+      }
+
+      for (size_t i = 2; ok && i < words.size(); i++) {
+        const std::string &w = words[i];
+        size_t eq = w.find('=');
+        if (eq == std::string::npos) { ok = false; break; }
+        std::string key = w.substr(0, eq);
+        const char *v = w.c_str() + eq + 1, *end = w.c_str() + w.size();
+
+        if (key == "size" && c.role == CALLEE_ALLOC) {
+          const char *star = std::strchr(v, '*');
+          ok = star ? parse_arg_number(v, star, &c.size_arg) && parse_arg_number(star + 1, end, &c.count_arg)
+                    : parse_arg_number(v, end, &c.size_arg);
+        } else if (key == "ptr") {
+          ok = parse_arg_number(v, end, &c.ptr_arg);
+        } else if (key == "out" && c.role == CALLEE_ALLOC) {
+          ok = parse_arg_number(v, end, &c.out_arg);
+        } else if (key == "free" && c.role == CALLEE_ALLOC && *v) {
+          c.free_fn = v;
+          free_fns.push_back(v);
+        } else {
+          ok = false;
+        }
+      }
+      if (ok && c.role == CALLEE_ALLOC && c.size_arg < 0) ok = false;
+
+      if (!ok) {
+        std::fprintf(stderr, "memlog_plugin: %s:%d: ignoring allocator declaration\n", config_path, lineno);
+        continue;
+      }
+      add_callee(c);
+    }
+    std::fclose(f);
+
+    for (const std::string &fn : free_fns)
+      if (!g_callees.count(fn)) add_callee(make_free(fn.c_str(), 0));
+    return true;
+  }
+
+  // ---------------------------
+  // Detection logic
+  // ---------------------------
+
+  //A site found while walking a function, waiting to be logged (see log_found_sites).
+  struct found_site {
+    hook_kind kind;
+    gimple *stmt;
+    tree lhs;            //store: destination. alloc: where the result goes (may be null). write: see pending_hook
+    tree arg;            //alloc: size expression. free: the pointer. write: bytes written (may be null)
+    tree src;            //write: the source, memset's fill value, or an aggregate assignment's right-hand side.
+                         //alloc: the block being resized (the callee's ptr= argument), or null
+    const char *fn_name; //alloc/free: the function called. write: "memcpy", ..., or "aggregate"
+    const callee_info *callee; //calls: the callee's table entry (see classify_callee), otherwise null
+    bool ranged;         //store: summarized for its whole loop (range holds the summary)
+    store_range range;
+    //set by plan_reg_stores (register local stores only):
+    tree reg;            //store: the "reg" local it assigns (see "Escape analysis"), otherwise null
+    bool derived;        //no hook: it happens right before its anchor's record
+    int anchor;          //derived: index of the anchor in g_found_sites, or ANCHOR_EXIT
+    tree from;           //derived: the value is from + add (null: add alone)
+    long long add;
+  };
+  static std::vector<found_site> g_found_sites;
+  static const int ANCHOR_EXIT = -1; //found_site.anchor: the frame's exit hook
+
+  /*
+    This function finds calls to allocators, frees and bulk writes (they are logged afterwards, by log_found_sites).
+
+    Given a gimple statement, it decides:
+      -is this statement a function call? (if so, does the callee table know the function? see classify_callee)
+        -if yes,
+          -for allocations log the allocation size and where the returned pointer goes
+          -for frees log the pointer expression being freed
+          -for memcpy/memset/strcpy-style calls log destination, length and source (see "BULK WRITES")
+
+    params:
+      -stmt (gimple *): a pointer to a gimple statement
+
+      return: void
+  */
+  static void detect_call_if_any(gimple *stmt) {
+    //if stmt is not a function call, return
+    if (!is_gimple_call(stmt)) return;
+
+    //gimple_call_fndecl(stmt) returns a tree for the function being called (if gcc can identify it (a FUNCTION_DECL))
+    //if it is null, it could be a function pointer or something else (*TO DO* research how to deal with function pointers)
+    const callee_info *c = classify_callee(gimple_call_fndecl(stmt));
+    if (!c) return;
+
+    //every argument the entry refers to has to be there (a declaration may not match how the function is called)
+    int nargs = (int)gimple_call_num_args(stmt);
+    if (c->size_arg >= nargs || c->count_arg >= nargs || c->ptr_arg >= nargs || c->out_arg >= nargs) return;
+
+    if (c->role == CALLEE_WRITE) {
+      if (nargs < 2) return;
+      tree len = c->size_arg >= 0 ? gimple_call_arg(stmt, c->size_arg) : NULL_TREE;
+      found_site f = { HOOK_WRITE, stmt, NULL_TREE, len, gimple_call_arg(stmt, 1), c->name.c_str(), c, false,
+                       store_range() };
+      g_found_sites.push_back(f);
+      return;
+    }
+
+    if (c->role == CALLEE_FREE) {
+      //gimple_call_arg(stmt, i) returns a tree representing the ith argument expression
+      found_site f = { HOOK_FREE, stmt, NULL_TREE, gimple_call_arg(stmt, c->ptr_arg), NULL_TREE, c->name.c_str(), c,
+                       false, store_range() };
+      g_found_sites.push_back(f);
+      return;
+    }
+
+    //lhs is the expression that holds the memory address of the memory allocation
+    //Examples:
+    // p = malloc(n);                 → lhs represents p
+    // malloc(n);                     → lhs is NULL_TREE
+    // posix_memalign(&p, 64, n);     → the block is stored through argument 1: lhs represents p
+    tree lhs = gimple_call_lhs(stmt);
+    if (c->out_arg >= 0) {
+      tree out = gimple_call_arg(stmt, c->out_arg);
+      lhs = TREE_CODE(out) == ADDR_EXPR ? TREE_OPERAND(out, 0) : build_simple_mem_ref(out);
+    }
+
+    //size_expr is a gcc tree that represents the expression for “how many bytes requested”
+    // malloc(n) -> arg0
+    // calloc(a,b) -> a*b
+    // strdup(s) -> strlen(s) + 1
+    tree size_expr = gimple_call_arg(stmt, c->size_arg);
+    if (c->size_how == SIZE_STRING) {
+      tree len;
+      if (c->count_arg >= 0)
+        len = build_call_expr(builtin_decl_explicit(BUILT_IN_STRNLEN), 2, size_expr, gimple_call_arg(stmt, c->count_arg));
+      else
+        len = build_call_expr(builtin_decl_explicit(BUILT_IN_STRLEN), 1, size_expr);
+      size_expr = fold_build2(PLUS_EXPR, size_type_node, fold_convert(size_type_node, len), size_one_node);
+    } else if (c->count_arg >= 0) {
+      //fold_build2 is a gcc helper functions that builds a binary expression node and immediately tries to simplify it
+      //fold_build2(MULT_EXPR, size_type_node, a, b) tries to build the expression a*b and simpilfy it if possible
+      //(for example if a=10 and b = 4, calling this function would give us the tree representation of a*b = 40)
+      //If it can’t simplify, it returns a plain tree node (with TREE_CODE MULT_EXPR) representing the multiplication
+      size_expr = fold_build2(MULT_EXPR, size_type_node, fold_convert(size_type_node, size_expr),
+                              fold_convert(size_type_node, gimple_call_arg(stmt, c->count_arg)));
+    }
+
+    //realloc(p, n): the runtime hook is told p too, so the old block ends where the new one starts
+    tree old = c->ptr_arg >= 0 ? gimple_call_arg(stmt, c->ptr_arg) : NULL_TREE;
+
+    //remember it; log_found_sites writes it to the output file
+    found_site f = { HOOK_ALLOC, stmt, lhs, size_expr, old, c->name.c_str(), c, false, store_range() };
+    g_found_sites.push_back(f);
+  }
+
+
+  /*
+
+    This function checks whether a GIMPLE statement performs a write to a variable or memory location
+      -if so, it adds the store to g_found_sites (log_found_sites then logs it as a JSON event)
+    
+    params:
+      -stmt (gimple *): a pointer to a gimple statement (could represent many different things)
+
+    return: void
+  */
+  static void detect_store_if_any(gimple *stmt) {
+    //is_gimple_assign(stmt) comes from gimple.h
+    if (!is_gimple_assign(stmt)) return;
+
+    //gimple_assign_lhs(stmt) returns a tree representing the variable/memory location being written (comes from gimple.h)
+    tree lhs = gimple_assign_lhs(stmt);
+    if (!lhs) return;
 
-    params:
-      -stmt (gimple *): pointer to a gimple struct which represents the specific statement being logged
-      -lhs (tree): a tree node pointer that represents the expression on the left-hand side of the assignment
+    // We include both:
+    // - memory stores (*p, a[i], s->f)
+    // - and local var stores (x = ...)
+
+    //unwrap_ssa(lhs) turns tree node SSA_NAME(x_3) → tree node VAR_DECL(x) (this gets the base name of the variable from the ssa name)
+    //TREE_CODE(unwrap_ssa(lhs) returns the type of the tree node representing the base variable of the ssa expression
+    //At stage=late only definitions of a user variable's value count: a temporary's SSA name (or an artificial
+    //variable in memory) has nothing in the source to point at
+    tree dest = lhs;
+    if (g_stage == STAGE_LATE) {
+      if (TREE_CODE(lhs) == SSA_NAME) dest = ssa_source_var(lhs);
+      else if (DECL_P(lhs)) dest = source_ref(lhs);
+      if (!dest) return;
+    }
+    enum tree_code lhs_code = TREE_CODE(unwrap_ssa(dest));
+
+    //log stores to variables or memory locations that correspond to real program state
+    bool is_interesting =
+        (lhs_code == VAR_DECL) ||  //local/global variable (ex. int x = 5)
+        (lhs_code == PARM_DECL) || //function parameter (ex. void f(int p) { ... p = 3; ...})
+        (lhs_code == MEM_REF) || //generalized memory ref (ex. *(p + offset) = 2)
+        (lhs_code == ARRAY_REF) || //array index (ex. a[i] = 6)
+        (lhs_code == COMPONENT_REF) || //struct field access (ex. s.f = 9 or s->f = 9)
+        (lhs_code == INDIRECT_REF) || //dereference (ex. *p = 4)
+        (lhs_code == TARGET_MEM_REF); //an address ivopts rewrote (stage=late)
+
+    if (!is_interesting) return;
+
+  /*
+    Now, we know:
+      -This is an assignment
+      -It writes to a meaningful memory location
 
-    returns: void
+    We have the full gimple statement (stmt) and the memory location being written to (lhs)
   */
-  static void log_store_site(gimple *stmt, tree lhs) {
-    const char *file; int line, col;
 
-    //get_loc initializes the file, line and col for this expression
-    get_loc(stmt, file, line, col);
+    //a whole struct or array at once (s = t; char buf[8] = "abc"; struct point p = {1, 2};) is one bulk write;
+    //end-of-scope clobbers look like aggregate assignments but write nothing
+    if (AGGREGATE_TYPE_P(TREE_TYPE(lhs))) {
+      if (gimple_clobber_p(stmt) || !gimple_assign_single_p(stmt)) return;
+      found_site f = { HOOK_WRITE, stmt, lhs, TYPE_SIZE_UNIT(TREE_TYPE(lhs)), gimple_assign_rhs1(stmt), "aggregate",
+                       nullptr, false, store_range() };
+      g_found_sites.push_back(f);
+      return;
+    }
 
-    //make a new site number for this event
-    unsigned site = g_site_counter++;
+    //a store in a simple counting loop may be described once for the whole loop
+    found_site f = { HOOK_STORE, stmt, lhs, NULL_TREE, NULL_TREE, nullptr, nullptr, false, store_range() };
+    f.ranged = analyze_store_range(stmt, lhs, f.range);
+    g_found_sites.push_back(f);
+  }
 
-    //bytes is the size of the memory location/variable being written to (-1 if unknown or not static)
-    long long bytes = -1;
+  // ---------------------------
+  // Escape analysis
+  //
+  // Sorts the current function's locals into three classes (the "esc" of their frame site entries):
+  //   LOCAL_REG      a scalar whose address is never taken: only the function's own assignments change it
+  //   LOCAL_ADDR     lives in memory, but its address is only compared or handed to builtins that don't keep it
+  //   LOCAL_ESCAPES  its address may end up anywhere
+  // In runtime mode at stage=early, plan_reg_stores then uses it to leave out the hooks of stores to "reg" locals
+  // whose records another one implies (memlog_format.h, "REGISTER LOCAL STORES").
+  // ---------------------------
 
-    //lhs_j is a JSON string describing where the store writes (also emit_lhs(lhs, bytes) initializes bytes by reference)
-    std::string lhs_j = emit_lhs(lhs, bytes);
+  //Does fun get a frame site (see reserve_frame_site)? Only the user's own functions do.
+  static bool has_frame_site(function *fun) {
+    location_t loc = DECL_SOURCE_LOCATION(fun->decl);
+    return loc != UNKNOWN_LOCATION && LOCATION_FILE(loc) && path_is_user_code(LOCATION_FILE(loc));
+  }
 
-    //create string buffer to write output to
-    std::ostringstream oss;
-    oss << "{"
-        << "\"v\":1," //log format version (right now this is always 1, but possible to extend this in the future to add multiple versions)
-        << "\"site\":" << site << "," //unique site id
-        << "\"kind\":\"store\"," //type of event (in this case, memory store)
+  enum local_class { LOCAL_REG, LOCAL_ADDR, LOCAL_ESCAPES };
+  struct local_info {
+    local_class cls;
+    bool untracked; //"reg": some assignment to it is neither recorded nor derived, so its value can't be followed
+  };
+  //parameters and automatic variables of the current function
+  static std::unordered_map<tree, local_info> g_locals;
 
-        //gives us the location this memory store happened at in our source code
-        << "\"loc\":{"
-          << "\"file\":\"" << json_escape(file) << "\","
-          << "\"line\":" << line << ","
-          << "\"col\":" << col
-        << "},"
+  /*
+    Can the address of a local used by stmt stay in the function? Only if stmt compares it, or passes it to a
+    builtin that reads or writes through it without keeping it (and, for the ones returning their destination,
+    drops the result).
+  */
+  static bool address_stays_local(gimple *stmt) {
+    if (gimple_code(stmt) == GIMPLE_COND) return true;
+    if (is_gimple_assign(stmt)) return TREE_CODE_CLASS(gimple_assign_rhs_code(stmt)) == tcc_comparison;
+    if (!gimple_call_builtin_p(stmt, BUILT_IN_NORMAL)) return false;
+
+    switch (DECL_FUNCTION_CODE(gimple_call_fndecl(stmt))) {
+      case BUILT_IN_MEMSET: case BUILT_IN_MEMCPY: case BUILT_IN_MEMMOVE:
+      case BUILT_IN_STRCPY: case BUILT_IN_STRNCPY: case BUILT_IN_STRCAT: case BUILT_IN_STRNCAT:
+        return !gimple_call_lhs(stmt);
+      case BUILT_IN_MEMCMP: case BUILT_IN_BCMP: case BUILT_IN_STRCMP: case BUILT_IN_STRNCMP:
+      case BUILT_IN_STRLEN: case BUILT_IN_BZERO:
+        return true;
+      default:
+        return false;
+    }
+  }
 
-        //current_func_name() returns a const char * of the name of the function our memory store happened in
-        << "\"func\":\"" << json_escape(current_func_name()) << "\"," 
-        << "\"store\":{"
-          << "\"lhs\":" << lhs_j << ","; //lhs_j is a json string representing the lefthand side of the assignment
+  //walk_stmt_load_store_addr_ops callback: stmt takes the address of op
+  static bool note_address_use(gimple *stmt, tree op, tree, void *) {
+    tree base = get_base_address(op);
+    auto it = base ? g_locals.find(base) : g_locals.end();
+    if (it == g_locals.end()) return false;
+    if (!address_stays_local(stmt)) it->second.cls = LOCAL_ESCAPES;
+    else if (it->second.cls == LOCAL_REG) it->second.cls = LOCAL_ADDR;
+    return false;
+  }
 
-    if (bytes >= 0) oss << "\"bytes\":" << bytes; //log size of memory/variable being written to if it is known
-    else oss << "\"bytes\":null";
-    oss << "}"
-        << "}";
+  static void mark_untracked(tree var) {
+    auto it = var && DECL_P(var) ? g_locals.find(var) : g_locals.end();
+    if (it != g_locals.end()) it->second.untracked = true;
+  }
 
-    //oss.str() returns the final JSON string, emit_jsonl_line prints it with a newline to file/stderr
-    emit_jsonl_line(oss.str());
+  /*
+    Fills g_locals for fun. A scalar the front end never saw the address of starts out "reg", anything else
+    "addr"; every address of a local the body computes then either leaves it at that or makes it "escapes".
+    Also marks the "reg" locals assigned where no store site is (calls, asm outputs, code outside the user's).
+  */
+  static void classify_locals(function *fun) {
+    g_locals.clear();
+    auto add = [](tree d) {
+      local_info li;
+      li.cls = is_gimple_reg_type(TREE_TYPE(d)) && !TREE_ADDRESSABLE(d) && !TREE_THIS_VOLATILE(d) ? LOCAL_REG : LOCAL_ADDR;
+      //a parameter's first value comes from the caller, unrecorded
+      li.untracked = TREE_CODE(d) == PARM_DECL;
+      g_locals[d] = li;
+    };
+    for (tree p = DECL_ARGUMENTS(fun->decl); p; p = DECL_CHAIN(p)) add(p);
+    unsigned ix;
+    tree var;
+    FOR_EACH_LOCAL_DECL(fun, ix, var)
+      if (VAR_P(var) && !TREE_STATIC(var) && !DECL_EXTERNAL(var)) add(var);
+
+    basic_block bb;
+    FOR_EACH_BB_FN(bb, fun) {
+      for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+        gimple *stmt = gsi_stmt(gsi);
+        if (is_gimple_debug(stmt)) continue;
+        walk_stmt_load_store_addr_ops(stmt, nullptr, nullptr, nullptr, note_address_use);
+
+        if (is_gimple_call(stmt) || (is_gimple_assign(stmt) && !stmt_is_user_code(stmt)))
+          mark_untracked(gimple_get_lhs(stmt));
+        if (gasm *asm_stmt = dyn_cast<gasm *>(stmt))
+          for (unsigned i = 0; i < gimple_asm_noutputs(asm_stmt); i++)
+            mark_untracked(TREE_VALUE(gimple_asm_output_op(asm_stmt, i)));
+      }
+    }
   }
 
+  //A "reg" local a frame site lists: the function's own, named, automatic variables and parameters.
+  static bool frame_reg_local(tree d) {
+    if (!d || (!VAR_P(d) && TREE_CODE(d) != PARM_DECL)) return false;
+    if (DECL_CONTEXT(d) != current_function_decl || DECL_ARTIFICIAL(d) || !DECL_NAME(d)) return false;
+    auto it = g_locals.find(d);
+    return it != g_locals.end() && it->second.cls == LOCAL_REG;
+  }
 
   /*
-    This function logs a memory allocation as a JSONL object. 
-    It records where the allocation happens, the size of the allocation, and the variable the memory location is stored in
+    Is the value the store f writes (to the "reg" local f.reg) known from the replayed trace alone: a constant, or
+    a followed "reg" local plus a constant? Sets f.from and f.add if so.
+  */
+  static bool derivable_value(found_site &f) {
+    gimple *stmt = f.stmt;
+    tree ty = TREE_TYPE(f.lhs);
+    long long bytes = type_size_bytes(ty);
+    if (bytes <= 0 || bytes > 8) return false;
+    tree rhs = gimple_assign_rhs1(stmt);
+
+    if (gimple_assign_single_p(stmt) && CONSTANT_CLASS_P(rhs)) {
+      tree v = store_value_u64(rhs);
+      if (v) v = fold(v);
+      if (!v || TREE_CODE(v) != INTEGER_CST) return false;
+      f.from = NULL_TREE;
+      f.add = (long long)TREE_INT_CST_LOW(v);
+      return true;
+    }
 
-    params:
-      -stmt (gimple *): pointer to a gimple struct representing the gimple call statement for malloc/calloc/realloc
-      -fn_name (const char *): C string naming the allocator function, e.g. "malloc", "calloc", "realloc"
-      -lhs (tree): a tree node pointer representing the left-hand side of the call, i.e. the pointer to the allocated memory location
-      -size_expr_j: a tree node pointer representing the size expression of the memory assignment call (ex. n for malloc(n), a*b for calloc(a,b))
+    //relative values wrap like the local's type does only if all of its bits are value bits
+    if (!(INTEGRAL_TYPE_P(ty) || POINTER_TYPE_P(ty)) || TYPE_PRECISION(ty) != bytes * 8) return false;
+    enum tree_code code = gimple_assign_rhs_code(stmt);
+    long long add = 0;
+    if (code == PLUS_EXPR || code == POINTER_PLUS_EXPR || code == MINUS_EXPR) {
+      tree c = gimple_assign_rhs2(stmt);
+      if (TREE_CODE(c) != INTEGER_CST) return false;
+      unsigned long long u = (unsigned long long)TREE_INT_CST_LOW(c);
+      add = (long long)(code == MINUS_EXPR ? 0ull - u : u);
+    } else if (!gimple_assign_single_p(stmt)) {
+      return false;
+    }
+
+    if (!frame_reg_local(rhs) || TREE_CODE(rhs) != VAR_DECL || g_locals[rhs].untracked) return false;
+    if (TYPE_PRECISION(TREE_TYPE(rhs)) != TYPE_PRECISION(ty)) return false;
+    f.from = rhs;
+    f.add = add;
+    return true;
+  }
+
+  /*
+    Decides which of the current function's store sites assign "reg" locals (found_site.reg), and which of those
+    need no hook of their own (found_site.derived): a derivable value, and a later record in the same block -- the
+    next hooked store, or the frame's exit hook before a return -- with no call, asm or other record in between.
+    Runtime mode at stage=early only, for functions that get a frame site (the locals' places are in it).
+    Must run before log_found_sites.
+  */
+  static void plan_reg_stores(function *fun) {
+    if (g_mode != MODE_RUNTIME || g_stage != STAGE_EARLY || !has_frame_site(fun)) return;
+
+    std::unordered_map<gimple *, int> site_of_stmt;
+    for (size_t i = 0; i < g_found_sites.size(); i++) {
+      found_site &f = g_found_sites[i];
+      site_of_stmt[f.stmt] = (int)i;
+      if (f.kind != HOOK_STORE || !frame_reg_local(f.lhs)) continue;
+      //a local the trace won't show every assignment of can't be derived from
+      if (f.ranged || !store_hookable(f.stmt, f.lhs)) mark_untracked(f.lhs);
+      else f.reg = f.lhs;
+    }
+    if (!g_derive_stores) return;
+
+    basic_block bb;
+    FOR_EACH_BB_FN(bb, fun) {
+      //backwards, so the anchor (if any) is known by the time a store is reached
+      int anchor = -2;
+      gimple_stmt_iterator gsi = gsi_last_bb(bb);
+      if (!gsi_end_p(gsi) && gimple_code(gsi_stmt(gsi)) == GIMPLE_RETURN) anchor = ANCHOR_EXIT;
+      for (; !gsi_end_p(gsi); gsi_prev(&gsi)) {
+        gimple *stmt = gsi_stmt(gsi);
+        if (is_gimple_call(stmt) || gimple_code(stmt) == GIMPLE_ASM) {
+          anchor = -2;
+          continue;
+        }
+        auto it = site_of_stmt.find(stmt);
+        if (it == site_of_stmt.end()) continue;
+        found_site &f = g_found_sites[it->second];
+
+        if (f.kind != HOOK_STORE) {
+          anchor = -2;
+        } else if (f.reg) {
+          if (anchor != -2 && derivable_value(f)) {
+            f.derived = true;
+            f.anchor = anchor;
+          } else {
+            anchor = it->second;
+          }
+        } else if (!f.ranged && store_hookable(f.stmt, f.lhs)) {
+          anchor = it->second;
+        }
+      }
+    }
+  }
+
+  //A store to a "reg" local, kept for the function's frame site.
+  struct reg_store {
+    uint64_t site;
+    int local;       //DECL_UID of the local
+    bool derived;
+    uint64_t anchor; //derived: the anchor's site id (0: the frame's exit)
+    int from;        //derived: DECL_UID of the local the value is based on (-1: none)
+    long long add;
+  };
+  //the current function's, from log_found_sites until reserve_frame_site hands them to its frame
+  static std::vector<reg_store> g_reg_stores;
+
+
+  // ---------------------------
+  // Points-to
+  //
+  // Which of the current function's alloc sites each pointer may point into (memlog_format.h, "POINTS-TO").
+  // Every variable the function has to itself -- its SSA names, and the locals whose address doesn't escape --
+  // gets one set for the whole function, grown from every assignment to it until nothing changes. Other memory is
+  // not modelled: a pointer loaded from it, like one from a parameter, a global or a call, may point anywhere.
+  // ---------------------------
+
+  struct pt_set {
+    std::vector<int> allocs; //alloc sites (indices into g_found_sites), sorted
+    bool other = false;      //may point at something that is not a heap block: a local, a global, a literal
+    bool unknown = false;    //may point anywhere
+  };
+  static std::unordered_map<tree, pt_set> g_pts;
+
+  //Is v a variable whose every assignment is in the function's body?
+  static bool pt_tracked(tree v) {
+    if (TREE_CODE(v) == SSA_NAME) return true;
+    auto it = g_locals.find(v);
+    return it != g_locals.end() && it->second.cls != LOCAL_ESCAPES;
+  }
+
+  //The tracked variable an assignment to lhs changes (a whole local, or part of one), or null.
+  static tree pt_target(tree lhs) {
+    if (TREE_CODE(lhs) == SSA_NAME) return lhs;
+    tree base = get_base_address(lhs);
+    return base && DECL_P(base) && pt_tracked(base) ? base : NULL_TREE;
+  }
+
+  //dst |= src; true if dst changed
+  static bool pt_join(pt_set &dst, const pt_set &src) {
+    bool changed = (src.other && !dst.other) || (src.unknown && !dst.unknown);
+    dst.other |= src.other;
+    dst.unknown |= src.unknown;
+    for (int a : src.allocs) {
+      auto it = std::lower_bound(dst.allocs.begin(), dst.allocs.end(), a);
+      if (it != dst.allocs.end() && *it == a) continue;
+      dst.allocs.insert(it, a);
+      changed = true;
+    }
+    return changed;
+  }
+
+  //Adds what the value of op may point to to out.
+  static void pt_of_operand(tree op, pt_set &out) {
+    switch (TREE_CODE(op)) {
+      case SSA_NAME:
+      case VAR_DECL:
+      case PARM_DECL:
+      case RESULT_DECL: {
+        if (!pt_tracked(op)) {
+          out.unknown = true;
+          return;
+        }
+        auto it = g_pts.find(op);
+        if (it != g_pts.end()) pt_join(out, it->second);
+        return;
+      }
+      case INTEGER_CST:
+        //null points nowhere; any other number at something that is no block of ours
+        if (!integer_zerop(op)) out.other = true;
+        return;
+      case ADDR_EXPR: {
+        //&p->f, &p[i] point into whatever p does; &x at x
+        tree base = get_base_address(TREE_OPERAND(op, 0));
+        if (base && (TREE_CODE(base) == MEM_REF || TREE_CODE(base) == TARGET_MEM_REF)) pt_of_operand(TREE_OPERAND(base, 0), out);
+        else out.other = true;
+        return;
+      }
+      case CONSTRUCTOR: {
+        unsigned i;
+        tree v;
+        FOR_EACH_CONSTRUCTOR_VALUE(CONSTRUCTOR_ELTS(op), i, v) pt_of_operand(v, out);
+        return;
+      }
+      default: {
+        if (CONSTANT_CLASS_P(op)) return;
+        //a load: from (part of) one of our locals, or from memory we know nothing about
+        tree base = get_base_address(op);
+        if (base && DECL_P(base) && pt_tracked(base)) pt_of_operand(base, out);
+        else out.unknown = true;
+        return;
+      }
+    }
+  }
+
+  //Does the builtin call stmt write through its first argument (and return it)?
+  static bool builtin_writes_dest(gimple *stmt) {
+    if (!gimple_call_builtin_p(stmt, BUILT_IN_NORMAL)) return false;
+    switch (DECL_FUNCTION_CODE(gimple_call_fndecl(stmt))) {
+      case BUILT_IN_MEMSET: case BUILT_IN_MEMCPY: case BUILT_IN_MEMMOVE: case BUILT_IN_BZERO:
+      case BUILT_IN_STRCPY: case BUILT_IN_STRNCPY: case BUILT_IN_STRCAT: case BUILT_IN_STRNCAT:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  /*
+    Grows the sets stmt assigns to. alloc is the alloc site stmt is (index into g_found_sites), or -1.
+
+    return: true if any set changed
+  */
+  static bool pt_visit(gimple *stmt, int alloc) {
+    pt_set in;
+    tree target = NULL_TREE;
+    bool changed = false;
+
+    switch (gimple_code(stmt)) {
+      case GIMPLE_ASSIGN:
+        target = pt_target(gimple_assign_lhs(stmt));
+        if (!target || TREE_CODE_CLASS(gimple_assign_rhs_code(stmt)) == tcc_comparison) return false;
+        if (gimple_assign_single_p(stmt) || CONVERT_EXPR_CODE_P(gimple_assign_rhs_code(stmt))) {
+          //a copy, a load or a cast
+          pt_of_operand(gimple_assign_rhs1(stmt), in);
+          break;
+        }
+        //otherwise the result points where its pointer operands do (p + n, cond ? p : q)
+        for (unsigned i = 1; i < gimple_num_ops(stmt); i++) {
+          tree op = gimple_op(stmt, i);
+          if (op && POINTER_TYPE_P(TREE_TYPE(op))) pt_of_operand(op, in);
+        }
+        break;
+
+      case GIMPLE_PHI: {
+        gphi *phi = as_a<gphi *>(stmt);
+        target = gimple_phi_result(phi);
+        if (virtual_operand_p(target)) return false;
+        for (unsigned i = 0; i < gimple_phi_num_args(phi); i++) pt_of_operand(gimple_phi_arg_def(phi, i), in);
+        break;
+      }
+
+      case GIMPLE_CALL: {
+        tree alloc_target = NULL_TREE;
+        if (alloc >= 0 && g_found_sites[alloc].lhs) {
+          alloc_target = pt_target(g_found_sites[alloc].lhs);
+          if (alloc_target) {
+            pt_set block;
+            block.allocs.push_back(alloc);
+            changed |= pt_join(g_pts[alloc_target], block);
+          }
+        }
+        //memcpy(&x, ...) and the like are the only calls that can write a tracked local (see address_stays_local)
+        if (builtin_writes_dest(stmt) && TREE_CODE(gimple_call_arg(stmt, 0)) == ADDR_EXPR) {
+          tree written = pt_target(TREE_OPERAND(gimple_call_arg(stmt, 0), 0));
+          bool zeroes = gimple_call_builtin_p(stmt, BUILT_IN_BZERO) ||
+                        (gimple_call_builtin_p(stmt, BUILT_IN_MEMSET) && integer_zerop(gimple_call_arg(stmt, 1)));
+          if (written && !zeroes) {
+            pt_set any;
+            any.unknown = true;
+            changed |= pt_join(g_pts[written], any);
+          }
+        }
+        tree lhs = gimple_call_lhs(stmt);
+        target = lhs ? pt_target(lhs) : NULL_TREE;
+        if (!target || target == alloc_target) return changed;
+        if (builtin_writes_dest(stmt) && !gimple_call_builtin_p(stmt, BUILT_IN_BZERO)) pt_of_operand(gimple_call_arg(stmt, 0), in);
+        else in.unknown = true;
+        break;
+      }
+
+      case GIMPLE_ASM: {
+        gasm *asm_stmt = as_a<gasm *>(stmt);
+        pt_set any;
+        any.unknown = true;
+        for (unsigned i = 0; i < gimple_asm_noutputs(asm_stmt); i++)
+          if (tree t = pt_target(TREE_VALUE(gimple_asm_output_op(asm_stmt, i)))) changed |= pt_join(g_pts[t], any);
+        return changed;
+      }
+
+      default:
+        return false;
+    }
+    return pt_join(g_pts[target], in) || changed;
+  }
+
+  /*
+    Fills g_pts for fun, from every statement of its body (the user's or not). Needs g_locals and g_found_sites.
+  */
+  static void compute_points_to(function *fun) {
+    g_pts.clear();
+    std::unordered_map<gimple *, int> allocs;
+    for (size_t i = 0; i < g_found_sites.size(); i++)
+      if (g_found_sites[i].kind == HOOK_ALLOC) allocs[g_found_sites[i].stmt] = (int)i;
+
+    //parameters come from the caller
+    pt_set any;
+    any.unknown = true;
+    for (tree p = DECL_ARGUMENTS(fun->decl); p; p = DECL_CHAIN(p)) {
+      g_pts[p] = any;
+      if (gimple_in_ssa_p(fun))
+        if (tree d = ssa_default_def(fun, p)) g_pts[d] = any;
+    }
+
+    std::vector<std::pair<gimple *, int>> stmts;
+    basic_block bb;
+    FOR_EACH_BB_FN(bb, fun) {
+      for (gphi_iterator gsi = gsi_start_phis(bb); !gsi_end_p(gsi); gsi_next(&gsi)) stmts.emplace_back(gsi.phi(), -1);
+      for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+        gimple *stmt = gsi_stmt(gsi);
+        if (is_gimple_debug(stmt)) continue;
+        auto it = allocs.find(stmt);
+        stmts.emplace_back(stmt, it != allocs.end() ? it->second : -1);
+      }
+    }
+    //the sets only ever grow, and are bounded, so this ends
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (const auto &s : stmts) changed |= pt_visit(s.first, s.second);
+    }
+  }
+
+  /*
+    What the store or write site f writes through may point to, with the alloc sites as site ids (ids, by index
+    into g_found_sites).
+
+    return: false if it writes a variable of its own, or through a pointer that may point anywhere
+  */
+  static bool site_points_to(const found_site &f, const std::vector<uint64_t> &ids, site_pt &out) {
+    if (f.kind != HOOK_STORE && f.kind != HOOK_WRITE) return false;
+    tree ptr;
+    if (f.kind == HOOK_WRITE && !f.lhs) {
+      ptr = gimple_call_arg(f.stmt, 0);
+      if (TREE_CODE(ptr) == ADDR_EXPR) {
+        tree base = get_base_address(TREE_OPERAND(ptr, 0));
+        if (!base || (TREE_CODE(base) != MEM_REF && TREE_CODE(base) != TARGET_MEM_REF)) return false;
+      }
+    } else {
+      tree base = get_base_address(f.lhs);
+      if (!base || (TREE_CODE(base) != MEM_REF && TREE_CODE(base) != TARGET_MEM_REF)) return false;
+      ptr = TREE_OPERAND(base, 0);
+    }
+
+    pt_set s;
+    pt_of_operand(ptr, s);
+    if (s.unknown) return false;
+    out.allocs.clear();
+    for (int a : s.allocs) out.allocs.push_back(ids[a]);
+    out.definite = s.allocs.size() == 1 && !s.other;
+    return true;
+  }
+
+  //Set while the current function's records are being replayed from the output cache: its sites only get their ids
+  //(and hooks) back here, nothing is serialized again.
+  static bool g_cache_replaying = false;
+  static void cache_capture_event(uint64_t site);
+
+  /*
+    Logs every site the classification walk found in the current function, in the order it found them,
+    and queues their runtime hooks.
+  */
+  static void log_found_sites() {
+    //every site's number first: a store may point into a block whose alloc site comes after it
+    std::vector<uint64_t> ids;
+    ids.reserve(g_found_sites.size());
+    for (size_t i = 0; i < g_found_sites.size(); i++) ids.push_back(next_site_id());
+
+    site_pt pt;
+    for (size_t i = 0; i < g_found_sites.size(); i++) {
+      const found_site &f = g_found_sites[i];
+      uint64_t site = ids[i];
+      const site_pt *known = !g_cache_replaying && site_points_to(f, ids, pt) ? &pt : nullptr;
+      switch (f.kind) {
+        case HOOK_ALLOC:
+          if (!g_cache_replaying)
+            log_alloc_site(site, f.stmt, f.fn_name, f.lhs, f.arg, f.callee->free_fn.c_str(), f.callee->arena);
+          queue_hook(HOOK_ALLOC, f.stmt, f.lhs, f.arg, site, f.src);
+          g_stats.allocs++;
+          break;
+
+        case HOOK_FREE:
+          if (!g_cache_replaying) log_free_site(site, f.stmt, f.fn_name, f.arg);
+          queue_hook(HOOK_FREE, f.stmt, NULL_TREE, f.arg, site);
+          g_stats.frees++;
+          break;
+
+        case HOOK_WRITE:
+          if (!g_cache_replaying) log_write_site(site, f.stmt, f.fn_name, f.lhs, f.arg, f.src, known);
+          queue_hook(HOOK_WRITE, f.stmt, f.lhs, f.arg, site);
+          g_stats.writes++;
+          break;
+
+        case HOOK_STORE:
+          //log_store_site logs the event to the output file
+          if (!g_cache_replaying) log_store_site(site, f.stmt, f.lhs, f.ranged ? &f.range : nullptr, known);
+
+          //runtime mode: record the store as it happens (or, for a summarized store, once when its loop finishes)
+          //(a derived store has no hook at all: replay puts it back in front of its anchor's record)
+          if (f.ranged) {
+            queue_range(f.stmt, f.lhs, f.range, site);
+            g_stats.range_stores++;
+          } else {
+            if (f.derived) g_stats.derived++;
+            else queue_hook(HOOK_STORE, f.stmt, f.lhs, NULL_TREE, site);
+            g_stats.stores++;
+          }
+          break;
+      }
+      cache_capture_event(site);
+    }
+
+    //the frame site says which local each "reg" store assigns (see plan_reg_stores)
+    for (size_t i = 0; i < g_found_sites.size(); i++) {
+      const found_site &f = g_found_sites[i];
+      if (!f.reg) continue;
+      reg_store r = { ids[i], (int)DECL_UID(f.reg), f.derived, 0, -1, 0 };
+      if (f.derived) {
+        if (f.anchor != ANCHOR_EXIT) r.anchor = ids[f.anchor];
+        if (f.from) r.from = (int)DECL_UID(f.from);
+        r.add = f.add;
+      }
+      g_reg_stores.push_back(r);
+    }
+    g_found_sites.clear();
+  }
+
+
+  // ---------------------------
+  // Frames
+  //
+  // One "frame" site per function (layout and meaning in memlog_format.h, "FRAMES"). memlog_pass reserves its
+  // id and, in runtime mode, inserts the entry/exit hooks; memlog_frame_pass writes it once register allocation
+  // has given the locals their stack slots.
+  // ---------------------------
+
+  struct pending_frame {
+    uint64_t site;
+    unsigned fid; //the function's header record (JSONL)
+    std::unordered_map<int, local_class> esc; //what classify_locals found, by DECL_UID of the local
+    std::vector<reg_store> reg_stores;        //anchor 0 resolved to site
+  };
+  //frame sites reserved by memlog_pass, by DECL_UID of their function, until memlog_frame_pass writes them
+  static std::unordered_map<int, pending_frame> g_pending_frames;
+
+  /*
+    Gives the function being walked its frame site (user code only), making sure its header record exists.
+
+    return: the site id, or 0 if the function gets no frame site
+  */
+  static uint64_t reserve_frame_site(function *fun) {
+    if (!has_frame_site(fun)) return 0;
+
+    //the frame site refers to the header by fid, even if the function has no other events
+    if (g_format == FORMAT_JSONL && !g_func.header_done) emit_func_header();
+
+    pending_frame &pf = g_pending_frames[DECL_UID(fun->decl)];
+    pf.site = g_reuse_frame ? MEMLOG_SITE_ID(g_tu_id, g_reuse_frame) : next_site_id();
+    pf.fid = g_func.fid;
+    pf.esc.clear();
+    for (const auto &l : g_locals) pf.esc[DECL_UID(l.first)] = l.second.cls;
+    pf.reg_stores.swap(g_reg_stores);
+    for (reg_store &r : pf.reg_stores)
+      if (r.derived && !r.anchor) r.anchor = pf.site;
+    return pf.site;
+  }
+
+  /*
+    Inserts __memlog_enter(site, frame) at the start of the function and __memlog_exit(site, frame) before each of
+    its returns, where frame = __builtin_frame_address(0) is computed once, on entry.
+  */
+  static void instrument_frame(function *fun, uint64_t site) {
+    build_hook_decls();
+    tree site_cst = build_int_cst(uint64_type_node, site);
+    location_t loc = DECL_SOURCE_LOCATION(fun->decl);
+
+    //a block of its own, so that a loop back to the function's first statement does not enter it again
+    basic_block entry = split_edge(single_succ_edge(ENTRY_BLOCK_PTR_FOR_FN(fun)));
+    gimple_stmt_iterator gsi = gsi_last_bb(entry);
+
+    tree frame = new_temp(ptr_type_node, "memlog_frame");
+    gcall *g = gimple_build_call(builtin_decl_explicit(BUILT_IN_FRAME_ADDRESS), 1, build_int_cst(unsigned_type_node, 0));
+    gimple_call_set_lhs(g, frame);
+    gimple_set_location(g, loc);
+    gsi_insert_after(&gsi, g, GSI_NEW_STMT);
+    g = gimple_build_call(g_hook_enter, 2, site_cst, frame);
+    gimple_set_location(g, loc);
+    gsi_insert_after(&gsi, g, GSI_NEW_STMT);
+
+    //every way out that returns (calls to noreturn functions have no edge to the exit block)
+    edge e;
+    edge_iterator ei;
+    FOR_EACH_EDGE(e, ei, EXIT_BLOCK_PTR_FOR_FN(fun)->preds) {
+      gimple_stmt_iterator ret = gsi_last_bb(e->src);
+      if (gsi_end_p(ret) || gimple_code(gsi_stmt(ret)) != GIMPLE_RETURN) continue;
+      g = gimple_build_call(g_hook_exit, 2, site_cst, frame);
+      gimple_set_location(g, gimple_location(gsi_stmt(ret)));
+      gsi_insert_before(&ret, g, GSI_SAME_STMT);
+    }
+  }
+
+  //One row of a frame site's locals table.
+  struct frame_local {
+    const char *name;
+    bool param;
+    bool has_offset;
+    long long offset; //from the frame base (valid if has_offset)
+    long long size;   //-1: not a constant
+    tree inl;         //the inlined function it belongs to (NULL_TREE: the frame's own function)
+    int uid;          //DECL_UID of the variable
+    uint32_t type;    //its type (index in g_types)
+  };
+
+  /*
+    Where var's stack slot is, relative to the hard frame pointer (what __builtin_frame_address(0) returns).
+    Only meaningful after register allocation: DECL_RTL is then frame pointer + constant, once the soft frame
+    pointer is eliminated the way the debug info does it.
+
+    return: false if var has no such slot (no RTL yet, kept in a register, or addressed some other way)
+  */
+  static bool frame_offset(tree var, long long &offset) {
+    rtx r = DECL_RTL_IF_SET(var);
+    if (!r || !MEM_P(r)) return false;
+
+    rtx addr = ira_use_lra_p ? lra_eliminate_regs(XEXP(r, 0), VOIDmode, NULL_RTX)
+                             : eliminate_regs(XEXP(r, 0), VOIDmode, NULL_RTX);
+    poly_int64 off;
+    rtx base = strip_offset(addr, &off);
+    HOST_WIDE_INT c;
+    if (!REG_P(base) || REGNO(base) != HARD_FRAME_POINTER_REGNUM || !off.is_constant(&c)) return false;
+    offset = (long long)c;
+    return true;
+  }
+
+  static void add_frame_local(std::vector<frame_local> &out, tree var, bool param, tree inl = NULL_TREE) {
+    frame_local l;
+    l.name = decl_name(var);
+    if (!*l.name) l.name = "?";
+    l.param = param;
+    l.inl = inl;
+    l.uid = (int)DECL_UID(var);
+    l.has_offset = frame_offset(var, l.offset);
+    tree size = DECL_SIZE_UNIT(var);
+    l.size = size && tree_fits_shwi_p(size) ? (long long)tree_to_shwi(size) : -1;
+    l.type = type_index(TREE_TYPE(var));
+    out.push_back(l);
+  }
+
+  /*
+    Adds the user's variables of block, its siblings and all of their sub-blocks (the BLOCK tree outlives the
+    function's GIMPLE body; it is what the debug info is written from). Below the outermost scope of an inlined
+    call (stage=late) they belong to the inlined function, and the copies of its parameters count as parameters.
+  */
+  static void collect_block_locals(tree block, std::vector<frame_local> &out, tree inl = NULL_TREE) {
+    for (; block; block = BLOCK_CHAIN(block)) {
+      tree owner = inl;
+      if (tree fn = inlined_fn_of_block(block)) owner = fn;
+      for (tree v = BLOCK_VARS(block); v; v = DECL_CHAIN(v)) {
+        if (!VAR_P(v) || TREE_STATIC(v) || DECL_EXTERNAL(v) || DECL_ARTIFICIAL(v) || !DECL_NAME(v)) continue;
+        tree origin = DECL_ABSTRACT_ORIGIN(v);
+        add_frame_local(out, v, owner && origin && TREE_CODE(origin) == PARM_DECL, owner);
+      }
+      collect_block_locals(BLOCK_SUBBLOCKS(block), out, owner);
+    }
+  }
+
+  /*
+    Writes the frame site of the function being compiled (current_function_decl), reserved earlier by
+    reserve_frame_site. Its location is spelled out: the function's running position belongs to memlog_pass.
+  */
+  static void log_frame_site(const pending_frame &pf) {
+    tree fn = current_function_decl;
+    location_t loc = DECL_SOURCE_LOCATION(fn);
+    const char *file = LOCATION_FILE(loc);
+    int line = LOCATION_LINE(loc), col = LOCATION_COLUMN(loc);
+
+    //parameters first, then every block's locals
+    std::vector<frame_local> locals;
+    for (tree p = DECL_ARGUMENTS(fn); p; p = DECL_CHAIN(p)) add_frame_local(locals, p, true);
+    collect_block_locals(DECL_INITIAL(fn), locals);
+    g_stats.frames++;
+
+    //the "esc" of each local, and where the register local stores' locals are in the table
+    std::unordered_map<int, uint32_t> index;
+    std::vector<int> esc(locals.size(), -1);
+    for (size_t i = 0; i < locals.size(); i++) {
+      index[locals[i].uid] = (uint32_t)i;
+      auto it = pf.esc.find(locals[i].uid);
+      if (it != pf.esc.end() && !locals[i].inl) esc[i] = it->second;
+    }
+    static const char *const esc_names[] = { "reg", "addr", "escapes" };
+    static const uint32_t esc_flags[] = { MEMLOG_LOCAL_F_REG, MEMLOG_LOCAL_F_ADDR, MEMLOG_LOCAL_F_ESCAPES };
+    //a store whose local didn't make it into the table (it had no name after all) is left out
+    auto local_of = [&](int uid, uint32_t &out) {
+      auto it = index.find(uid);
+      if (it == index.end()) return false;
+      out = it->second;
+      return true;
+    };
+
+    if (g_format == FORMAT_BIN) {
+      uint32_t local_site = bin_new_site(pf.site, MEMLOG_SITE_FRAME, file, line, col).site;
+      for (const frame_local &l : locals) {
+        memlog_bin_local bl;
+        std::memset(&bl, 0, sizeof(bl));
+        bl.site = local_site;
+        bl.name = g_bin_idents.intern_gcc(l.name);
+        bl.flags = l.param ? MEMLOG_LOCAL_F_PARAM : 0;
+        bl.inl = MEMLOG_NONE;
+        if (l.inl) {
+          bl.flags |= MEMLOG_LOCAL_F_INLINED;
+          bl.inl = g_bin_funcs.intern_gcc(decl_name(l.inl));
+        }
+        int cls = esc[&l - locals.data()];
+        if (cls >= 0) bl.flags |= esc_flags[cls];
+        bl.offset = l.has_offset ? (int64_t)l.offset : MEMLOG_NO_OFFSET;
+        bl.size = l.size;
+        bl.type = l.type;
+        g_bin_locals.push_back(bl);
+      }
+      for (const reg_store &r : pf.reg_stores) {
+        memlog_bin_reg_store br;
+        std::memset(&br, 0, sizeof(br));
+        if (!local_of(r.local, br.local)) continue;
+        br.from = MEMLOG_NONE;
+        if (r.derived && r.from >= 0 && !local_of(r.from, br.from)) continue;
+        br.site = (uint32_t)(r.site & MEMLOG_SITE_LOCAL_MAX);
+        br.frame = local_site;
+        br.anchor = r.derived ? (uint32_t)(r.anchor & MEMLOG_SITE_LOCAL_MAX) : MEMLOG_NONE;
+        br.add = r.add;
+        g_bin_reg_stores.push_back(br);
+      }
+      return;
+    }
+
+    g_buf.clear();
+    g_buf.lit("{\"v\":2,\"site\":");
+    g_buf.num((long long)pf.site);
+    g_buf.lit(",\"kind\":\"frame\",\"fid\":");
+    g_buf.num(pf.fid);
+    g_buf.lit(",\"file\":\"");
+    json_escape(g_buf, file);
+    g_buf.lit("\",\"line\":");
+    g_buf.num(line);
+    g_buf.lit(",\"col\":");
+    g_buf.num(col);
+    g_buf.lit(",\"frame\":{\"locals\":[");
+    for (size_t i = 0; i < locals.size(); i++) {
+      const frame_local &l = locals[i];
+      if (i) g_buf.put(',');
+      g_buf.lit("{\"name\":\"");
+      json_escape(g_buf, l.name);
+      if (l.param) g_buf.lit("\",\"param\":true,\"offset\":");
+      else g_buf.lit("\",\"param\":false,\"offset\":");
+      if (l.has_offset) g_buf.num(l.offset);
+      else g_buf.lit("null");
+      g_buf.lit(",\"size\":");
+      if (l.size >= 0) g_buf.num(l.size);
+      else g_buf.lit("null");
+      emit_type_ref(g_buf, l.type);
+      if (esc[i] >= 0) {
+        g_buf.lit(",\"esc\":\"");
+        g_buf.str(esc_names[esc[i]]);
+        g_buf.put('"');
+      }
+      if (l.inl) {
+        g_buf.lit(",\"inl\":\"");
+        json_escape(g_buf, decl_name(l.inl));
+        g_buf.put('"');
+      }
+      g_buf.put('}');
+    }
+    g_buf.put(']');
+    if (!pf.reg_stores.empty()) {
+      g_buf.lit(",\"reg_stores\":[");
+      bool first = true;
+      for (const reg_store &r : pf.reg_stores) {
+        uint32_t local, from = MEMLOG_NONE;
+        if (!local_of(r.local, local) || (r.derived && r.from >= 0 && !local_of(r.from, from))) continue;
+        if (!first) g_buf.put(',');
+        first = false;
+        g_buf.lit("{\"site\":");
+        g_buf.num((long long)r.site);
+        g_buf.lit(",\"local\":");
+        g_buf.num(local);
+        if (r.derived) {
+          g_buf.lit(",\"anchor\":");
+          g_buf.num((long long)r.anchor);
+          g_buf.lit(",\"from\":");
+          if (from != MEMLOG_NONE) g_buf.num(from);
+          else g_buf.lit("null");
+          g_buf.lit(",\"add\":");
+          g_buf.num(r.add);
+        }
+        g_buf.put('}');
+      }
+      g_buf.put(']');
+    }
+    g_buf.lit("}}");
+    emit_jsonl_line();
+  }
+
+
+  // ---------------------------
+  // Incremental output cache
+  // ---------------------------
+
+  /**
+  * NOTE: Incremental output cache
+  *
+  * With -fplugin-arg-memlog_plugin-cache=<dir>, every compile keeps what it wrote for each function in
+  * <dir>/memlog-<TU id>.cache, next to a structural hash of the function's GIMPLE body. On the next compile of the
+  * same file, a function whose hash hasn't changed gets its previous records back instead of being serialized again:
+  *   - mode=static: the function is not walked at all; its event lines (or binary records) are written as they were
+  *   - mode=runtime: the hooks still have to go in, so the function is walked, but nothing is serialized
+  * Either way its sites keep their ids, so a runtime trace recorded before the rebuild still joins to them.
+  *
+  * A function that did change takes its old ids back first (in the order its sites are found), and only sites it
+  * didn't have before get new numbers, from above the highest number the cache has ever handed out. So an edit
+  * never renumbers another function's sites.
+  *
+  * The body hash covers everything a function's records are made of: each statement's code, operands (types with
+  * everything their dictionary entries hold, see type_layout_key; constants, variable and field names, which locals
+  * are the same variable), source location, and the CFG (the loop summaries are read off it). Nothing about other
+  * functions goes in, so editing one function leaves every other one a hit; editing a struct only misses the
+  * functions that use it. Lines in the function's own file are hashed, and cached, relative to its declaration
+  * (func_line), so adding a line above a function doesn't make it a miss: its records are written at its new
+  * place. Whatever else changes the output -- format, mode, path rules, the allocator table, the TU id, the gcc or
+  * record version -- is hashed into the file header, and a cache written under different settings is ignored.
+  * Frame sites are always written afresh: their offsets come from register allocation.
+  *
+  * JSONL events carry their function's fid, which depends on what was compiled before it, and absolute lines in
+  * their "inl" calls (their own position is a delta from the function's header already), so each cached line is kept
+  * with holes where those go (cache_hole). Binary records are kept with their string and expression indices, and
+  * their lines, relative to the function and are re-interned and rebased when they are replayed.
+  *
+  * Site numbers of deleted functions are never handed out again, so over many edits the numbering creeps up. Once
+  * the highest number passes half of MEMLOG_SITE_LOCAL_MAX the cache is dropped and the file is numbered afresh
+  * (every id of the file changes once), well before next_site_id would run out.
+  *
+  * The file is rewritten at PLUGIN_FINISH (to a temporary name, then renamed), holding the functions of this compile
+  * and the old entries of any it didn't get to. A compile gcc stops early (fatal errors, an ICE) leaves it alone.
+  * The header carries a checksum of the rest of the file: a truncated or overwritten file is ignored as a whole
+  * rather than replayed with damaged records.
+  */
+
+  static const uint32_t CACHE_VERSION = 8;
+  static const char CACHE_MAGIC[MEMLOG_BIN_MAGIC_LEN] = "MEMLOGC";
+
+  //The per-function counters a cached function adds to the stats record.
+  struct cache_counts {
+    uint64_t stmts, filtered, stores, range_stores, allocs, frees, writes;
+  };
+
+  //Where a cached JSONL line gets a number back: this compile's fid, or decl_line + rel (see event_hole).
+  struct cache_hole {
+    uint32_t at;  //offset in text
+    uint32_t fid; //1: the fid, 0: a line
+    int32_t rel;
+  };
+
+  //A JSONL event line, without its holes' numbers (and its newline).
+  struct cache_line {
+    std::string text;
+    std::vector<cache_hole> holes;
+  };
+
+  //What one function wrote last time.
+  struct cache_entry {
+    uint64_t hash;
+    uint32_t frame;               //local number of its frame site (0: none)
+    std::vector<uint32_t> sites;  //local numbers of its other sites, in the order they were found
+    cache_counts counts;
+
+    //format=jsonl
+    std::vector<cache_line> lines;
+
+    //format=bin: string indices point into strings, expression indices into exprs
+    std::vector<std::string> strings;
+    std::vector<memlog_bin_expr> exprs;
+    std::vector<memlog_bin_site> bin_sites;
+    std::vector<memlog_bin_range> ranges;
+    std::vector<memlog_bin_inline> inlines;
+    std::vector<memlog_bin_points_to> points_to; //site ids are reused as they were, so kept as is
+
+    //both formats: the types its records refer to (and the types those refer to), names in strings, fields in
+    //type_fields; a binary site's type is an index into types
+    std::vector<type_desc> types;
+    std::vector<type_field> type_fields;
+  };
+
+  //header of a cache file (32 bytes)
+  struct cache_header {
+    char     magic[MEMLOG_BIN_MAGIC_LEN]; //CACHE_MAGIC
+    uint32_t version;                    //CACHE_VERSION
+    uint32_t high_water;                 //highest local site number ever handed out for this TU
+    uint64_t config;                     //cache_config_hash() of the compile that wrote it
+    uint32_t n_funcs;
+    uint32_t body_sum;                   //low 32 bits of the FNV-1a hash of everything after the header
+  };
+
+  static std::string g_cache_dir;                                 //from cache=; empty: no cache
+  static bool g_cache_loaded = false;
+  static std::unordered_map<std::string, cache_entry> g_cache_old; //read before the first function
+  static std::map<std::string, cache_entry> g_cache_new;           //written at PLUGIN_FINISH
+  static std::unordered_map<std::string, unsigned> g_cache_keys;   //times each function name was seen this compile
+  static std::string g_cache_key;                                 //the current function's key
+  static uint32_t g_cache_high_water = 0;
+
+  //the entry being filled for the function being walked (null on a hit, or without a cache)
+  static cache_entry *g_cache_fill = nullptr;
+  //where its records start in the binary arrays
+  static size_t g_cache_site0, g_cache_expr0, g_cache_range0, g_cache_inline0, g_cache_pt0;
+
+  static std::string cache_path() {
+    char name[32];
+    std::snprintf(name, sizeof(name), "memlog-%08x.cache", g_tu_id);
+    return path_join(g_cache_dir, name);
+  }
+
+  /*
+    Everything other than the function bodies that changes what the plugin writes.
+  */
+  static uint64_t cache_config_hash() {
+    hasher h;
+    h.num(CACHE_VERSION);
+    h.num(MEMLOG_BIN_VERSION);
+    h.str(gcc_version.basever);
+    h.str(gcc_version.datestamp);
+    h.num(g_format);
+    h.num(g_mode);
+    h.num(g_loop_ranges);
+    h.num(g_stage);
+    h.num(g_field_captures);
+    h.num(g_tu_id);
+    for (const path_rule &r : g_path_rules) {
+      h.num(r.include);
+      h.str(r.pattern.c_str());
+    }
+    //g_callees is unordered: go through it by name
+    std::map<std::string, const callee_info *> callees;
+    for (const auto &c : g_callees) callees[c.first] = &c.second;
+    for (const auto &c : callees) {
+      const callee_info &i = *c.second;
+      h.str(c.first.c_str());
+      h.str(i.name.c_str());
+      h.num(i.role);
+      h.num(i.size_how);
+      h.num((uint64_t)(int64_t)i.size_arg);
+      h.num((uint64_t)(int64_t)i.count_arg);
+      h.num((uint64_t)(int64_t)i.ptr_arg);
+      h.num((uint64_t)(int64_t)i.out_arg);
+      h.str(i.free_fn.c_str());
+      h.num(i.arena);
+    }
+    return h.h;
+  }
+
+  // ---- reading and writing the cache file ----
+
+  //Reads fixed-width values out of a cache file held in memory; any read past the end fails.
+  struct cache_in {
+    const char *p, *end;
+
+    template <typename T> bool get(T &v) {
+      if ((size_t)(end - p) < sizeof(T)) return false;
+      std::memcpy(&v, p, sizeof(T));
+      p += sizeof(T);
+      return true;
+    }
+    bool str(std::string &s) {
+      uint32_t n;
+      if (!get(n) || (size_t)(end - p) < n) return false;
+      s.assign(p, n);
+      p += n;
+      return true;
+    }
+    template <typename T> bool vec(std::vector<T> &v) {
+      uint32_t n;
+      if (!get(n) || (size_t)(end - p) / sizeof(T) < n) return false;
+      v.resize(n);
+      if (n) std::memcpy(v.data(), p, n * sizeof(T));
+      p += n * sizeof(T);
+      return true;
+    }
+  };
+
+  struct cache_out {
+    std::string buf;
+
+    template <typename T> void put(const T &v) { buf.append((const char *)&v, sizeof(T)); }
+    void str(const std::string &s) {
+      put((uint32_t)s.size());
+      buf += s;
+    }
+    template <typename T> void vec(const std::vector<T> &v) {
+      put((uint32_t)v.size());
+      buf.append((const char *)v.data(), v.size() * sizeof(T));
+    }
+  };
+
+  static bool cache_read_entry(cache_in &in, std::string &key, cache_entry &e) {
+    uint32_t n;
+    if (!in.str(key) || !in.get(e.hash) || !in.get(e.frame) || !in.vec(e.sites) || !in.get(e.counts)) return false;
+    //a line is at least its two length fields, a string its one: a count the bytes left can't hold is damage
+    if (!in.get(n) || (size_t)(in.end - in.p) / 8 < n) return false;
+    e.lines.resize(n);
+    for (cache_line &l : e.lines)
+      if (!in.str(l.text) || !in.vec(l.holes)) return false;
+    if (!in.get(n) || (size_t)(in.end - in.p) / 4 < n) return false;
+    e.strings.resize(n);
+    for (std::string &s : e.strings)
+      if (!in.str(s)) return false;
+    return in.vec(e.exprs) && in.vec(e.bin_sites) && in.vec(e.ranges) && in.vec(e.inlines) && in.vec(e.points_to) &&
+           in.vec(e.types) && in.vec(e.type_fields);
+  }
+
+  /*
+    Reads this TU's cache file, once, before the first function is compiled. A missing, damaged or stale file
+    (written under other settings) just means an empty cache.
+  */
+  static void cache_load() {
+    g_cache_loaded = true;
+    ensure_tu_id();
+
+    FILE *f = std::fopen(cache_path().c_str(), "rb");
+    if (!f) return;
+    std::string data;
+    char chunk[1 << 16];
+    for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), f)) > 0;) data.append(chunk, n);
+    std::fclose(f);
+
+    cache_in in = { data.data(), data.data() + data.size() };
+    cache_header h;
+    if (!in.get(h) || std::memcmp(h.magic, CACHE_MAGIC, sizeof(h.magic)) != 0 || h.version != CACHE_VERSION ||
+        h.config != cache_config_hash())
+      return;
+    hasher sum;
+    sum.bytes(in.p, (size_t)(in.end - in.p));
+    if ((uint32_t)sum.h != h.body_sum) {
+      std::fprintf(stderr, "memlog_plugin: ignoring damaged cache file %s\n", cache_path().c_str());
+      return;
+    }
+
+    std::string key;
+    for (uint32_t i = 0; i < h.n_funcs; i++) {
+      cache_entry e;
+      if (!cache_read_entry(in, key, e)) {
+        std::fprintf(stderr, "memlog_plugin: ignoring damaged cache file %s\n", cache_path().c_str());
+        g_cache_old.clear();
+        return;
+      }
+      g_cache_old[key] = std::move(e);
+    }
 
-    returns: void
-  */
-  static void log_alloc_site(gimple *stmt, const char *fn_name, tree lhs /* may be null */, tree size_expr_j) {
-    const char *file; int line, col;
-    get_loc(stmt, file, line, col);  //get_loc initializes the file, line and col for this expression
+    //numbers of deleted functions' sites are never reused: renumber the file before that runs out of numbers
+    if (h.high_water > MEMLOG_SITE_LOCAL_MAX / 2) {
+      std::fprintf(stderr, "memlog_plugin: site numbers in %s have grown past %u; dropping the cache (site ids of "
+                   "this file change once)\n", cache_path().c_str(), MEMLOG_SITE_LOCAL_MAX / 2);
+      g_cache_old.clear();
+      return;
+    }
 
-    unsigned site = g_site_counter++; //make a new site number for this event
-
-    //lhs_j holds a json string of the left hand side expression, if it exists; otherwise it holds the string "null"
-    std::string lhs_j = lhs ? emit_expr(lhs) : "null";
-    std::string size_j = emit_expr(size_expr_j); //size_j holds a json string representing the size of the memory being allocated
-                                                //Examples:
-                                                //n → {"k":"var","name":"n"}
-                                                //a*b → {"k":"bin","op":"*","a":...,"b":...}
-                                                //40 → {"k":"int","v":40}
-    std::ostringstream oss;
-    oss << "{"
-        << "\"v\":1,"
-        << "\"site\":" << site << ","
-        << "\"kind\":\"alloc\","
-        << "\"loc\":{"
-          << "\"file\":\"" << json_escape(file) << "\","
-          << "\"line\":" << line << ","
-          << "\"col\":" << col
-        << "},"
-        << "\"func\":\"" << json_escape(current_func_name()) << "\","
-        << "\"alloc\":{"
-          << "\"fn\":\"" << json_escape(fn_name) << "\","
-          << "\"lhs\":" << lhs_j << ","
-          << "\"size_expr\":" << size_j
-        << "}"
-        << "}";
-
-    emit_jsonl_line(oss.str());
+    //new sites are numbered above every number the old ones use
+    g_cache_high_water = h.high_water;
+    if (g_site_counter <= h.high_water) g_site_counter = h.high_water + 1;
   }
 
   /*
-    This function logs a memory free as a JSONL object. 
-    It records where the free occurs, which function it’s in, and what pointer expression is being freed.
+    Writes the functions of this compile back to the cache file, and the old entries of functions this compile
+    didn't lower (a compile that stopped on errors, static functions nothing used), so their ids are there to take
+    back next time. Called from finish_output at PLUGIN_FINISH only: a compile gcc left through exit() may have
+    stopped halfway through a function.
+  */
+  static void cache_save() {
+    if (g_cache_dir.empty() || !g_cache_loaded) return;
+
+    for (auto &kv : g_cache_old) g_cache_new.emplace(kv.first, std::move(kv.second));
+
+    cache_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, CACHE_MAGIC, sizeof(h.magic));
+    h.version = CACHE_VERSION;
+    h.high_water = g_site_counter - 1 > g_cache_high_water ? g_site_counter - 1 : g_cache_high_water;
+    h.config = cache_config_hash();
+    h.n_funcs = (uint32_t)g_cache_new.size();
+
+    cache_out out;
+    out.put(h);
+    for (const auto &kv : g_cache_new) {
+      const cache_entry &e = kv.second;
+      out.str(kv.first);
+      out.put(e.hash);
+      out.put(e.frame);
+      out.vec(e.sites);
+      out.put(e.counts);
+      out.put((uint32_t)e.lines.size());
+      for (const cache_line &l : e.lines) {
+        out.str(l.text);
+        out.vec(l.holes);
+      }
+      out.put((uint32_t)e.strings.size());
+      for (const std::string &s : e.strings) out.str(s);
+      out.vec(e.exprs);
+      out.vec(e.bin_sites);
+      out.vec(e.ranges);
+      out.vec(e.inlines);
+      out.vec(e.points_to);
+      out.vec(e.types);
+      out.vec(e.type_fields);
+    }
+    hasher sum;
+    sum.bytes(out.buf.data() + sizeof(h), out.buf.size() - sizeof(h));
+    h.body_sum = (uint32_t)sum.h;
+    std::memcpy(&out.buf[0], &h, sizeof(h));
+
+    //another compile of the same file may be reading it: never let it see half a file
+    std::string path = cache_path();
+    std::string tmp = path + ".tmp" + std::to_string((long)getpid());
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    bool ok = f && std::fwrite(out.buf.data(), 1, out.buf.size(), f) == out.buf.size();
+    if (f && std::fclose(f) != 0) ok = false;
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+      std::fprintf(stderr, "memlog_plugin: could not write cache file %s\n", path.c_str());
+      std::remove(tmp.c_str());
+    }
+  }
 
-    params:
-      -stmt (gimple *): pointer to a gimple statement representing the gimple call for free
-      -ptr_expr (tree): a tree node pointer to the expression passed to the free() function
+  // ---- hashing a function body ----
 
-    return: void
-  */
-  static void log_free_site(gimple *stmt, tree ptr_expr) {
-    const char *file; int line, col;
-    //
-    get_loc(stmt, file, line, col);
+  //A line as the cache keeps it: relative to the function's declaration in its own file, as it is in other files.
+  static uint64_t func_line(const char *file, int line) {
+    return in_func_file(file) ? (uint64_t)(int64_t)(line - g_func.decl_line) : (uint64_t)line;
+  }
+
+  //Hashes one function's GIMPLE body (see the NOTE above).
+  struct body_hasher {
+    hasher h;
+    std::unordered_map<tree, unsigned> locals; //the function's own declarations, numbered in the order first seen
+
+    void type(tree ty) {
+      if (!ty) { h.num(0); return; }
+      h.num(TREE_CODE(ty));
+      h.num(TYPE_UNSIGNED(ty));
+      h.num(TYPE_QUALS(ty));
+      if (INTEGRAL_TYPE_P(ty) || POINTER_TYPE_P(ty) || SCALAR_FLOAT_TYPE_P(ty)) h.num(TYPE_PRECISION(ty));
+      tree size = TYPE_SIZE_UNIT(ty);
+      h.num(size && tree_fits_shwi_p(size) ? (uint64_t)tree_to_shwi(size) : ~(uint64_t)0);
+      //the records keep type entries (fields and all) in the cache: an edited struct must not reuse them
+      h.num(type_layout_key(ty));
+    }
 
-    unsigned site = g_site_counter++;
+    void decl(tree d) {
+      h.str(DECL_NAME(d) ? IDENTIFIER_POINTER(DECL_NAME(d)) : "");
+      //the same name can be two different locals (shadowing): number them instead of using their DECL_UIDs,
+      //which change whenever anything earlier in the file does
+      if (DECL_CONTEXT(d) == current_function_decl) {
+        auto it = locals.emplace(d, (unsigned)locals.size()).first;
+        h.num(it->second);
+        h.num(TREE_ADDRESSABLE(d));
+      }
+      h.num(TREE_THIS_VOLATILE(d));
+      h.num(TREE_STATIC(d));
+      h.num(DECL_EXTERNAL(d));
+      h.num(DECL_ARTIFICIAL(d));
+      if (VAR_P(d)) h.num(DECL_HARD_REGISTER(d));
+      //what a scalar SRA split out of an aggregate prints as (stage=late)
+      if (VAR_P(d) && DECL_HAS_DEBUG_EXPR_P(d)) expr(DECL_DEBUG_EXPR(d));
+      if (TREE_CODE(d) == FIELD_DECL) {
+        h.num(DECL_BIT_FIELD(d));
+        expr(DECL_FIELD_OFFSET(d));
+        expr(DECL_FIELD_BIT_OFFSET(d));
+      }
+      if (TREE_CODE(d) == FUNCTION_DECL) h.num(fndecl_built_in_p(d, BUILT_IN_NORMAL) ? DECL_FUNCTION_CODE(d) : 0);
+      type(TREE_TYPE(d));
+    }
 
-    //p is the json string of the expression passed to free
-    std::string p = emit_expr(ptr_expr);
+    void expr(tree t) {
+      if (!t) { h.num(0); return; }
+      enum tree_code code = TREE_CODE(t);
+      h.num(code);
+      if (DECL_P(t)) { decl(t); return; }
+
+      switch (code) {
+        case INTEGER_CST:
+          for (int i = 0; i < TREE_INT_CST_NUNITS(t); i++) h.num((uint64_t)TREE_INT_CST_ELT(t, i));
+          break;
+        case REAL_CST:
+          h.num(real_hash(TREE_REAL_CST_PTR(t)));
+          break;
+        case STRING_CST:
+          h.num(TREE_STRING_LENGTH(t));
+          h.bytes(TREE_STRING_POINTER(t), TREE_STRING_LENGTH(t));
+          break;
+        case SSA_NAME:
+          h.num(SSA_NAME_VERSION(t));
+          expr(SSA_NAME_VAR(t));
+          break;
+        case CONSTRUCTOR: {
+          h.num(TREE_CLOBBER_P(t));
+          h.num(CONSTRUCTOR_NELTS(t));
+          unsigned i;
+          tree idx, val;
+          FOR_EACH_CONSTRUCTOR_ELT(CONSTRUCTOR_ELTS(t), i, idx, val) {
+            expr(idx);
+            expr(val);
+          }
+          break;
+        }
+        case TREE_LIST: //asm operands
+          expr(TREE_PURPOSE(t));
+          expr(TREE_VALUE(t));
+          return;
+        default:
+          if (EXPR_P(t))
+            for (int i = 0; i < TREE_OPERAND_LENGTH(t); i++) expr(TREE_OPERAND(t, i));
+          break;
+      }
+      if (CONSTANT_CLASS_P(t) || EXPR_P(t) || code == SSA_NAME || code == CONSTRUCTOR) type(TREE_TYPE(t));
+    }
 
-    std::ostringstream oss;
-    oss << "{"
-        << "\"v\":1,"
-        << "\"site\":" << site << ","
-        << "\"kind\":\"free\","
-        << "\"loc\":{"
-          << "\"file\":\"" << json_escape(file) << "\","
-          << "\"line\":" << line << ","
-          << "\"col\":" << col
-        << "},"
-        << "\"func\":\"" << json_escape(current_func_name()) << "\","
-        << "\"free\":{"
-          << "\"ptr_expr\":" << p
-        << "}"
-        << "}";
+    void stmt(gimple *s) {
+      h.num(gimple_code(s));
+      h.num(s->subcode);
+      const char *file; int line, col;
+      get_loc(s, file, line, col);
+      h.str(file);
+      h.num(func_line(file, line));
+      h.num((uint64_t)col);
+      //the calls it was inlined through (stage=late)
+      std::vector<inline_call> chain;
+      inline_chain(s, chain);
+      for (const inline_call &c : chain) {
+        h.str(decl_name(c.fn));
+        h.str(c.file);
+        h.num(func_line(c.file, c.line));
+        h.num((uint64_t)c.col);
+      }
+      if (is_gimple_call(s)) h.num(gimple_call_internal_p(s) ? (uint64_t)gimple_call_internal_fn(s) + 1 : 0);
+      if (gimple_code(s) == GIMPLE_ASM) h.str(gimple_asm_string(as_a<gasm *>(s)));
+      h.num(gimple_num_ops(s));
+      for (unsigned i = 0; i < gimple_num_ops(s); i++) expr(gimple_op(s, i));
+    }
+  };
 
-    emit_jsonl_line(oss.str());
+  /*
+    The structural hash of fun's body. begin_function must have run (the header record's fields go in too).
+  */
+  static uint64_t hash_function(function *fun) {
+    body_hasher b;
+    b.h.str(current_func_name());
+    b.h.str(g_func.file);
+    //not decl_line: the records are rebased onto it (decl_col stays, a JSONL event's first "dc" is relative to it)
+    b.h.num((uint64_t)g_func.decl_col);
+
+    basic_block bb;
+    FOR_ALL_BB_FN(bb, fun) {
+      b.h.num((uint64_t)bb->index);
+      edge e;
+      edge_iterator ei;
+      FOR_EACH_EDGE(e, ei, bb->succs) {
+        b.h.num((uint64_t)e->dest->index);
+        b.h.num((uint64_t)e->flags);
+      }
+      for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) b.stmt(gsi_stmt(gsi));
+    }
+    return b.h.h;
   }
 
-  // ---------------------------
-  // Detection logic
-  // ---------------------------
+  // ---- using the cache while a function is compiled ----
 
   /*
-    This function logs allocations and frees.
+    Looks the function memlog_pass is about to walk up in the cache, and makes its old site numbers the ones
+    next_site_id hands out first.
 
-    Given a gimple statement, it decides:
-      -is this statement a function call? (if so, is it a call to malloc, calloc, or realloc?)
-        -if yes, 
-          -for allocations log allocation size and return pointer
-          -for free log the pointer expression being 
-    
-    params:
-      -stmt (gimple *): a pointer to a gimple statement
-    
-      return: void
+    return: its cached entry if its body hasn't changed, otherwise null (the entry for this compile is then filled
+            in as its sites are logged)
   */
-  static void detect_alloc_free_if_any(gimple *stmt) {
-    //if stmt is not a function call, return
-    if (!is_gimple_call(stmt)) return;
-
-    //gimple_call_fndecl(stmt) returns a tree for the function being called (if gcc can identify it (a FUNCTION_DECL))
-    tree callee = gimple_call_fndecl(stmt);
-    //if callee is null, it could be a function pointer or something else, so return
-    if (!callee) return; //(*TO DO* research how to deal with function pointers)
-
-    //DECL_NAME(callee) gives an IDENTIFIER_NODE for the function’s name
-    //IDENTIFIER_POINTER(...) turns that into a raw const char * (ex. "malloc")
-    const char *name = IDENTIFIER_POINTER(DECL_NAME(callee));
-    if (!name) return;
+  static const cache_entry *cache_begin_function(function *fun) {
+    g_cache_fill = nullptr;
+    if (g_cache_dir.empty()) return nullptr;
+    if (!g_cache_loaded) cache_load();
+
+    //a name seen twice in one file (nested functions) gets "name#2", "name#3", ... in the order they are compiled
+    std::string &key = g_cache_key;
+    key = current_func_name();
+    unsigned seen = g_cache_keys[key]++;
+    if (seen) key += "#" + std::to_string(seen + 1);
+
+    uint64_t hash;
+    {
+      auto_client_timevar tv(PHASE_CLASSIFY);
+      hash = hash_function(fun);
+    }
 
-    bool is_malloc =
-        (std::strcmp(name, "malloc") == 0) ||
-        (std::strcmp(name, "calloc") == 0) ||
-        (std::strcmp(name, "realloc") == 0);
+    cache_entry &now = g_cache_new[key];
+    auto it = g_cache_old.find(key);
+    if (it != g_cache_old.end()) {
+      g_reuse_ids = &it->second.sites;
+      g_reuse_next = 0;
+      g_reuse_frame = it->second.frame;
+      if (it->second.hash == hash) {
+        now = it->second;
+        return &it->second;
+      }
+    }
 
-    bool is_free = (std::strcmp(name, "free") == 0);
+    now.hash = hash;
+    g_cache_fill = &now;
+    return nullptr;
+  }
 
-    if (!is_malloc && !is_free) return;
+  /*
+    Called once the walk has found the function's sites, before anything is worked out for them. On a hit, the walk
+    must have found the sites the cache has ids for (it always does for an unchanged body; if not, the function is
+    logged as if it had changed).
+  */
+  static void cache_check_hit(const cache_entry *&hit) {
+    if (!hit || hit->sites.size() == g_found_sites.size()) return;
+    hit = nullptr;
+    cache_entry &now = g_cache_new[g_cache_key];
+    uint64_t hash = now.hash;
+    now = cache_entry();
+    now.hash = hash;
+    g_cache_fill = &now;
+  }
 
-    //lhs is the expression that holds the memory address of the memory allocation
-    tree lhs = gimple_call_lhs(stmt); // p = malloc(...)
-                                      //Examples: 
-                                      // p = malloc(n); → lhs represents p
-                                      //malloc(n); → lhs is NULL_TREE
-    if (is_malloc) {
-      // size expression:
-      // malloc(n) -> arg0
-      // calloc(a,b) -> a*b
-      // realloc(p,n) -> arg1
-
-      // /size_expr is a gcc tree that represents the expression for “how many bytes requested”
-      tree size_expr = NULL_TREE;
-
-      if (std::strcmp(name, "malloc") == 0) { //if the name is malloc...
-
-        //gimple_call_arg(stmt, i) returns the i-th argument expression of a GIMPLE call as a gcc tree
-        size_expr = gimple_call_arg(stmt, 0); //For malloc(n), the size of the memory allocation is found at argument 0.
-
-      } else if (std::strcmp(name, "calloc") == 0) { //if the name is calloc...
-        tree a = gimple_call_arg(stmt, 0); //a is a gcc tree representing the first arguement to calloc
-        tree b = gimple_call_arg(stmt, 1); //b is a gcc tree representing the second arguement to calloc
-
-        //fold_build2 is a gcc helper functions that builds a binary expression node and immediately tries to simplify it
-        //fold_build2(MULT_EXPR, size_type_node, a, b) tries to build the expression a*b and simpilfy it if possible
-        //(for example if a=10 and b = 4, calling this function would give us the tree representation of a*b = 40)
-        //If it can’t simplify, it returns a plain tree node (with TREE_CODE MULT_EXPR) representing the multiplication
-        size_expr = fold_build2(MULT_EXPR, size_type_node, a, b);
-      } else { //otherwise the name is realloc
-        size_expr = gimple_call_arg(stmt, 1); //For realloc(ptr, n), the size of the memory allocation is stored in n
-      }
-
-      //give the info we just computed to a function that will log it to the output file
-      log_alloc_site(stmt, name, lhs, size_expr);
+  /*
+    Called right before log_found_sites, after cache_check_hit.
+  */
+  static void cache_begin_sites(const cache_entry *hit) {
+    g_func_types.clear();
+    if (hit) {
+      g_cache_replaying = true;
       return;
     }
-
-    if (is_free) {// if the function call is to free...
-      //if number of arguments to free is > 0, arg0 becomes a tree node pointer representing the argument to free()  (otherwise it is NULL_TREE)
-      
-      //gimple_call_num_args(stmt) and gimple_call_arg(stmt, 0) are gcc helper functions (included through the headers)
-      //gimple_call_num_args(stmt) returns how many argument expressions the call has
-      //gimple_call_arg(stmt, 0) returns a tree representing the ith argument expression
-      tree arg0 = gimple_call_num_args(stmt) > 0 ? gimple_call_arg(stmt, 0) : NULL_TREE;
-      
-      //give the info we just computerd to a function that will log it to the output file
-      log_free_site(stmt, arg0);
-      return;
+    if (!g_cache_fill) return;
+
+    cache_counts &c = g_cache_fill->counts;
+    for (const found_site &f : g_found_sites) {
+      switch (f.kind) {
+        case HOOK_ALLOC: c.allocs++; break;
+        case HOOK_FREE:  c.frees++; break;
+        case HOOK_WRITE: c.writes++; break;
+        case HOOK_STORE: if (f.ranged) c.range_stores++; else c.stores++; break;
+      }
     }
+    g_cache_site0 = g_bin_sites.size();
+    g_cache_expr0 = g_bin_exprs.size();
+    g_cache_range0 = g_bin_ranges.size();
+    g_cache_inline0 = g_bin_inlines.size();
+    g_cache_pt0 = g_bin_points_to.size();
   }
 
-
   /*
+    Called by log_found_sites after each site: records its number and (JSONL) the event line still in g_buf.
+  */
+  static void cache_capture_event(uint64_t site) {
+    if (!g_cache_fill) return;
+    g_cache_fill->sites.push_back((uint32_t)(site & MEMLOG_SITE_LOCAL_MAX));
+    if (g_format != FORMAT_JSONL) return;
+
+    cache_line l;
+    size_t from = 0;
+    for (const event_hole &h : g_event_holes) {
+      l.text.append(g_buf.data + from, h.begin - from);
+      l.holes.push_back({(uint32_t)l.text.size(), h.fid, h.fid ? 0 : h.line - g_func.decl_line});
+      from = h.end;
+    }
+    l.text.append(g_buf.data + from, g_buf.len - 1 - from); //without the newline
+    g_cache_fill->lines.push_back(std::move(l));
+  }
 
-    This function checks whether a GIMPLE statement performs a write to a variable or memory location
-      -if so, it logs that store as a JSON event
-    
-    params:
-      -stmt (gimple *): a pointer to a gimple statement (could represent many different things)
-
-    return: void
+  /*
+    Copies the types the current function's records referred to, and every type those refer to, into its entry.
   */
-  static void detect_store_if_any(gimple *stmt) {
-    //is_gimple_assign(stmt) comes from gimple.h
-    if (!is_gimple_assign(stmt)) return;
+  static void cache_capture_types(cache_entry &e) {
+    std::unordered_map<uint64_t, uint32_t> local;  //type id -> index in e.types
+    std::unordered_map<uint32_t, uint32_t> names;  //g_bin_idents index -> index in e.strings
+    auto name = [&](uint32_t i) -> uint32_t {
+      if (i == MEMLOG_NONE) return i;
+      auto it = names.find(i);
+      if (it != names.end()) return it->second;
+      uint32_t id = (uint32_t)e.strings.size();
+      e.strings.push_back(g_bin_idents.strings[i]);
+      names.emplace(i, id);
+      return id;
+    };
+    auto follow = [](uint64_t id, std::vector<uint32_t> &todo) {
+      auto it = g_type_by_id.find(id);
+      if (it != g_type_by_id.end()) todo.push_back(it->second);
+    };
+
+    std::vector<uint32_t> todo(g_func_types);
+    while (!todo.empty()) {
+      const type_desc &t = g_types[todo.back()];
+      todo.pop_back();
+      if (!local.emplace(t.id, (uint32_t)e.types.size()).second) continue;
+      type_desc c = t;
+      c.name = name(t.name);
+      c.first_field = (uint32_t)e.type_fields.size();
+      for (uint32_t i = 0; i < t.n_fields; i++) {
+        type_field f = g_type_fields[t.first_field + i];
+        f.name = name(f.name);
+        e.type_fields.push_back(f);
+        follow(f.type, todo);
+      }
+      if (t.ref) follow(t.ref, todo);
+      e.types.push_back(c);
+    }
+  }
 
-    //gimple_assign_lhs(stmt) returns a tree representing the variable/memory location being written (comes from gimple.h)
-    tree lhs = gimple_assign_lhs(stmt);
-    if (!lhs) return;
+  /*
+    Copies the binary records logged for the current function (from g_cache_*0 on) into its entry, with their
+    string and expression indices made relative to the entry (and their types to e.types, see cache_capture_types).
+  */
+  static void cache_capture_bin(cache_entry &e) {
+    std::unordered_map<std::string, uint32_t> local;
+    auto str = [&](const string_table &t, uint32_t i) -> uint32_t {
+      if (i == MEMLOG_NONE) return i;
+      const std::string &s = t.strings[i];
+      auto it = local.find(s);
+      if (it != local.end()) return it->second;
+      uint32_t id = (uint32_t)e.strings.size();
+      e.strings.push_back(s);
+      local.emplace(s, id);
+      return id;
+    };
+    uint32_t expr0 = (uint32_t)g_cache_expr0;
+    auto ex = [expr0](uint32_t i) { return i == MEMLOG_NONE ? i : i - expr0; };
+    std::unordered_map<uint64_t, uint32_t> types;
+    for (uint32_t i = 0; i < e.types.size(); i++) types.emplace(e.types[i].id, i);
+    auto ty = [&](uint32_t i) { return i == MEMLOG_NONE ? i : types[g_types[i].id]; };
+
+    for (size_t i = g_cache_expr0; i < g_bin_exprs.size(); i++) {
+      memlog_bin_expr x = g_bin_exprs[i];
+      x.a = ex(x.a);
+      x.b = ex(x.b);
+      x.name = str(g_bin_idents, x.name);
+      e.exprs.push_back(x);
+    }
+    //lines of the function's file relative to its declaration (unsigned, so negative ones wrap and wrap back)
+    uint32_t decl = (uint32_t)g_func.decl_line;
+    auto own = [](const string_table &t, uint32_t i) { return t.strings[i] == g_func.file; };
+
+    for (size_t i = g_cache_site0; i < g_bin_sites.size(); i++) {
+      memlog_bin_site s = g_bin_sites[i];
+      if (own(g_bin_files, s.file)) s.line -= decl;
+      s.file = str(g_bin_files, s.file);
+      s.func = str(g_bin_funcs, s.func);
+      s.name = str(g_bin_idents, s.name);
+      s.name2 = str(g_bin_idents, s.name2);
+      s.expr = ex(s.expr);
+      s.expr2 = ex(s.expr2);
+      s.expr3 = ex(s.expr3);
+      s.type = ty(s.type);
+      e.bin_sites.push_back(s);
+    }
+    for (size_t i = g_cache_range0; i < g_bin_ranges.size(); i++) {
+      memlog_bin_range r = g_bin_ranges[i];
+      r.iv = str(g_bin_idents, r.iv);
+      e.ranges.push_back(r);
+    }
+    for (size_t i = g_cache_inline0; i < g_bin_inlines.size(); i++) {
+      memlog_bin_inline c = g_bin_inlines[i];
+      if (own(g_bin_files, c.file)) c.line -= decl;
+      c.fn = str(g_bin_funcs, c.fn);
+      c.file = str(g_bin_files, c.file);
+      e.inlines.push_back(c);
+    }
+    e.points_to.insert(e.points_to.end(), g_bin_points_to.begin() + g_cache_pt0, g_bin_points_to.end());
+  }
 
-    // We include both:
-    // - memory stores (*p, a[i], s->f)
-    // - and local var stores (x = ...)
+  /*
+    Adds a cached function's types to the dictionary (those this compile hasn't met yet).
 
-    //unwrap_ssa(lhs) turns tree node SSA_NAME(x_3) → tree node VAR_DECL(x) (this gets the base name of the variable from the ssa name)
-    //TREE_CODE(unwrap_ssa(lhs) returns the type of the tree node representing the base variable of the ssa expression
-    enum tree_code lhs_code = TREE_CODE(unwrap_ssa(lhs));
+    return: the index in g_types of each of e.types
+  */
+  static std::vector<uint32_t> cache_replay_types(const cache_entry &e) {
+    std::vector<uint32_t> out;
+    std::vector<type_field> fields;
+    auto name = [&](uint32_t i) { return i == MEMLOG_NONE ? i : g_bin_idents.intern(e.strings[i].c_str()); };
+    for (const type_desc &c : e.types) {
+      type_desc t = c;
+      t.name = name(c.name);
+      fields.assign(e.type_fields.begin() + c.first_field, e.type_fields.begin() + c.first_field + c.n_fields);
+      for (type_field &f : fields) f.name = name(f.name);
+      out.push_back(type_add(t, fields.data()));
+    }
+    return out;
+  }
 
-    //log stores to variables or memory locations that correspond to real program state
-    bool is_interesting =
-        (lhs_code == VAR_DECL) ||  //local/global variable (ex. int x = 5)
-        (lhs_code == PARM_DECL) || //function parameter (ex. void f(int p) { ... p = 3; ...})
-        (lhs_code == MEM_REF) || //generalized memory ref (ex. *(p + offset) = 2)
-        (lhs_code == ARRAY_REF) || //array index (ex. a[i] = 6)
-        (lhs_code == COMPONENT_REF) || //struct field access (ex. s.f = 9 or s->f = 9)
-        (lhs_code == INDIRECT_REF); //dereference (ex. *p = 4)
+  /*
+    Writes a cached function's records to the output, as log_found_sites would have.
+  */
+  static void cache_write_records(const cache_entry &e) {
+    std::vector<uint32_t> types = cache_replay_types(e);
+    if (g_format == FORMAT_JSONL) {
+      for (const cache_line &l : e.lines) {
+        //the function's header goes out right before its first event, with this compile's fid
+        if (!g_func.header_done) emit_func_header();
+        g_buf.clear();
+        size_t from = 0;
+        for (const cache_hole &h : l.holes) {
+          g_buf.put(l.text.data() + from, h.at - from);
+          if (h.fid) g_buf.num(g_func.fid);
+          else g_buf.num(g_func.decl_line + h.rel);
+          from = h.at;
+        }
+        g_buf.put(l.text.data() + from, l.text.size() - from);
+        emit_jsonl_line();
+      }
+      return;
+    }
 
-    if (!is_interesting) return;
+    auto str = [&](string_table &t, uint32_t i) { return i == MEMLOG_NONE ? i : t.intern(e.strings[i].c_str()); };
+    uint32_t decl = (uint32_t)g_func.decl_line;
+    auto own = [&](uint32_t i) { return e.strings[i] == g_func.file; };
+    uint32_t expr0 = (uint32_t)g_bin_exprs.size();
+    auto ex = [expr0](uint32_t i) { return i == MEMLOG_NONE ? i : i + expr0; };
+
+    for (memlog_bin_expr x : e.exprs) {
+      x.a = ex(x.a);
+      x.b = ex(x.b);
+      x.name = str(g_bin_idents, x.name);
+      g_bin_exprs.push_back(x);
+    }
+    for (memlog_bin_site s : e.bin_sites) {
+      if (own(s.file)) s.line += decl;
+      s.file = str(g_bin_files, s.file);
+      s.func = str(g_bin_funcs, s.func);
+      s.name = str(g_bin_idents, s.name);
+      s.name2 = str(g_bin_idents, s.name2);
+      s.expr = ex(s.expr);
+      s.expr2 = ex(s.expr2);
+      s.expr3 = ex(s.expr3);
+      s.type = s.type == MEMLOG_NONE ? s.type : types[s.type];
+      g_bin_sites.push_back(s);
+    }
+    for (memlog_bin_range r : e.ranges) {
+      r.iv = str(g_bin_idents, r.iv);
+      g_bin_ranges.push_back(r);
+    }
+    for (memlog_bin_inline c : e.inlines) {
+      if (own(c.file)) c.line += decl;
+      c.fn = str(g_bin_funcs, c.fn);
+      c.file = str(g_bin_files, c.file);
+      g_bin_inlines.push_back(c);
+    }
+    g_bin_points_to.insert(g_bin_points_to.end(), e.points_to.begin(), e.points_to.end());
+  }
 
   /*
-    Now, we know:
-      -This is an assignment
-      -It writes to a meaningful memory location
+    Called right after log_found_sites: writes a hit's records, or keeps a miss's binary records.
+    The site numbers reused from here on are the frame site's alone.
+  */
+  static void cache_end_sites(const cache_entry *hit) {
+    if (hit) {
+      cache_write_records(*hit);
+    } else if (g_cache_fill) {
+      cache_capture_types(*g_cache_fill);
+      if (g_format == FORMAT_BIN) cache_capture_bin(*g_cache_fill);
+    }
+    g_cache_replaying = false;
+    g_reuse_ids = nullptr;
+  }
 
-    We have the full gimple statement (stmt) and the memory location being written to (lhs)
+  /*
+    A hit in static mode: the function is not walked, so its records and its share of the stats come from the cache.
   */
+  static void cache_replay(const cache_entry &e) {
+    cache_write_records(e);
+    g_stats.filtered += e.counts.filtered;
+    g_stats.stores += e.counts.stores;
+    g_stats.range_stores += e.counts.range_stores;
+    g_stats.allocs += e.counts.allocs;
+    g_stats.frees += e.counts.frees;
+    g_stats.writes += e.counts.writes;
+    g_reuse_ids = nullptr;
+  }
 
-    //log_store_site(stmt, lhs) logs the event to the output file
-    log_store_site(stmt, lhs);
+  /*
+    Finishes the current function's entry once its frame site is reserved.
+  */
+  static void cache_end_function(const cache_entry *hit, uint64_t frame_site, unsigned long long stmts,
+                                 unsigned long long filtered) {
+    if (hit) g_stats.cached++;
+    if (g_cache_fill) {
+      g_cache_fill->frame = (uint32_t)(frame_site & MEMLOG_SITE_LOCAL_MAX);
+      g_cache_fill->counts.stmts = stmts;
+      g_cache_fill->counts.filtered = filtered;
+    }
+    g_cache_fill = nullptr;
+    g_reuse_frame = 0;
   }
 
 
@@ -1072,7 +6071,7 @@ namespace{
     GIMPLE_PASS,    //tells us that this gcc pass runs on the gimple level of the compiler
     "memlog_static", //internal name of the pass
     OPTGROUP_NONE, //tells us this pass is not associated with a specific optimization group.
-    TV_NONE,   //tells us there is no dedicated timing variable for this pass
+    TV_PLUGIN_RUN, //timing variable ("plugin execution" in -ftime-report; the phases are listed on their own, see above)
     PROP_gimple_any, //we are not requiring SSA-only form or a specific property set
     0,
     0,
@@ -1096,25 +6095,178 @@ namespace{
     memlog_pass(gcc::context *ctxt) : gimple_opt_pass(memlog_pass_data, ctxt) {}
 
 
+    //The capture functions we add (see "Field captures") come through the pass like any other function
+    bool gate(function *fun) override { return !is_field_capturer(fun->decl); }
+
     //We override execute(...) to add our own logic
     unsigned int execute(function *fun) override {
-      basic_block bb;
-      FOR_EACH_BB_FN(bb, fun) {
-        for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
-          gimple *stmt = gsi_stmt(gsi);
-          if (!stmt_is_user_code(stmt)) continue;
+      //new function: its header record is written before its first event
+      begin_function(fun);
+      g_loop_summaries.clear();
+      unsigned long long stmts = 0, events_before = g_stats.events();
+      unsigned long long filtered_before = g_stats.filtered;
+      uint64_t frame_site = 0;
+
+      //what each local's address does (the frame site's "esc"), needed even when the walk is skipped
+      {
+        auto_client_timevar tv(PHASE_CLASSIFY);
+        classify_locals(fun);
+      }
+
+      //unchanged since the last compile (cache= only): its records can be written as they were
+      const cache_entry *hit = cache_begin_function(fun);
 
-          // Log alloc/free call sites
-          detect_alloc_free_if_any(stmt);
+      if (hit && g_mode == MODE_STATIC) {
+        //nothing to instrument, so nothing to walk
+        auto_client_timevar tv(PHASE_SERIALIZE);
+        stmts = hit->counts.stmts;
+        cache_replay(*hit);
+        frame_site = reserve_frame_site(fun);
+      } else {
+        {
+          auto_client_timevar tv(PHASE_CLASSIFY);
+          if (g_stage == STAGE_LATE) collect_debug_binds(fun);
+          basic_block bb;
+          FOR_EACH_BB_FN(bb, fun) {
+            for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
+              gimple *stmt = gsi_stmt(gsi);
+              //debug statements (stage=late with -g) are not code
+              if (is_gimple_debug(stmt)) continue;
+              stmts++;
+              if (!stmt_is_user_code(stmt)) {
+                g_stats.filtered++;
+                continue;
+              }
+
+              // Find alloc/free/memcpy-style call sites
+              detect_call_if_any(stmt);
+
+              // Find assignment store sites (aggregate assignments become bulk writes)
+              detect_store_if_any(stmt);
+            }
+          }
+          // Runtime mode: which stores to register locals can do without a hook
+          plan_reg_stores(fun);
+          cache_check_hit(hit);
+          // What the store and write sites write through may point to (their records only, so not on a hit)
+          if (!hit) compute_points_to(fun);
+        }
 
-          // Log assignment store sites
-          detect_store_if_any(stmt);
+        {
+          auto_client_timevar tv(PHASE_SERIALIZE);
+          //on a hit (runtime mode) the sites only get their ids and hooks; their records come from the cache
+          cache_begin_sites(hit);
+          log_found_sites();
+          cache_end_sites(hit);
+          frame_site = reserve_frame_site(fun);
         }
       }
+      cache_end_function(hit, frame_site, stmts, g_stats.filtered - filtered_before);
+
+      g_stats.funcs++;
+      g_stats.stmts += stmts;
+      if (stmts > g_stats.largest_stmts) {
+        g_stats.largest_func = current_func_name();
+        g_stats.largest_stmts = stmts;
+        g_stats.largest_events = g_stats.events() - events_before;
+      }
+
+      // The loop analysis is done; the instrumentation below changes the CFG without keeping dominators up to date
+      free_dominance_info(CDI_DOMINATORS);
+
+      // Runtime mode: now that the walk is over, insert the hooks for the sites it found
+      // (the loop summaries first, while the loops' entry and exit edges are still the ones the analysis recorded)
+      bool instrumented = !g_pending_ranges.empty() || !g_pending_hooks.empty() ||
+                          (g_mode == MODE_RUNTIME && frame_site);
+      instrument_pending_ranges();
+      instrument_pending_hooks();
+      if (g_mode == MODE_RUNTIME && frame_site) instrument_frame(fun, frame_site);
+      g_debug_binds.clear();
+      g_built_nodes.clear();
+      g_locals.clear();
+      g_reg_stores.clear();
+      g_pts.clear();
+
+      // stage=late: the hooks' loads and stores of memory need virtual operands like the function's own
+      if (instrumented && gimple_in_ssa_p(fun)) {
+        mark_virtual_operands_for_renaming(fun);
+        return TODO_update_ssa_only_virtuals;
+      }
+      return 0;
+    }
+  };
+
+  //The frame sites are written after register allocation ("reload"), when the locals have their stack slots.
+  const pass_data memlog_frame_pass_data = {
+    RTL_PASS,        //runs on RTL, once per function
+    "memlog_frames", //internal name of the pass
+    OPTGROUP_NONE,
+    TV_PLUGIN_RUN,
+    0,
+    0,
+    0,
+    0,
+    0
+  };
+
+  struct memlog_frame_pass : rtl_opt_pass {
+    memlog_frame_pass(gcc::context *ctxt) : rtl_opt_pass(memlog_frame_pass_data, ctxt) {}
+
+    bool gate(function *) override { return !g_pending_frames.empty(); }
+
+    unsigned int execute(function *fun) override {
+      auto it = g_pending_frames.find(DECL_UID(fun->decl));
+      if (it == g_pending_frames.end()) return 0;
+
+      auto_client_timevar tv(PHASE_SERIALIZE);
+      log_frame_site(it->second);
+      g_pending_frames.erase(it);
       return 0;
     }
   };
 
+  /*
+    Binary mode writes its file here (everything it found is still in memory), JSONL mode its stats record,
+    then the output file is closed. The cache is written only when the compile got to PLUGIN_FINISH (completed).
+
+    memlog_finish and memlog_atexit can both get here (PLUGIN_FINISH, then the atexit handler); only the first
+    call does anything.
+  */
+  static void finish_output(bool completed) {
+    static bool finished = false;
+    if (finished) return;
+    finished = true;
+
+    auto_client_timevar tv(PHASE_IO);
+    if (g_format == FORMAT_BIN) {
+      bin_write_file();
+    } else {
+      emit_type_lines();
+      emit_stats_line();
+    }
+    out_close();
+    if (completed) cache_save();
+  }
+
+  /*
+    PLUGIN_FINISH callback: gcc calls this once, after the whole translation unit has been compiled.
+  */
+  static void memlog_finish(void *gcc_data, void *user_data) {
+    (void)gcc_data;
+    (void)user_data;
+    finish_output(true);
+  }
+
+  /*
+    atexit handler. gcc leaves through exit() without running PLUGIN_FINISH when it stops early
+    (-Wfatal-errors, fatal_error(), or an internal compiler error), so we drain whatever was traced so far here.
+    The cache file is left as it was: the function being compiled when gcc stopped, and every one after it, would
+    drop out of it.
+  */
+  static void memlog_atexit() {
+    finish_output(false);
+  }
+
 } // end anonymous namespace
 
 int plugin_init(struct plugin_name_args *plugin_info, struct plugin_gcc_version *version) {
@@ -1129,20 +6281,107 @@ int plugin_init(struct plugin_name_args *plugin_info, struct plugin_gcc_version
     if (key && std::strcmp(key, "out") == 0 && val) {
       g_out_path = val;
     }
+    // -fplugin-arg-<pluginname>-format=jsonl|bin
+    if (key && std::strcmp(key, "format") == 0 && val) {
+      if (std::strcmp(val, "bin") == 0) g_format = FORMAT_BIN;
+      else if (std::strcmp(val, "jsonl") == 0) g_format = FORMAT_JSONL;
+      else std::fprintf(stderr, "memlog_plugin: unknown format '%s', using jsonl\n", val);
+    }
+    // -fplugin-arg-<pluginname>-tu-id=<n>   (fixes the high bits of this compile's site ids, see memlog_format.h)
+    if (key && std::strcmp(key, "tu-id") == 0 && val) {
+      g_tu_id = (uint32_t)std::strtoul(val, nullptr, 0);
+      g_tu_id_set = true;
+    }
+    // -fplugin-arg-<pluginname>-ranges=0|1   (summarize affine stores in simple loops, default 1)
+    if (key && std::strcmp(key, "ranges") == 0 && val) g_loop_ranges = std::strcmp(val, "0") != 0;
+    // -fplugin-arg-<pluginname>-inline-stores=0|1   (runtime mode: record scalar stores inline, default 1)
+    if (key && std::strcmp(key, "inline-stores") == 0 && val) g_inline_stores = std::strcmp(val, "0") != 0;
+    // -fplugin-arg-<pluginname>-derive=0|1   (runtime mode: no hooks for stores another record implies, default 1)
+    if (key && std::strcmp(key, "derive") == 0 && val) g_derive_stores = std::strcmp(val, "0") != 0;
+    // -fplugin-arg-<pluginname>-fields=0|1   (runtime mode: capture struct assignments field by field, default 1)
+    if (key && std::strcmp(key, "fields") == 0 && val) g_field_captures = std::strcmp(val, "0") != 0;
+    // -fplugin-arg-<pluginname>-cache=<dir>   (reuse unchanged functions' records, see "Incremental output cache")
+    if (key && std::strcmp(key, "cache") == 0 && val && *val)
+      g_cache_dir = val[0] == '/' ? std::string(val) : path_join(getpwd(), val);
+    // -fplugin-arg-<pluginname>-mode=static|runtime
+    if (key && std::strcmp(key, "mode") == 0 && val) {
+      if (std::strcmp(val, "runtime") == 0) g_mode = MODE_RUNTIME;
+      else if (std::strcmp(val, "static") == 0) g_mode = MODE_STATIC;
+      else std::fprintf(stderr, "memlog_plugin: unknown mode '%s', using static\n", val);
+    }
+    // -fplugin-arg-<pluginname>-stage=early|late   (late: run on the optimized code, see "Optimized code")
+    if (key && std::strcmp(key, "stage") == 0 && val) {
+      if (std::strcmp(val, "late") == 0) g_stage = STAGE_LATE;
+      else if (std::strcmp(val, "early") == 0) g_stage = STAGE_EARLY;
+      else std::fprintf(stderr, "memlog_plugin: unknown stage '%s', using early\n", val);
+    }
+  }
+
+  // the loop range summaries read loops as the gimplifier wrote them
+  if (g_stage == STAGE_LATE) g_loop_ranges = false;
+
+  // Which files count as user code: built-in excludes first, so any rule given on the command line can override them
+  add_default_path_rules();
+  for (int i = 0; i < plugin_info->argc; i++) {
+    const char *key = plugin_info->argv[i].key;
+    const char *val = plugin_info->argv[i].value;
+    if (!key || !val) continue;
+    // -fplugin-arg-<pluginname>-include=<pattern>[:<pattern>...]   (and exclude=, filter=<config file>)
+    if (std::strcmp(key, "include") == 0) add_path_rules(true, val, getpwd());
+    else if (std::strcmp(key, "exclude") == 0) add_path_rules(false, val, getpwd());
+    else if (std::strcmp(key, "filter") == 0 && !load_path_rules(val))
+      std::fprintf(stderr, "memlog_plugin: could not read filter file '%s'\n", val);
+  }
+
+  // Which calls allocate, free or write blocks: the C library's, then -fplugin-arg-<pluginname>-allocators=<file>
+  add_default_callees();
+  for (int i = 0; i < plugin_info->argc; i++) {
+    const char *key = plugin_info->argv[i].key;
+    const char *val = plugin_info->argv[i].value;
+    if (key && val && std::strcmp(key, "allocators") == 0 && !load_callees(val))
+      std::fprintf(stderr, "memlog_plugin: could not read allocators file '%s'\n", val);
+  }
+
+  // Binary output needs a real file; never write raw bytes to the terminal.
+  if (g_format == FORMAT_BIN && g_out_path.empty()) {
+    std::fprintf(stderr, "memlog_plugin: format=bin needs -fplugin-arg-memlog_plugin-out=<path>, using jsonl\n");
+    g_format = FORMAT_JSONL;
   }
 
   out_open_or_stderr();
 
-  // Register pass after "cfg" (safe anchor)
+  if (g_format == FORMAT_BIN && g_out == stderr) {
+    std::fprintf(stderr, "memlog_plugin: could not open '%s', using jsonl on stderr\n", g_out_path.c_str());
+    g_format = FORMAT_JSONL;
+  }
+
+  // Files are written by a background thread; make sure it gets drained however compilation ends
+  out_start_writer();
+  std::atexit(memlog_atexit);
+
+  // Register pass after "cfg" (safe anchor), or after "optimized" (the last GIMPLE pass before expansion to RTL)
   memlog_pass *pass = new memlog_pass(g);
   struct register_pass_info pass_info;
   pass_info.pass = pass;
-  pass_info.reference_pass_name = "cfg";
+  pass_info.reference_pass_name = g_stage == STAGE_LATE ? "optimized" : "cfg";
   pass_info.ref_pass_instance_number = 1;
   pass_info.pos_op = PASS_POS_INSERT_AFTER;
 
   register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, NULL, &pass_info);
 
+  // And the frame sites once the stack is laid out (after register allocation)
+  memlog_frame_pass *frame_pass = new memlog_frame_pass(g);
+  struct register_pass_info frame_pass_info;
+  frame_pass_info.pass = frame_pass;
+  frame_pass_info.reference_pass_name = "reload";
+  frame_pass_info.ref_pass_instance_number = 1;
+  frame_pass_info.pos_op = PASS_POS_INSERT_AFTER;
+  register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, NULL, &frame_pass_info);
+
+  // The hook declarations outlive any one function, so gcc's garbage collector has to know about them
+  if (g_mode == MODE_RUNTIME)
+    register_callback(plugin_info->base_name, PLUGIN_REGISTER_GGC_ROOTS, NULL, (void *)memlog_gc_roots);
+
   // Close output file
   register_callback(plugin_info->base_name, PLUGIN_FINISH, memlog_finish, NULL);
 
@@ -1305,249 +6544,3 @@ int plugin_init(struct plugin_name_args *plugin_info, struct plugin_gcc_version
 //   }
 
 // }
-
-// // ---- Declare runtime hooks we will insert calls to ----
-// static tree hook_alloc_decl = NULL_TREE;
-// static tree hook_store_decl = NULL_TREE;
-// static tree hook_local_decl = NULL_TREE;
-
-// static tree get_or_create_decl_cached(const char *name, tree ret_type, tree arg_types) {
-//   tree fntype = build_function_type(ret_type, arg_types);
-
-//   // Simple cache by name (we only have a few hooks)
-//   tree *slot = NULL;
-//   if (strcmp(name, "__memlog_alloc") == 0) slot = &hook_alloc_decl;
-//   else if (strcmp(name, "__memlog_store") == 0) slot = &hook_store_decl;
-//   else if (strcmp(name, "__memlog_local") == 0) slot = &hook_local_decl;
-
-//   if (slot && *slot) return *slot;
-
-//   tree fn = build_fn_decl(name, fntype);
-//   TREE_PUBLIC(fn) = 1;
-//   DECL_EXTERNAL(fn) = 1;
-
-//   if (slot) *slot = fn;
-//   return fn;
-// }
-// static tree make_arg_list(std::initializer_list<tree> args) {
-//   tree list = NULL_TREE;
-//   for (auto it = std::rbegin(args); it != std::rend(args); ++it) {
-//     list = tree_cons(NULL_TREE, *it, list);
-//   }
-//   return list;
-// }
-
-// // Create a uint32 constant
-// static tree u32(unsigned v) {
-//   return build_int_cst(unsigned_type_node, v);
-// }
-
-// // ---- Core instrumentation ----
-
-// // Instrument: __memlog_alloc(site, ptr, size)
-// static void instrument_alloc_if_any(gimple_stmt_iterator *gsi, gimple *stmt) {
-//   if (!is_gimple_call(stmt)) return;
-
-//   tree callee = gimple_call_fndecl(stmt);
-//   if (!callee) return;
-
-//   const char *name = IDENTIFIER_POINTER(DECL_NAME(callee));
-//   if (!name) return;
-
-//   // Recognize common allocators by name. Extend as needed.
-//   bool is_alloc =
-//       (strcmp(name, "malloc") == 0) ||
-//       (strcmp(name, "calloc") == 0) ||
-//       (strcmp(name, "realloc") == 0);
-
-//   if (!is_alloc) return;
-
-//   // Only if the call assigns to something (p = malloc(...))
-//   tree lhs = gimple_call_lhs(stmt);
-//   if (!lhs) return;
-
-//   unsigned site = g_site_counter++;
-  
-//   log_mem(site,stmt,name);
-
-//   // Build decl: void __memlog_alloc(uint32_t, const void*, size_t)
-//   tree void_t = void_type_node;
-//   tree u32_t = unsigned_type_node;          // good enough for uint32 in practice
-//   tree const_void_ptr_t = build_pointer_type(build_qualified_type(void_type_node, TYPE_QUAL_CONST));
-//   tree size_t_t = size_type_node;
-
-//   tree args_type =
-//       tree_cons(NULL_TREE, u32_t,
-//       tree_cons(NULL_TREE, const_void_ptr_t,
-//       tree_cons(NULL_TREE, size_t_t, NULL_TREE)));
-
-//   tree hook = get_or_create_decl_cached("__memlog_alloc", void_t, args_type);
-
-//   // ptr argument: cast LHS (returned pointer) to const void*
-//   tree ptr_as_voidp = build1(NOP_EXPR, const_void_ptr_t, lhs);
-
-//   // size: malloc(arg0), calloc(arg0*arg1), realloc(arg1)
-//   tree nbytes = NULL_TREE;
-//   if (strcmp(name, "malloc") == 0) {
-//     nbytes = gimple_call_arg(stmt, 0);
-//   } else if (strcmp(name, "calloc") == 0) {
-//     tree a = gimple_call_arg(stmt, 0);
-//     tree b = gimple_call_arg(stmt, 1);
-//     nbytes = fold_build2(MULT_EXPR, size_t_t, a, b);
-//   } else { // realloc(ptr, n)
-//     nbytes = gimple_call_arg(stmt, 1);
-//   }
-
-//   // Insert call right after allocator call
-//   gcall *logcall = gimple_build_call(hook, 3, u32(site), ptr_as_voidp, nbytes);
-//   gimple_set_location(logcall, gimple_location(stmt));
-//   gsi_insert_after(gsi, logcall, GSI_NEW_STMT);
-// }
-
-
-// // Instrument stores:
-// //   tmp = RHS
-// //   __memlog_store(site, &LHS, sizeof(LHS), &tmp)
-// //   LHS = tmp
-// //Use this function to also flag any first initializations.
-// static void instrument_store_if_any(gimple_stmt_iterator *gsi, gimple *stmt) {
-//   if (!is_gimple_assign(stmt)) return;
-
-//   // LHS
-//   tree lhs = gimple_assign_lhs(stmt);
-
-//   // We want: (A) indirect/memory refs like *p, a[i], s->f
-//   // and also (B) local VAR_DECL assignments (for init/changes).
-//   const enum tree_code lhs_code = TREE_CODE(lhs);
-
-//   bool is_mem_store =
-//       (lhs_code == MEM_REF) ||
-//       (lhs_code == ARRAY_REF) ||
-//       (lhs_code == COMPONENT_REF) ||
-//       (lhs_code == INDIRECT_REF);
-
-//   bool is_var_store = (lhs_code == VAR_DECL);
-
-//   if (!is_mem_store && !is_var_store) return;
-
-//   unsigned site = g_site_counter++;
-
-//   log_write(site,stmt);
-
-//   // Runtime hook: void __memlog_store(uint32_t, const void*, size_t, const void*)
-//   tree void_t = void_type_node;
-//   tree u32_t = unsigned_type_node;
-//   tree const_void_ptr_t = build_pointer_type(build_qualified_type(void_type_node, TYPE_QUAL_CONST));
-//   tree size_t_t = size_type_node;
-
-//   tree args_type =
-//       tree_cons(NULL_TREE, u32_t,
-//       tree_cons(NULL_TREE, const_void_ptr_t,
-//       tree_cons(NULL_TREE, size_t_t,
-//       tree_cons(NULL_TREE, const_void_ptr_t, NULL_TREE))));
-
-//   tree hook = get_or_create_decl_cached("__memlog_store", void_t, args_type);
-
-//   // RHS
-//   tree rhs1 = gimple_assign_rhs1(stmt);
-
-//   // If RHS has side effects, the “tmp = RHS” step is essential.
-//   // We always do it, for simplicity.
-
-//   tree lhs_type = TREE_TYPE(lhs);
-//   if (!lhs_type)return;
-
-//   // Create a temporary to hold the value being written
-//     tree tmp = create_tmp_var(lhs_type, "memlog_tmp");
-
-// /* Make sure it belongs to this function. */
-//     DECL_CONTEXT(tmp) = current_function_decl;
-
-// /* Add it to the function's local declarations so it gets emitted. */
-//     add_local_decl(cfun, tmp);
-
-// /* If you take &tmp (you do), it must be addressable. */
-//     mark_addressable(tmp);
-
-//   // tmp = rhs1
-//   gimple *tmp_assign = gimple_build_assign(tmp, rhs1);
-//   gimple_set_location(tmp_assign, gimple_location(stmt));
-//   gsi_insert_before(gsi, tmp_assign, GSI_SAME_STMT);
-
-//   // address-of lhs: build &lhs, then cast to const void*
-//   tree addr = build1(ADDR_EXPR, build_pointer_type(lhs_type), lhs);
-//   tree addr_as_voidp = build1(NOP_EXPR, const_void_ptr_t, addr);
-
-//   // sizeof(lhs_type)
-//   tree nbytes = TYPE_SIZE_UNIT(lhs_type);
-//   if (!nbytes) return;
-
-//   // &tmp
-//   tree tmp_addr = build1(ADDR_EXPR, build_pointer_type(lhs_type), tmp);
-//   tree tmp_as_voidp = build1(NOP_EXPR, const_void_ptr_t, tmp_addr);
-
-//   // __memlog_store(site, &lhs, sizeof, &tmp)
-//   gcall *logcall = gimple_build_call(hook, 4, u32(site), addr_as_voidp, nbytes, tmp_as_voidp);
-//   gimple_set_location(logcall, gimple_location(stmt));
-//   gsi_insert_before(gsi, logcall, GSI_SAME_STMT);
-
-//   // Replace original store with: lhs = tmp
-//   gimple_assign_set_rhs1(stmt, tmp);
-// }
-
-// // ---- Pass class ----
-// namespace {
-
-// const pass_data memlog_pass_data = {
-//   GIMPLE_PASS,     // type
-//   "memlog",        // name
-//   OPTGROUP_NONE,   // optinfo_flags
-//   TV_NONE,         // tv_id
-//   PROP_gimple_any, // properties_required
-//   0,               // properties_provided
-//   0,               // properties_destroyed
-//   0,               // todo_flags_start
-//   0                // todo_flags_finish
-// };
-
-// struct memlog_pass : gimple_opt_pass {
-//   memlog_pass(gcc::context *ctxt) : gimple_opt_pass(memlog_pass_data, ctxt) {}
-
-//   unsigned int execute(function *fun) override {
-//     // Walk all basic blocks and statements
-//     basic_block bb;
-//     FOR_EACH_BB_FN(bb, fun) {
-//       for (gimple_stmt_iterator gsi = gsi_start_bb(bb); !gsi_end_p(gsi); gsi_next(&gsi)) {
-//         gimple *stmt = gsi_stmt(gsi);
-//         if (!stmt_is_user_code(stmt)) continue;
-
-//         // Instrument alloc calls (log after call)
-//         instrument_alloc_if_any(&gsi, stmt);
-
-//         // Instrument stores (log before store)
-//         instrument_store_if_any(&gsi, stmt);
-//       }
-//     }
-//     return 0;
-//   }
-// };
-
-// } // end anonymous namespace
-
-// int plugin_init(struct plugin_name_args *plugin_info, struct plugin_gcc_version *version) {
-//   if (!plugin_default_version_check(version, &gcc_version))
-//     return 1;
-
-//   // Register pass after gimplification (common stable point).
-//   memlog_pass *pass = new memlog_pass(g);
-//   struct register_pass_info pass_info;
-//   pass_info.pass = pass;
-//   pass_info.reference_pass_name = "cfg"; // safe anchor; you can move this later
-//   pass_info.ref_pass_instance_number = 1;
-//   pass_info.pos_op = PASS_POS_INSERT_AFTER;
-
-//   register_callback(plugin_info->base_name, PLUGIN_PASS_MANAGER_SETUP, NULL, &pass_info);
-//   register_callback(plugin_info->base_name, PLUGIN_FINISH_DECL, log_decl, &pass_info);
-
-//   return 0;
-// }
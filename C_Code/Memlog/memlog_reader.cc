@@ -0,0 +1,847 @@
+// memlog_reader.cc
+// Reader for the binary site files written by memlog_plugin (and the traces and indices the other tools write).
+// See memlog_reader.h and memlog_format.h.
+
+#include "memlog_reader.h"
+
+#include <algorithm>
+#include <cstring>
+
+void memlog_json_escape(const std::string &s, std::string &out) {
+  for (unsigned char c : s) {
+    switch (c) {
+      case '\\': out += "\\\\"; break;
+      case '"':  out += "\\\""; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char buf[7];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          out += buf;
+        } else {
+          out += (char)c;
+        }
+    }
+  }
+}
+
+
+namespace {
+
+  //The JSON "kind" of a memlog_site_kind.
+  const char *site_kind_name(uint32_t kind) {
+    switch (kind) {
+      case MEMLOG_SITE_STORE: return "store";
+      case MEMLOG_SITE_ALLOC: return "alloc";
+      case MEMLOG_SITE_WRITE: return "write";
+      case MEMLOG_SITE_FRAME: return "frame";
+      default: return "free";
+    }
+  }
+
+  //Looks up idx in a string table; anything out of range reads as fallback.
+  const std::string &table_str(const std::vector<std::string> &t, uint32_t idx, const std::string &fallback) {
+    return idx < t.size() ? t[idx] : fallback;
+  }
+
+  bool read_exact(FILE *in, void *dst, size_t n) {
+    return n == 0 || std::fread(dst, 1, n, in) == n;
+  }
+
+  //Bytes from the current position to the end of the file; SIZE_MAX if in can't seek (a pipe).
+  size_t bytes_left(FILE *in) {
+    long at = std::ftell(in);
+    if (at < 0 || std::fseek(in, 0, SEEK_END) != 0) return SIZE_MAX;
+    long end = std::ftell(in);
+    if (std::fseek(in, at, SEEK_SET) != 0 || end < at) return SIZE_MAX;
+    return (size_t)(end - at);
+  }
+
+  /*
+    Reads count records into out. The counts come from the file, so one the rest of the file (left bytes, taken off
+    as they are read) can't hold is a damaged file, not something to allocate for.
+  */
+  template <typename T> bool read_array(FILE *in, size_t count, std::vector<T> &out, size_t &left) {
+    if (count > left / sizeof(T)) return false;
+    out.resize(count);
+    if (!read_exact(in, out.data(), count * sizeof(T))) return false;
+    left -= count * sizeof(T);
+    return true;
+  }
+
+  bool read_table(FILE *in, uint32_t count, std::vector<std::string> &out, size_t &left) {
+    //every string is at least its length
+    if (count > left / sizeof(uint32_t)) return false;
+    out.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t len;
+      if (!read_exact(in, &len, sizeof(len))) return false;
+      left -= sizeof(len);
+      if (len > left) return false;
+      out[i].resize(len);
+      if (!read_exact(in, &out[i][0], len)) return false;
+      left -= len;
+    }
+    return true;
+  }
+
+  //",\"pt\":{...}" for a store or write site that has points-to entries (see "POINTS-TO")
+  void points_to_json(const memlog_bin_file &f, uint32_t site, std::string &out) {
+    auto it = f.points_to_of_site.find(site);
+    if (it == f.points_to_of_site.end()) return;
+    out += ",\"pt\":{\"alloc\":[";
+    uint32_t i = it->second;
+    bool definite = (f.points_to[i].flags & MEMLOG_PT_F_DEFINITE) != 0;
+    for (bool first = true; i < f.points_to.size() && f.points_to[i].site == site; i++) {
+      if (f.points_to[i].alloc == MEMLOG_NONE) continue;
+      if (!first) out += ',';
+      first = false;
+      out += std::to_string((unsigned long long)MEMLOG_SITE_ID(f.header.tu_id, f.points_to[i].alloc));
+    }
+    out += definite ? "],\"definite\":true}" : "],\"definite\":false}";
+  }
+
+  //",\"type\":<id>" for a site or local that refers to a type (see "TYPES")
+  void type_ref_json(const memlog_bin_file &f, uint32_t idx, std::string &out) {
+    if (idx >= f.types.size()) return;
+    out += ",\"type\":";
+    out += std::to_string((unsigned long long)f.types[idx].id);
+  }
+
+  //A child index is valid if it is MEMLOG_NONE or points at an earlier node (children are written first).
+  bool child_ok(uint32_t child, uint32_t parent) {
+    return child == MEMLOG_NONE || child < parent;
+  }
+
+} // end anonymous namespace
+
+
+bool memlog_bin_load(FILE *in, memlog_bin_file &out, std::string &err) {
+  if (!in) { err = "no input file"; return false; }
+
+  std::memset(&out.header, 0, sizeof(out.header));
+
+  //read the fields we know about; a newer writer may have a bigger header, which we skip over
+  if (!read_exact(in, &out.header, sizeof(out.header))) { err = "truncated header"; return false; }
+  if (std::memcmp(out.header.magic, MEMLOG_BIN_MAGIC, MEMLOG_BIN_MAGIC_LEN) != 0) { err = "not a memlog binary file"; return false; }
+  if (out.header.version != MEMLOG_BIN_VERSION) {
+    err = "unsupported version " + std::to_string(out.header.version);
+    return false;
+  }
+  if (out.header.header_size < sizeof(out.header)) { err = "bad header size"; return false; }
+  if (out.header.header_size > sizeof(out.header) &&
+      std::fseek(in, (long)(out.header.header_size - sizeof(out.header)), SEEK_CUR) != 0) {
+    err = "truncated header";
+    return false;
+  }
+
+  size_t left = bytes_left(in);
+  if (!read_table(in, out.header.n_files, out.files, left) ||
+      !read_table(in, out.header.n_funcs, out.funcs, left) ||
+      !read_table(in, out.header.n_idents, out.idents, left)) {
+    err = "truncated string table";
+    return false;
+  }
+
+  if (!read_array(in, out.header.n_exprs, out.exprs, left)) { err = "truncated expressions"; return false; }
+
+  if (!read_array(in, out.header.n_sites, out.sites, left)) { err = "truncated sites"; return false; }
+
+  if (!read_array(in, out.header.n_ranges, out.ranges, left)) { err = "truncated ranges"; return false; }
+  out.range_of_site.clear();
+  for (uint32_t i = 0; i < out.ranges.size(); i++) out.range_of_site[out.ranges[i].site] = i;
+
+  if (!read_array(in, out.header.n_locals, out.locals, left)) { err = "truncated locals"; return false; }
+  out.locals_of_site.clear();
+  //a frame's locals are consecutive: remember where each frame's run starts
+  for (uint32_t i = out.locals.size(); i-- > 0;) out.locals_of_site[out.locals[i].site] = i;
+
+  if (!read_array(in, out.header.n_inlines, out.inlines, left)) { err = "truncated inlines"; return false; }
+  out.inlines_of_site.clear();
+  //same for a site's inlined calls
+  for (uint32_t i = out.inlines.size(); i-- > 0;) out.inlines_of_site[out.inlines[i].site] = i;
+
+  if (!read_array(in, out.header.n_reg_stores, out.reg_stores, left)) { err = "truncated register local stores"; return false; }
+  out.reg_stores_of_frame.clear();
+  //and a frame's register local stores
+  for (uint32_t i = out.reg_stores.size(); i-- > 0;) out.reg_stores_of_frame[out.reg_stores[i].frame] = i;
+
+  if (!read_array(in, out.header.n_points_to, out.points_to, left)) { err = "truncated points-to"; return false; }
+  out.points_to_of_site.clear();
+  for (uint32_t i = out.points_to.size(); i-- > 0;) out.points_to_of_site[out.points_to[i].site] = i;
+
+  if (!read_array(in, out.header.n_types, out.types, left)) { err = "truncated types"; return false; }
+  if (!read_array(in, out.header.n_fields, out.fields, left)) { err = "truncated fields"; return false; }
+  out.fields_of_type.clear();
+  for (uint32_t i = out.fields.size(); i-- > 0;) out.fields_of_type[out.fields[i].owner] = i;
+
+  //the stats record; like the header, a newer writer's may be bigger than ours
+  out.has_stats = out.header.stats_size != 0;
+  std::memset(&out.stats, 0, sizeof(out.stats));
+  if (out.has_stats) {
+    size_t n = out.header.stats_size < sizeof(out.stats) ? out.header.stats_size : sizeof(out.stats);
+    if (!read_exact(in, &out.stats, n)) { err = "truncated stats"; return false; }
+  }
+
+  //reject files whose expression children point forwards (they could loop forever when printed)
+  for (uint32_t i = 0; i < out.exprs.size(); i++) {
+    if (!child_ok(out.exprs[i].a, i) || !child_ok(out.exprs[i].b, i)) {
+      err = "bad child index in expression " + std::to_string(i);
+      return false;
+    }
+  }
+  for (const memlog_bin_site &s : out.sites) {
+    if ((s.expr != MEMLOG_NONE && s.expr >= out.exprs.size()) ||
+        (s.expr2 != MEMLOG_NONE && s.expr2 >= out.exprs.size()) ||
+        (s.expr3 != MEMLOG_NONE && s.expr3 >= out.exprs.size())) {
+      err = "bad expression index in site " + std::to_string(s.site);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+void memlog_bin_expr_json(const memlog_bin_file &f, uint32_t idx, std::string &out) {
+  static const std::string unknown_name = "?";
+  static const std::string unknown_field = "<field>";
+  static const std::string unknown_float = "null";
+
+  if (idx == MEMLOG_NONE || idx >= f.exprs.size()) { out += "null"; return; }
+  const memlog_bin_expr &e = f.exprs[idx];
+
+  switch (e.kind) {
+    case MEMLOG_EX_VAR:
+      out += "{\"k\":\"var\",\"name\":\"";
+      memlog_json_escape(table_str(f.idents, e.name, unknown_name), out);
+      out += "\"}";
+      return;
+
+    case MEMLOG_EX_INT:
+      out += "{\"k\":\"int\",\"v\":";
+      out += std::to_string((long long)e.value);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_BIGINT:
+      out += "{\"k\":\"int\",\"v\":\"<bigint>\"}";
+      return;
+
+    case MEMLOG_EX_BIN:
+      out += "{\"k\":\"bin\",\"op\":\"";
+      out.append(e.op, strnlen(e.op, sizeof(e.op)));
+      out += "\",\"a\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += ",\"b\":";
+      memlog_bin_expr_json(f, e.b, out);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_CAST:
+      out += "{\"k\":\"cast\",\"to\":\"<nop>\",\"x\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_ADDR:
+      out += "{\"k\":\"addr\",\"x\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_INDEX:
+      out += "{\"k\":\"index\",\"base\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += ",\"index\":";
+      memlog_bin_expr_json(f, e.b, out);
+      if (e.value >= 0) {
+        out += ",\"elem_bytes\":";
+        out += std::to_string((long long)e.value);
+      }
+      out += "}";
+      return;
+
+    case MEMLOG_EX_FIELD:
+      out += "{\"k\":\"field\",\"base\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += ",\"field\":\"";
+      memlog_json_escape(table_str(f.idents, e.name, unknown_field), out);
+      out += "\",\"via_ptr\":";
+      out += (e.flags & MEMLOG_EXF_VIA_PTR) ? "true" : "false";
+      out += "}";
+      return;
+
+    case MEMLOG_EX_STR:
+      out += "{\"k\":\"str\",\"v\":\"";
+      memlog_json_escape(table_str(f.idents, e.name, unknown_name), out);
+      out += "\"}";
+      return;
+
+    case MEMLOG_EX_CTOR:
+      out += "{\"k\":\"ctor\",\"n\":";
+      out += std::to_string((long long)e.value);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_DEREF:
+      out += "{\"k\":\"deref\",\"base\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_MEM_REF:
+      out += "{\"k\":\"mem_ref\",\"base\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += ",\"offset\":";
+      memlog_bin_expr_json(f, e.b, out);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_FLOAT:
+      //the plugin stored the JSON text of the value
+      out += "{\"k\":\"float\",\"v\":";
+      out += table_str(f.idents, e.name, unknown_float);
+      out += "}";
+      return;
+
+    case MEMLOG_EX_UN:
+      out += "{\"k\":\"un\",\"op\":\"";
+      out.append(e.op, strnlen(e.op, sizeof(e.op)));
+      out += "\",\"x\":";
+      memlog_bin_expr_json(f, e.a, out);
+      out += "}";
+      return;
+
+    default:
+      out += "{\"k\":\"unknown\"}";
+      return;
+  }
+}
+
+
+void memlog_bin_site_json(const memlog_bin_file &f, const memlog_bin_site &s, std::string &out) {
+  static const std::string unknown = "<unknown>";
+
+  out += "{\"v\":1,\"site\":";
+  out += std::to_string((unsigned long long)MEMLOG_SITE_ID(f.header.tu_id, s.site));
+  out += ",\"kind\":\"";
+  out += site_kind_name(s.kind);
+  out += "\",\"loc\":{\"file\":\"";
+  memlog_json_escape(table_str(f.files, s.file, unknown), out);
+  out += "\",\"line\":";
+  out += std::to_string(s.line);
+  out += ",\"col\":";
+  out += std::to_string(s.col);
+  out += "},\"func\":\"";
+  memlog_json_escape(table_str(f.funcs, s.func, unknown), out);
+  out += "\",";
+
+  auto inl = f.inlines_of_site.find(s.site);
+  if (inl != f.inlines_of_site.end()) {
+    out += "\"inl\":[";
+    for (uint32_t i = inl->second; i < f.inlines.size() && f.inlines[i].site == s.site; i++) {
+      const memlog_bin_inline &c = f.inlines[i];
+      if (i != inl->second) out += ',';
+      out += "{\"fn\":\"";
+      memlog_json_escape(table_str(f.funcs, c.fn, unknown), out);
+      out += "\",\"file\":\"";
+      memlog_json_escape(table_str(f.files, c.file, unknown), out);
+      out += "\",\"line\":";
+      out += std::to_string(c.line);
+      out += ",\"col\":";
+      out += std::to_string(c.col);
+      out += '}';
+    }
+    out += "],";
+  }
+
+  switch (s.kind) {
+    case MEMLOG_SITE_STORE:
+      out += "\"store\":{\"lhs\":";
+      memlog_bin_expr_json(f, s.expr, out);
+      out += ",\"bytes\":";
+      out += s.bytes >= 0 ? std::to_string((long long)s.bytes) : "null";
+      type_ref_json(f, s.type, out);
+      out += ",\"rhs\":";
+      memlog_bin_expr_json(f, s.expr2, out);
+      out += (s.flags & MEMLOG_SITE_F_VALUE_STATIC) ? ",\"value_static\":true" : ",\"value_static\":false";
+      {
+        auto it = f.range_of_site.find(s.site);
+        if (it != f.range_of_site.end()) {
+          static const std::string unknown_name = "?";
+          const memlog_bin_range &r = f.ranges[it->second];
+          out += ",\"range\":{\"iv\":\"";
+          memlog_json_escape(table_str(f.idents, r.iv, unknown_name), out);
+          out += "\",\"step\":";
+          out += std::to_string((long long)r.step);
+          out += ",\"stride\":";
+          out += std::to_string((long long)r.stride);
+          out += ",\"value\":{\"mul\":";
+          out += std::to_string((long long)r.value_mul);
+          out += ",\"add\":";
+          out += std::to_string((long long)r.value_add);
+          out += "}}";
+        }
+      }
+      points_to_json(f, s.site, out);
+      out += "}";
+      break;
+
+    case MEMLOG_SITE_ALLOC:
+      out += "\"alloc\":{\"fn\":\"";
+      memlog_json_escape(table_str(f.idents, s.name, unknown), out);
+      out += "\",\"lhs\":";
+      memlog_bin_expr_json(f, s.expr, out);
+      type_ref_json(f, s.type, out);
+      out += ",\"size_expr\":";
+      memlog_bin_expr_json(f, s.expr2, out);
+      out += ",\"free_fn\":";
+      if (s.name2 == MEMLOG_NONE) {
+        out += "null";
+      } else {
+        out += '"';
+        memlog_json_escape(table_str(f.idents, s.name2, unknown), out);
+        out += '"';
+      }
+      out += (s.flags & MEMLOG_SITE_F_ARENA) ? ",\"arena\":true}" : ",\"arena\":false}";
+      break;
+
+    case MEMLOG_SITE_WRITE: {
+      static const std::string unknown_fn = "?";
+      const std::string &fn = table_str(f.idents, s.name, unknown_fn);
+      out += "\"write\":{\"fn\":\"";
+      memlog_json_escape(fn, out);
+      out += "\",\"dst\":";
+      memlog_bin_expr_json(f, s.expr, out);
+      type_ref_json(f, s.type, out);
+      out += ",\"len\":";
+      memlog_bin_expr_json(f, s.expr2, out);
+      out += fn == "memset" ? ",\"value\":" : ",\"src\":";
+      memlog_bin_expr_json(f, s.expr3, out);
+      if (s.flags & MEMLOG_SITE_F_FIELDS) out += ",\"capture\":\"fields\"";
+      points_to_json(f, s.site, out);
+      out += "}";
+      break;
+    }
+
+    case MEMLOG_SITE_FRAME: {
+      static const std::string unknown_name = "?";
+      out += "\"frame\":{\"locals\":[";
+      auto it = f.locals_of_site.find(s.site);
+      uint32_t first = it != f.locals_of_site.end() ? it->second : (uint32_t)f.locals.size();
+      for (uint32_t i = first; i < f.locals.size() && f.locals[i].site == s.site; i++) {
+        const memlog_bin_local &l = f.locals[i];
+        if (i != first) out += ',';
+        out += "{\"name\":\"";
+        memlog_json_escape(table_str(f.idents, l.name, unknown_name), out);
+        out += (l.flags & MEMLOG_LOCAL_F_PARAM) ? "\",\"param\":true" : "\",\"param\":false";
+        out += ",\"offset\":";
+        out += l.offset != MEMLOG_NO_OFFSET ? std::to_string((long long)l.offset) : "null";
+        out += ",\"size\":";
+        out += l.size >= 0 ? std::to_string((long long)l.size) : "null";
+        type_ref_json(f, l.type, out);
+        if (l.flags & MEMLOG_LOCAL_F_REG) out += ",\"esc\":\"reg\"";
+        else if (l.flags & MEMLOG_LOCAL_F_ADDR) out += ",\"esc\":\"addr\"";
+        else if (l.flags & MEMLOG_LOCAL_F_ESCAPES) out += ",\"esc\":\"escapes\"";
+        if (l.flags & MEMLOG_LOCAL_F_INLINED) {
+          out += ",\"inl\":\"";
+          memlog_json_escape(table_str(f.funcs, l.inl, unknown_name), out);
+          out += '"';
+        }
+        out += '}';
+      }
+      out += ']';
+      auto d = f.reg_stores_of_frame.find(s.site);
+      if (d != f.reg_stores_of_frame.end()) {
+        out += ",\"reg_stores\":[";
+        for (uint32_t i = d->second; i < f.reg_stores.size() && f.reg_stores[i].frame == s.site; i++) {
+          const memlog_bin_reg_store &x = f.reg_stores[i];
+          if (i != d->second) out += ',';
+          out += "{\"site\":";
+          out += std::to_string((unsigned long long)MEMLOG_SITE_ID(f.header.tu_id, x.site));
+          out += ",\"local\":";
+          out += std::to_string(x.local);
+          if (x.anchor == MEMLOG_NONE) {
+            out += '}';
+            continue;
+          }
+          out += ",\"anchor\":";
+          out += std::to_string((unsigned long long)MEMLOG_SITE_ID(f.header.tu_id, x.anchor));
+          out += ",\"from\":";
+          out += x.from != MEMLOG_NONE ? std::to_string(x.from) : "null";
+          out += ",\"add\":";
+          out += std::to_string((long long)x.add);
+          out += '}';
+        }
+        out += ']';
+      }
+      out += '}';
+      break;
+    }
+
+    default:
+      out += "\"free\":{\"fn\":\"";
+      memlog_json_escape(table_str(f.idents, s.name, unknown), out);
+      out += "\",\"ptr_expr\":";
+      memlog_bin_expr_json(f, s.expr, out);
+      out += "}";
+      break;
+  }
+  out += "}";
+}
+
+
+void memlog_bin_type_json(const memlog_bin_file &f, uint32_t idx, std::string &out) {
+  static const char *const kinds[] = { "other", "int", "bool", "enum", "float", "ptr", "array", "struct", "union",
+                                       "func", "void" };
+  static const std::string unknown = "?";
+  const memlog_bin_type &t = f.types[idx];
+
+  out += "{\"v\":2,\"kind\":\"type\",\"id\":";
+  out += std::to_string((unsigned long long)t.id);
+  out += ",\"k\":\"";
+  out += t.kind < sizeof(kinds) / sizeof(kinds[0]) ? kinds[t.kind] : "other";
+  out += '"';
+  if (t.name != MEMLOG_NONE) {
+    out += ",\"name\":\"";
+    memlog_json_escape(table_str(f.idents, t.name, unknown), out);
+    out += '"';
+  }
+  out += ",\"size\":";
+  out += t.size >= 0 ? std::to_string((long long)t.size) : "null";
+  out += ",\"align\":";
+  out += t.align ? std::to_string(t.align) : "null";
+
+  auto ref = [&](uint32_t i) {
+    out += i < f.types.size() ? std::to_string((unsigned long long)f.types[i].id) : "null";
+  };
+  switch (t.kind) {
+    case MEMLOG_TY_INT:
+    case MEMLOG_TY_ENUM:
+      out += (t.flags & MEMLOG_TYPE_F_UNSIGNED) ? ",\"unsigned\":true" : ",\"unsigned\":false";
+      break;
+    case MEMLOG_TY_PTR:
+      out += ",\"to\":";
+      ref(t.ref);
+      break;
+    case MEMLOG_TY_ARRAY:
+      out += ",\"elem\":";
+      ref(t.ref);
+      out += ",\"count\":";
+      out += t.count >= 0 ? std::to_string((long long)t.count) : "null";
+      break;
+    case MEMLOG_TY_STRUCT:
+    case MEMLOG_TY_UNION: {
+      if (!(t.flags & MEMLOG_TYPE_F_COMPLETE)) break;
+      out += ",\"fields\":[";
+      auto it = f.fields_of_type.find(idx);
+      if (it != f.fields_of_type.end()) {
+        for (uint32_t i = it->second; i < f.fields.size() && f.fields[i].owner == idx; i++) {
+          const memlog_bin_field &x = f.fields[i];
+          if (i != it->second) out += ',';
+          out += "{\"name\":";
+          if (x.name != MEMLOG_NONE) {
+            out += '"';
+            memlog_json_escape(table_str(f.idents, x.name, unknown), out);
+            out += '"';
+          } else {
+            out += "null";
+          }
+          out += ",\"offset\":";
+          out += x.bit_offset >= 0 ? std::to_string((long long)(x.bit_offset / 8)) : "null";
+          if (x.bits) {
+            out += ",\"bit\":";
+            out += x.bit_offset >= 0 ? std::to_string((long long)(x.bit_offset % 8)) : "null";
+            out += ",\"bits\":";
+            out += std::to_string(x.bits);
+          }
+          out += ",\"type\":";
+          ref(x.type);
+          out += '}';
+        }
+      }
+      out += ']';
+      break;
+    }
+    default:
+      break;
+  }
+  out += '}';
+}
+
+
+void memlog_bin_stats_json(const memlog_bin_file &f, std::string &out) {
+  const memlog_bin_stats &st = f.stats;
+  out += "{\"v\":2,\"kind\":\"stats\",\"funcs\":";
+  out += std::to_string((unsigned long long)st.funcs);
+  out += ",\"cached\":";
+  out += std::to_string((unsigned long long)st.funcs_cached);
+  out += ",\"stmts\":";
+  out += std::to_string((unsigned long long)st.stmts);
+  out += ",\"filtered\":";
+  out += std::to_string((unsigned long long)st.stmts_filtered);
+  out += ",\"events\":{\"store\":";
+  out += std::to_string((unsigned long long)st.stores);
+  out += ",\"range_store\":";
+  out += std::to_string((unsigned long long)st.range_stores);
+  out += ",\"alloc\":";
+  out += std::to_string((unsigned long long)st.allocs);
+  out += ",\"free\":";
+  out += std::to_string((unsigned long long)st.frees);
+  out += ",\"write\":";
+  out += std::to_string((unsigned long long)st.writes);
+  out += ",\"frame\":";
+  out += std::to_string((unsigned long long)st.frames);
+  out += "},\"derived\":";
+  out += std::to_string((unsigned long long)st.stores_derived);
+  out += ",\"bytes\":";
+  out += std::to_string((unsigned long long)st.bytes);
+  out += ",\"largest_func\":";
+  if (st.largest_func == MEMLOG_NONE) {
+    out += "null";
+  } else {
+    static const std::string unknown = "<unknown>";
+    out += "{\"name\":\"";
+    memlog_json_escape(table_str(f.funcs, st.largest_func, unknown), out);
+    out += "\",\"stmts\":";
+    out += std::to_string((unsigned long long)st.largest_func_stmts);
+    out += ",\"events\":";
+    out += std::to_string((unsigned long long)st.largest_func_events);
+    out += "}";
+  }
+  out += "}";
+}
+
+
+void memlog_bin_write_jsonl(const memlog_bin_file &f, FILE *out) {
+  std::string line;
+  for (const memlog_bin_site &s : f.sites) {
+    line.clear();
+    memlog_bin_site_json(f, s, line);
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), out);
+  }
+  for (uint32_t i = 0; i < f.types.size(); i++) {
+    line.clear();
+    memlog_bin_type_json(f, i, line);
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), out);
+  }
+  if (f.has_stats) {
+    line.clear();
+    memlog_bin_stats_json(f, line);
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), out);
+  }
+}
+
+
+bool memlog_bin_to_jsonl(FILE *in, FILE *out, std::string &err) {
+  memlog_bin_file f;
+  if (!memlog_bin_load(in, f, err)) return false;
+  memlog_bin_write_jsonl(f, out);
+  return true;
+}
+
+
+bool memlog_rt_to_jsonl(FILE *in, FILE *out, std::string &err) {
+  if (!in) { err = "no input file"; return false; }
+
+  memlog_rt_header h;
+  std::memset(&h, 0, sizeof(h));
+  if (!read_exact(in, &h, sizeof(h))) { err = "truncated header"; return false; }
+  if (std::memcmp(h.magic, MEMLOG_RT_MAGIC, MEMLOG_BIN_MAGIC_LEN) != 0) { err = "not a memlog runtime trace"; return false; }
+  if (h.version != MEMLOG_RT_VERSION) {
+    err = "unsupported version " + std::to_string(h.version);
+    return false;
+  }
+  if (h.header_size < sizeof(h) || h.record_size < sizeof(memlog_rt_record)) { err = "bad header size"; return false; }
+  if (h.header_size > sizeof(h) && std::fseek(in, (long)(h.header_size - sizeof(h)), SEEK_CUR) != 0) {
+    err = "truncated header";
+    return false;
+  }
+
+  std::vector<char> rec_bytes(h.record_size);
+  std::vector<char> data; //a write record's captured bytes
+  std::string line;
+  memlog_rt_chunk c;
+  while (std::fread(&c, 1, sizeof(c), in) == sizeof(c)) {
+    for (uint32_t i = 0; i < c.n_records; i++) {
+      if (!read_exact(in, rec_bytes.data(), rec_bytes.size())) { err = "truncated chunk"; return false; }
+      memlog_rt_record r;
+      std::memcpy(&r, rec_bytes.data(), sizeof(r));
+
+      char addr[24];
+      std::snprintf(addr, sizeof(addr), "0x%llx", (unsigned long long)r.addr);
+
+      line = "{\"tid\":";
+      line += std::to_string(c.tid);
+      uint32_t kind = (uint32_t)(r.site >> MEMLOG_RT_KIND_SHIFT);
+      line += ",\"site\":";
+      line += std::to_string((unsigned long long)(r.site & MEMLOG_RT_SITE_MASK));
+      line += ",\"kind\":\"";
+      line += kind == MEMLOG_RT_STORE ? "store" : kind == MEMLOG_RT_ALLOC ? "alloc" : kind == MEMLOG_RT_FREE ? "free" :
+              kind == MEMLOG_RT_RANGE_STORE ? "range_store" : kind == MEMLOG_RT_WRITE ? "write" :
+              kind == MEMLOG_RT_ENTER ? "enter" : kind == MEMLOG_RT_EXIT ? "exit" : "unknown";
+      line += "\",\"addr\":\"";
+      line += addr;
+      if (kind == MEMLOG_RT_ENTER || kind == MEMLOG_RT_EXIT) {
+        //addr is the frame base; nothing else to say
+        line += "\"}\n";
+        std::fwrite(line.data(), 1, line.size(), out);
+        continue;
+      }
+      if (kind == MEMLOG_RT_RANGE_STORE) {
+        line += "\",\"count\":";
+        line += std::to_string((unsigned long long)r.size);
+        line += ",\"iv0\":";
+        line += std::to_string((long long)r.value);
+        line += "}\n";
+        std::fwrite(line.data(), 1, line.size(), out);
+        continue;
+      }
+      line += "\",\"size\":";
+      line += std::to_string((unsigned long long)r.size);
+      if (kind == MEMLOG_RT_WRITE) {
+        //the captured bytes follow in whole records
+        uint64_t captured = r.value;
+        uint64_t n_data = (captured + rec_bytes.size() - 1) / rec_bytes.size();
+        if (n_data > c.n_records - 1 - i) { err = "truncated write data"; return false; }
+        data.resize(n_data * rec_bytes.size());
+        if (!read_exact(in, data.data(), data.size())) { err = "truncated chunk"; return false; }
+        i += (uint32_t)n_data;
+
+        static const char hex[] = "0123456789abcdef";
+        line += ",\"data\":\"";
+        for (uint64_t b = 0; b < captured; b++) {
+          line += hex[(unsigned char)data[b] >> 4];
+          line += hex[(unsigned char)data[b] & 15];
+        }
+        line += '"';
+      }
+      if (kind == MEMLOG_RT_STORE) {
+        line += ",\"value\":";
+        line += std::to_string((unsigned long long)r.value);
+      }
+      if (kind == MEMLOG_RT_ALLOC && r.value) {
+        //the block a realloc was given
+        std::snprintf(addr, sizeof(addr), "0x%llx", (unsigned long long)r.value);
+        line += ",\"old\":\"";
+        line += addr;
+        line += '"';
+      }
+      line += "}\n";
+      std::fwrite(line.data(), 1, line.size(), out);
+    }
+  }
+  return true;
+}
+
+
+const memlog_idx_site *memlog_idx_file::find_site(uint64_t site) const {
+  auto it = std::lower_bound(sites.begin(), sites.end(), site,
+                             [](const memlog_idx_site &s, uint64_t id) { return s.site < id; });
+  return it != sites.end() && it->site == site ? &*it : nullptr;
+}
+
+
+const memlog_idx_type *memlog_idx_file::find_type(uint64_t id) const {
+  auto it = std::lower_bound(types.begin(), types.end(), id,
+                             [](const memlog_idx_type &t, uint64_t v) { return t.id < v; });
+  return it != types.end() && it->id == id ? &*it : nullptr;
+}
+
+
+bool memlog_idx_load(FILE *in, memlog_idx_file &out, std::string &err) {
+  if (!in) { err = "no input file"; return false; }
+
+  memlog_idx_header &h = out.header;
+  std::memset(&h, 0, sizeof(h));
+  if (!read_exact(in, &h, sizeof(h))) { err = "truncated header"; return false; }
+  if (std::memcmp(h.magic, MEMLOG_IDX_MAGIC, MEMLOG_BIN_MAGIC_LEN) != 0) { err = "not a memlog index"; return false; }
+  if (h.version != MEMLOG_IDX_VERSION) {
+    err = "unsupported version " + std::to_string(h.version);
+    return false;
+  }
+  if (h.header_size != sizeof(h)) { err = "bad header size"; return false; }
+
+  size_t left = bytes_left(in);
+  if (!read_array(in, (size_t)h.n_strings + 1, out.str_off, left) || h.string_bytes > left) {
+    err = "truncated strings";
+    return false;
+  }
+  out.blob.resize(h.string_bytes);
+  if (!read_exact(in, &out.blob[0], out.blob.size())) {
+    err = "truncated strings";
+    return false;
+  }
+  left -= out.blob.size();
+  for (size_t i = 0; i + 1 < out.str_off.size(); i++) {
+    if (out.str_off[i] > out.str_off[i + 1] || out.str_off[i + 1] > h.string_bytes) { err = "bad string offsets"; return false; }
+  }
+  size_t pad = (8 - (out.blob.size() + out.str_off.size() * sizeof(uint32_t)) % 8) % 8;
+  char zeros[8];
+  if (!read_exact(in, zeros, pad)) { err = "truncated strings"; return false; }
+
+  left -= std::min(left, pad);
+  if (!read_array(in, h.n_sites, out.sites, left) || !read_array(in, h.n_types, out.types, left) ||
+      !read_array(in, h.n_files, out.files, left) || !read_array(in, h.n_sites, out.by_line, left) ||
+      !read_array(in, h.n_funcs, out.funcs, left) || !read_array(in, h.n_sites, out.by_func, left)) {
+    err = "truncated index";
+    return false;
+  }
+
+  for (const memlog_idx_site &s : out.sites) {
+    if (s.file >= h.n_strings || s.func >= h.n_strings || s.detail >= h.n_strings) {
+      err = "bad string index in site " + std::to_string((unsigned long long)s.site);
+      return false;
+    }
+  }
+  for (size_t i = 0; i < out.sites.size(); i++) {
+    if (out.by_line[i] >= h.n_sites || out.by_func[i] >= h.n_sites) { err = "bad site index"; return false; }
+  }
+  for (const memlog_idx_type &t : out.types) {
+    if (t.json >= h.n_strings) {
+      err = "bad string index in type " + std::to_string((unsigned long long)t.id);
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool memlog_idx_to_jsonl(FILE *in, FILE *out, std::string &err) {
+  memlog_idx_file f;
+  if (!memlog_idx_load(in, f, err)) return false;
+
+  std::string line;
+  for (const memlog_idx_site &s : f.sites) {
+    const char *kind = site_kind_name(s.kind);
+    line = "{\"v\":1,\"site\":";
+    line += std::to_string((unsigned long long)s.site);
+    line += ",\"kind\":\"";
+    line += kind;
+    line += "\",\"loc\":{\"file\":\"";
+    memlog_json_escape(f.str(s.file), line);
+    line += "\",\"line\":";
+    line += std::to_string(s.line);
+    line += ",\"col\":";
+    line += std::to_string(s.col);
+    line += "},\"func\":\"";
+    memlog_json_escape(f.str(s.func), line);
+    line += "\",\"";
+    line += kind;
+    line += "\":";
+    line += f.str(s.detail); //already JSON
+    line += "}\n";
+    std::fwrite(line.data(), 1, line.size(), out);
+  }
+  for (const memlog_idx_type &t : f.types) {
+    line = f.str(t.json);
+    line += '\n';
+    std::fwrite(line.data(), 1, line.size(), out);
+  }
+  return true;
+}
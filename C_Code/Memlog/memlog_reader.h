@@ -0,0 +1,136 @@
+// memlog_reader.h
+// Small reader library for the binary site files written by memlog_plugin (-fplugin-arg-memlog_plugin-format=bin),
+// for the runtime trace files written by memlog_runtime.c, and for the merged indices written by memlog_merge.
+//
+// The reader loads a whole file into memory and can print it back out as "v":1 JSONL, where every event
+// carries its own "loc" and "func" (the plugin's JSONL mode now writes the more compact "v":2 form with
+// function header records), so consumers of the original schema keep working unchanged.
+
+#ifndef MEMLOG_READER_H
+#define MEMLOG_READER_H
+
+#include "memlog_format.h"
+
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+//Everything stored in one binary site file.
+struct memlog_bin_file {
+  memlog_bin_header header;
+  std::vector<std::string> files;       //file string table
+  std::vector<std::string> funcs;       //function string table
+  std::vector<std::string> idents;      //identifier string table
+  std::vector<memlog_bin_expr> exprs;   //expression nodes
+  std::vector<memlog_bin_site> sites;   //site records
+  std::vector<memlog_bin_range> ranges; //loop summaries of store sites
+  std::unordered_map<uint32_t, uint32_t> range_of_site; //site number -> index in ranges
+  std::vector<memlog_bin_local> locals; //locals of frame sites
+  std::unordered_map<uint32_t, uint32_t> locals_of_site; //frame site number -> index of its first local
+  std::vector<memlog_bin_inline> inlines; //calls inlined sites came through
+  std::unordered_map<uint32_t, uint32_t> inlines_of_site; //site number -> index of its first (outermost) call
+  std::vector<memlog_bin_reg_store> reg_stores; //stores to the register locals of frame sites
+  std::unordered_map<uint32_t, uint32_t> reg_stores_of_frame; //frame site number -> index of its first one
+  std::vector<memlog_bin_points_to> points_to; //alloc sites stores and writes may write into
+  std::unordered_map<uint32_t, uint32_t> points_to_of_site; //site number -> index of its first entry
+  std::vector<memlog_bin_type> types;   //the type dictionary
+  std::vector<memlog_bin_field> fields; //fields of its struct and union types
+  std::unordered_map<uint32_t, uint32_t> fields_of_type; //type index -> index of its first field
+  bool has_stats;                       //did the file end with a stats record?
+  memlog_bin_stats stats;
+};
+
+/*
+  Appends s to out as the inside of a JSON string (same escaping rules as json_escape() in memlog_plugin.cc).
+*/
+void memlog_json_escape(const std::string &s, std::string &out);
+
+/*
+  Reads a complete binary site file from in.
+
+  returns: true on success. On failure returns false and describes the problem in err.
+*/
+bool memlog_bin_load(FILE *in, memlog_bin_file &out, std::string &err);
+
+/*
+  Appends the JSON for expression number idx (and all of its children) to out.
+  MEMLOG_NONE is written as null.
+*/
+void memlog_bin_expr_json(const memlog_bin_file &f, uint32_t idx, std::string &out);
+
+/*
+  Appends the "v":1 JSON object (no trailing newline) for one site record to out.
+*/
+void memlog_bin_site_json(const memlog_bin_file &f, const memlog_bin_site &s, std::string &out);
+
+/*
+  Appends the "kind":"type" JSON object (no trailing newline) for type number idx of f's dictionary to out.
+*/
+void memlog_bin_type_json(const memlog_bin_file &f, uint32_t idx, std::string &out);
+
+/*
+  Appends the "kind":"stats" JSON object (no trailing newline) for f's stats record to out.
+*/
+void memlog_bin_stats_json(const memlog_bin_file &f, std::string &out);
+
+/*
+  Writes every site of f to out as JSONL, one object per line, followed by its type dictionary and the stats record
+  if there is one.
+*/
+void memlog_bin_write_jsonl(const memlog_bin_file &f, FILE *out);
+
+/*
+  Convenience wrapper: memlog_bin_load followed by memlog_bin_write_jsonl.
+*/
+bool memlog_bin_to_jsonl(FILE *in, FILE *out, std::string &err);
+
+/*
+  Reads a runtime trace (memlog_runtime.c) from in and writes one JSON object per record to out:
+    {"tid":1,"site":12,"kind":"store","addr":"0x7ffd5c1e0a4c","size":4,"value":5}
+  ("value" is only present for stores.) Loop summaries come out as
+    {"tid":1,"site":9,"kind":"range_store","addr":"0x5581c0a012a0","count":4,"iv0":0}
+  and function entries and returns as
+    {"tid":1,"site":40,"kind":"enter","addr":"0x7ffd5c1e0a60"}     (addr: the frame base, see "FRAMES")
+
+  returns: true on success. On failure returns false and describes the problem in err.
+*/
+bool memlog_rt_to_jsonl(FILE *in, FILE *out, std::string &err);
+
+//Everything stored in one merged index (memlog_merge).
+struct memlog_idx_file {
+  memlog_idx_header header;
+  std::vector<uint32_t> str_off;         //string i is blob[str_off[i] .. str_off[i+1])
+  std::string blob;
+  std::vector<memlog_idx_site> sites;    //sorted by site id
+  std::vector<memlog_idx_type> types;    //sorted by type id
+  std::vector<memlog_idx_range> files;   //runs of by_line
+  std::vector<uint32_t> by_line;
+  std::vector<memlog_idx_range> funcs;   //runs of by_func
+  std::vector<uint32_t> by_func;
+
+  std::string str(uint32_t i) const {
+    return i + 1 < str_off.size() ? blob.substr(str_off[i], str_off[i + 1] - str_off[i]) : std::string();
+  }
+
+  //binary search by site id; returns null if there is no such site
+  const memlog_idx_site *find_site(uint64_t site) const;
+
+  //binary search by type id; returns null if there is no such type
+  const memlog_idx_type *find_type(uint64_t id) const;
+};
+
+/*
+  Reads a complete merged index from in.
+
+  returns: true on success. On failure returns false and describes the problem in err.
+*/
+bool memlog_idx_load(FILE *in, memlog_idx_file &out, std::string &err);
+
+/*
+  Reads a merged index from in and writes its sites to out as "v":1 JSONL, in site id order, followed by its type
+  dictionary ("kind":"type" records, in type id order).
+*/
+bool memlog_idx_to_jsonl(FILE *in, FILE *out, std::string &err);
+
+#endif // MEMLOG_READER_H
@@ -0,0 +1,1534 @@
+// memlog_replay.cc
+// Loads a runtime trace (memlog_runtime.c) and, optionally, the merged index of the program's sites (memlog_merge),
+// indexes the trace once, and then answers questions about it over a Unix domain socket: one request per line,
+// one JSON object per line back.
+//
+//   info                        records, events, threads, heap blocks and frames in the trace
+//   state <step> [tid]          every thread's call stack (each local's address and value) and the live heap blocks
+//   history <addr> [from] [n]   the writes that touched byte <addr>, from step <from> on (at most n, default 100)
+//   next <var> <step> [tid]     the first write to variable <var> after <step>
+//   init <addr> <len> <step>    which bytes of [addr, addr + len) had been written by <step>, and which are garbage
+//
+// usage: memlog_replay <trace.bin> [index.idx] [-s socket-path] [-q request]...
+//   (-q answers its requests on stdout, in order, and exits instead of serving; -q - reads them from stdin, one per
+//   line; the default socket is ./memlog-replay.sock)
+//
+// Steps number the trace's records in file order: step s is the s-th record, counting the records that carry a
+// write's captured bytes (those are never an event themselves). A "state" is the state after its step ran. One
+// thread's steps are in the order it ran; different threads' are only interleaved the way the runtime drained
+// them (see "RUNTIME TRACE LAYOUT" in memlog_format.h), so they are not a common clock.
+//
+// Locals, variable names and loop summaries come from the index: without one, frames are listed without their
+// locals, "next" only works for locals, and range stores are not in any address's history.
+//
+// The index also says which sites store to register locals (see "REGISTER LOCAL STORES" in memlog_format.h). Their
+// records carry no address, so the build adds a copy at the local's place in the frame; and the stores the plugin
+// left without a hook are put back, each with the step of the record it comes right before (its anchor) and
+// listed before that record. Answers mark those with "derived":true.
+//
+// Garbage (bytes never written since their block was allocated or their frame entered, see shadow_index) is
+// tracked to the byte. "init" answers with a mask of 64 bit words, each a hex string: bit i of word k is byte
+// addr + 64k + i, set if it had been written. "state" gives each local's mask and each heap block's count of
+// garbage bytes. Without an index every heap block starts as garbage (calloc's too) and locals are not tracked.
+
+#include "memlog_reader.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+  //the end of an interval that never ends (a block never freed, a frame never left)
+  const uint64_t OPEN = UINT64_MAX;
+
+  //writes spanning more bytes than this are not listed under every 8 byte granule they touch, but under coarser ones
+  //(see replay): each level's granules are 2^9 times the size of the one below it
+  const uint64_t WIDE_BYTES = 256;
+  const unsigned ADDR_LEVELS = 7;
+
+  //the most bytes an "init" request looks at (a heap block's garbage count has no limit)
+  const uint64_t MAX_MASK_BYTES = UINT64_C(1) << 24;
+
+  // ---------------------------
+  // The trace (mapped, never copied)
+  // ---------------------------
+
+  //a run of records from one thread
+  struct chunk_ref {
+    uint64_t first; //step of its first record
+    uint64_t off;   //file offset of its first record
+    uint32_t n;
+    uint32_t tid;
+  };
+
+  struct trace_file {
+    const unsigned char *map = nullptr;
+    size_t len = 0;
+    uint32_t rec_size = 0;
+    std::vector<chunk_ref> chunks; //non-empty ones only, in file order
+    uint64_t n_steps = 0;
+
+    const chunk_ref &chunk_of(uint64_t s) const {
+      return *(std::upper_bound(chunks.begin(), chunks.end(), s,
+                                [](uint64_t v, const chunk_ref &c) { return v < c.first; }) - 1);
+    }
+
+    //the record at step s (an event, not write data), and the thread that wrote it
+    memlog_rt_record at(uint64_t s, uint32_t *tid = nullptr) const {
+      const chunk_ref &c = chunk_of(s);
+      memlog_rt_record r;
+      std::memcpy(&r, map + c.off + (s - c.first) * rec_size, sizeof(r));
+      if (tid) *tid = c.tid;
+      return r;
+    }
+
+    //the captured bytes that follow the write record at step s
+    const unsigned char *write_data(uint64_t s) const {
+      const chunk_ref &c = chunk_of(s);
+      return map + c.off + (s + 1 - c.first) * rec_size;
+    }
+
+    /*
+      Calls fn(step, tid, record) for every event, in file order (a write's data records are skipped).
+      A write whose data runs past the end of its chunk ends that chunk (the trace was cut short).
+    */
+    template <typename Fn>
+    void for_each(Fn fn) const {
+      for (const chunk_ref &c : chunks) {
+        for (uint32_t i = 0; i < c.n; i++) {
+          memlog_rt_record r;
+          std::memcpy(&r, map + c.off + (uint64_t)i * rec_size, sizeof(r));
+          if ((r.site >> MEMLOG_RT_KIND_SHIFT) == MEMLOG_RT_WRITE) {
+            uint64_t n_data = (r.value + rec_size - 1) / rec_size;
+            if (n_data > c.n - 1 - i) break;
+            fn(c.first + i, c.tid, r);
+            i += (uint32_t)n_data;
+            continue;
+          }
+          fn(c.first + i, c.tid, r);
+        }
+      }
+    }
+  };
+
+  /*
+    Maps a runtime trace and finds its chunks.
+
+    returns: true on success. On failure returns false and describes the problem in err.
+  */
+  bool open_trace(const char *path, trace_file &t, std::string &err) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { err = std::strerror(errno); return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { err = std::strerror(errno); close(fd); return false; }
+    t.len = (size_t)st.st_size;
+    if (t.len < sizeof(memlog_rt_header)) { err = "truncated header"; close(fd); return false; }
+    void *m = mmap(nullptr, t.len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) { err = std::strerror(errno); return false; }
+    t.map = (const unsigned char *)m;
+
+    memlog_rt_header h;
+    std::memcpy(&h, t.map, sizeof(h));
+    if (std::memcmp(h.magic, MEMLOG_RT_MAGIC, MEMLOG_BIN_MAGIC_LEN) != 0) { err = "not a memlog runtime trace"; return false; }
+    if (h.version != MEMLOG_RT_VERSION) { err = "unsupported version " + std::to_string(h.version); return false; }
+    if (h.header_size < sizeof(h) || h.header_size > t.len || h.record_size < sizeof(memlog_rt_record)) {
+      err = "bad header size";
+      return false;
+    }
+    t.rec_size = h.record_size;
+
+    uint64_t off = h.header_size;
+    while (off + sizeof(memlog_rt_chunk) <= t.len) {
+      memlog_rt_chunk c;
+      std::memcpy(&c, t.map + off, sizeof(c));
+      off += sizeof(c);
+      //a program that died mid-drain leaves a short last chunk: keep the whole records it has
+      uint64_t n = std::min<uint64_t>(c.n_records, (t.len - off) / t.rec_size);
+      if (n) t.chunks.push_back({t.n_steps, off, (uint32_t)n, c.tid});
+      t.n_steps += n;
+      off += n * t.rec_size;
+      if (n < c.n_records) break;
+    }
+    //step lists are 32 bit
+    if (t.n_steps > UINT32_MAX) { err = "more than 2^32 records"; return false; }
+    return true;
+  }
+
+  // ---------------------------
+  // What the index says about the sites
+  // ---------------------------
+
+  struct local_var {
+    std::string name;
+    bool param;
+    int64_t offset; //from the frame base, MEMLOG_NO_OFFSET if none
+    int64_t size;   //-1 if unknown
+  };
+
+  /*
+    A store site's loop summary (see "LOOP RANGE STORES"). One record stands for every iteration, but the garbage
+    it clears does not always fit in one interval: when the stride is wider than the store, the bytes between the
+    iterations stay garbage, and shadow_index keeps one interval per gap. So the build pays O(iterations) for such
+    a summary (see shadow_write), unless none of its span was garbage to begin with.
+  */
+  struct range_info {
+    int64_t step, stride, mul, add;
+  };
+
+  //a store to a register local of a frame site
+  struct reg_store_info {
+    uint64_t site;  //the store site
+    uint64_t frame; //the frame site
+    uint32_t local; //index in the frame's locals
+    bool derived;   //no record of its own: it happens before each record of its anchor (see statics.derived)
+    bool has_from;
+    uint32_t from;  //derived: value = (has_from ? locals[from] : 0) + add
+    int64_t add;
+  };
+
+  //what an alloc site's blocks hold when they are handed out
+  enum alloc_fill {
+    FILL_GARBAGE, //malloc and anything the index says nothing about
+    FILL_SET,     //calloc zeroes them, strdup/strndup copy a string in
+    FILL_RESIZE   //realloc: what the old block held (see shadow_index)
+  };
+
+  struct statics {
+    bool loaded = false;
+    memlog_idx_file idx;
+    std::unordered_map<uint64_t, std::vector<local_var>> locals; //frame site -> its locals
+    std::unordered_map<uint64_t, range_info> ranges;             //store site -> its loop summary
+    std::unordered_map<uint64_t, int64_t> store_bytes;           //store site -> bytes per store
+    std::unordered_map<std::string, std::vector<uint64_t>> writers; //variable name -> sites that assign it by name
+    std::unordered_map<uint64_t, reg_store_info> reg_writers;       //store site -> the register local its records set
+    std::unordered_map<uint64_t, std::vector<reg_store_info>> derived; //anchor site -> the stores before its records
+    std::unordered_map<uint64_t, alloc_fill> fills; //alloc site -> how its blocks start, if not FILL_GARBAGE
+  };
+
+  //Reads the JSON string starting at s[i] (the opening quote) into out; i ends up past the closing quote.
+  bool json_string_at(const std::string &s, size_t &i, std::string &out) {
+    if (i >= s.size() || s[i] != '"') return false;
+    out.clear();
+    for (i++; i < s.size(); i++) {
+      char c = s[i];
+      if (c == '"') { i++; return true; }
+      if (c == '\\' && i + 1 < s.size()) {
+        c = s[++i];
+        if (c == 'n') c = '\n';
+        else if (c == 't') c = '\t';
+      }
+      out += c;
+    }
+    return false;
+  }
+
+  //The integer after key (which includes its quotes and colon), searched from s[from]; false if absent or null.
+  bool json_int_after(const std::string &s, const char *key, size_t from, int64_t &v) {
+    size_t p = s.find(key, from);
+    if (p == std::string::npos) return false;
+    p += std::strlen(key);
+    char *end;
+    long long x = std::strtoll(s.c_str() + p, &end, 10);
+    if (end == s.c_str() + p) return false;
+    v = x;
+    return true;
+  }
+
+  /*
+    Pulls what the queries need out of the sites' detail objects (the JSON the plugin wrote for each site):
+    frame layouts, loop summaries, store widths, and which sites assign a variable by name.
+  */
+  void load_statics(statics &st) {
+    static const char lhs_var[] = "{\"lhs\":{\"k\":\"var\",\"name\":";
+    static const char dst_var[] = "\"dst\":{\"k\":\"addr\",\"x\":{\"k\":\"var\",\"name\":";
+    static const char local_head[] = "{\"name\":";
+    static const char alloc_fn[] = "{\"fn\":";
+    std::string detail, name;
+    for (const memlog_idx_site &s : st.idx.sites) {
+      detail = st.idx.str(s.detail);
+      switch (s.kind) {
+        case MEMLOG_SITE_STORE: {
+          int64_t v;
+          if (json_int_after(detail, ",\"bytes\":", 0, v)) st.store_bytes[s.site] = v;
+          size_t r = detail.find("\"range\":{");
+          if (r != std::string::npos) {
+            range_info ri = {0, 0, 0, 0};
+            json_int_after(detail, "\"step\":", r, ri.step);
+            json_int_after(detail, "\"stride\":", r, ri.stride);
+            json_int_after(detail, "\"mul\":", r, ri.mul);
+            json_int_after(detail, "\"add\":", r, ri.add);
+            st.ranges[s.site] = ri;
+          }
+          size_t i = sizeof(lhs_var) - 1;
+          if (detail.compare(0, i, lhs_var) == 0 && json_string_at(detail, i, name)) st.writers[name].push_back(s.site);
+          break;
+        }
+        case MEMLOG_SITE_ALLOC: {
+          size_t i = sizeof(alloc_fn) - 1;
+          if (detail.compare(0, i, alloc_fn) != 0 || !json_string_at(detail, i, name)) break;
+          if (name == "calloc" || name == "strdup" || name == "strndup") st.fills[s.site] = FILL_SET;
+          else if (name == "realloc" || name == "reallocarray") st.fills[s.site] = FILL_RESIZE;
+          break;
+        }
+        case MEMLOG_SITE_WRITE: {
+          size_t i = detail.find(dst_var);
+          if (i == std::string::npos) break;
+          i += sizeof(dst_var) - 1;
+          if (json_string_at(detail, i, name)) st.writers[name].push_back(s.site);
+          break;
+        }
+        case MEMLOG_SITE_FRAME: {
+          std::vector<local_var> &ls = st.locals[s.site];
+          for (size_t p = 0; (p = detail.find(local_head, p)) != std::string::npos;) {
+            size_t i = p + sizeof(local_head) - 1;
+            local_var l = {std::string(), false, MEMLOG_NO_OFFSET, -1};
+            if (!json_string_at(detail, i, l.name)) break;
+            l.param = detail.compare(i, 13, ",\"param\":true") == 0;
+            json_int_after(detail, "\"offset\":", i, l.offset);
+            json_int_after(detail, "\"size\":", i, l.size);
+            ls.push_back(l);
+            p = i;
+          }
+          //the entries hold nothing but numbers (and null), so each ends at its first '}'
+          size_t r = detail.find("\"reg_stores\":[");
+          for (size_t p = r; r != std::string::npos && (p = detail.find("{\"site\":", p)) != std::string::npos;) {
+            size_t e = detail.find('}', p);
+            if (e == std::string::npos) break;
+            std::string entry = detail.substr(p, e - p);
+            p = e;
+            int64_t site = 0, local = 0, anchor = 0, from = 0, add = 0;
+            if (!json_int_after(entry, "\"site\":", 0, site) || !json_int_after(entry, "\"local\":", 0, local) ||
+                local < 0 || (size_t)local >= ls.size())
+              continue;
+            reg_store_info ri = {(uint64_t)site, s.site, (uint32_t)local, false, false, 0, 0};
+            if (!json_int_after(entry, "\"anchor\":", 0, anchor)) {
+              st.reg_writers[ri.site] = ri;
+              continue;
+            }
+            ri.derived = true;
+            ri.has_from = json_int_after(entry, "\"from\":", 0, from) && from >= 0 && (size_t)from < ls.size();
+            ri.from = (uint32_t)from;
+            json_int_after(entry, "\"add\":", 0, add);
+            ri.add = add;
+            st.derived[(uint64_t)anchor].push_back(ri);
+          }
+          break;
+        }
+        default:
+          break;
+      }
+    }
+  }
+
+  // ---------------------------
+  // Indices
+  // ---------------------------
+
+  /*
+    Intervals [from, to) of steps, added in order of from, and which of them are live at a given step.
+    Every so often the build keeps the set live at that point (a checkpoint); a query starts from the last
+    checkpoint before its step and only looks at the intervals added since. Checkpoints are at least as far apart
+    (in intervals) as the set they keep is big, so all of them together take no more room than the intervals.
+  */
+  struct live_index {
+    std::vector<uint64_t> from, to;
+    std::vector<uint32_t> ck_begin; //checkpoint c: intervals [0, ck_begin[c]) had been added,
+    std::vector<uint32_t> ck_first; //and ck_live[ck_first[c] .. ck_first[c + 1]) were live after the last of them
+    std::vector<uint32_t> ck_live;
+
+    uint32_t add(uint64_t step) {
+      from.push_back(step);
+      to.push_back(OPEN);
+      return (uint32_t)(from.size() - 1);
+    }
+
+    void build() {
+      static const size_t min_gap = 1024;
+      ck_begin.assign(1, 0);
+      ck_first.assign(2, 0);
+      ck_live.clear();
+      std::vector<uint32_t> cur, next;
+      uint32_t last = 0;
+      for (uint32_t i = 1; i <= from.size(); i++) {
+        if (i - last < std::max(min_gap, cur.size())) continue;
+        uint64_t t = from[i - 1];
+        next.clear();
+        for (uint32_t j : cur) if (to[j] > t) next.push_back(j);
+        for (uint32_t j = last; j < i; j++) if (to[j] > t) next.push_back(j);
+        cur.swap(next);
+        last = i;
+        ck_begin.push_back(i);
+        ck_live.insert(ck_live.end(), cur.begin(), cur.end());
+        ck_first.push_back((uint32_t)ck_live.size());
+      }
+    }
+
+    //the intervals live after step s, in the order they were added
+    void live_at(uint64_t s, std::vector<uint32_t> &out) const {
+      out.clear();
+      uint32_t n = (uint32_t)(std::upper_bound(from.begin(), from.end(), s) - from.begin());
+      size_t c = std::upper_bound(ck_begin.begin(), ck_begin.end(), n) - ck_begin.begin() - 1;
+      for (uint32_t k = ck_first[c]; k < ck_first[c + 1]; k++) {
+        if (to[ck_live[k]] > s) out.push_back(ck_live[k]);
+      }
+      for (uint32_t j = ck_begin[c]; j < n; j++) {
+        if (to[j] > s) out.push_back(j);
+      }
+    }
+  };
+
+  /*
+    Which bytes hold garbage (were never written since their memory came to be), at any step. A heap block is all
+    garbage when it is allocated, unless its allocator fills it (see alloc_fill; a realloc passes on the old
+    block's bits), and again once it is freed; a frame's locals are garbage when it is entered, its parameters are
+    not; every write clears the bytes it wrote. Memory none of that covers (globals, what code built without the
+    plugin owns) is never garbage.
+
+    The garbage bytes are kept as disjoint intervals, so marking a whole block costs the same whatever its size.
+    The build records each interval it adds or removes as a change (step, interval); a mark adds at most two and
+    removes only what it overlaps, so the journal grows with the number of marks, not with the bytes they cover.
+    intervals is left as it is at the end of the trace; a query moves it to its step by redoing or undoing the
+    changes in between (forward or back, so stepping through the trace costs only what changed) and then reads
+    the intervals that overlap its region. So that a jump across the trace does not redo all of it, the build
+    also keeps a copy of intervals every so many changes (at least as many as the copy holds, so the copies
+    together are no bigger than the journal), and a seek starts from the nearest one when that is less work.
+  */
+  struct shadow_index {
+    struct change {
+      uint64_t step, lo, hi;
+      bool add; //intervals gained [lo, hi) at step, or lost it
+    };
+    mutable std::map<uint64_t, uint64_t> intervals; //garbage: start -> end
+    std::vector<change> changes;                     //in step order
+    mutable size_t at = 0;                           //intervals has changes [0, at) applied
+
+    struct snapshot {
+      size_t at;
+      std::vector<std::pair<uint64_t, uint64_t>> intervals;
+    };
+    std::vector<snapshot> snapshots; //by at
+    static constexpr size_t snapshot_min = 4096; //changes between snapshots, at least
+
+    //the build's step: takes a snapshot when enough changes have piled up since the last one
+    void checkpoint() {
+      at = changes.size();
+      size_t last = snapshots.empty() ? 0 : snapshots.back().at;
+      if (at - last < std::max(snapshot_min, intervals.size())) return;
+      snapshots.push_back({at, std::vector<std::pair<uint64_t, uint64_t>>(intervals.begin(), intervals.end())});
+    }
+
+    void add(uint64_t lo, uint64_t hi, uint64_t step) {
+      intervals.emplace(lo, hi);
+      changes.push_back({step, lo, hi, true});
+    }
+
+    std::map<uint64_t, uint64_t>::iterator remove(std::map<uint64_t, uint64_t>::iterator it, uint64_t step) {
+      changes.push_back({step, it->first, it->second, false});
+      return intervals.erase(it);
+    }
+
+    //the first interval that ends after a (or at a, if touching counts)
+    std::map<uint64_t, uint64_t>::iterator first_after(uint64_t a, bool touching) const {
+      auto it = intervals.upper_bound(a);
+      if (it != intervals.begin()) {
+        auto p = std::prev(it);
+        if (p->second > a || (touching && p->second == a)) return p;
+      }
+      return it;
+    }
+
+    //is any byte of [lo, hi) garbage now?
+    bool any_garbage(uint64_t lo, uint64_t hi) const {
+      auto it = first_after(lo, false);
+      return it != intervals.end() && it->first < hi;
+    }
+
+    //makes bytes [lo, hi) garbage, or not, at step
+    void mark(uint64_t lo, uint64_t hi, bool garbage, uint64_t step) {
+      if (lo >= hi) return;
+      auto it = first_after(lo, garbage);
+      if (garbage) {
+        if (it != intervals.end() && it->first <= lo && it->second >= hi) return; //already garbage
+        //merged with everything it overlaps or touches
+        uint64_t a = lo, b = hi;
+        while (it != intervals.end() && it->first <= hi) {
+          a = std::min(a, it->first);
+          b = std::max(b, it->second);
+          it = remove(it, step);
+        }
+        add(a, b, step);
+      } else {
+        //what sticks out on either side stays
+        uint64_t left = OPEN, right = OPEN;
+        while (it != intervals.end() && it->first < hi) {
+          if (it->first < lo) left = it->first;
+          if (it->second > hi) right = it->second;
+          it = remove(it, step);
+        }
+        if (left != OPEN) add(left, lo, step);
+        if (right != OPEN) add(hi, right, step);
+      }
+      checkpoint();
+    }
+
+    //gives bytes [to, to + len) the garbage bytes [from, from + len) have now, at step (a block realloc moved)
+    void copy(uint64_t from, uint64_t to, uint64_t len, uint64_t step) {
+      std::vector<std::pair<uint64_t, uint64_t>> g;
+      for (auto it = first_after(from, false); it != intervals.end() && it->first < from + len; ++it) {
+        g.push_back({std::max(it->first, from) - from, std::min(it->second, from + len) - from});
+      }
+      mark(to, to + len, false, step);
+      for (const auto &p : g) mark(to + p.first, to + p.second, true, step);
+    }
+
+    //moves intervals to the state after step s
+    void seek(uint64_t s) const {
+      size_t to = std::upper_bound(changes.begin(), changes.end(), s,
+                                   [](uint64_t v, const change &c) { return v < c.step; }) - changes.begin();
+      auto sn = std::upper_bound(snapshots.begin(), snapshots.end(), to,
+                                 [](size_t v, const snapshot &x) { return v < x.at; });
+      if (sn != snapshots.begin()) {
+        const snapshot &x = *--sn;
+        if (x.intervals.size() + (to - x.at) < (at > to ? at - to : to - at)) {
+          intervals = std::map<uint64_t, uint64_t>(x.intervals.begin(), x.intervals.end());
+          at = x.at;
+        }
+      }
+      for (; at < to; at++) {
+        const change &c = changes[at];
+        if (c.add) intervals.emplace(c.lo, c.hi);
+        else intervals.erase(c.lo);
+      }
+      for (; at > to; at--) {
+        const change &c = changes[at - 1];
+        if (c.add) intervals.erase(c.lo);
+        else intervals.emplace(c.lo, c.hi);
+      }
+    }
+
+    /*
+      Which bytes of [a, a + len) had been written after step s, 64 to a word: bit i of out[k] is byte a + 64k + i
+      (bits past len are 0).
+
+      returns: how many of the bytes are garbage
+    */
+    uint64_t init_mask(uint64_t a, uint64_t len, uint64_t s, std::vector<uint64_t> &out) const {
+      seek(s);
+      out.assign((len + 63) / 64, ~UINT64_C(0));
+      if (!len) return 0;
+      if (len & 63) out.back() = (UINT64_C(1) << (len & 63)) - 1;
+      uint64_t garbage = 0;
+      for (auto it = first_after(a, false); it != intervals.end() && it->first < a + len; ++it) {
+        uint64_t lo = std::max(it->first, a) - a, hi = std::min(it->second, a + len) - a;
+        garbage += hi - lo;
+        for (uint64_t k = lo >> 6; k <= (hi - 1) >> 6; k++) {
+          uint64_t m = ~UINT64_C(0);
+          if (k == lo >> 6) m &= ~UINT64_C(0) << (lo & 63);
+          if (k == (hi - 1) >> 6) m &= ~UINT64_C(0) >> (63 - ((hi - 1) & 63));
+          out[k] &= ~m;
+        }
+      }
+      return garbage;
+    }
+
+    //How many bytes of [a, a + len) were garbage after step s: the overlap of each interval, without a mask.
+    uint64_t garbage_count(uint64_t a, uint64_t len, uint64_t s) const {
+      seek(s);
+      uint64_t garbage = 0;
+      for (auto it = first_after(a, false); it != intervals.end() && it->first < a + len; ++it) {
+        garbage += std::min(it->second, a + len) - std::max(it->first, a);
+      }
+      return garbage;
+    }
+  };
+
+  struct heap_block {
+    uint64_t site, addr, size;
+    uint32_t tid;
+  };
+
+  struct frame {
+    uint64_t site, base;
+    uint32_t tid;
+  };
+
+  //a store that is not a record of the trace: a register local's (at its place in the frame), or a derived one
+  struct placed_store {
+    memlog_rt_record r;
+    uint64_t step; //of the record it was made from, or of its anchor
+    uint32_t tid;
+    bool derived;  //an anchored store (see reg_store_info), not a copy of a record
+    bool known;    //derived: was the local it is based on known? (if not, r.value means nothing)
+  };
+
+  //a register local's value in one frame, as far as the trace tells
+  struct local_value {
+    bool known;
+    uint64_t v;
+  };
+
+  /*
+    Everything the queries use, built in two passes over the trace: the first finds the heap blocks and frames
+    and counts the entries of the address and site lists, the second fills those lists in (so they come out in
+    step order without being sorted).
+
+    Address lists are keyed by granule and hashed into buckets; each bucket's steps are every write that touched a
+    granule hashing there. Granules are 8 bytes for writes of up to WIDE_BYTES, and for wider ones the smallest of
+    4 KiB, 2 MiB, ... that keeps the write within about 32 of them. A history query looks at one bucket per level.
+
+    The lists hold write refs: a ref below n_steps is that step's record, n_steps + i is placed[i] (see
+    placed_store), and UINT32_MAX fills the unused end of a bucket. Refs are in step order, placed stores before
+    the record of the step they have.
+  */
+  struct replay {
+    trace_file t;
+    statics st;
+
+    uint64_t n_events = 0;
+    uint32_t n_threads = 0;
+
+    live_index heap_live;
+    std::vector<heap_block> blocks;
+    live_index frame_live;
+    std::vector<frame> frames;
+
+    unsigned bucket_bits = 10;
+    std::vector<uint64_t> bucket_first; //bucket b is addr_steps[bucket_first[b] .. bucket_first[b + 1])
+    std::vector<uint32_t> addr_steps;
+
+    std::unordered_map<uint64_t, uint32_t> site_slot; //site -> its run of site_steps
+    std::vector<uint64_t> site_first;
+    std::vector<uint32_t> site_steps;
+
+    std::vector<placed_store> placed;
+    uint64_t n_derived = 0;
+
+    shadow_index shadow;
+
+    //the step a write ref (see above) has; OPEN for the filler
+    uint64_t step_of(uint32_t ref) const {
+      if (ref == UINT32_MAX) return OPEN;
+      return ref < t.n_steps ? ref : placed[ref - t.n_steps].step;
+    }
+
+    memlog_rt_record record_at(uint32_t ref, uint32_t *tid = nullptr) const {
+      if (ref < t.n_steps) return t.at(ref, tid);
+      const placed_store &p = placed[ref - t.n_steps];
+      if (tid) *tid = p.tid;
+      return p.r;
+    }
+
+    bool is_derived(uint32_t ref) const { return ref >= t.n_steps && placed[ref - t.n_steps].derived; }
+
+    //does a store's value field hold what it stored?
+    bool value_known(uint32_t ref) const { return ref < t.n_steps || placed[ref - t.n_steps].known; }
+
+    size_t bucket_of(unsigned level, uint64_t granule) const {
+      return (size_t)(((granule << 3 | level) * UINT64_C(0x9E3779B97F4A7C15)) >> (64 - bucket_bits));
+    }
+
+    static unsigned granule_shift(unsigned level) { return 3 + 9 * level; }
+
+    //does ref x come before ref y in the lists? (step order, placed stores before the record of their step)
+    bool before(uint32_t x, uint32_t y) const {
+      uint64_t sx = step_of(x), sy = step_of(y);
+      if (sx != sy) return sx < sy;
+      if ((x >= t.n_steps) != (y >= t.n_steps)) return x >= t.n_steps;
+      return x < y;
+    }
+
+    int64_t bytes_of(uint64_t site) const {
+      auto it = st.store_bytes.find(site);
+      return it != st.store_bytes.end() && it->second > 0 ? it->second : 1;
+    }
+
+    /*
+      The bytes [lo, hi) a write-like event may have touched.
+
+      returns: false if the event writes nothing we can place (not a write, or a loop summary we know nothing about).
+    */
+    bool span(const memlog_rt_record &r, uint64_t &lo, uint64_t &hi) const {
+      uint32_t kind = (uint32_t)(r.site >> MEMLOG_RT_KIND_SHIFT);
+      if (kind == MEMLOG_RT_STORE || kind == MEMLOG_RT_WRITE) {
+        if (r.size == 0) return false;
+        lo = r.addr;
+        hi = r.addr + r.size < r.addr ? UINT64_MAX : r.addr + r.size;
+        return true;
+      }
+      if (kind != MEMLOG_RT_RANGE_STORE || r.size == 0) return false;
+      uint64_t site = r.site & MEMLOG_RT_SITE_MASK;
+      auto it = st.ranges.find(site);
+      if (it == st.ranges.end() || (it->second.stride == 0 && r.addr == 0)) return false; //the induction variable's own step
+      uint64_t last = r.addr + (uint64_t)it->second.stride * (r.size - 1);
+      lo = std::min(r.addr, last);
+      hi = std::max(r.addr, last) + (uint64_t)bytes_of(site);
+      return true;
+    }
+
+    /*
+      Does the write-like event r touch byte a? For a loop summary also says which iteration did (k).
+    */
+    bool covers(const memlog_rt_record &r, uint64_t a, uint64_t &k) const {
+      uint64_t lo, hi;
+      if (!span(r, lo, hi) || a < lo || a >= hi) return false;
+      k = 0;
+      if ((r.site >> MEMLOG_RT_KIND_SHIFT) != MEMLOG_RT_RANGE_STORE) return true;
+      const range_info &ri = st.ranges.find(r.site & MEMLOG_RT_SITE_MASK)->second;
+      uint64_t elem = (uint64_t)bytes_of(r.site & MEMLOG_RT_SITE_MASK);
+      if (ri.stride == 0) {
+        k = r.size - 1; //every iteration wrote the same place: the last one counts
+        return true;
+      }
+      uint64_t stride = ri.stride > 0 ? (uint64_t)ri.stride : (uint64_t)-ri.stride;
+      //distance from the first iteration's bytes, in the direction the loop walks
+      uint64_t d = ri.stride > 0 ? a - r.addr : r.addr + elem - 1 - a;
+      k = d / stride;
+      return k < r.size && d % stride < elem;
+    }
+
+    //calls fn(bucket) for every bucket r belongs in: those of the granules it touches, at its level
+    template <typename Fn>
+    void buckets_of(const memlog_rt_record &r, Fn fn) const {
+      uint64_t lo, hi;
+      if (!span(r, lo, hi)) return;
+      unsigned level = 0;
+      while (level + 1 < ADDR_LEVELS && hi - lo > WIDE_BYTES << (granule_shift(level) - 3)) level++;
+      unsigned shift = granule_shift(level);
+      for (uint64_t g = lo >> shift; g <= (hi - 1) >> shift; g++) fn(bucket_of(level, g));
+    }
+
+    /*
+      The lists that may hold writes to byte a: one bucket per level, less those that are the same bucket as a
+      lower level's. A wide write can still be in two of them (another of its granules shares the other bucket).
+
+      returns: how many of b/e it filled
+    */
+    unsigned runs_of(uint64_t a, const uint32_t **b, const uint32_t **e) const {
+      size_t seen[ADDR_LEVELS];
+      unsigned n = 0;
+      for (unsigned level = 0; level < ADDR_LEVELS; level++) {
+        size_t bk = bucket_of(level, a >> granule_shift(level));
+        if (std::find(seen, seen + n, bk) != seen + n) continue;
+        seen[n] = bk;
+        b[n] = addr_steps.data() + bucket_first[bk];
+        e[n] = addr_steps.data() + bucket_first[bk + 1];
+        n++;
+      }
+      return n;
+    }
+
+    //clears the garbage bits of the bytes the write-like event r wrote
+    void shadow_write(const memlog_rt_record &r, uint64_t step) {
+      uint64_t lo, hi;
+      if (r.addr == 0 || !span(r, lo, hi)) return; //a register local's store has no place of its own
+      if ((r.site >> MEMLOG_RT_KIND_SHIFT) == MEMLOG_RT_RANGE_STORE) {
+        uint64_t site = r.site & MEMLOG_RT_SITE_MASK;
+        int64_t stride = st.ranges.find(site)->second.stride;
+        uint64_t elem = (uint64_t)bytes_of(site);
+        //iterations that leave gaps between them are marked one by one (the gaps stay garbage, an interval each:
+        //O(iterations), see range_info), the rest as the span they cover
+        if ((uint64_t)(stride < 0 ? -stride : stride) > elem) {
+          if (!shadow.any_garbage(lo, hi)) return;
+          for (uint64_t k = 0; k < r.size; k++) {
+            uint64_t a = r.addr + (uint64_t)stride * k;
+            shadow.mark(a, a + elem, false, step);
+          }
+          return;
+        }
+      }
+      shadow.mark(lo, hi, false, step);
+    }
+
+    bool is_write(uint32_t kind) const {
+      return kind == MEMLOG_RT_STORE || kind == MEMLOG_RT_RANGE_STORE || kind == MEMLOG_RT_WRITE;
+    }
+
+    void build() {
+      //about 16 steps per bucket
+      while (bucket_bits < 30 && (UINT64_C(16) << bucket_bits) < t.n_steps) bucket_bits++;
+      bucket_first.assign(((size_t)1 << bucket_bits) + 1, 0);
+
+      //1. heap blocks, frames, and how long each list will be
+      std::unordered_map<uint64_t, uint32_t> open_blocks; //address -> block
+      std::vector<std::vector<uint32_t>> stacks;          //by tid: frames entered and not yet left
+      std::vector<bool> seen;                             //by tid
+      std::vector<uint64_t> site_count;
+      uint64_t last_site = OPEN;
+      uint32_t last_slot = 0;
+      auto count_write = [&](const memlog_rt_record &r) {
+        uint64_t site = r.site & MEMLOG_RT_SITE_MASK;
+        if (site != last_site) {
+          auto ins = site_slot.emplace(site, (uint32_t)site_count.size());
+          if (ins.second) site_count.push_back(0);
+          last_site = site;
+          last_slot = ins.first->second;
+        }
+        site_count[last_slot]++;
+        buckets_of(r, [&](size_t b) { bucket_first[b + 1]++; });
+      };
+
+      //register locals: their values in each frame that has stores to them, and the stores to put in the lists
+      std::unordered_map<uint32_t, std::vector<local_value>> values; //frame -> by local
+      auto set_local = [&](uint32_t fr, const reg_store_info &ri, uint64_t v, bool known, uint64_t step,
+                           uint32_t tid, bool derived) {
+        const std::vector<local_var> &ls = st.locals.find(ri.frame)->second;
+        const local_var &l = ls[ri.local];
+        if (l.size > 0 && l.size < 8) v &= (UINT64_C(1) << (8 * l.size)) - 1;
+        std::vector<local_value> &vs = values[fr];
+        vs.resize(ls.size(), local_value{false, 0});
+        vs[ri.local] = local_value{known, v};
+        //a register local's own record (addr 0) or a derived store, at the local's place; refs are 32 bit
+        if (l.offset == MEMLOG_NO_OFFSET || l.size <= 0 || t.n_steps + placed.size() + 1 >= UINT32_MAX) return;
+        memlog_rt_record r = {MEMLOG_RT_SITE_KIND(ri.site, MEMLOG_RT_STORE), frames[fr].base + (uint64_t)l.offset,
+                              (uint64_t)l.size, v};
+        placed.push_back(placed_store{r, step, tid, derived, known});
+        if (derived) n_derived++;
+        count_write(r);
+        shadow_write(r, step);
+      };
+
+      t.for_each([&](uint64_t step, uint32_t tid, const memlog_rt_record &r) {
+        n_events++;
+        if (tid >= stacks.size()) stacks.resize(tid + 1);
+        if (tid >= seen.size()) seen.resize(tid + 1);
+        if (!seen[tid]) {
+          seen[tid] = true;
+          n_threads++;
+        }
+        uint32_t kind = (uint32_t)(r.site >> MEMLOG_RT_KIND_SHIFT);
+        uint64_t site = r.site & MEMLOG_RT_SITE_MASK;
+
+        //the stores derived from this record happen first, in the innermost frame (if it is theirs)
+        if ((kind == MEMLOG_RT_STORE || kind == MEMLOG_RT_EXIT) && !stacks[tid].empty()) {
+          auto d = st.derived.find(site);
+          uint32_t fr = stacks[tid].back();
+          if (d != st.derived.end() && frames[fr].site == d->second[0].frame) {
+            for (const reg_store_info &ri : d->second) {
+              bool known = true;
+              uint64_t v = (uint64_t)ri.add;
+              if (ri.has_from) {
+                auto vs = values.find(fr);
+                known = vs != values.end() && vs->second[ri.from].known;
+                if (known) v += vs->second[ri.from].v;
+              }
+              set_local(fr, ri, v, known, step, tid, true);
+            }
+          }
+        }
+
+        switch (kind) {
+          case MEMLOG_RT_ALLOC: {
+            if (r.addr == 0) break; //the allocation failed (a realloc's old block is still there)
+            //a block at the same address was resized in place, or freed by code built without the plugin
+            auto it = open_blocks.find(r.addr);
+            if (it != open_blocks.end()) heap_live.to[it->second] = step;
+            //a realloc that kept its block keeps what it held, and so does one that moved it (value: the old
+            //block), which ends the old one; the bytes past the old size are garbage either way
+            auto moved = r.value && r.value != r.addr ? open_blocks.find(r.value) : open_blocks.end();
+            auto f = st.fills.find(site);
+            alloc_fill fill = r.value ? FILL_RESIZE : f == st.fills.end() ? FILL_GARBAGE : f->second;
+            if (fill == FILL_RESIZE && !r.value) fill = FILL_GARBAGE; //realloc(NULL, n) is a malloc
+            if (moved != open_blocks.end()) {
+              uint64_t old_size = blocks[moved->second].size, kept = std::min(r.size, old_size);
+              shadow.copy(r.value, r.addr, kept, step);
+              shadow.mark(r.addr + kept, r.addr + r.size, true, step);
+              shadow.mark(r.value, r.value + old_size, true, step);
+              heap_live.to[moved->second] = step;
+              open_blocks.erase(moved);
+            } else if (fill == FILL_RESIZE && it != open_blocks.end()) {
+              //grown: the new bytes are garbage; shrunk: the bytes it gave back are
+              uint64_t old_size = blocks[it->second].size;
+              shadow.mark(r.addr + std::min(r.size, old_size), r.addr + std::max(r.size, old_size), true, step);
+            } else {
+              //a realloc whose old block the trace does not give (or does not know) copied bytes it does not
+              //say, so they count as written rather than as garbage
+              shadow.mark(r.addr, r.addr + r.size, fill == FILL_GARBAGE, step);
+            }
+            uint32_t b = heap_live.add(step);
+            blocks.push_back({site, r.addr, r.size, tid});
+            open_blocks[r.addr] = b;
+            break;
+          }
+          case MEMLOG_RT_FREE: {
+            auto it = open_blocks.find(r.addr);
+            if (it == open_blocks.end()) break;
+            heap_live.to[it->second] = step;
+            shadow.mark(r.addr, r.addr + blocks[it->second].size, true, step);
+            open_blocks.erase(it);
+            break;
+          }
+          case MEMLOG_RT_ENTER: {
+            stacks[tid].push_back(frame_live.add(step));
+            frames.push_back({site, r.addr, tid});
+            //the caller set the parameters; the other locals hold whatever the stack held
+            auto ls = st.locals.find(site);
+            if (ls == st.locals.end()) break;
+            for (const local_var &l : ls->second) {
+              if (l.offset == MEMLOG_NO_OFFSET || l.size <= 0) continue;
+              uint64_t a = r.addr + (uint64_t)l.offset;
+              shadow.mark(a, a + (uint64_t)l.size, !l.param, step);
+            }
+            break;
+          }
+          case MEMLOG_RT_EXIT: {
+            //frames above the one returning were left by longjmp; they end here too
+            std::vector<uint32_t> &s = stacks[tid];
+            size_t d = s.size();
+            while (d > 0 && (frames[s[d - 1]].site != site || frames[s[d - 1]].base != r.addr)) d--;
+            if (d == 0) break;
+            for (size_t i = d - 1; i < s.size(); i++) {
+              frame_live.to[s[i]] = step;
+              values.erase(s[i]);
+            }
+            s.resize(d - 1);
+            break;
+          }
+          default:
+            break;
+        }
+        if (!is_write(kind)) return;
+        count_write(r);
+        shadow_write(r, step);
+
+        //a store to a register local of the innermost frame: its value, and (without an address) a copy at its place
+        if (kind != MEMLOG_RT_STORE || stacks[tid].empty()) return;
+        auto w = st.reg_writers.find(site);
+        uint32_t fr = stacks[tid].back();
+        if (w == st.reg_writers.end() || frames[fr].site != w->second.frame) return;
+        if (r.addr == 0) {
+          set_local(fr, w->second, r.value, true, step, tid, false);
+        } else {
+          std::vector<local_value> &vs = values[fr];
+          vs.resize(st.locals.find(w->second.frame)->second.size(), local_value{false, 0});
+          vs[w->second.local] = local_value{true, r.value};
+        }
+      });
+      heap_live.build();
+      frame_live.build();
+
+      //2. the lists themselves
+      for (size_t b = 1; b < bucket_first.size(); b++) bucket_first[b] += bucket_first[b - 1];
+      addr_steps.resize(bucket_first.back());
+      site_first.assign(site_count.size() + 1, 0);
+      for (size_t i = 0; i < site_count.size(); i++) site_first[i + 1] = site_first[i] + site_count[i];
+      site_steps.resize(site_first.back());
+      std::vector<uint64_t> bucket_fill(bucket_first.begin(), bucket_first.end() - 1);
+      std::vector<uint64_t> site_fill(site_first.begin(), site_first.end() - 1);
+      last_site = OPEN;
+      auto list_write = [&](uint32_t ref, const memlog_rt_record &r) {
+        uint64_t site = r.site & MEMLOG_RT_SITE_MASK;
+        if (site != last_site) {
+          last_site = site;
+          last_slot = site_slot[site];
+        }
+        site_steps[site_fill[last_slot]++] = ref;
+        buckets_of(r, [&](size_t b) {
+          //a write over two granules of the same bucket is listed once
+          uint64_t &f = bucket_fill[b];
+          if (f == bucket_first[b] || addr_steps[f - 1] != ref) addr_steps[f++] = ref;
+        });
+      };
+      //the placed stores were made in the same order as this pass meets their steps; they go before the step's
+      //own record (so a site's first event at a step is the copy that has the local's address)
+      size_t next_placed = 0;
+      t.for_each([&](uint64_t step, uint32_t, const memlog_rt_record &r) {
+        for (; next_placed < placed.size() && placed[next_placed].step == step; next_placed++)
+          list_write((uint32_t)(t.n_steps + next_placed), placed[next_placed].r);
+        if (is_write((uint32_t)(r.site >> MEMLOG_RT_KIND_SHIFT))) list_write((uint32_t)step, r);
+      });
+      //the duplicates skipped above leave a few unused entries at the end of their bucket: fill them with a step
+      //no query asks for (one past the end) so every bucket stays sorted
+      for (size_t b = 0; b + 1 < bucket_first.size(); b++) {
+        for (uint64_t f = bucket_fill[b]; f < bucket_first[b + 1]; f++) addr_steps[f] = UINT32_MAX;
+      }
+    }
+
+    //the first ref of [b, e) at step `from` or later, and the first after step s
+    const uint32_t *first_from(const uint32_t *b, const uint32_t *e, uint64_t from) const {
+      return std::lower_bound(b, e, from, [this](uint32_t ref, uint64_t v) { return step_of(ref) < v; });
+    }
+    const uint32_t *first_after(const uint32_t *b, const uint32_t *e, uint64_t s) const {
+      return std::upper_bound(b, e, s, [this](uint64_t v, uint32_t ref) { return v < step_of(ref); });
+    }
+
+    /*
+      Calls fn(ref, k) for every write that touched byte a, in step order, from step `from` up to (not including)
+      step `end`, until fn returns false. k is the iteration of a loop summary that did.
+    */
+    template <typename Fn>
+    void writes_to(uint64_t a, uint64_t from, uint64_t end, Fn fn) const {
+      const uint32_t *p[ADDR_LEVELS], *pe[ADDR_LEVELS];
+      unsigned n = runs_of(a, p, pe);
+      for (unsigned i = 0; i < n; i++) p[i] = first_from(p[i], pe[i], from);
+      end = std::min(end, t.n_steps); //the filler's step is OPEN
+      for (uint32_t last = UINT32_MAX;;) {
+        unsigned m = n;
+        for (unsigned i = 0; i < n; i++) {
+          if (p[i] < pe[i] && (m == n || before(*p[i], *p[m]))) m = i;
+        }
+        if (m == n || step_of(*p[m]) >= end) return;
+        uint32_t ref = *p[m]++;
+        if (ref == last) continue; //the same write from a second list comes right after the first
+        last = ref;
+        uint64_t k;
+        if (covers(record_at(ref), a, k) && !fn(ref, k)) return;
+      }
+    }
+
+    //the last write that touched byte a at or before step s, not before step since; false if there is none
+    bool last_write(uint64_t a, uint64_t since, uint64_t s, uint32_t &ref, uint64_t &k) const {
+      const uint32_t *pb[ADDR_LEVELS], *pe[ADDR_LEVELS];
+      unsigned n = runs_of(a, pb, pe);
+      bool found = false;
+      for (unsigned i = 0; i < n; i++) {
+        const uint32_t *p = first_after(pb[i], pe[i], s);
+        while (p > pb[i] && step_of(p[-1]) >= since && (!found || before(ref, p[-1]))) {
+          p--;
+          uint64_t pk;
+          if (covers(record_at(*p), a, pk)) { ref = *p; k = pk; found = true; break; }
+        }
+      }
+      return found;
+    }
+
+    //the first event of one of sites after step s; false if there is none
+    bool next_of_sites(const std::vector<uint64_t> &sites, uint64_t s, uint32_t &ref) const {
+      bool found = false;
+      for (uint64_t site : sites) {
+        auto it = site_slot.find(site);
+        if (it == site_slot.end()) continue;
+        const uint32_t *b = site_steps.data() + site_first[it->second], *e = site_steps.data() + site_first[it->second + 1];
+        const uint32_t *p = first_after(b, e, s);
+        if (p != e && (!found || step_of(*p) < step_of(ref))) { ref = *p; found = true; }
+      }
+      return found;
+    }
+  };
+
+  // ---------------------------
+  // Answers
+  // ---------------------------
+
+  void hex_addr(uint64_t a, std::string &out) {
+    char buf[24];
+    std::snprintf(buf, sizeof(buf), "\"0x%llx\"", (unsigned long long)a);
+    out += buf;
+  }
+
+  //",\"func\":...,\"line\":..." for a site the index knows
+  void site_where(const replay &R, uint64_t site, std::string &out) {
+    if (!R.st.loaded) return;
+    const memlog_idx_site *s = R.st.idx.find_site(site);
+    if (!s) return;
+    out += ",\"func\":\"";
+    memlog_json_escape(R.st.idx.str(s->func), out);
+    out += "\",\"line\":";
+    out += std::to_string(s->line);
+  }
+
+  /*
+    One write-like event as JSON. For a loop summary, k picks the iteration: addr, size and value are that
+    iteration's.
+  */
+  void event_json(const replay &R, uint32_t ref, uint64_t k, std::string &out) {
+    static const char hex[] = "0123456789abcdef";
+    uint32_t tid;
+    memlog_rt_record r = R.record_at(ref, &tid);
+    uint32_t kind = (uint32_t)(r.site >> MEMLOG_RT_KIND_SHIFT);
+    uint64_t site = r.site & MEMLOG_RT_SITE_MASK;
+    out += "{\"step\":";
+    out += std::to_string((unsigned long long)R.step_of(ref));
+    if (R.is_derived(ref)) out += ",\"derived\":true";
+    out += ",\"tid\":";
+    out += std::to_string(tid);
+    out += ",\"site\":";
+    out += std::to_string((unsigned long long)site);
+    site_where(R, site, out);
+    out += ",\"kind\":\"";
+    out += kind == MEMLOG_RT_STORE ? "store" : kind == MEMLOG_RT_RANGE_STORE ? "range_store" : "write";
+    out += "\",\"addr\":";
+    if (kind == MEMLOG_RT_RANGE_STORE) {
+      const range_info &ri = R.st.ranges.find(site)->second;
+      hex_addr(r.addr + (uint64_t)ri.stride * k, out);
+      out += ",\"size\":";
+      out += std::to_string((long long)R.bytes_of(site));
+      out += ",\"iter\":";
+      out += std::to_string((unsigned long long)k);
+      out += ",\"value\":";
+      out += std::to_string((long long)(ri.mul * ((int64_t)r.value + (int64_t)k * ri.step) + ri.add));
+      out += '}';
+      return;
+    }
+    hex_addr(r.addr, out);
+    out += ",\"size\":";
+    out += std::to_string((unsigned long long)r.size);
+    if (kind == MEMLOG_RT_STORE) {
+      out += ",\"value\":";
+      out += R.value_known(ref) ? std::to_string((unsigned long long)r.value) : "null";
+    } else {
+      const unsigned char *d = R.t.write_data(ref);
+      out += ",\"data\":\"";
+      for (uint64_t b = 0; b < r.value; b++) {
+        out += hex[d[b] >> 4];
+        out += hex[d[b] & 15];
+      }
+      out += '"';
+    }
+    out += '}';
+  }
+
+  bool parse_u64(const std::string &s, uint64_t &v) {
+    if (s.empty()) return false;
+    char *end;
+    errno = 0;
+    unsigned long long x = std::strtoull(s.c_str(), &end, 0);
+    if (*end || errno) return false;
+    v = x;
+    return true;
+  }
+
+  //a mask from shadow_index::init_mask, as hex strings (64 bit words do not fit a JSON number)
+  void mask_json(const std::vector<uint64_t> &mask, std::string &out) {
+    char buf[24];
+    out += '[';
+    for (size_t k = 0; k < mask.size(); k++) {
+      std::snprintf(buf, sizeof(buf), "%s\"%016llx\"", k ? "," : "", (unsigned long long)mask[k]);
+      out += buf;
+    }
+    out += ']';
+  }
+
+  void answer_info(const replay &R, std::string &out) {
+    out += "{\"records\":";
+    out += std::to_string((unsigned long long)R.t.n_steps);
+    out += ",\"events\":";
+    out += std::to_string((unsigned long long)R.n_events);
+    out += ",\"derived\":";
+    out += std::to_string((unsigned long long)R.n_derived);
+    out += ",\"threads\":";
+    out += std::to_string(R.n_threads);
+    out += ",\"blocks\":";
+    out += std::to_string(R.blocks.size());
+    out += ",\"frames\":";
+    out += std::to_string(R.frames.size());
+    out += ",\"sites\":";
+    out += std::to_string(R.st.loaded ? R.st.idx.sites.size() : 0);
+    out += '}';
+  }
+
+  void answer_state(const replay &R, uint64_t s, uint32_t tid, std::string &out) {
+    std::vector<uint32_t> live;
+    std::vector<uint64_t> mask;
+    out += "{\"step\":";
+    out += std::to_string((unsigned long long)s);
+    out += ",\"stacks\":[";
+    R.frame_live.live_at(s, live);
+    //live is in the order the frames were entered, so each thread's frames are outermost first
+    std::stable_sort(live.begin(), live.end(), [&](uint32_t a, uint32_t b) { return R.frames[a].tid < R.frames[b].tid; });
+    for (size_t i = 0; i < live.size(); i++) {
+      const frame &f = R.frames[live[i]];
+      if (tid && f.tid != tid) continue;
+      bool first_of_thread = i == 0 || R.frames[live[i - 1]].tid != f.tid;
+      if (first_of_thread) {
+        if (out.back() != '[') out += ',';
+        out += "{\"tid\":";
+        out += std::to_string(f.tid);
+        out += ",\"frames\":[";
+      } else {
+        out += ',';
+      }
+      out += "{\"site\":";
+      out += std::to_string((unsigned long long)f.site);
+      site_where(R, f.site, out);
+      out += ",\"base\":";
+      hex_addr(f.base, out);
+      out += ",\"since\":";
+      out += std::to_string((unsigned long long)R.frame_live.from[live[i]]);
+      auto ls = R.st.locals.find(f.site);
+      if (ls != R.st.locals.end()) {
+        out += ",\"locals\":[";
+        for (size_t j = 0; j < ls->second.size(); j++) {
+          const local_var &l = ls->second[j];
+          if (j) out += ',';
+          out += "{\"name\":\"";
+          memlog_json_escape(l.name, out);
+          out += "\",\"param\":";
+          out += l.param ? "true" : "false";
+          if (l.offset == MEMLOG_NO_OFFSET) {
+            out += ",\"addr\":null}";
+            continue;
+          }
+          uint64_t a = f.base + (uint64_t)l.offset;
+          out += ",\"addr\":";
+          hex_addr(a, out);
+          out += ",\"size\":";
+          out += l.size >= 0 ? std::to_string((long long)l.size) : "null";
+          //its value is the last store to exactly it since the frame was entered (anything older is another
+          //call's garbage); writes that only cover part of it give the step but no value
+          uint32_t w = 0;
+          uint64_t k = 0;
+          if (R.last_write(a, R.frame_live.from[live[i]], s, w, k)) {
+            memlog_rt_record r = R.record_at(w);
+            uint32_t kind = (uint32_t)(r.site >> MEMLOG_RT_KIND_SHIFT);
+            out += ",\"set\":";
+            out += std::to_string((unsigned long long)R.step_of(w));
+            out += ",\"value\":";
+            if (kind == MEMLOG_RT_STORE && r.addr == a && l.size >= 0 && r.size == (uint64_t)l.size && R.value_known(w)) {
+              out += std::to_string((unsigned long long)r.value);
+            } else {
+              out += "null";
+            }
+          } else {
+            out += ",\"set\":null,\"value\":null";
+          }
+          if (l.size > 0) {
+            R.shadow.init_mask(a, (uint64_t)l.size, s, mask);
+            out += ",\"init\":";
+            mask_json(mask, out);
+          }
+          out += '}';
+        }
+        out += ']';
+      }
+      out += '}';
+      bool last_of_thread = i + 1 == live.size() || R.frames[live[i + 1]].tid != f.tid;
+      if (last_of_thread) out += "]}";
+    }
+    out += "],\"heap\":[";
+    R.heap_live.live_at(s, live);
+    bool first = true;
+    for (uint32_t b : live) {
+      const heap_block &h = R.blocks[b];
+      if (tid && h.tid != tid) continue;
+      if (!first) out += ',';
+      first = false;
+      out += "{\"site\":";
+      out += std::to_string((unsigned long long)h.site);
+      site_where(R, h.site, out);
+      out += ",\"tid\":";
+      out += std::to_string(h.tid);
+      out += ",\"addr\":";
+      hex_addr(h.addr, out);
+      out += ",\"size\":";
+      out += std::to_string((unsigned long long)h.size);
+      out += ",\"since\":";
+      out += std::to_string((unsigned long long)R.heap_live.from[b]);
+      //blocks can be big: which of their bytes are garbage is an "init" request away
+      out += ",\"garbage\":";
+      out += std::to_string((unsigned long long)R.shadow.garbage_count(h.addr, h.size, s));
+      out += '}';
+    }
+    out += "]}";
+  }
+
+  void answer_history(const replay &R, uint64_t a, uint64_t from, uint64_t limit, std::string &out) {
+    out += "{\"addr\":";
+    hex_addr(a, out);
+    out += ",\"writes\":[";
+    uint64_t n = 0;
+    bool more = false;
+    R.writes_to(a, from, OPEN, [&](uint32_t ref, uint64_t k) {
+      if (n == limit) { more = true; return false; }
+      if (n++) out += ',';
+      event_json(R, ref, k, out);
+      return true;
+    });
+    out += "],\"more\":";
+    out += more ? "true" : "false";
+    out += '}';
+  }
+
+  void answer_init(const replay &R, uint64_t a, uint64_t len, uint64_t s, std::string &out) {
+    std::vector<uint64_t> mask;
+    uint64_t garbage = R.shadow.init_mask(a, len, s, mask);
+    out += "{\"addr\":";
+    hex_addr(a, out);
+    out += ",\"len\":";
+    out += std::to_string((unsigned long long)len);
+    out += ",\"step\":";
+    out += std::to_string((unsigned long long)s);
+    out += ",\"garbage\":";
+    out += std::to_string((unsigned long long)garbage);
+    out += ",\"init\":";
+    mask_json(mask, out);
+    out += '}';
+  }
+
+  /*
+    A local is found in the innermost frame (of tid, or of any thread) live at step s that has one by that name;
+    its next write is the first that touches its first byte before the frame is left. Anything else is looked up
+    by the sites that assign it by name.
+  */
+  void answer_next(const replay &R, const std::string &var, uint64_t s, uint32_t tid, std::string &out) {
+    out += "{\"var\":\"";
+    memlog_json_escape(var, out);
+    out += "\",\"after\":";
+    out += std::to_string((unsigned long long)s);
+
+    std::vector<uint32_t> live;
+    R.frame_live.live_at(s, live);
+    for (size_t i = live.size(); i-- > 0;) {
+      const frame &f = R.frames[live[i]];
+      if (tid && f.tid != tid) continue;
+      auto ls = R.st.locals.find(f.site);
+      if (ls == R.st.locals.end()) continue;
+      for (const local_var &l : ls->second) {
+        if (l.name != var || l.offset == MEMLOG_NO_OFFSET) continue;
+        uint64_t a = f.base + (uint64_t)l.offset;
+        uint64_t end = R.frame_live.to[live[i]];
+        out += ",\"via\":\"frame\",\"tid\":";
+        out += std::to_string(f.tid);
+        out += ",\"addr\":";
+        hex_addr(a, out);
+        out += ",\"write\":";
+        bool found = false;
+        R.writes_to(a, s + 1, end, [&](uint32_t w, uint64_t k) {
+          event_json(R, w, k, out);
+          found = true;
+          return false;
+        });
+        if (!found) out += "null";
+        out += '}';
+        return;
+      }
+    }
+
+    out += ",\"via\":\"site\",\"write\":";
+    auto it = R.st.writers.find(var);
+    uint32_t w = 0;
+    if (it != R.st.writers.end() && R.next_of_sites(it->second, s, w)) {
+      //a loop summary is reported as its first iteration
+      event_json(R, w, 0, out);
+    } else {
+      out += "null";
+    }
+    out += '}';
+  }
+
+  void answer_error(const char *what, std::string &out) {
+    out += "{\"error\":\"";
+    memlog_json_escape(what, out);
+    out += "\"}";
+  }
+
+  //Answers one request line; the answer (one line, newline included) is appended to out.
+  void answer(const replay &R, const std::string &line, std::string &out) {
+    std::vector<std::string> w;
+    for (size_t i = 0; i < line.size();) {
+      while (i < line.size() && std::isspace((unsigned char)line[i])) i++;
+      size_t j = i;
+      while (j < line.size() && !std::isspace((unsigned char)line[j])) j++;
+      if (j > i) w.push_back(line.substr(i, j - i));
+      i = j;
+    }
+    uint64_t a = 0, b = 0, c = 0;
+    if (w.empty()) {
+      answer_error("empty request", out);
+    } else if (w[0] == "info" && w.size() == 1) {
+      answer_info(R, out);
+    } else if (w[0] == "state" && (w.size() == 2 || w.size() == 3) && parse_u64(w[1], a) &&
+               (w.size() == 2 || parse_u64(w[2], b))) {
+      answer_state(R, a, (uint32_t)b, out);
+    } else if (w[0] == "history" && w.size() >= 2 && w.size() <= 4 && parse_u64(w[1], a) &&
+               (w.size() < 3 || parse_u64(w[2], b)) && (w.size() < 4 || parse_u64(w[3], c))) {
+      answer_history(R, a, b, w.size() < 4 ? 100 : c, out);
+    } else if (w[0] == "next" && (w.size() == 3 || w.size() == 4) && parse_u64(w[2], a) &&
+               (w.size() == 3 || parse_u64(w[3], b))) {
+      answer_next(R, w[1], a, (uint32_t)b, out);
+    } else if (w[0] == "init" && w.size() == 4 && parse_u64(w[1], a) && parse_u64(w[2], b) && parse_u64(w[3], c)) {
+      if (b > MAX_MASK_BYTES || a + b < a) answer_error("init: len too big", out);
+      else answer_init(R, a, b, c, out);
+    } else {
+      answer_error("bad request (info | state <step> [tid] | history <addr> [from] [n] | next <var> <step> [tid] | "
+                   "init <addr> <len> <step>)", out);
+    }
+    out += '\n';
+  }
+
+  // ---------------------------
+  // Serving
+  // ---------------------------
+
+  volatile sig_atomic_t g_stop = 0;
+
+  void on_signal(int) { g_stop = 1; }
+
+  bool write_all(int fd, const std::string &s) {
+    for (size_t done = 0; done < s.size();) {
+      ssize_t n = write(fd, s.data() + done, s.size() - done);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      done += (size_t)n;
+    }
+    return true;
+  }
+
+  /*
+    Answers requests on a Unix domain socket at path until SIGINT or SIGTERM. Clients are served one request at
+    a time, in the order their lines arrive; an answer is written in full before the next request is read.
+  */
+  int serve(const replay &R, const char *path) {
+    //a request line longer than this is not a request
+    static const size_t max_line = 1 << 16;
+
+    sockaddr_un sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(sa.sun_path)) {
+      std::fprintf(stderr, "memlog_replay: socket path too long: %s\n", path);
+      return 1;
+    }
+    std::strcpy(sa.sun_path, path);
+    int ls = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (ls < 0) { std::perror("socket"); return 1; }
+    unlink(path); //left behind by an earlier run
+    if (bind(ls, (sockaddr *)&sa, sizeof(sa)) != 0 || listen(ls, 16) != 0) {
+      std::perror(path);
+      close(ls);
+      return 1;
+    }
+
+    struct sigaction act;
+    std::memset(&act, 0, sizeof(act));
+    act.sa_handler = on_signal;
+    sigaction(SIGINT, &act, nullptr);
+    sigaction(SIGTERM, &act, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+    std::fprintf(stderr, "memlog_replay: listening on %s\n", path);
+
+    std::vector<pollfd> fds(1, pollfd{ls, POLLIN, 0});
+    std::vector<std::string> pending(1); //unfinished request line of each client (fds[i])
+    std::string reply;
+    char buf[1 << 14];
+    while (!g_stop) {
+      if (poll(fds.data(), fds.size(), -1) < 0) {
+        if (errno == EINTR) continue;
+        std::perror("poll");
+        break;
+      }
+      if (fds[0].revents & POLLIN) {
+        int c = accept4(ls, nullptr, nullptr, SOCK_CLOEXEC);
+        if (c >= 0) {
+          fds.push_back(pollfd{c, POLLIN, 0});
+          pending.emplace_back();
+        }
+      }
+      for (size_t i = fds.size(); i-- > 1;) {
+        if (!fds[i].revents) continue;
+        ssize_t n = read(fds[i].fd, buf, sizeof(buf));
+        bool ok = n > 0 || (n < 0 && errno == EINTR);
+        if (n > 0) {
+          std::string &p = pending[i];
+          p.append(buf, (size_t)n);
+          size_t start = 0;
+          for (size_t nl; ok && (nl = p.find('\n', start)) != std::string::npos; start = nl + 1) {
+            reply.clear();
+            answer(R, p.substr(start, nl - start), reply);
+            ok = write_all(fds[i].fd, reply);
+          }
+          p.erase(0, start);
+          if (p.size() > max_line) ok = false;
+        }
+        if (!ok) {
+          close(fds[i].fd);
+          fds.erase(fds.begin() + i);
+          pending.erase(pending.begin() + i);
+        }
+      }
+    }
+    for (size_t i = 1; i < fds.size(); i++) close(fds[i].fd);
+    close(ls);
+    unlink(path);
+    return 0;
+  }
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  const char *trace_path = nullptr;
+  const char *idx_path = nullptr;
+  const char *sock_path = "memlog-replay.sock";
+  std::vector<const char *> queries;
+  bool bad = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc) sock_path = argv[++i];
+    else if (std::strcmp(argv[i], "-q") == 0 && i + 1 < argc) queries.push_back(argv[++i]);
+    else if (!trace_path) trace_path = argv[i];
+    else if (!idx_path) idx_path = argv[i];
+    else bad = true;
+  }
+  if (!trace_path || bad) {
+    std::fprintf(stderr, "usage: %s <trace.bin> [index.idx] [-s socket-path] [-q request]... (-q -: one request per "
+                         "line of stdin)\n", argv[0]);
+    return 2;
+  }
+
+  auto t0 = std::chrono::steady_clock::now();
+  static replay R; //big; and it lives as long as the process anyway
+  std::string err;
+  if (!open_trace(trace_path, R.t, err)) {
+    std::fprintf(stderr, "memlog_replay: %s: %s\n", trace_path, err.c_str());
+    return 1;
+  }
+  if (idx_path) {
+    FILE *in = std::fopen(idx_path, "rb");
+    if (!in) {
+      std::perror(idx_path);
+      return 1;
+    }
+    bool ok = memlog_idx_load(in, R.st.idx, err);
+    std::fclose(in);
+    if (!ok) {
+      std::fprintf(stderr, "memlog_replay: %s: %s\n", idx_path, err.c_str());
+      return 1;
+    }
+    R.st.loaded = true;
+    load_statics(R.st);
+  }
+  R.build();
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+  std::fprintf(stderr, "memlog_replay: %llu records (%llu events, %u threads, %zu blocks, %zu frames) indexed in %lld ms\n",
+               (unsigned long long)R.t.n_steps, (unsigned long long)R.n_events, R.n_threads, R.blocks.size(),
+               R.frames.size(), (long long)ms);
+
+  if (!queries.empty()) {
+    //answered in order by the same index, so a step can be revisited after a later one
+    std::vector<std::string> lines;
+    for (const char *q : queries) {
+      if (std::strcmp(q, "-") != 0) { lines.push_back(q); continue; }
+      char buf[1 << 16];
+      while (std::fgets(buf, sizeof(buf), stdin)) {
+        std::string l(buf);
+        while (!l.empty() && (l.back() == '\n' || l.back() == '\r')) l.pop_back();
+        if (!l.empty()) lines.push_back(l);
+      }
+    }
+    std::string out;
+    auto q0 = std::chrono::steady_clock::now();
+    for (const std::string &l : lines) answer(R, l, out);
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - q0).count();
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fprintf(stderr, "memlog_replay: answered %zu requests in %lld us\n", lines.size(), (long long)us);
+    return 0;
+  }
+  return serve(R, sock_path);
+}
@@ -0,0 +1,567 @@
+// memlog_runtime.c
+// Runtime half of memlog: the hooks an instrumented program calls (see memlog_runtime.h), and the
+// machinery that gets their records to disk (file layout in memlog_format.h, "RUNTIME TRACE LAYOUT").
+
+#define _GNU_SOURCE
+#include "memlog_runtime.h"
+#include "memlog_format.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+  NOTE: One ring buffer per thread, no locks on the hot path
+
+  A naive runtime would fprintf (or fwrite under a lock) once per hook, which makes store-heavy code about 100x slower.
+  Instead every thread owns a ring buffer of fixed-size records, and writes its records straight into it
+  (see "The write window" below). Records are published to the drainer by bumping head with a release store.
+
+  One background thread (the drainer) walks every ring, writes out whatever is between tail and head as one chunk,
+  and then moves tail forward. Each ring has exactly one producer (its thread) and one consumer (whoever holds
+  g_file_mutex, normally the drainer), so plain atomic loads and stores are enough; nothing ever spins on a lock.
+
+  If a ring fills up (the drainer can't keep up with the disk), its thread waits for room rather than losing records.
+
+  Rings are never freed. When a thread exits its ring is marked RING_EXITED, and once it has been drained, the next
+  new thread takes it over instead of allocating another one.
+ */
+
+#define RING_RECORDS (1u << 17) // records per thread (32 bytes each: 4 MiB)
+#define RING_MASK    (RING_RECORDS - 1)
+
+/**
+  NOTE: The write window (inline fast path)
+
+  For a plain scalar store the plugin doesn't emit a call at all. It emits, inline (memlog_plugin.cc, instrument_store_inline):
+
+      rec = __memlog_cursor;
+      if (rec >= __memlog_limit) rec = __memlog_refill();   //unlikely
+      rec->site = MEMLOG_RT_SITE_KIND(site, MEMLOG_RT_STORE); rec->addr = &lhs; rec->size = sizeof lhs; rec->value = lhs;
+      __memlog_cursor = rec + 1;
+
+  [__memlog_cursor, __memlog_limit) is a run of free slots in the thread's ring (the window) that the thread has
+  reserved but not yet published. __memlog_refill publishes everything written to the old window with one release
+  store of head, then reserves the next one (waiting for the drainer if the ring is full). So the slow path runs once
+  every WINDOW_RECORDS events, and the fast path is two thread-local loads, a compare, five stores and a bump.
+
+  The C hooks (emit, below) fill the same window the same way.
+
+  Records reach the drainer when their window is published: at the next refill, when the thread exits, or at shutdown
+  for the thread that calls exit(). A thread that is still running when the process exits can lose at most one
+  unpublished window, just like an unflushed stdio buffer.
+ */
+#define WINDOW_RECORDS 1024
+
+/**
+  NOTE: Bulk writes
+
+  __memlog_write (memcpy, memset, struct copies, ...) records the block's address and length, and also copies its
+  first bytes into the trace: up to MEMLOG_WRITE_BYTES of them (environment variable, default 64; 0 records only
+  address and length). They go into the records right after the MEMLOG_RT_WRITE record, so the whole run has to fit
+  into one window; if the current window is too short, the thread publishes it and reserves the next one.
+
+  A run never wraps around the end of the ring. When the slots left before the end are too few, the thread marks them
+  skipped (the ring's skip_from; drain_ring leaves them out of the file) and takes the run from slot 0 instead, waiting
+  for the drainer if it has to, so a capture is only ever lost when tracing is off.
+
+  A struct assignment the plugin compiled a capture function for ("FIELD CAPTURES" in memlog_format.h) takes the
+  same run of records, in two steps: __memlog_fields_begin reserves it and writes the record, the capture function
+  packs the fields into the data records itself, and __memlog_fields_end says how many bytes that came to and
+  publishes the run. The limit is the same, counted in packed bytes.
+ */
+#define WRITE_CAPTURE_DEFAULT 64
+#define WRITE_CAPTURE_MAX ((WINDOW_RECORDS - 1) * sizeof(struct memlog_rt_record))
+
+//how long the drainer sleeps when it found nothing to write (a busy thread fills a ring in well over a millisecond)
+#define DRAIN_IDLE_NS (200 * 1000)
+
+enum { RING_LIVE = 0, RING_EXITED = 1 };
+
+struct memlog_ring {
+  //written only by the owning thread
+  _Alignas(64) _Atomic uint64_t head; // next slot to fill
+  uint64_t cached_tail;               // the owner's last look at tail (saves reading the drainer's cache line)
+  _Atomic uint64_t skip_from;         // slots from here to the end of the ring hold nothing (see "Bulk writes")
+  _Atomic uint64_t skipped;           // slots skipped so far (head counts them, the event count doesn't)
+  uint32_t tid;
+
+  //written only by the consumer
+  _Alignas(64) _Atomic uint64_t tail; // next slot to write out
+
+  _Alignas(64) _Atomic int state;     // RING_LIVE or RING_EXITED
+  struct memlog_ring *next;           // g_rings list (only ever pushed onto)
+
+  struct memlog_rt_record recs[RING_RECORDS];
+};
+
+static __thread struct memlog_ring *t_ring; //this thread's ring, NULL until its first event
+
+__thread struct memlog_rt_record *__memlog_cursor; //next record to fill
+__thread struct memlog_rt_record *__memlog_limit;  //end of the window
+static __thread struct memlog_rt_record *t_window; //start of the window (NULL: no window reserved)
+static __thread struct memlog_rt_record t_scratch; //events land here (and are dropped) while tracing is off:
+                                                   //a window of one slot, [&t_scratch, &t_scratch + 1)
+
+static struct memlog_ring *_Atomic g_rings; //every ring ever made
+static _Atomic uint32_t g_next_tid = 1;
+
+static pthread_once_t g_init_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_ring_key;            //only used for its destructor, which runs when a thread exits
+static pthread_mutex_t g_file_mutex = PTHREAD_MUTEX_INITIALIZER; //held by whoever is draining rings into g_file
+static FILE *g_file;
+static pid_t g_pid;
+
+static pthread_t g_drainer;
+static int g_drainer_running;
+static _Atomic int g_stop;                  //tells the drainer to exit
+static _Atomic int g_done;                  //shut down (or never started): events are dropped
+
+static _Atomic uint64_t g_dropped;          //events dropped (or written without their bytes) because tracing was off
+static _Atomic uint64_t g_stalls;           //times a thread had to wait for room in its ring
+static size_t g_write_capture = WRITE_CAPTURE_DEFAULT; //bytes of each bulk write copied into the trace
+
+
+//Writes out slots [from, to) of r, which may wrap around the end of the ring.
+static void write_slots(struct memlog_ring *r, uint64_t from, uint64_t to) {
+  size_t n = (size_t)(to - from);
+  size_t first = (size_t)(from & RING_MASK);
+  size_t run = RING_RECORDS - first;
+  if (run > n) run = n;
+  fwrite(&r->recs[first], sizeof(struct memlog_rt_record), run, g_file);
+  if (n > run) fwrite(&r->recs[0], sizeof(struct memlog_rt_record), n - run, g_file);
+}
+
+/*
+  Writes out everything in r between tail and head as one chunk, leaving out the slots a run skipped at the end of
+  the ring. Caller holds g_file_mutex.
+
+  returns: number of records written
+*/
+static size_t drain_ring(struct memlog_ring *r) {
+  uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  if (head == tail) return 0;
+
+  //tail..head covers at most one ring's worth of slots, so at most one skipped stretch; an older skip_from is
+  //below tail, and one made after head was read is at or above it
+  uint64_t skip = atomic_load_explicit(&r->skip_from, memory_order_relaxed);
+  uint64_t skipped = skip >= tail && skip < head ? RING_RECORDS - (skip & RING_MASK) : 0;
+  uint64_t n = head - tail - skipped;
+
+  if (n) {
+    struct memlog_rt_chunk c;
+    c.tid = r->tid;
+    c.n_records = (uint32_t)n;
+    fwrite(&c, sizeof(c), 1, g_file);
+    if (skipped) {
+      write_slots(r, tail, skip);
+      write_slots(r, skip + skipped, head);
+    } else {
+      write_slots(r, tail, head);
+    }
+  }
+
+  //hand the slots back to the producer only once their contents have been copied out
+  atomic_store_explicit(&r->tail, head, memory_order_release);
+  return (size_t)n;
+}
+
+//Drains every ring once. Caller holds g_file_mutex.
+static size_t drain_all(void) {
+  size_t total = 0;
+  for (struct memlog_ring *r = atomic_load_explicit(&g_rings, memory_order_acquire); r; r = r->next)
+    total += drain_ring(r);
+  return total;
+}
+
+static void *drainer_main(void *arg) {
+  (void)arg;
+  while (!atomic_load_explicit(&g_stop, memory_order_acquire)) {
+    pthread_mutex_lock(&g_file_mutex);
+    size_t n = drain_all();
+    pthread_mutex_unlock(&g_file_mutex);
+
+    if (!n) {
+      struct timespec ts = { 0, DRAIN_IDLE_NS };
+      nanosleep(&ts, NULL);
+    }
+  }
+  return NULL;
+}
+
+static void window_publish(struct memlog_ring *r);
+
+//pthread key destructor: the thread that owned this ring has exited
+static void ring_release(void *p) {
+  struct memlog_ring *r = p;
+  window_publish(r);
+  t_ring = NULL;
+  atomic_store_explicit(&r->state, RING_EXITED, memory_order_release);
+}
+
+/*
+  fork(): the child gets a copy of the rings and the file, but not the drainer thread.
+  Make sure the file buffer is empty when the process is copied (so the child can't write the parent's data again),
+  and switch tracing off in the child.
+*/
+static void fork_prepare(void) {
+  pthread_mutex_lock(&g_file_mutex);
+  if (g_file) fflush(g_file);
+}
+
+static void fork_parent(void) {
+  pthread_mutex_unlock(&g_file_mutex);
+}
+
+static void fork_child(void) {
+  atomic_store(&g_done, 1);
+  g_drainer_running = 0;
+  g_file = NULL;
+  pthread_mutex_unlock(&g_file_mutex);
+}
+
+//Runs once, on the first event of the process.
+static void runtime_init(void) {
+  char path[4096];
+  const char *env = getenv("MEMLOG_TRACE");
+  g_pid = getpid();
+  if (env && *env) snprintf(path, sizeof(path), "%s", env);
+  else snprintf(path, sizeof(path), "memlog-trace-%d.bin", (int)g_pid);
+
+  const char *capture = getenv("MEMLOG_WRITE_BYTES");
+  if (capture && *capture) {
+    unsigned long n = strtoul(capture, NULL, 0);
+    g_write_capture = n < WRITE_CAPTURE_MAX ? (size_t)n : WRITE_CAPTURE_MAX;
+  }
+
+  g_file = fopen(path, "wb");
+  if (!g_file) {
+    fprintf(stderr, "memlog_runtime: could not open '%s', tracing is off\n", path);
+    atomic_store(&g_done, 1);
+    return;
+  }
+  setvbuf(g_file, NULL, _IOFBF, 1 << 20);
+
+  struct memlog_rt_header h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MEMLOG_RT_MAGIC, sizeof(MEMLOG_RT_MAGIC));
+  h.version = MEMLOG_RT_VERSION;
+  h.header_size = sizeof(h);
+  h.record_size = sizeof(struct memlog_rt_record);
+  h.pid = (uint32_t)g_pid;
+  fwrite(&h, sizeof(h), 1, g_file);
+
+  pthread_key_create(&g_ring_key, ring_release);
+  pthread_atfork(fork_prepare, fork_parent, fork_child);
+
+  //without a drainer, threads drain their own ring whenever it fills (see ring_wait_for_room)
+  g_drainer_running = pthread_create(&g_drainer, NULL, drainer_main, NULL) == 0;
+  atexit(memlog_runtime_shutdown);
+}
+
+/*
+  Gives the calling thread a ring: an exited thread's drained ring if there is one, otherwise a new one.
+
+  returns: NULL if tracing is off
+*/
+static struct memlog_ring *ring_attach(void) {
+  pthread_once(&g_init_once, runtime_init);
+  if (atomic_load(&g_done)) return NULL;
+
+  struct memlog_ring *r;
+  for (r = atomic_load_explicit(&g_rings, memory_order_acquire); r; r = r->next) {
+    int exited = RING_EXITED;
+    //only take over an empty ring, so none of the previous thread's records get the new thread's tid
+    if (atomic_load_explicit(&r->state, memory_order_relaxed) == RING_EXITED &&
+        atomic_load_explicit(&r->tail, memory_order_acquire) == atomic_load_explicit(&r->head, memory_order_relaxed) &&
+        atomic_compare_exchange_strong(&r->state, &exited, RING_LIVE))
+      break;
+  }
+
+  if (!r) {
+    void *mem = NULL;
+    if (posix_memalign(&mem, 64, sizeof(struct memlog_ring)) != 0) return NULL;
+    r = mem;
+    atomic_init(&r->head, 0);
+    atomic_init(&r->tail, 0);
+    atomic_init(&r->state, RING_LIVE);
+    atomic_init(&r->skip_from, UINT64_MAX);
+    atomic_init(&r->skipped, 0);
+    r->cached_tail = 0;
+
+    //push onto the list; only the drainer and ring_attach ever walk it
+    struct memlog_ring *old = atomic_load_explicit(&g_rings, memory_order_relaxed);
+    do {
+      r->next = old;
+    } while (!atomic_compare_exchange_weak_explicit(&g_rings, &old, r, memory_order_release, memory_order_relaxed));
+  }
+
+  r->tid = atomic_fetch_add(&g_next_tid, 1);
+  r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  t_ring = r;
+  pthread_setspecific(g_ring_key, r);
+  return r;
+}
+
+/*
+  Slow path: r is full. Waits for the drainer to make room, until slot head is free.
+
+  returns: 0 if tracing was shut down while waiting (the event is dropped)
+*/
+static int ring_wait_for_room(struct memlog_ring *r, uint64_t head) {
+  atomic_fetch_add_explicit(&g_stalls, 1, memory_order_relaxed);
+  for (;;) {
+    r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    if (head - r->cached_tail < RING_RECORDS) return 1;
+    if (atomic_load(&g_done)) return 0;
+
+    if (!g_drainer_running) {
+      pthread_mutex_lock(&g_file_mutex);
+      if (g_file) drain_ring(r);
+      pthread_mutex_unlock(&g_file_mutex);
+    } else {
+      sched_yield();
+    }
+  }
+}
+
+/*
+  Publishes the records written to the current window (hands them to the drainer) and forgets the window.
+*/
+static void window_publish(struct memlog_ring *r) {
+  if (!t_window) return;
+  uint64_t n = (uint64_t)(__memlog_cursor - t_window);
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  atomic_store_explicit(&r->head, head + n, memory_order_release);
+
+  t_window = NULL;
+  __memlog_cursor = __memlog_limit = NULL;
+}
+
+/*
+  Reserves the next window: up to WINDOW_RECORDS free slots starting at head, without wrapping past the end of the ring.
+
+  returns: the first slot, or NULL if tracing was shut down while waiting for room
+*/
+static struct memlog_rt_record *window_reserve(struct memlog_ring *r) {
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  if (head - r->cached_tail >= RING_RECORDS && !ring_wait_for_room(r, head)) return NULL;
+
+  uint64_t n = RING_RECORDS - (head - r->cached_tail);   //free slots
+  uint64_t contiguous = RING_RECORDS - (head & RING_MASK); //slots before the end of the ring
+  if (n > contiguous) n = contiguous;
+  if (n > WINDOW_RECORDS) n = WINDOW_RECORDS;
+
+  t_window = &r->recs[head & RING_MASK];
+  __memlog_limit = t_window + n;
+  return t_window;
+}
+
+struct memlog_rt_record *__memlog_refill(void) {
+  struct memlog_ring *r = t_ring;
+  if (r) window_publish(r);
+  else r = ring_attach();
+
+  if (r && !atomic_load_explicit(&g_done, memory_order_relaxed)) {
+    struct memlog_rt_record *rec = window_reserve(r);
+    if (rec) return rec;
+  }
+
+  //tracing is off: the caller writes into t_scratch and moves the cursor to the limit, so the next event comes
+  //straight back here and cursor <= limit holds as it does for a real window
+  atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+  __memlog_cursor = &t_scratch;
+  __memlog_limit = &t_scratch + 1;
+  return &t_scratch;
+}
+
+//Appends one record to the calling thread's window (the C version of the plugin's inline fast path).
+static inline void emit(uint64_t site, uint32_t kind, const void *addr, uint64_t size, uint64_t value) {
+  struct memlog_rt_record *rec = __memlog_cursor;
+  if (__builtin_expect(rec >= __memlog_limit, 0)) rec = __memlog_refill();
+
+  rec->site = MEMLOG_RT_SITE_KIND(site, kind);
+  rec->addr = (uint64_t)(uintptr_t)addr;
+  rec->size = size;
+  rec->value = value;
+  __memlog_cursor = rec + 1;
+}
+
+
+void __memlog_store(uint64_t site, const void *addr, size_t size) {
+  //the store has already happened, so the value is whatever is at addr now (the first 8 bytes of bigger stores)
+  uint64_t value = 0;
+  if (addr) memcpy(&value, addr, size < sizeof(value) ? size : sizeof(value));
+  emit(site, MEMLOG_RT_STORE, addr, size, value);
+}
+
+void __memlog_alloc(uint64_t site, const void *ptr, size_t size) {
+  emit(site, MEMLOG_RT_ALLOC, ptr, size, 0);
+}
+
+void __memlog_realloc(uint64_t site, const void *ptr, size_t size, const void *old) {
+  emit(site, MEMLOG_RT_ALLOC, ptr, size, (uint64_t)(uintptr_t)old);
+}
+
+void __memlog_free(uint64_t site, const void *ptr) {
+  emit(site, MEMLOG_RT_FREE, ptr, 0, 0);
+}
+
+void __memlog_enter(uint64_t site, const void *frame) {
+  emit(site, MEMLOG_RT_ENTER, frame, 0, 0);
+}
+
+void __memlog_exit(uint64_t site, const void *frame) {
+  emit(site, MEMLOG_RT_EXIT, frame, 0, 0);
+}
+
+void __memlog_range_store(uint64_t site, const void *last, int64_t stride, uint64_t count, int64_t iv0) {
+  if (!count) return;
+  //the plugin hands us the last address (the only one it keeps while the loop runs); the record holds the first
+  uint64_t first = (uint64_t)(uintptr_t)last - (uint64_t)stride * (count - 1);
+  emit(site, MEMLOG_RT_RANGE_STORE, (const void *)(uintptr_t)first, count, (uint64_t)iv0);
+}
+
+/*
+  Reserves n consecutive slots (at most WINDOW_RECORDS) in the calling thread's window. If this window is too short,
+  publishes it and reserves a new one that is long enough: from slot 0 if the run doesn't fit before the end of the
+  ring (the slots in between are skipped), after waiting for the drainer if the ring is too full.
+
+  returns: the first slot, or NULL if tracing is off
+*/
+static struct memlog_rt_record *reserve_run(size_t n) {
+  struct memlog_rt_record *rec = __memlog_cursor;
+  //only a reserved window holds a run (t_scratch has room for one record, and no window at all for none)
+  if (t_window && rec < __memlog_limit && __memlog_limit - rec >= (ptrdiff_t)n &&
+      !atomic_load_explicit(&g_done, memory_order_relaxed))
+    return rec;
+
+  //nothing was written to the rest of the old window; if we give up, the next emit sees no window and refills
+  struct memlog_ring *r = t_ring;
+  if (r) window_publish(r);
+  else if (!(r = ring_attach())) return NULL;
+  if (atomic_load_explicit(&g_done, memory_order_relaxed)) return NULL;
+
+  uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  uint64_t contiguous = RING_RECORDS - (head & RING_MASK);
+  if (contiguous < n) {
+    //the skipped slots may still hold the last lap's records: wait until those are out before head passes them
+    uint64_t last = head + contiguous - 1;
+    if (last - r->cached_tail >= RING_RECORDS && !ring_wait_for_room(r, last)) return NULL;
+    atomic_store_explicit(&r->skip_from, head, memory_order_relaxed);
+    atomic_store_explicit(&r->skipped, atomic_load_explicit(&r->skipped, memory_order_relaxed) + contiguous,
+                          memory_order_relaxed);
+    head += contiguous;
+    atomic_store_explicit(&r->head, head, memory_order_release);
+  }
+  if (head + n - 1 - r->cached_tail >= RING_RECORDS && !ring_wait_for_room(r, head + n - 1)) return NULL;
+  return window_reserve(r);
+}
+
+//Writes one MEMLOG_RT_WRITE record, followed by the first bytes of [dst, dst + len).
+static void emit_write(uint64_t site, const void *dst, size_t len) {
+  pthread_once(&g_init_once, runtime_init);
+
+  size_t capture = dst && len < g_write_capture ? len : dst ? g_write_capture : 0;
+  size_t n_data = (capture + sizeof(struct memlog_rt_record) - 1) / sizeof(struct memlog_rt_record);
+  struct memlog_rt_record *rec = n_data ? reserve_run(1 + n_data) : NULL;
+  if (!rec) {
+    //no room for the bytes (or nothing to capture): address and length only
+    emit(site, MEMLOG_RT_WRITE, dst, len, 0);
+    return;
+  }
+
+  rec->site = MEMLOG_RT_SITE_KIND(site, MEMLOG_RT_WRITE);
+  rec->addr = (uint64_t)(uintptr_t)dst;
+  rec->size = len;
+  rec->value = capture;
+  char *data = (char *)(rec + 1);
+  memcpy(data, dst, capture);
+  memset(data + capture, 0, n_data * sizeof(struct memlog_rt_record) - capture);
+  __memlog_cursor = rec + 1 + n_data;
+}
+
+void __memlog_write(uint64_t site, const void *dst, size_t len) {
+  emit_write(site, dst, len);
+}
+
+void __memlog_write_str(uint64_t site, const void *dst) {
+  //the copy has already happened, so dst holds the string now
+  emit_write(site, dst, dst ? strlen((const char *)dst) + 1 : 0);
+}
+
+char *__memlog_fields_begin(uint64_t site, const void *dst, size_t len, size_t packed, size_t *room) {
+  pthread_once(&g_init_once, runtime_init);
+
+  size_t capture = packed < g_write_capture ? packed : g_write_capture;
+  size_t n_data = (capture + sizeof(struct memlog_rt_record) - 1) / sizeof(struct memlog_rt_record);
+  struct memlog_rt_record *rec = dst && n_data ? reserve_run(1 + n_data) : NULL;
+  if (!rec) {
+    //no live window (tracing is off) or nothing to capture: the caller packs nothing, the record has no bytes
+    emit(site, MEMLOG_RT_WRITE, dst, len, 0);
+    return NULL;
+  }
+
+  //value is filled in by __memlog_fields_end; until then the cursor stays on the record (nothing else can run in
+  //between: the capture function only copies bytes)
+  rec->site = MEMLOG_RT_SITE_KIND(site, MEMLOG_RT_WRITE);
+  rec->addr = (uint64_t)(uintptr_t)dst;
+  rec->size = len;
+  rec->value = 0;
+  __memlog_cursor = rec;
+  *room = capture;
+  return (char *)(rec + 1);
+}
+
+void __memlog_fields_end(const void *end) {
+  struct memlog_rt_record *rec = __memlog_cursor;
+  char *data = (char *)(rec + 1);
+  size_t used = (size_t)((const char *)end - data);
+  size_t n_data = (used + sizeof(struct memlog_rt_record) - 1) / sizeof(struct memlog_rt_record);
+  memset(data + used, 0, n_data * sizeof(struct memlog_rt_record) - used);
+  rec->value = used;
+  __memlog_cursor = rec + 1 + n_data;
+}
+
+uint64_t memlog_runtime_event_count(void) {
+  uint64_t n = 0;
+  for (struct memlog_ring *r = atomic_load(&g_rings); r; r = r->next)
+    n += atomic_load_explicit(&r->head, memory_order_acquire) - atomic_load_explicit(&r->skipped, memory_order_relaxed);
+  if (t_window) n += (uint64_t)(__memlog_cursor - t_window);
+  return n;
+}
+
+uint64_t memlog_runtime_stall_count(void) {
+  return atomic_load_explicit(&g_stalls, memory_order_relaxed);
+}
+
+void memlog_runtime_shutdown(void) {
+  //never started, or we are a forked child (the drainer and the file belong to the parent)
+  if (!g_file || getpid() != g_pid) return;
+  if (atomic_exchange(&g_done, 1)) return;
+
+  //the exiting thread's last window is still unpublished
+  if (t_ring) window_publish(t_ring);
+
+  if (g_drainer_running) {
+    atomic_store_explicit(&g_stop, 1, memory_order_release);
+    pthread_join(g_drainer, NULL);
+    g_drainer_running = 0;
+  }
+
+  pthread_mutex_lock(&g_file_mutex);
+  drain_all();
+  fclose(g_file);
+  g_file = NULL;
+  pthread_mutex_unlock(&g_file_mutex);
+
+  uint64_t dropped = atomic_load(&g_dropped);
+  if (dropped) fprintf(stderr, "memlog_runtime: %llu events were not recorded\n", (unsigned long long)dropped);
+}
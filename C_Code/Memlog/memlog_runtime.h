@@ -0,0 +1,86 @@
+// memlog_runtime.h
+// Hooks that memlog_plugin inserts calls to when it is run with -fplugin-arg-memlog_plugin-mode=runtime.
+// Link the instrumented program with memlog_runtime.o (and -pthread).
+//
+// Every hook appends one fixed-size record (memlog_rt_record, see memlog_format.h) to a buffer owned by the
+// calling thread. No locks are taken; a background thread writes the buffers out to the trace file.
+//
+// The trace goes to the path in the MEMLOG_TRACE environment variable, or to memlog-trace-<pid>.bin
+// in the current directory.
+
+#ifndef MEMLOG_RUNTIME_H
+#define MEMLOG_RUNTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//site is the site id the plugin gave the store/alloc/free/... (see "SITE IDS" in memlog_format.h).
+
+//Called right after a store: addr is the destination, size the number of bytes written.
+//The value is read back from addr. (The plugin only calls this for stores it can't record inline, see below.)
+void __memlog_store(uint64_t site, const void *addr, size_t size);
+
+//Called right after p = malloc/calloc/realloc(...) returns.
+void __memlog_alloc(uint64_t site, const void *ptr, size_t size);
+
+//The same for an allocator that resizes a block (realloc, reallocarray, or ptr= in the allocator file): old is
+//the block it was given, which ends here if the call returned a block (see MEMLOG_RT_ALLOC in memlog_format.h).
+void __memlog_realloc(uint64_t site, const void *ptr, size_t size, const void *old);
+
+//Called right before free(ptr).
+void __memlog_free(uint64_t site, const void *ptr);
+
+//Called once when a loop whose stores to site were summarized finishes (see "LOOP RANGE STORES" in memlog_format.h).
+//last is the address the final iteration wrote, stride the distance between iterations, count the number of
+//iterations and iv0 the induction variable's value when the loop started. Nothing is recorded for count == 0.
+void __memlog_range_store(uint64_t site, const void *last, int64_t stride, uint64_t count, int64_t iv0);
+
+//Called when a function starts, and right before each of its returns: site is the function's frame site and
+//frame its frame base, __builtin_frame_address(0) (see "FRAMES" in memlog_format.h).
+void __memlog_enter(uint64_t site, const void *frame);
+void __memlog_exit(uint64_t site, const void *frame);
+
+//Called right after a call that wrote a whole block (memcpy, memmove, memset, strncpy, ...) or a struct/array
+//assignment: dst is where the block starts and len its size. The first bytes of the block are recorded as well
+//(see "BULK WRITES" in memlog_format.h; how many is set by the MEMLOG_WRITE_BYTES environment variable).
+void __memlog_write(uint64_t site, const void *dst, size_t len);
+
+//The same, after strcpy/stpcpy: the block is the string now at dst, including its terminating NUL.
+void __memlog_write_str(uint64_t site, const void *dst);
+
+//A struct assignment's write with its fields captured (see "FIELD CAPTURES" in memlog_format.h). The plugin's
+//generated capture function calls __memlog_fields_begin(site, dst, sizeof *dst, packed, &room), where packed is
+//the most bytes the fields can pack into. It returns where to pack them, with room set to how many fit, or NULL
+//if nothing is to be captured (the write is then already recorded). Otherwise the function packs the fields
+//that fit and calls __memlog_fields_end(just past the last byte it packed).
+char *__memlog_fields_begin(uint64_t site, const void *dst, size_t len, size_t packed, size_t *room);
+void __memlog_fields_end(const void *end);
+
+//The inline fast path for scalar stores. The plugin writes records for these straight into the calling thread's
+//window [__memlog_cursor, __memlog_limit), and calls __memlog_refill (which returns the slot to write) only when
+//the window is used up. See "The write window" in memlog_runtime.c.
+struct memlog_rt_record;
+extern __thread struct memlog_rt_record *__memlog_cursor;
+extern __thread struct memlog_rt_record *__memlog_limit;
+struct memlog_rt_record *__memlog_refill(void);
+
+//Number of events recorded so far: everything published by any thread, plus the calling thread's open window.
+//(Meant for benchmarks and tests; other threads' unpublished windows are not counted.)
+uint64_t memlog_runtime_event_count(void);
+
+//Number of times a thread found its ring full and had to wait for the drainer (also meant for benchmarks).
+uint64_t memlog_runtime_stall_count(void);
+
+//Writes out everything buffered so far and closes the trace file. Runs automatically at exit;
+//after it returns, further events are dropped.
+void memlog_runtime_shutdown(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMLOG_RUNTIME_H
@@ -0,0 +1,27 @@
+// frame_locals.c
+// Input of make check_frame_offsets (compiled, never run): functions whose locals keep stack slots at -O0 and at
+// -O2, because their addresses are passed to a function in another file. Their offsets in the frame sites must be
+// the ones the final RTL addresses them at.
+
+int sink(void *p);
+
+int scale(int n) {
+  int x = n * 3;
+  long y = n;
+  sink(&x);
+  sink(&y);
+  return x + (int)y + n;
+}
+
+int pick(const int *v, int n) {
+  int best = 0;
+  short hits = 0;
+  for (int i = 0; i < n; i++)
+    if (v[i] > best) {
+      best = v[i];
+      hits++;
+    }
+  sink(&best);
+  sink(&hits);
+  return best + hits;
+}
@@ -0,0 +1,128 @@
+// frame_offsets.cc
+// For make check_frame_offsets: compares the locals' offsets in a binary site file's frame sites (frame_offset() in
+// memlog_plugin.cc) with where the same compile's final RTL (-fdump-rtl-final=<file>) addresses them.
+//
+// usage: frame_offsets <sites.bin> <rtl dump> <function>...
+//
+// In the dump a local's stack slot shows up as (mem (plus (reg/f 6 bp) (const_int C)) [alias name+K ...]): the
+// variable name starts C - K bytes from the frame pointer. Every such mention of a local the frame site gives an
+// offset must agree with it, and each function named must have at least one. Locals without an offset (register
+// variables, which LRA may still spill to a slot named after them) and compiler temporaries are not compared.
+
+#include "../memlog_reader.h"
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+
+namespace {
+
+  //the function's part of the dump, whitespace runs folded into one space (RTL is broken across lines anywhere)
+  bool function_rtl(const std::string &dump, const std::string &fn, std::string &out) {
+    std::string head = ";; Function " + fn + " (";
+    size_t at = dump.find(head);
+    if (at == std::string::npos) return false;
+    size_t end = dump.find(";; Function ", at + head.size());
+    if (end == std::string::npos) end = dump.size();
+    out.clear();
+    for (size_t i = at; i < end; i++) {
+      char c = dump[i];
+      if (std::isspace((unsigned char)c)) {
+        if (!out.empty() && out.back() != ' ') out += ' ';
+      } else {
+        out += c;
+      }
+    }
+    return true;
+  }
+
+  //name -> offsets from the frame pointer the RTL addresses it at
+  std::multimap<std::string, long long> bp_slots(const std::string &rtl) {
+    static const char pat[] = "(plus:DI (reg/f:DI 6 bp) (const_int ";
+    std::multimap<std::string, long long> out;
+    for (size_t at = rtl.find(pat); at != std::string::npos; at = rtl.find(pat, at + 1)) {
+      const char *p = rtl.c_str() + at + sizeof(pat) - 1;
+      char *e;
+      long long c = std::strtoll(p, &e, 10);
+      //the rest of the const_int and the plus, then the mem's attributes: "[<alias set> <expr>+<offset> "
+      const char *attrs = std::strstr(e, ")) [");
+      if (!attrs || attrs != std::strchr(e, ')') || !(attrs = std::strchr(attrs + 4, ' '))) continue;
+      const char *name = attrs + 1;
+      const char *n = name;
+      if (!std::isalpha((unsigned char)*n) && *n != '_') continue;
+      while (std::isalnum((unsigned char)*n) || *n == '_') n++;
+      //a field (s.a), an element (a[1]) or a temporary (D.1234): not the variable's own start
+      if (*n != '+') continue;
+      long long k = std::strtoll(n + 1, &e, 10);
+      if (*e != ' ') continue;
+      out.emplace(std::string(name, n), c - k);
+    }
+    return out;
+  }
+
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::fprintf(stderr, "usage: %s <sites.bin> <rtl dump> <function>...\n", argv[0]);
+    return 2;
+  }
+  FILE *in = std::fopen(argv[1], "rb");
+  if (!in) { std::perror(argv[1]); return 1; }
+  memlog_bin_file f;
+  std::string err;
+  bool ok = memlog_bin_load(in, f, err);
+  std::fclose(in);
+  if (!ok) { std::fprintf(stderr, "frame_offsets: %s: %s\n", argv[1], err.c_str()); return 1; }
+
+  in = std::fopen(argv[2], "rb");
+  if (!in) { std::perror(argv[2]); return 1; }
+  std::string dump;
+  char buf[1 << 16];
+  for (size_t n; (n = std::fread(buf, 1, sizeof(buf), in)) > 0;) dump.append(buf, n);
+  std::fclose(in);
+
+  int failures = 0;
+  for (int a = 3; a < argc; a++) {
+    const std::string fn = argv[a];
+    const memlog_bin_site *frame = nullptr;
+    for (const memlog_bin_site &s : f.sites)
+      if (s.kind == MEMLOG_SITE_FRAME && s.func < f.funcs.size() && f.funcs[s.func] == fn) frame = &s;
+    std::string rtl;
+    if (!frame || !function_rtl(dump, fn, rtl)) {
+      std::fprintf(stderr, "frame_offsets: %s: no frame site or no RTL\n", fn.c_str());
+      failures++;
+      continue;
+    }
+
+    std::map<std::string, long long> recorded;
+    auto first = f.locals_of_site.find(frame->site);
+    for (size_t i = first == f.locals_of_site.end() ? f.locals.size() : first->second;
+         i < f.locals.size() && f.locals[i].site == frame->site; i++) {
+      const memlog_bin_local &l = f.locals[i];
+      if (l.offset != MEMLOG_NO_OFFSET && !(l.flags & MEMLOG_LOCAL_F_INLINED) && l.name < f.idents.size())
+        recorded[f.idents[l.name]] = l.offset;
+    }
+
+    int compared = 0;
+    for (const auto &slot : bp_slots(rtl)) {
+      auto it = recorded.find(slot.first);
+      if (it == recorded.end()) continue;
+      compared++;
+      if (it->second != slot.second) {
+        std::fprintf(stderr, "frame_offsets: %s: %s recorded at %lld, the RTL has it at %lld\n", fn.c_str(),
+                     slot.first.c_str(), it->second, slot.second);
+        failures++;
+      }
+    }
+    if (!compared) {
+      std::fprintf(stderr, "frame_offsets: %s: no local of the frame site is addressed off the frame pointer\n",
+                   fn.c_str());
+      failures++;
+    } else {
+      std::printf("%s: %d stack slot references agree\n", fn.c_str(), compared);
+    }
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+// frames.c
+// Compiled with the plugin (mode=runtime) for make check_frames, at -O0 and at -O2 (stage=late): checks the
+// MEMLOG_RT_ENTER/EXIT records instrument_frame inserts, reading back its own trace once the runtime has shut down.
+//   depth     recursive (not a tail call: the Makefile also turns off sibling-call optimization, so -O2 keeps the
+//             recursion), called as depth(3): four frames entered one inside the other, left in reverse order
+//   classify  three returns, called once for each of them: one enter and one exit per call
+// Each function writes its __builtin_frame_address(0) to a global, which is what the records' addr must be. The
+// functions' frame sites are told apart by those addresses: the first ENTER at depth(3)'s frame is depth's site.
+
+#include "../memlog_format.h"
+#include "../memlog_runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEPTH 3
+#define CALLS 3
+
+static void *g_depth_frame[DEPTH + 1];
+static void *g_classify_frame[CALLS];
+static int g_call;
+static volatile int g_args[CALLS] = {-5, 0, 5};
+
+__attribute__((noipa)) static int depth(int n) {
+  g_depth_frame[n] = __builtin_frame_address(0);
+  if (n == 0) return 0;
+  int r = depth(n - 1);
+  return r * 2 + n;
+}
+
+__attribute__((noipa)) static int classify(int x) {
+  g_classify_frame[g_call++] = __builtin_frame_address(0);
+  if (x < 0) return -1;
+  if (x == 0) return 0;
+  return 1;
+}
+
+static int fail(const char *what, size_t i) {
+  fprintf(stderr, "frames: %s (frame record %zu)\n", what, i);
+  return 1;
+}
+
+int main(void) {
+  const char *path = getenv("MEMLOG_TRACE");
+  if (!path) {
+    fprintf(stderr, "frames: set MEMLOG_TRACE\n");
+    return 1;
+  }
+
+  int sum = depth(DEPTH);
+  for (int i = 0; i < CALLS; i++) sum += classify(g_args[i]);
+  //everything up to here is in the file once this returns; what follows is not recorded
+  memlog_runtime_shutdown();
+
+  FILE *in = fopen(path, "rb");
+  if (!in) {
+    perror(path);
+    return 1;
+  }
+  struct memlog_rt_header h;
+  if (fread(&h, sizeof(h), 1, in) != 1 || memcmp(h.magic, MEMLOG_RT_MAGIC, sizeof(MEMLOG_RT_MAGIC)) ||
+      h.record_size != sizeof(struct memlog_rt_record)) {
+    fprintf(stderr, "frames: %s is not a runtime trace\n", path);
+    return 1;
+  }
+  fseek(in, (long)h.header_size, SEEK_SET);
+
+  //the ENTER/EXIT records, in order (one thread)
+  static struct memlog_rt_record frames[256];
+  size_t n_frames = 0;
+  struct memlog_rt_chunk c;
+  while (fread(&c, sizeof(c), 1, in) == 1) {
+    for (uint32_t i = 0; i < c.n_records; i++) {
+      struct memlog_rt_record r;
+      if (fread(&r, sizeof(r), 1, in) != 1) return fail("trace ends inside a chunk", n_frames);
+      uint64_t kind = r.site >> MEMLOG_RT_KIND_SHIFT;
+      //a bulk write's captured bytes follow it as whole records
+      if (kind == MEMLOG_RT_WRITE) {
+        uint64_t skip = (r.value + sizeof(r) - 1) / sizeof(r);
+        if (skip > c.n_records - 1 - i) return fail("write data past the end of its chunk", n_frames);
+        fseek(in, (long)(skip * sizeof(r)), SEEK_CUR);
+        i += (uint32_t)skip;
+        continue;
+      }
+      if (kind != MEMLOG_RT_ENTER && kind != MEMLOG_RT_EXIT) continue;
+      if (n_frames == sizeof(frames) / sizeof(frames[0])) return fail("too many frame records", n_frames);
+      frames[n_frames++] = r;
+    }
+  }
+  fclose(in);
+
+  //every EXIT leaves the innermost frame not left yet (nothing here longjmps)
+  uint64_t stack[sizeof(frames) / sizeof(frames[0])][2];
+  size_t top = 0;
+  for (size_t i = 0; i < n_frames; i++) {
+    uint64_t site = frames[i].site & MEMLOG_RT_SITE_MASK;
+    if (frames[i].site >> MEMLOG_RT_KIND_SHIFT == MEMLOG_RT_ENTER) {
+      stack[top][0] = site;
+      stack[top++][1] = frames[i].addr;
+    } else if (!top || stack[top - 1][0] != site || stack[top - 1][1] != frames[i].addr) {
+      return fail("EXIT does not match the innermost ENTER", i);
+    } else {
+      top--;
+    }
+  }
+  //main's own frame is still open: its exit comes after the shutdown
+  if (top != 1) return fail("frames left open", n_frames);
+
+  size_t at = 0;
+  while (at < n_frames && frames[at].addr != (uint64_t)(uintptr_t)g_depth_frame[DEPTH]) at++;
+  if (at == n_frames) return fail("no ENTER at depth(3)'s frame", at);
+  uint64_t depth_site = frames[at].site & MEMLOG_RT_SITE_MASK;
+
+  //depth(3) .. depth(0) entered, then left innermost first
+  for (int k = 0; k < 2 * (DEPTH + 1); k++, at++) {
+    int n = k <= DEPTH ? DEPTH - k : k - DEPTH - 1;
+    uint64_t kind = k <= DEPTH ? MEMLOG_RT_ENTER : MEMLOG_RT_EXIT;
+    if (at == n_frames) return fail("depth's records end early", at);
+    if (frames[at].site != MEMLOG_RT_SITE_KIND(depth_site, kind)) return fail("depth: wrong site or kind", at);
+    if (frames[at].addr != (uint64_t)(uintptr_t)g_depth_frame[n]) return fail("depth: wrong frame base", at);
+  }
+
+  //each classify call: ENTER and EXIT at its frame, whichever return it took
+  if (at == n_frames) return fail("no classify records", at);
+  uint64_t classify_site = frames[at].site & MEMLOG_RT_SITE_MASK;
+  if (classify_site == depth_site) return fail("classify has depth's frame site", at);
+  for (int k = 0; k < 2 * CALLS; k++, at++) {
+    uint64_t kind = k % 2 ? MEMLOG_RT_EXIT : MEMLOG_RT_ENTER;
+    if (at == n_frames) return fail("classify's records end early", at);
+    if (frames[at].site != MEMLOG_RT_SITE_KIND(classify_site, kind)) return fail("classify: wrong site or kind", at);
+    if (frames[at].addr != (uint64_t)(uintptr_t)g_classify_frame[k / 2]) return fail("classify: wrong frame base", at);
+  }
+  if (at != n_frames) return fail("frame records after classify's", at);
+
+  printf("frames: ok (sum %d)\n", sum);
+  return 0;
+}
@@ -0,0 +1,112 @@
+// plugin_sites.cc
+// For make check_plugin: checks the store sites of a binary site file against the markers in the source it was
+// compiled from (test/site_kinds.c, see there), and the type dictionary's entry for struct pair.
+//
+// usage: plugin_sites <sites.bin> <source.c>
+
+#include "../memlog_reader.h"
+
+#include <cstring>
+#include <map>
+#include <set>
+
+namespace {
+
+  int failures = 0;
+
+  void fail(const char *what, unsigned line) {
+    std::fprintf(stderr, "plugin_sites: line %u: %s\n", line, what);
+    failures++;
+  }
+
+  //line -> markers on it
+  std::map<unsigned, std::set<std::string>> read_markers(FILE *in) {
+    std::map<unsigned, std::set<std::string>> out;
+    char buf[1024];
+    for (unsigned line = 1; std::fgets(buf, sizeof(buf), in); line++) {
+      //the header comment lists the markers too: only code lines count
+      if (!std::strstr(buf, "; //")) continue;
+      for (const char *m = std::strchr(buf, '@'); m; m = std::strchr(m + 1, '@')) {
+        size_t n = std::strspn(m + 1, "abcdefghijklmnopqrstuvwxyz");
+        out[line].insert(std::string(m + 1, n));
+      }
+    }
+    return out;
+  }
+
+  //the struct's field, by name
+  const memlog_bin_field *field(const memlog_bin_file &f, uint32_t type, const char *name) {
+    auto it = f.fields_of_type.find(type);
+    for (size_t i = it == f.fields_of_type.end() ? f.fields.size() : it->second;
+         i < f.fields.size() && f.fields[i].owner == type; i++)
+      if (f.fields[i].name < f.idents.size() && f.idents[f.fields[i].name] == name) return &f.fields[i];
+    return nullptr;
+  }
+
+}
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "usage: %s <sites.bin> <source.c>\n", argv[0]);
+    return 2;
+  }
+  FILE *in = std::fopen(argv[1], "rb");
+  if (!in) { std::perror(argv[1]); return 1; }
+  memlog_bin_file f;
+  std::string err;
+  bool ok = memlog_bin_load(in, f, err);
+  std::fclose(in);
+  if (!ok) { std::fprintf(stderr, "plugin_sites: %s: %s\n", argv[1], err.c_str()); return 1; }
+
+  in = std::fopen(argv[2], "r");
+  if (!in) { std::perror(argv[2]); return 1; }
+  std::map<unsigned, std::set<std::string>> markers = read_markers(in);
+  std::fclose(in);
+  if (markers.empty()) { std::fprintf(stderr, "plugin_sites: no markers in %s\n", argv[2]); return 1; }
+
+  std::map<uint32_t, const memlog_bin_site *> by_number;
+  for (const memlog_bin_site &s : f.sites) by_number[s.site] = &s;
+
+  for (const auto &m : markers) {
+    unsigned line = m.first;
+    const memlog_bin_site *store = nullptr;
+    for (const memlog_bin_site &s : f.sites)
+      if (s.kind == MEMLOG_SITE_STORE && s.line == line) store = &s;
+    if (!store) { fail("no store site", line); continue; }
+
+    for (const std::string &what : m.second) {
+      if (what == "const") {
+        if (!(store->flags & MEMLOG_SITE_F_VALUE_STATIC)) fail("store is not value_static", line);
+      } else if (what == "heap") {
+        auto pt = f.points_to_of_site.find(store->site);
+        bool traced = false;
+        for (size_t i = pt == f.points_to_of_site.end() ? f.points_to.size() : pt->second;
+             i < f.points_to.size() && f.points_to[i].site == store->site; i++) {
+          auto a = by_number.find(f.points_to[i].alloc);
+          if (a != by_number.end() && a->second->kind == MEMLOG_SITE_ALLOC) traced = true;
+        }
+        if (!traced) fail("store points to no alloc site", line);
+      } else if (what == "typed") {
+        if (store->type >= f.types.size()) fail("store has no type", line);
+      } else {
+        fail(("unknown marker @" + what).c_str(), line);
+      }
+    }
+  }
+
+  //struct pair { int a; long b; }
+  bool found = false;
+  for (uint32_t t = 0; t < f.types.size(); t++) {
+    const memlog_bin_type &ty = f.types[t];
+    if (ty.kind != MEMLOG_TY_STRUCT || ty.name >= f.idents.size() || f.idents[ty.name] != "pair") continue;
+    found = true;
+    const memlog_bin_field *a = field(f, t, "a"), *b = field(f, t, "b");
+    if (!(ty.flags & MEMLOG_TYPE_F_COMPLETE) || ty.size != (int64_t)(2 * sizeof(long)) || !a || !b ||
+        a->bit_offset != 0 || b->bit_offset != (int64_t)(8 * sizeof(long)))
+      fail("struct pair's layout is wrong", 0);
+  }
+  if (!found) fail("struct pair is not in the type dictionary", 0);
+
+  if (!failures) std::printf("%s: %zu marked lines ok\n", argv[1], markers.size());
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+// reader_damaged.cc
+// Feeds memlog_bin_load and memlog_idx_load files whose counts, lengths and indices lie, for make check_reader.
+// Each must be rejected with an error: not allocated for (bad_alloc, with -fno-exceptions elsewhere a crash), and
+// not read out of bounds.
+
+#include "../memlog_reader.h"
+
+#include <cstring>
+
+namespace {
+
+  int failures = 0;
+
+  memlog_bin_header bin_header() {
+    memlog_bin_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MEMLOG_BIN_MAGIC, MEMLOG_BIN_MAGIC_LEN);
+    h.version = MEMLOG_BIN_VERSION;
+    h.header_size = sizeof(h);
+    return h;
+  }
+
+  //writes the pieces to a temporary file and loads it; the load must fail
+  template <typename Load> void expect_rejected(const char *what, const std::string &bytes, Load load) {
+    FILE *f = std::tmpfile();
+    if (!f) { std::perror("tmpfile"); failures++; return; }
+    std::fwrite(bytes.data(), 1, bytes.size(), f);
+    std::rewind(f);
+    std::string err;
+    if (load(f, err)) {
+      std::fprintf(stderr, "reader_damaged: %s: loaded\n", what);
+      failures++;
+    } else {
+      std::printf("%s: %s\n", what, err.c_str());
+    }
+    std::fclose(f);
+  }
+
+  template <typename T> std::string bytes_of(const T &v) { return std::string((const char *)&v, sizeof(v)); }
+
+  bool load_bin(FILE *f, std::string &err) {
+    memlog_bin_file b;
+    return memlog_bin_load(f, b, err);
+  }
+
+  bool load_idx(FILE *f, std::string &err) {
+    memlog_idx_file x;
+    return memlog_idx_load(f, x, err);
+  }
+
+} // end anonymous namespace
+
+int main() {
+  {
+    memlog_bin_header h = bin_header();
+    h.n_files = 1;
+    expect_rejected("string longer than the file", bytes_of(h) + bytes_of((uint32_t)0xfffffff0u) + "abc", load_bin);
+  }
+  {
+    memlog_bin_header h = bin_header();
+    h.n_idents = 0xffffffffu;
+    expect_rejected("more strings than the file holds", bytes_of(h) + bytes_of((uint32_t)0), load_bin);
+  }
+  {
+    memlog_bin_header h = bin_header();
+    h.n_sites = 0xffffffffu;
+    memlog_bin_site s;
+    std::memset(&s, 0, sizeof(s));
+    expect_rejected("more sites than the file holds", bytes_of(h) + bytes_of(s), load_bin);
+  }
+  {
+    memlog_bin_header h = bin_header();
+    h.n_sites = 1;
+    memlog_bin_site s;
+    std::memset(&s, 0, sizeof(s));
+    s.kind = MEMLOG_SITE_WRITE;
+    s.expr = s.expr2 = MEMLOG_NONE;
+    s.expr3 = 5;
+    expect_rejected("expr3 past the expressions", bytes_of(h) + bytes_of(s), load_bin);
+  }
+  {
+    memlog_idx_header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, MEMLOG_IDX_MAGIC, MEMLOG_BIN_MAGIC_LEN);
+    h.version = MEMLOG_IDX_VERSION;
+    h.header_size = sizeof(h);
+    h.string_bytes = UINT64_C(1) << 40;
+    expect_rejected("index string blob bigger than the file", bytes_of(h) + bytes_of((uint32_t)0), load_idx);
+    h.string_bytes = 0;
+    h.n_sites = 0x10000000u;
+    expect_rejected("index with more sites than the file holds", bytes_of(h) + bytes_of((uint32_t)0) +
+                    std::string(4, '\0'), load_idx);
+  }
+  return failures ? 1 : 0;
+}
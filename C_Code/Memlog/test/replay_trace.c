@@ -0,0 +1,116 @@
+// replay_trace.c
+// Writes a small runtime trace for make check_replay by calling the runtime hooks directly (no plugin needed), at
+// fixed addresses so memlog_replay's answers can be compared with test/replay_expected.jsonl byte for byte.
+//
+// The blocks live in one fixed mapping; only the bytes __memlog_store reads back have to exist. Steps (one record
+// each; MEMLOG_WRITE_BYTES=0, so writes carry no data records):
+//   0  alloc  A = BASE,           100 bytes            A: all garbage
+//   1  write  A + 10, 20 bytes                          A: 80 garbage
+//   2  store  A + 50, 8 bytes                           A: 72 garbage
+//   3  realloc A -> C = BASE + 0x1000, 200 bytes        C[0, 100) keeps A's bits, C[100, 200) garbage; A ends
+//   4  write  C + 150, 10 bytes                         C: 162 garbage
+//   5  alloc  D = BASE + 0x100000, 64 MiB               D: all garbage (bigger than an "init" may look at)
+//   6  write  D + 0x1001, 16 bytes                      D: 64 MiB - 16 garbage
+//   7  realloc C in place, 50 bytes                     C: 30 garbage, C[50, 200) garbage again
+//   8  free   C
+//   9  realloc NULL -> E = BASE + 0x2000, 40 bytes     E: all garbage (a realloc site, see replay_session/)
+//  10  write  E + 8, 8 bytes                           E: 32 garbage
+//
+// Then a function f (frame site 20, see replay_session/) with a parameter n, an array buf and a register local i:
+//  11  enter  f, frame F = BASE + 0x3000                n written; buf, i garbage
+//  12  store  i = 5 (site 21, no address)               i: 5, put at its place in F
+//  13  store  buf[0], 8 bytes (site 23)                 first i = i + 1 (site 22, derived): 6; buf: 8 garbage
+//  14  enter  f, frame G = BASE + 0x3100                G's buf and i garbage, F's untouched
+//  15  enter  f, frame H = BASE + 0x3200
+//  16  exit   f, frame G                                H was left by longjmp: G and H end
+//  17  exit   f, frame F
+//  18  alloc  R = BASE + 0x4000, 64 bytes                R: all garbage
+//  19  range_store R[0, 16, 32, 48], 8 bytes each       site 31 (stride 16, see replay_session/): R: 32 garbage,
+//                                                      the gaps between the iterations stay garbage
+//
+// Then a loop in a function k (frame site 40): for (i = 0; ...) { i = i + 1; arr[i] = 7; } where the plugin left
+// i = i + 1 (site 44) without a hook, anchored to the store to arr[i] (site 43) right after it:
+//  20  enter  k, frame K = BASE + 0x5000                arr, i garbage
+//  21  store  i = 0 (site 41, no address)
+//  22  store  arr[1] (site 43)                          derived first: i = 1
+//  23  store  arr[2]                                    i = 2
+//  24  store  arr[3]                                    i = 3
+//  25  exit   k
+
+#define _GNU_SOURCE
+#include "../memlog_format.h"
+#include "../memlog_runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define BASE ((char *)0x10000000)
+#define MAP_BYTES (1 << 16)
+
+//a store to a register local, as the plugin records it: no address, just the value
+static void reg_store(uint64_t site, size_t size, uint64_t value) {
+  struct memlog_rt_record *rec = __memlog_cursor;
+  if (rec >= __memlog_limit) rec = __memlog_refill();
+  rec->site = MEMLOG_RT_SITE_KIND(site, MEMLOG_RT_STORE);
+  rec->addr = 0;
+  rec->size = size;
+  rec->value = value;
+  __memlog_cursor = rec + 1;
+}
+
+int main(void) {
+  //before the first hook reads it
+  setenv("MEMLOG_WRITE_BYTES", "0", 1);
+
+  char *m = mmap(BASE, MAP_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+  if (m != BASE) {
+    fprintf(stderr, "replay_trace: could not map %p\n", (void *)BASE);
+    return 1;
+  }
+  char *a = BASE, *c = BASE + 0x1000, *d = BASE + 0x100000, *e = BASE + 0x2000;
+  char *f = BASE + 0x3000, *g = BASE + 0x3100, *h = BASE + 0x3200, *r = BASE + 0x4000;
+  char *k = BASE + 0x5000;
+
+  __memlog_alloc(1, a, 100);
+  memset(a + 10, 1, 20);
+  __memlog_write(2, a + 10, 20);
+  memcpy(a + 50, "12345678", 8);
+  __memlog_store(3, a + 50, 8);
+  memcpy(c, a, 100);
+  __memlog_realloc(4, c, 200, a);
+  memset(c + 150, 2, 10);
+  __memlog_write(5, c + 150, 10);
+  __memlog_alloc(6, d, (size_t)64 << 20);
+  __memlog_write(7, d + 0x1001, 16);
+  __memlog_realloc(8, c, 50, c);
+  __memlog_free(9, c);
+  __memlog_realloc(10, e, 40, NULL);
+  memset(e + 8, 3, 8);
+  __memlog_write(11, e + 8, 8);
+
+  __memlog_enter(20, f);
+  reg_store(21, 4, 5);
+  memcpy(f - 48, "abcdefgh", 8);
+  __memlog_store(23, f - 48, 8);
+  __memlog_enter(20, g);
+  __memlog_enter(20, h);
+  __memlog_exit(20, g);
+  __memlog_exit(20, f);
+
+  __memlog_alloc(30, r, 64);
+  __memlog_range_store(31, r + 48, 16, 4, 0);
+
+  __memlog_enter(40, k);
+  reg_store(41, 4, 0);
+  for (int i = 1; i <= 3; i++) {
+    int *arr = (int *)(k - 32);
+    arr[i] = 7;
+    __memlog_store(43, &arr[i], sizeof(int));
+  }
+  __memlog_exit(40, k);
+
+  memlog_runtime_shutdown();
+  return 0;
+}
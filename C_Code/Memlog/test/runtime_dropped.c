@@ -0,0 +1,58 @@
+// runtime_dropped.c
+// Calls the runtime hooks while events are being dropped, for make check_runtime. Every mode must exit 0: a hook
+// that wrote a multi-record event into the one-slot scratch window would overwrite thread-local storage past it.
+//   off       MEMLOG_TRACE names a file that cannot be created, so tracing is off from the first event
+//   shutdown  an atexit handler registered before the runtime's own runs after memlog_runtime_shutdown
+//   fork      a forked child (tracing is off in the child)
+// Each of them does a store first (which leaves the scratch window in place), then the multi-record hooks. A field
+// capture must be refused (__memlog_fields_begin returns NULL), so the caller records address and length only.
+
+#include "../memlog_runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static char g_block[256];
+
+static void hooks_while_dropped(void) {
+  memset(g_block, 7, sizeof(g_block));
+  __memlog_store(1, g_block, 8);
+  __memlog_write(2, g_block, sizeof(g_block));
+  __memlog_write_str(3, "a string longer than one record");
+  size_t room = 0;
+  if (__memlog_fields_begin(4, g_block, sizeof(g_block), 48, &room)) {
+    fprintf(stderr, "runtime_dropped: __memlog_fields_begin gave a place to pack fields while events are dropped\n");
+    _exit(1);
+  }
+  __memlog_store(5, g_block + 8, 8);
+}
+
+int main(int argc, char **argv) {
+  const char *mode = argc > 1 ? argv[1] : "";
+  if (!strcmp(mode, "off")) {
+    hooks_while_dropped();
+    return 0;
+  }
+  if (!strcmp(mode, "shutdown")) {
+    //registered before the first hook, so it runs after the runtime's own atexit handler
+    atexit(hooks_while_dropped);
+    __memlog_store(6, g_block, 8);
+    return 0;
+  }
+  if (!strcmp(mode, "fork")) {
+    __memlog_store(6, g_block, 8);
+    pid_t pid = fork();
+    if (pid == 0) {
+      hooks_while_dropped();
+      _exit(0);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid) return 1;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+  }
+  fprintf(stderr, "usage: %s off|shutdown|fork\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,31 @@
+// site_kinds.c
+// Input of make check_plugin (compiled, never run), at -O0 and at -O2 (stage=late). Each marked line must have a
+// store site with what the marker names (test/plugin_sites.cc reads the markers from this file):
+//   @const   its value is a compile-time constant: value_static
+//   @heap    it writes through a pointer the points-to analysis traced to an alloc site of this file
+//   @typed   it has a type in the dictionary
+// and the dictionary must describe struct pair with its fields at their offsets. Everything written here stays
+// visible to other files (a global, or passed to sink), so -O2 keeps the stores.
+
+#include <stdlib.h>
+
+struct pair {
+  int a;
+  long b;
+};
+
+int sink(void *p);
+
+int g_count;
+struct pair *g_last;
+
+void fill(int n) {
+  g_count = 50; // @const @typed
+  int *mal = malloc((size_t)n * sizeof(int) + sizeof(int));
+  mal[0] = n; // @heap @typed
+  struct pair *p = malloc(sizeof(*p));
+  p->a = n; // @heap @typed
+  p->b = 8; // @const @heap @typed
+  g_last = p;
+  sink(mal);
+}
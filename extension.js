@@ -47,12 +47,16 @@ set -euo pipefail
 REAL="\${REAL_${key}:-}"
 PLUGIN_SO="\${MEMVIZ_PLUGIN_SO:-}"
 OUT_DIR="\${MEMVIZ_OUT_DIR:-}"
+CACHE_DIR="\${MEMVIZ_CACHE_DIR:-}"
 if [[ -z "$REAL" ]]; then exit 2; fi
 compile_like=0
+optimized=0
 src_base="unknown"
 for a in "$@"; do
   case "$a" in
     -c|-S|-E) compile_like=1 ;;
+    -O0) optimized=0 ;;
+    -O|-O[1-3]|-Os|-Oz|-Ofast|-Og) optimized=1 ;;
     *.c|*.cc|*.cpp|*.cxx|*.C)
       compile_like=1
       if [[ "$src_base" == "unknown" ]]; then
@@ -63,7 +67,16 @@ done
 if [[ "$compile_like" -eq 1 && -n "$PLUGIN_SO" && -n "$OUT_DIR" ]]; then
   mkdir -p "$OUT_DIR"
   out_file="$OUT_DIR/site-\${src_base}-$$.jsonl"
-  exec "$REAL" -fdump-tree-all -fplugin="$PLUGIN_SO" -fplugin-arg-memlog_plugin-out="$out_file" "$@"
+  cache_args=()
+  if [[ -n "$CACHE_DIR" ]]; then
+    mkdir -p "$CACHE_DIR"
+    cache_args=(-fplugin-arg-memlog_plugin-cache="$CACHE_DIR")
+  fi
+  # optimized builds are traced after the optimizers ran, so they stay optimized
+  if [[ "$optimized" -eq 1 ]]; then
+    cache_args+=(-fplugin-arg-memlog_plugin-stage=late)
+  fi
+  exec "$REAL" -fdump-tree-all -fplugin="$PLUGIN_SO" -fplugin-arg-memlog_plugin-out="$out_file" \${cache_args[@]+"\${cache_args[@]}"} "$@"
 else
   exec "$REAL" "$@"
 fi`;
@@ -86,9 +99,12 @@ async function runBuildWithWrappers(output, workspaceRoot, buildCmdLine, pluginS
     const storageRoot = ctx.globalStorageUri.fsPath;
     const sessionDir = path.join(storageRoot, "sessions", nowStamp());
     const binDir = path.join(storageRoot, "bin");
+    // Outlives the session: unchanged functions reuse their records from the previous build
+    const cacheDir = path.join(storageRoot, "cache");
     
     ensureDir(sessionDir);
     ensureDir(binDir);
+    ensureDir(cacheDir);
 
     const wrappers = ["gcc", "g++", "cc", "c++"];
     for (const name of wrappers) {
@@ -103,7 +119,8 @@ async function runBuildWithWrappers(output, workspaceRoot, buildCmdLine, pluginS
         REAL_GCC: real.gcc, REAL_GPP: real.gpp,
         REAL_CC: real.cc, REAL_CXX: real.cxx,
         MEMVIZ_PLUGIN_SO: pluginSoPath,
-        MEMVIZ_OUT_DIR: sessionDir
+        MEMVIZ_OUT_DIR: sessionDir,
+        MEMVIZ_CACHE_DIR: cacheDir
     };
 
     output.appendLine(`[memviz] Session Dir: ${sessionDir}`);